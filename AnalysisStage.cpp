@@ -0,0 +1,483 @@
+/**
+ * @file AnalysisStage.cpp
+ * @brief Implementation of the AnalysisStage class.
+ *
+ * Workers never touch the part's actors or mappers. They work on a shallow copy of
+ * the geometry and hand back plain arrays through the GeometryCache.
+ */
+
+#include "AnalysisStage.h"
+#include "GeometryCache.h"
+
+#include <QCryptographicHash>
+#include <QMetaObject>
+#include <QSet>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+
+#include <vtkAppendPolyData.h>
+#include <vtkCurvatures.h>
+#include <vtkDataArray.h>
+#include <vtkFloatArray.h>
+#include <vtkGenericCell.h>
+#include <vtkModifiedBSPTree.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkPolyDataNormals.h>
+#include <vtkTransform.h>
+#include <vtkTransformPolyDataFilter.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Computes a display range that ignores NaNs and clips the outer 2% at each end.
+ * @param values The array to examine.
+ * @param range Receives the lower and upper bound.
+ */
+void robustRange(vtkDataArray* values, double range[2]) {
+    std::vector<double> v;
+    v.reserve(values->GetNumberOfTuples());
+    for (vtkIdType i = 0; i < values->GetNumberOfTuples(); ++i) {
+        double x = values->GetComponent(i, 0);
+        if (std::isfinite(x))
+            v.push_back(x);
+    }
+
+    range[0] = range[1] = 0.0;
+    if (v.empty())
+        return;
+
+    size_t lo = v.size() / 50;
+    size_t hi = v.size() - 1 - lo;
+    std::nth_element(v.begin(), v.begin() + lo, v.end());
+    range[0] = v[lo];
+    std::nth_element(v.begin(), v.begin() + hi, v.end());
+    range[1] = v[hi];
+}
+
+/**
+ * @brief Returns a copy of a part's geometry in world coordinates.
+ * Points keep their order, so arrays computed on the copy fit the model.
+ * @param polyData The geometry in model coordinates.
+ * @param transform Model to world transform, row-major.
+ * @return The transformed copy; cells and arrays other than the points are shared.
+ */
+vtkSmartPointer<vtkPolyData> inWorld(vtkPolyData* polyData, const double transform[16]) {
+    vtkNew<vtkTransform> placement;
+    placement->SetMatrix(transform);
+    vtkNew<vtkTransformPolyDataFilter> filter;
+    filter->SetInputData(polyData);
+    filter->SetTransform(placement);
+    filter->Update();
+    return filter->GetOutput();
+}
+
+/**
+ * @brief Returns the cache entry name of one placement of a part in an assembly.
+ * @param assemblyName cacheName(AssemblyOcclusion) of the assembly.
+ * @param transform The part's model to world transform, row-major.
+ * @return The name.
+ */
+QString instanceName(const QString& assemblyName, const double transform[16]) {
+    const QByteArray bytes(reinterpret_cast<const char*>(transform), 16 * sizeof(double));
+    return assemblyName + '/' + QString::fromLatin1(QCryptographicHash::hash(bytes, QCryptographicHash::Sha1).toHex());
+}
+
+/**
+ * @brief Computes mean curvature at every vertex.
+ * @param input The part geometry.
+ * @return A float array named after AnalysisStage::Curvature.
+ */
+vtkSmartPointer<vtkDataArray> computeCurvature(vtkPolyData* input) {
+    vtkNew<vtkCurvatures> curvatures;
+    curvatures->SetInputData(input);
+    curvatures->SetCurvatureTypeToMean();
+    curvatures->Update();
+
+    vtkSmartPointer<vtkFloatArray> result = vtkSmartPointer<vtkFloatArray>::New();
+    result->DeepCopy(curvatures->GetOutput()->GetPointData()->GetArray("Mean_Curvature"));
+    result->SetName(AnalysisStage::arrayName(AnalysisStage::Curvature).toUtf8().constData());
+    return result;
+}
+
+/**
+ * @brief Computes point normals without splitting, so the output points match the input points.
+ * @param input The part geometry.
+ * @return A copy of the geometry with point normals.
+ */
+vtkSmartPointer<vtkPolyData> withPointNormals(vtkPolyData* input) {
+    vtkNew<vtkPolyDataNormals> normals;
+    normals->SetInputData(input);
+    normals->ComputePointNormalsOn();
+    normals->ComputeCellNormalsOff();
+    normals->SplittingOff();
+    normals->ConsistencyOn();
+    normals->AutoOrientNormalsOn();
+    normals->Update();
+    return normals->GetOutput();
+}
+
+/**
+ * @brief Estimates wall thickness by casting a ray from each vertex along its inward normal.
+ *
+ * The nearest hit on the same part, found with a per-part BVH, gives the thickness.
+ * Vertices whose ray leaves the part without a hit get NaN, which the lookup table
+ * shows in its NaN colour.
+ * @param input The part geometry.
+ * @return A float array named after AnalysisStage::Thickness.
+ */
+vtkSmartPointer<vtkDataArray> computeThickness(vtkPolyData* input) {
+    vtkSmartPointer<vtkPolyData> mesh = withPointNormals(input);
+    vtkDataArray* n = mesh->GetPointData()->GetNormals();
+
+    vtkNew<vtkModifiedBSPTree> bvh;
+    bvh->SetDataSet(mesh);
+    bvh->BuildLocator();
+
+    const double maxLength = mesh->GetLength();
+    const double offset = 1.0e-5 * maxLength;
+    const vtkIdType count = mesh->GetNumberOfPoints();
+
+    vtkSmartPointer<vtkFloatArray> result = vtkSmartPointer<vtkFloatArray>::New();
+    result->SetName(AnalysisStage::arrayName(AnalysisStage::Thickness).toUtf8().constData());
+    result->SetNumberOfTuples(count);
+
+    for (vtkIdType i = 0; i < count; ++i) {
+        double p[3], dir[3], start[3], end[3];
+        mesh->GetPoint(i, p);
+        n->GetTuple(i, dir);
+
+        // Start just inside the surface so the ray does not hit the triangles around the vertex
+        for (int k = 0; k < 3; ++k) {
+            start[k] = p[k] - dir[k] * offset;
+            end[k] = p[k] - dir[k] * maxLength;
+        }
+
+        double t, x[3], pcoords[3];
+        int subId;
+        vtkIdType cellId;
+        float thickness = std::numeric_limits<float>::quiet_NaN();
+        if (bvh->IntersectWithLine(start, end, 0.0, t, x, pcoords, subId, cellId))
+            thickness = static_cast<float>(offset + t * (maxLength - offset));
+        result->SetValue(i, thickness);
+    }
+    return result;
+}
+
+/**
+ * @brief Returns a fixed set of cosine-weighted hemisphere directions around +Z.
+ * A Hammersley sequence is used so every vertex is sampled the same way and the
+ * bake is deterministic.
+ * @return The sample directions.
+ */
+const std::vector<std::array<double, 3>>& hemisphereSamples() {
+    static const std::vector<std::array<double, 3>> samples = [] {
+        const int count = 32;
+        std::vector<std::array<double, 3>> dirs;
+        for (int i = 0; i < count; ++i) {
+            // Van der Corput radical inverse in base 2
+            unsigned int bits = static_cast<unsigned int>(i);
+            bits = (bits << 16u) | (bits >> 16u);
+            bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+            bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+            bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+            bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+            double u1 = (i + 0.5) / count;
+            double u2 = bits * 2.3283064365386963e-10;
+
+            double r = std::sqrt(u1);
+            double phi = 2.0 * 3.14159265358979323846 * u2;
+            dirs.push_back({ r * std::cos(phi), r * std::sin(phi), std::sqrt(1.0 - u1) });
+        }
+        return dirs;
+    }();
+    return samples;
+}
+
+/**
+ * @brief Bakes per-vertex ambient occlusion by ray casting against a BVH.
+ *
+ * For each vertex a fixed set of cosine-weighted rays is cast over the hemisphere
+ * around its normal, and the fraction that escapes within @p radius is stored.
+ * The thread-safe IntersectWithLine overload is used, so one BVH can be shared by
+ * several tasks.
+ * @param mesh The part geometry with point normals.
+ * @param bvh A locator built over the occluding geometry.
+ * @param radius Maximum distance at which geometry occludes.
+ * @param name Name of the output array.
+ * @return A float array of visibility values in [0, 1], 1 meaning fully open.
+ */
+vtkSmartPointer<vtkDataArray> computeOcclusion(vtkPolyData* mesh, vtkModifiedBSPTree* bvh, double radius, const QString& name) {
+    vtkDataArray* n = mesh->GetPointData()->GetNormals();
+    const vtkIdType count = mesh->GetNumberOfPoints();
+    const std::vector<std::array<double, 3>>& samples = hemisphereSamples();
+    const double offset = 1.0e-4 * radius;
+
+    vtkSmartPointer<vtkFloatArray> result = vtkSmartPointer<vtkFloatArray>::New();
+    result->SetName(name.toUtf8().constData());
+    result->SetNumberOfTuples(count);
+
+    vtkNew<vtkGenericCell> cell;
+    for (vtkIdType i = 0; i < count; ++i) {
+        double p[3], normal[3];
+        mesh->GetPoint(i, p);
+        n->GetTuple(i, normal);
+
+        // Orthonormal basis with the normal as the Z axis
+        double a[3] = { 1.0, 0.0, 0.0 };
+        if (std::fabs(normal[0]) > 0.9) {
+            a[0] = 0.0;
+            a[1] = 1.0;
+        }
+        double tangent[3] = {
+            a[1] * normal[2] - a[2] * normal[1],
+            a[2] * normal[0] - a[0] * normal[2],
+            a[0] * normal[1] - a[1] * normal[0]
+        };
+        double len = std::sqrt(tangent[0] * tangent[0] + tangent[1] * tangent[1] + tangent[2] * tangent[2]);
+        if (len == 0.0) {
+            result->SetValue(i, 1.0f);
+            continue;
+        }
+        for (double& c : tangent)
+            c /= len;
+        double bitangent[3] = {
+            normal[1] * tangent[2] - normal[2] * tangent[1],
+            normal[2] * tangent[0] - normal[0] * tangent[2],
+            normal[0] * tangent[1] - normal[1] * tangent[0]
+        };
+
+        int open = 0;
+        for (const std::array<double, 3>& s : samples) {
+            double start[3], end[3];
+            for (int k = 0; k < 3; ++k) {
+                double dir = s[0] * tangent[k] + s[1] * bitangent[k] + s[2] * normal[k];
+                start[k] = p[k] + normal[k] * offset;
+                end[k] = start[k] + dir * radius;
+            }
+
+            double t, x[3], pcoords[3];
+            int subId;
+            vtkIdType cellId;
+            if (!bvh->IntersectWithLine(start, end, 0.0, t, x, pcoords, subId, cellId, cell))
+                ++open;
+        }
+        result->SetValue(i, static_cast<float>(open) / samples.size());
+    }
+    return result;
+}
+
+} // namespace
+
+/**
+ * @brief Constructs the stage.
+ * @param cache The cache that receives results.
+ * @param parent The parent QObject.
+ */
+AnalysisStage::AnalysisStage(GeometryCache* cache, QObject* parent)
+    : QObject(parent), m_cache(cache) {
+}
+
+/**
+ * @brief Returns the name of the point array an analysis produces.
+ * @param analysis A single Analysis value.
+ * @return The array name.
+ */
+QString AnalysisStage::arrayName(Analysis analysis) {
+    switch (analysis) {
+    case Curvature: return QStringLiteral("Curvature");
+    case Thickness: return QStringLiteral("Thickness");
+    case AmbientOcclusion: return QStringLiteral("Ambient Occlusion");
+    case AssemblyOcclusion: return QStringLiteral("Assembly Occlusion");
+    }
+    return QString();
+}
+
+/**
+ * @brief Returns the cache entry name for an analysis.
+ * @param analysis A single Analysis value.
+ * @return The name used with GeometryCache.
+ */
+QString AnalysisStage::cacheName(Analysis analysis) const {
+    if (analysis == AssemblyOcclusion)
+        return arrayName(analysis) + '/' + QString::fromLatin1(m_assemblyKey);
+    return arrayName(analysis);
+}
+
+/**
+ * @brief Queues analyses for one part's geometry on the global thread pool.
+ * @param hash Content hash of the part's source file.
+ * @param polyData The part geometry.
+ * @param analyses OR'ed Analysis values to compute.
+ */
+void AnalysisStage::submit(const QByteArray& hash, vtkSmartPointer<vtkPolyData> polyData, int analyses) {
+    if (hash.isEmpty() || !polyData)
+        return;
+
+    // Drop anything that is already cached or on its way from an earlier task
+    const int running = m_running.value(hash, 0);
+    int cached = 0;
+    int missing = 0;
+    for (Analysis a : { Curvature, Thickness, AmbientOcclusion }) {
+        if (!(analyses & a) || (running & a))
+            continue;
+        if (m_cache->contains(hash, arrayName(a)))
+            cached |= a;
+        else
+            missing |= a;
+    }
+    if (!missing) {
+        if (cached)
+            emit analysisFinished(hash, cached);
+        return;
+    }
+
+    // Workers read a private shallow copy, so attaching arrays to the part later is safe
+    vtkSmartPointer<vtkPolyData> input = vtkSmartPointer<vtkPolyData>::New();
+    input->ShallowCopy(polyData);
+
+    m_running.insert(hash, running | missing);
+    GeometryCache* cache = m_cache;
+    QtConcurrent::run(QThreadPool::globalInstance(), [this, cache, hash, input, missing, cached]() {
+        run(cache, hash, input, missing);
+        QMetaObject::invokeMethod(this, [this, hash, missing, cached]() {
+            const int stillRunning = m_running.value(hash, 0) & ~missing;
+            if (stillRunning)
+                m_running.insert(hash, stillRunning);
+            else
+                m_running.remove(hash);
+            emit analysisFinished(hash, missing | cached);
+        }, Qt::QueuedConnection);
+    });
+}
+
+/**
+ * @brief Worker body: runs the requested analyses and stores them in the cache.
+ * @param cache The cache to store results in.
+ * @param hash Content hash of the geometry.
+ * @param polyData The geometry to analyse.
+ * @param analyses OR'ed Analysis values to compute.
+ */
+void AnalysisStage::run(GeometryCache* cache, const QByteArray& hash, vtkSmartPointer<vtkPolyData> polyData, int analyses) {
+    if (analyses & Curvature) {
+        GeometryCache::PointArray entry;
+        entry.values = computeCurvature(polyData);
+        robustRange(entry.values, entry.range);
+        cache->storePointArray(hash, arrayName(Curvature), entry);
+    }
+    if (analyses & Thickness) {
+        GeometryCache::PointArray entry;
+        entry.values = computeThickness(polyData);
+        robustRange(entry.values, entry.range);
+        cache->storePointArray(hash, arrayName(Thickness), entry);
+    }
+    if (analyses & AmbientOcclusion) {
+        vtkSmartPointer<vtkPolyData> mesh = withPointNormals(polyData);
+        vtkNew<vtkModifiedBSPTree> bvh;
+        bvh->SetDataSet(mesh);
+        bvh->BuildLocator();
+
+        GeometryCache::PointArray entry;
+        entry.values = computeOcclusion(mesh, bvh, 0.25 * mesh->GetLength(), arrayName(AmbientOcclusion));
+        entry.range[0] = 0.0;
+        entry.range[1] = 1.0;
+        cache->storePointArray(hash, arrayName(AmbientOcclusion), entry);
+    }
+}
+
+/**
+ * @brief Queues an assembly-wide ambient occlusion bake.
+ *
+ * A first pool task takes every part into world space, appends them and builds one
+ * shared BVH; once it is ready, one task per placed part bakes against it, so the
+ * bake uses all cores even when the assembly has a few large parts. Each part's
+ * array is baked on its world-space copy, whose points are in the same order as the
+ * model, so it attaches to the part's own geometry.
+ * @param parts Every part in the assembly.
+ */
+void AnalysisStage::submitAssembly(const QVector<AssemblyPart>& parts) {
+    if (parts.isEmpty())
+        return;
+
+    // The result depends on which parts make up the assembly and where they are
+    QVector<QByteArray> placements;
+    for (const AssemblyPart& part : parts)
+        placements.append(part.hash + QByteArray(reinterpret_cast<const char*>(part.transform), sizeof(part.transform)));
+    std::sort(placements.begin(), placements.end());
+    QCryptographicHash key(QCryptographicHash::Sha1);
+    for (const QByteArray& placement : placements)
+        key.addData(placement);
+    m_assemblyKey = key.result().toHex();
+
+    // Workers read private shallow copies, so attaching arrays to the parts later is safe
+    QVector<AssemblyPart> inputs = parts;
+    QVector<int> missing;
+    QSet<QPair<QByteArray, QString>> seen;
+    for (int i = 0; i < inputs.size(); ++i) {
+        vtkSmartPointer<vtkPolyData> copy = vtkSmartPointer<vtkPolyData>::New();
+        copy->ShallowCopy(inputs[i].geometry);
+        inputs[i].geometry = copy;
+
+        const QString name = instanceCacheName(inputs[i].transform);
+        if (seen.contains(qMakePair(inputs[i].hash, name)))
+            continue;
+        seen.insert(qMakePair(inputs[i].hash, name));
+        if (m_cache->contains(inputs[i].hash, name))
+            emit assemblyOcclusionFinished(inputs[i].hash, name);
+        else
+            missing.append(i);
+    }
+    if (missing.isEmpty())
+        return;
+
+    GeometryCache* cache = m_cache;
+    const QString assemblyName = cacheName(AssemblyOcclusion);
+    QtConcurrent::run(QThreadPool::globalInstance(), [this, cache, assemblyName, inputs, missing]() {
+        QVector<vtkSmartPointer<vtkPolyData>> world;
+        vtkNew<vtkAppendPolyData> append;
+        for (const AssemblyPart& input : inputs) {
+            world.append(inWorld(input.geometry, input.transform));
+            append->AddInputData(world.last());
+        }
+        append->Update();
+
+        vtkSmartPointer<vtkModifiedBSPTree> bvh = vtkSmartPointer<vtkModifiedBSPTree>::New();
+        bvh->SetDataSet(append->GetOutput());
+        bvh->BuildLocator();
+        const double radius = 0.05 * append->GetOutput()->GetLength();
+
+        for (int i : missing) {
+            const QByteArray hash = inputs[i].hash;
+            const QString name = instanceName(assemblyName, inputs[i].transform);
+            vtkSmartPointer<vtkPolyData> part = world[i];
+            QtConcurrent::run(QThreadPool::globalInstance(), [this, cache, bvh, radius, name, hash, part]() {
+                vtkSmartPointer<vtkPolyData> mesh = withPointNormals(part);
+
+                GeometryCache::PointArray entry;
+                entry.values = computeOcclusion(mesh, bvh, radius, arrayName(AssemblyOcclusion));
+                entry.range[0] = 0.0;
+                entry.range[1] = 1.0;
+                cache->storePointArray(hash, name, entry);
+
+                QMetaObject::invokeMethod(this, [this, hash, name]() {
+                    emit assemblyOcclusionFinished(hash, name);
+                }, Qt::QueuedConnection);
+            });
+        }
+    });
+}
+
+/**
+ * @brief Returns the cache entry name of a placed part's assembly occlusion bake.
+ * @param transform The part's model to world transform.
+ * @return The name used with GeometryCache.
+ */
+QString AnalysisStage::instanceCacheName(const double transform[16]) const {
+    return instanceName(cacheName(AssemblyOcclusion), transform);
+}
@@ -0,0 +1,139 @@
+/**
+ * @file AnalysisStage.h
+ * @brief Declaration of the AnalysisStage class.
+ *
+ * The analysis stage computes per-vertex scalar overlays (mean curvature, wall
+ * thickness and baked ambient occlusion) for parts on the global Qt thread pool and
+ * stores the results in the GeometryCache. Overlays are then shown by selecting the
+ * cached array on the mappers, so switching between them costs no recomputation.
+ */
+#ifndef ANALYSIS_STAGE_H
+#define ANALYSIS_STAGE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+
+class GeometryCache;
+
+/**
+ * @brief Runs per-part geometry analyses in the background.
+ *
+ * Each submitted part is processed by one pool task, which builds its own BVH
+ * (vtkModifiedBSPTree) for the ray casts. Results are keyed by content hash so
+ * parts loaded from identical files are analysed once.
+ */
+class AnalysisStage : public QObject {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Analyses that can be requested; values can be OR'ed together.
+     */
+    enum Analysis {
+        Curvature         = 0x01,   /**< Mean curvature at each vertex */
+        Thickness         = 0x02,   /**< Wall thickness from a ray cast along the inward normal */
+        AmbientOcclusion  = 0x04,   /**< Ambient occlusion baked against the part itself */
+        AssemblyOcclusion = 0x08    /**< Ambient occlusion baked against the whole assembly */
+    };
+
+    /**
+     * @brief Constructs the stage.
+     * @param cache The cache that receives results; must outlive the stage.
+     * @param parent The parent QObject.
+     */
+    explicit AnalysisStage(GeometryCache* cache, QObject* parent = nullptr);
+
+    /**
+     * @brief Returns the name of the point array an analysis produces.
+     * @param analysis A single Analysis value.
+     * @return The array name, also used as the cache key.
+     */
+    static QString arrayName(Analysis analysis);
+
+    /**
+     * @brief Queues analyses for one part's geometry.
+     *
+     * Analyses already cached or already running for the same content hash are skipped;
+     * the rest run in a new task, even while another task works on the same hash.
+     * @param hash Content hash of the part's source file.
+     * @param polyData The part geometry; it is only read by the worker.
+     * @param analyses OR'ed Analysis values to compute.
+     */
+    void submit(const QByteArray& hash, vtkSmartPointer<vtkPolyData> polyData, int analyses);
+
+    /**
+     * @brief One placed part of an assembly submitted to submitAssembly().
+     */
+    struct AssemblyPart {
+        QByteArray hash;                        /**< Content hash of the part's source file */
+        vtkSmartPointer<vtkPolyData> geometry;  /**< The part geometry in model coordinates; only read */
+        double transform[16];                   /**< Model to world transform, row-major */
+    };
+
+    /**
+     * @brief Queues an assembly-wide ambient occlusion bake.
+     *
+     * Every part is taken into world space and one BVH is built over them all, after
+     * which each placed part is baked by its own pool task against that shared BVH.
+     * Instances of one file are baked separately, since each sits somewhere else in
+     * the assembly; instances with the same transform share a bake. Results are cached
+     * under instanceCacheName(), which depends on the part's placement and on the
+     * placement of every part in the assembly.
+     * @param parts Every part in the assembly.
+     */
+    void submitAssembly(const QVector<AssemblyPart>& parts);
+
+    /**
+     * @brief Returns the cache entry name of a placed part's assembly occlusion bake.
+     * Keyed by the last submitted assembly, like cacheName(AssemblyOcclusion).
+     * @param transform The part's model to world transform, row-major.
+     * @return The name used with GeometryCache, together with the part's content hash.
+     */
+    QString instanceCacheName(const double transform[16]) const;
+
+    /**
+     * @brief Returns the cache entry name for an analysis.
+     * Equal to arrayName() except for AssemblyOcclusion, whose results depend on the
+     * assembly as well as the part and are keyed by the last submitted assembly.
+     * @param analysis A single Analysis value.
+     * @return The name used with GeometryCache.
+     */
+    QString cacheName(Analysis analysis) const;
+
+signals:
+    /**
+     * @brief Emitted on the GUI thread when a part's analyses have been cached.
+     * @param hash Content hash of the analysed geometry.
+     * @param analyses OR'ed Analysis values that are now available.
+     */
+    void analysisFinished(const QByteArray& hash, int analyses);
+
+    /**
+     * @brief Emitted on the GUI thread when a placed part's assembly occlusion has been cached.
+     * @param hash Content hash of the baked geometry.
+     * @param cacheName instanceCacheName() of the placement that was baked.
+     */
+    void assemblyOcclusionFinished(const QByteArray& hash, const QString& cacheName);
+
+private:
+    /**
+     * @brief Worker body: runs the requested analyses and stores them in the cache.
+     * @param cache The cache to store results in.
+     * @param hash Content hash of the geometry.
+     * @param polyData The geometry to analyse.
+     * @param analyses OR'ed Analysis values to compute.
+     */
+    static void run(GeometryCache* cache, const QByteArray& hash, vtkSmartPointer<vtkPolyData> polyData, int analyses);
+
+    GeometryCache* m_cache;         /**< Destination for results */
+    QByteArray m_assemblyKey;       /**< Identifies the assembly last submitted to submitAssembly() */
+    QHash<QByteArray, int> m_running; /**< OR'ed Analysis values in flight, by content hash (GUI thread only) */
+};
+
+#endif // ANALYSIS_STAGE_H
@@ -0,0 +1,188 @@
+/**
+ * @file AssemblyManifest.cpp
+ * @brief Implementation of the AssemblyManifest class.
+ */
+
+#include "AssemblyManifest.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkTransform.h>
+
+namespace {
+
+/**
+ * @brief Reads a fixed number of numbers from a JSON array.
+ * @param value The array.
+ * @param count Numbers expected.
+ * @param numbers Receives the numbers.
+ * @return False if the value is not an array of that many numbers.
+ */
+bool readNumbers(const QJsonValue& value, int count, double* numbers) {
+    const QJsonArray array = value.toArray();
+    if (array.size() != count)
+        return false;
+    for (int i = 0; i < count; ++i) {
+        if (!array[i].isDouble())
+            return false;
+        numbers[i] = array[i].toDouble();
+    }
+    return true;
+}
+
+/**
+ * @brief Reads the transform of a node.
+ * @param object The node.
+ * @param transform Receives the transform, the identity if none is given.
+ * @param error Receives a description of the problem.
+ * @return False if a transform member is malformed.
+ */
+bool readTransform(const QJsonObject& object, double transform[16], QString& error) {
+    if (object.contains("matrix")) {
+        if (!readNumbers(object["matrix"], 16, transform)) {
+            error = "\"matrix\" must be 16 numbers";
+            return false;
+        }
+        return true;
+    }
+
+    // Applied to the part in the order scale, rotation, translation
+    vtkNew<vtkTransform> placement;
+    placement->PostMultiply();
+    if (object.contains("scale")) {
+        double scale[3];
+        if (object["scale"].isDouble())
+            scale[0] = scale[1] = scale[2] = object["scale"].toDouble();
+        else if (!readNumbers(object["scale"], 3, scale)) {
+            error = "\"scale\" must be a number or 3 numbers";
+            return false;
+        }
+        placement->Scale(scale);
+    }
+    if (object.contains("rotation")) {
+        double rotation[3];
+        if (!readNumbers(object["rotation"], 3, rotation)) {
+            error = "\"rotation\" must be 3 angles in degrees";
+            return false;
+        }
+        placement->RotateX(rotation[0]);
+        placement->RotateY(rotation[1]);
+        placement->RotateZ(rotation[2]);
+    }
+    if (object.contains("translation")) {
+        double translation[3];
+        if (!readNumbers(object["translation"], 3, translation)) {
+            error = "\"translation\" must be 3 numbers";
+            return false;
+        }
+        placement->Translate(translation);
+    }
+    vtkMatrix4x4::DeepCopy(transform, placement->GetMatrix());
+    return true;
+}
+
+/**
+ * @brief Reads a node and its children.
+ * @param object The node.
+ * @param folder Folder file paths are relative to.
+ * @param node Receives the node.
+ * @param error Receives a description of the problem.
+ * @return False if the node or one of its children is malformed.
+ */
+bool readNode(const QJsonObject& object, const QDir& folder, AssemblyManifest::Node& node, QString& error) {
+    node.name = object["name"].toString();
+    if (object.contains("file")) {
+        const QString file = object["file"].toString();
+        if (file.isEmpty()) {
+            error = "\"file\" must be a path";
+            return false;
+        }
+        node.file = QFileInfo(folder, file).absoluteFilePath();
+        if (node.name.isEmpty())
+            node.name = QFileInfo(file).fileName();
+    }
+    if (object.contains("colour")) {
+        node.colour = QColor(object["colour"].toString());
+        if (!node.colour.isValid()) {
+            error = "\"colour\" must be a colour name such as \"#rrggbb\"";
+            return false;
+        }
+    }
+    if (!readTransform(object, node.transform, error))
+        return false;
+
+    for (const QJsonValue& child : object["children"].toArray()) {
+        if (!child.isObject()) {
+            error = "\"children\" must hold node objects";
+            return false;
+        }
+        node.children.append(AssemblyManifest::Node());
+        if (!readNode(child.toObject(), folder, node.children.last(), error)) {
+            error = node.name + ": " + error;
+            return false;
+        }
+    }
+
+    // Each instance is a copy of this node's part, placed within this node
+    const QJsonArray instances = object["instances"].toArray();
+    if (!instances.isEmpty() && node.file.isEmpty()) {
+        error = node.name + ": \"instances\" needs a \"file\"";
+        return false;
+    }
+    for (int i = 0; i < instances.size(); ++i) {
+        AssemblyManifest::Node instance;
+        const QJsonObject entry = instances[i].toObject();
+        instance.name = entry["name"].toString(node.name + ' ' + QString::number(i + 1));
+        instance.file = node.file;
+        instance.colour = node.colour;
+        if (!readTransform(entry, instance.transform, error)) {
+            error = instance.name + ": " + error;
+            return false;
+        }
+        node.children.append(instance);
+    }
+    if (!instances.isEmpty())
+        node.file.clear();
+    return true;
+}
+
+} // namespace
+
+/**
+ * @brief Reads a manifest file.
+ * @param path The manifest.
+ * @param root Receives the root node.
+ * @param error Receives a description of the problem.
+ * @return True on success.
+ */
+bool AssemblyManifest::read(const QString& path, Node& root, QString& error) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+    QJsonParseError parseError;
+    const QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parseError);
+    if (document.isNull()) {
+        error = parseError.errorString();
+        return false;
+    }
+    if (!document.isObject()) {
+        error = "the manifest must be a node object";
+        return false;
+    }
+
+    root = Node();
+    if (!readNode(document.object(), QFileInfo(path).absoluteDir(), root, error))
+        return false;
+    if (root.name.isEmpty())
+        root.name = QFileInfo(path).completeBaseName();
+    return true;
+}
@@ -0,0 +1,62 @@
+/**
+ * @file AssemblyManifest.h
+ * @brief Declaration of the AssemblyManifest class.
+ *
+ * CAD exports come with an assembly manifest: a JSON tree of subassemblies and part
+ * instances, where each instance names an STL file and gives its transform. Reading
+ * the manifest instead of a folder of pre-transformed copies lets every instance of
+ * a file share one mesh.
+ */
+#ifndef ASSEMBLY_MANIFEST_H
+#define ASSEMBLY_MANIFEST_H
+
+#include <QColor>
+#include <QString>
+#include <QVector>
+
+/**
+ * @brief Reads assembly manifests.
+ *
+ * A manifest is one node object:
+ * @code
+ * {
+ *   "name": "Chassis",
+ *   "translation": [0, 0, 120], "rotation": [0, 0, 90],
+ *   "children": [
+ *     { "name": "Wheel hub", "file": "parts/hub.stl", "colour": "#c0c0c0",
+ *       "matrix": [1, 0, 0, 400,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1] },
+ *     { "name": "Bolt", "file": "parts/m8.stl",
+ *       "instances": [ { "translation": [10, 0, 0] }, { "translation": [-10, 0, 0] } ] }
+ *   ]
+ * }
+ * @endcode
+ * A node with "file" is a part; files are relative to the manifest's folder. A node
+ * with "children" is a subassembly. "instances" is shorthand for one child per entry,
+ * each a node that inherits the name and file. A transform is either "matrix" (16
+ * numbers, row-major) or any of "scale" (a number or three), "rotation" (degrees
+ * about X, then Y, then Z) and "translation", applied in that order.
+ */
+class AssemblyManifest {
+public:
+    /**
+     * @brief A subassembly or part instance.
+     */
+    struct Node {
+        QString name;               /**< Name shown in the tree */
+        QString file;               /**< Absolute path of the STL file, or empty for a subassembly */
+        double transform[16];       /**< Transform relative to the parent node, row-major */
+        QColor colour;              /**< Colour of the part, or invalid to keep the default */
+        QVector<Node> children;     /**< Child nodes */
+    };
+
+    /**
+     * @brief Reads a manifest file.
+     * @param path The manifest.
+     * @param root Receives the root node.
+     * @param error Receives a description of the problem on failure.
+     * @return False if the file cannot be read or is not a valid manifest.
+     */
+    static bool read(const QString& path, Node& root, QString& error);
+};
+
+#endif // ASSEMBLY_MANIFEST_H
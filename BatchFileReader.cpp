@@ -0,0 +1,334 @@
+/**
+ * @file BatchFileReader.cpp
+ * @brief Implementation of the BatchFileReader class.
+ *
+ * With io_uring, each file goes through statx and openat (submitted together),
+ * then a read of the whole file and a close. Requests for many files are kept in
+ * flight and submitted with one system call per round, so the per-file latency of
+ * a slow or network file system is paid in parallel. liburing is optional at build
+ * time, and io_uring may be disabled at run time (old kernels, containers); either
+ * way the files are read by a pool of blocking reader threads instead.
+ */
+
+#include "BatchFileReader.h"
+
+#include <QFile>
+#include <QMutexLocker>
+#include <QThread>
+#include <QtConcurrent/QtConcurrent>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<liburing.h>)
+#define HAVE_LIBURING 1
+#include <liburing.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <limits>
+#include <vector>
+#endif
+#endif
+
+namespace {
+
+/** Files read but not yet claimed may hold at most this many bytes. */
+const qint64 maxReadyBytes = qint64(256) << 20;
+
+/** Blocking reader threads used when io_uring is not available. */
+const int readerThreads = 8;
+
+#ifdef HAVE_LIBURING
+/** Files being read through io_uring at once. */
+const int maxFilesInFlight = 32;
+
+/** Request kinds, kept in the low bits of a request's user data. */
+enum Request { Statx, Open, Read, Close };
+
+/** Packs a slot index and a request kind into user data. */
+quint64 tag(int slot, Request request) {
+    return (static_cast<quint64>(slot) << 2) | request;
+}
+
+/**
+ * @brief State of one file being read through io_uring.
+ */
+struct Slot {
+    int index = -1;             /**< Position in the path list, or -1 if the slot is free */
+    QByteArray path;            /**< Encoded path; must outlive the statx and open requests */
+    struct statx info;          /**< Filled by statx */
+    int fd = -1;                /**< Open file, or -1 */
+    int pending = 0;            /**< Requests still in flight */
+    bool failed = false;        /**< True if any request failed */
+    QByteArray data;            /**< File contents */
+    qint64 done = 0;            /**< Bytes read so far */
+};
+#endif
+
+} // namespace
+
+/**
+ * @brief Constructs a reader.
+ * @param files The files to read.
+ */
+BatchFileReader::BatchFileReader(const QStringList& files)
+    : paths(files), worker(nullptr), ioUring(false), readyBytes(0), delivered(0), stopping(false) {
+    pool.setMaxThreadCount(readerThreads);
+}
+
+/**
+ * @brief Destructor. Stops reading and waits for outstanding requests.
+ */
+BatchFileReader::~BatchFileReader() {
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+        changed.wakeAll();
+    }
+    if (worker) {
+        worker->wait();
+        delete worker;
+    }
+    pool.waitForDone();
+}
+
+/**
+ * @brief Starts reading in the background.
+ */
+void BatchFileReader::start() {
+    if (paths.isEmpty())
+        return;
+#ifdef HAVE_LIBURING
+    worker = QThread::create([this]() {
+        const int handled = readWithIoUring();
+        if (handled < paths.size())
+            readWithThreads(handled);
+    });
+    worker->start();
+#else
+    readWithThreads(0);
+#endif
+}
+
+/**
+ * @brief Waits for the next file to finish.
+ * @param index Receives the file's index.
+ * @param contents Receives its contents, empty on failure.
+ * @return False once every file has been returned.
+ */
+bool BatchFileReader::next(int& index, QByteArray& contents) {
+    QMutexLocker locker(&mutex);
+    if (delivered >= paths.size())
+        return false;
+    while (ready.isEmpty())
+        changed.wait(&mutex);
+
+    QPair<int, QByteArray> file = ready.dequeue();
+    readyBytes -= file.second.size();
+    ++delivered;
+    changed.wakeAll();
+    index = file.first;
+    contents = file.second;
+    return true;
+}
+
+/** @brief Checks whether io_uring is in use. */
+bool BatchFileReader::usesIoUring() const {
+    QMutexLocker locker(&mutex);
+    return ioUring;
+}
+
+/**
+ * @brief Checks whether the unclaimed bytes are under budget.
+ * @param wait Wait for room instead of returning false.
+ * @return True if there is room.
+ */
+bool BatchFileReader::hasRoom(bool wait) {
+    QMutexLocker locker(&mutex);
+    while (wait && readyBytes >= maxReadyBytes && !stopping)
+        changed.wait(&mutex);
+    return readyBytes < maxReadyBytes && !stopping;
+}
+
+/**
+ * @brief Hands a finished file to the consumer.
+ * @param index The file's index.
+ * @param contents Its contents.
+ */
+void BatchFileReader::push(int index, QByteArray contents) {
+    QMutexLocker locker(&mutex);
+    readyBytes += contents.size();
+    ready.enqueue(qMakePair(index, contents));
+    changed.wakeAll();
+}
+
+/**
+ * @brief Reads files with blocking tasks on the reader pool.
+ * @param first Index of the first file to read.
+ */
+void BatchFileReader::readWithThreads(int first) {
+    for (int i = first; i < paths.size(); ++i) {
+        QtConcurrent::run(&pool, [this, i]() {
+            if (!hasRoom(true))
+                return;
+            QFile file(paths[i]);
+            push(i, file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray());
+        });
+    }
+}
+
+/**
+ * @brief Reads files through io_uring.
+ * @return The number of files taken on.
+ */
+int BatchFileReader::readWithIoUring() {
+#ifdef HAVE_LIBURING
+    struct io_uring ring;
+    // Each file has at most two requests queued at a time, so the ring never fills
+    if (io_uring_queue_init(2 * maxFilesInFlight, &ring, 0) < 0)
+        return 0;
+    {
+        QMutexLocker locker(&mutex);
+        ioUring = true;
+    }
+
+    std::vector<Slot> slots(maxFilesInFlight);
+    std::vector<int> freeSlots;
+    for (int k = maxFilesInFlight - 1; k >= 0; --k)
+        freeSlots.push_back(k);
+    std::vector<std::pair<quint64, int>> completions;
+    int nextFile = 0;
+    bool broken = false;
+
+    auto submit = [&](int k, Request request) {
+        Slot& slot = slots[k];
+        io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+        switch (request) {
+        case Statx:
+            io_uring_prep_statx(sqe, AT_FDCWD, slot.path.constData(), 0, STATX_SIZE, &slot.info);
+            break;
+        case Open:
+            io_uring_prep_openat(sqe, AT_FDCWD, slot.path.constData(), O_RDONLY | O_CLOEXEC, 0);
+            break;
+        case Read:
+            io_uring_prep_read(sqe, slot.fd, slot.data.data() + slot.done,
+                               static_cast<unsigned>(slot.data.size() - slot.done),
+                               static_cast<quint64>(slot.done));
+            break;
+        case Close:
+            io_uring_prep_close(sqe, slot.fd);
+            slot.fd = -1;
+            break;
+        }
+        sqe->user_data = tag(k, request);
+        ++slot.pending;
+    };
+
+    auto finish = [&](int k) {
+        Slot& slot = slots[k];
+        push(slot.index, slot.failed ? QByteArray() : slot.data);
+        slot = Slot();
+        freeSlots.push_back(k);
+    };
+
+    while (true) {
+        // Take on more files while there are free slots and memory to spare; only
+        // block on the consumer when nothing is in flight
+        while (!freeSlots.empty() && nextFile < paths.size() && hasRoom(freeSlots.size() == slots.size())) {
+            const int k = freeSlots.back();
+            freeSlots.pop_back();
+            slots[k].index = nextFile;
+            slots[k].path = QFile::encodeName(paths[nextFile]);
+            ++nextFile;
+            submit(k, Statx);
+            submit(k, Open);
+        }
+        if (freeSlots.size() == slots.size())
+            break;  // All files done, or stopping with nothing in flight
+
+        int status = io_uring_submit_and_wait(&ring, 1);
+        if (status < 0 && status != -EINTR) {
+            broken = true;
+            break;
+        }
+
+        io_uring_cqe* cqe;
+        unsigned head;
+        unsigned seen = 0;
+        completions.clear();
+        io_uring_for_each_cqe(&ring, head, cqe) {
+            completions.emplace_back(cqe->user_data, cqe->res);
+            ++seen;
+        }
+        io_uring_cq_advance(&ring, seen);
+
+        for (const auto& completion : completions) {
+            const int k = static_cast<int>(completion.first >> 2);
+            const Request request = static_cast<Request>(completion.first & 3);
+            const int result = completion.second;
+            Slot& slot = slots[k];
+            --slot.pending;
+
+            switch (request) {
+            case Statx:
+            case Open:
+                if (result < 0)
+                    slot.failed = true;
+                else if (request == Open)
+                    slot.fd = result;
+                if (slot.pending > 0)
+                    break;
+                if (!slot.failed && slot.info.stx_size >= static_cast<quint64>(std::numeric_limits<int>::max()))
+                    slot.failed = true;     // Too large for a QByteArray; load it directly
+                if (!slot.failed && slot.info.stx_size > 0) {
+                    slot.data = QByteArray(static_cast<int>(slot.info.stx_size), Qt::Uninitialized);
+                    submit(k, Read);
+                }
+                else if (slot.fd >= 0) {
+                    submit(k, Close);
+                }
+                else {
+                    finish(k);
+                }
+                break;
+            case Read:
+                if (result < 0) {
+                    slot.failed = true;
+                }
+                else if (result == 0) {
+                    slot.data.truncate(static_cast<int>(slot.done));   // The file shrank
+                }
+                else {
+                    slot.done += result;
+                    if (slot.done < slot.data.size()) {
+                        submit(k, Read);     // Short read
+                        break;
+                    }
+                }
+                submit(k, Close);
+                break;
+            case Close:
+                finish(k);
+                break;
+            }
+        }
+    }
+
+    // Tearing the ring down cancels anything still in flight; those files are then
+    // reported as unreadable so the caller falls back to loading them directly
+    io_uring_queue_exit(&ring);
+    if (broken) {
+        for (size_t k = 0; k < slots.size(); ++k) {
+            if (slots[k].index < 0)
+                continue;
+            if (slots[k].fd >= 0)
+                ::close(slots[k].fd);
+            slots[k].failed = true;
+            finish(static_cast<int>(k));
+        }
+    }
+    return nextFile;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,100 @@
+/**
+ * @file BatchFileReader.h
+ * @brief Declaration of the BatchFileReader class.
+ *
+ * Opening a repository of tens of thousands of small STL files costs a stat, an
+ * open, a read and a close per file, each a separate blocking system call. The
+ * batch reader reads many whole files at once in the background, through io_uring
+ * where the kernel supports it and through a pool of reader threads otherwise, and
+ * hands the contents over as each file completes, so parsing overlaps the reading.
+ */
+#ifndef BATCH_FILE_READER_H
+#define BATCH_FILE_READER_H
+
+#include <QByteArray>
+#include <QMutex>
+#include <QQueue>
+#include <QStringList>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+class QThread;
+
+/**
+ * @brief Reads a list of files into memory in the background, many at a time.
+ *
+ * Files are returned by next() in the order they finish, not the order given.
+ * Memory held by read but unclaimed files is bounded; reading pauses while the
+ * consumer catches up.
+ */
+class BatchFileReader {
+public:
+    /**
+     * @brief Constructs a reader; call start() to begin reading.
+     * @param paths The files to read.
+     */
+    explicit BatchFileReader(const QStringList& paths);
+
+    /**
+     * @brief Stops reading and waits for outstanding requests to finish.
+     */
+    ~BatchFileReader();
+
+    /**
+     * @brief Starts reading in the background.
+     */
+    void start();
+
+    /**
+     * @brief Waits for the next file to finish.
+     * @param index Receives the file's position in the list given to the constructor.
+     * @param contents Receives the file contents; empty if it could not be read.
+     * @return False once every file has been returned.
+     */
+    bool next(int& index, QByteArray& contents);
+
+    /**
+     * @brief Returns whether io_uring is used rather than reader threads.
+     * @return True if io_uring support was built in and the kernel allows it; valid once
+     *         next() has returned a file.
+     */
+    bool usesIoUring() const;
+
+private:
+    /**
+     * @brief io_uring loop: keeps a batch of statx, open, read and close requests in flight.
+     * @return The number of files it took on; the rest are left to readWithThreads().
+     */
+    int readWithIoUring();
+
+    /**
+     * @brief Thread pool fallback: reads the files from @p first on with one blocking task each.
+     */
+    void readWithThreads(int first);
+
+    /**
+     * @brief Checks whether the unclaimed bytes are under the memory budget.
+     * @param wait Wait until they are, rather than return false.
+     * @return False if over budget (only when not waiting) or the reader is being destroyed.
+     */
+    bool hasRoom(bool wait);
+
+    /**
+     * @brief Hands a finished file to the consumer.
+     */
+    void push(int index, QByteArray contents);
+
+    QStringList paths;              /**< Files to read */
+    QThread* worker;                /**< Runs the io_uring loop or queues the fallback tasks */
+    QThreadPool pool;               /**< Reader threads for the fallback, kept apart from the compute pool */
+    bool ioUring;                   /**< True if io_uring is in use */
+
+    mutable QMutex mutex;           /**< Guards the fields below */
+    QWaitCondition changed;         /**< Signalled when a file finishes or one is claimed */
+    QQueue<QPair<int, QByteArray>> ready;   /**< Finished files not yet claimed */
+    qint64 readyBytes;              /**< Bytes held in ready */
+    int delivered;                  /**< Files returned by next() so far */
+    bool stopping;                  /**< True once the destructor runs */
+};
+
+#endif // BATCH_FILE_READER_H
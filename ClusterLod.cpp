@@ -0,0 +1,466 @@
+/**
+ * @file ClusterLod.cpp
+ * @brief Implementation of the ClusterLod class.
+ *
+ * Triangles are split recursively at the median centroid along the longest axis
+ * until each cluster is small enough. On the way back up, each pair of siblings is
+ * welded along their common seam and decimated back to about one cluster in size,
+ * with the vertices on the pair's outer border locked. A node's border is therefore
+ * always the border its leaves had in the original mesh, so clusters chosen at
+ * different levels meet exactly and no cracks open between them.
+ */
+
+#include "ClusterLod.h"
+#include "PackedMesh.h"
+
+#include <vtkAppendPolyData.h>
+#include <vtkCellArray.h>
+#include <vtkCellArrayIterator.h>
+#include <vtkCleanPolyData.h>
+#include <vtkDecimatePro.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkQuadricClustering.h>
+#include <vtkStaticCellLocator.h>
+#include <vtkTriangle.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+/**
+ * @brief Recursive builder; holds the per-triangle data shared by all levels.
+ */
+struct Builder {
+    vtkPolyData* mesh;                      /**< Full-resolution input */
+    vtkIdType target;                       /**< Triangles per cluster */
+    std::vector<vtkIdType> corners;         /**< Three point ids per triangle */
+    std::vector<double> centroids;          /**< Three coordinates per triangle */
+    std::vector<vtkIdType> order;           /**< Triangle ids, partitioned by the recursion */
+    std::vector<vtkIdType> pointMap;        /**< Input point id to cluster point id, or -1 */
+    std::vector<ClusterLod::Node>* nodes;   /**< Output */
+
+    int buildNode(size_t begin, size_t end);
+    vtkSmartPointer<vtkPolyData> extract(size_t begin, size_t end);
+    vtkSmartPointer<vtkPolyData> simplify(vtkPolyData* a, vtkPolyData* b, double& error);
+};
+
+/**
+ * @brief Sums the triangle areas of a mesh.
+ */
+double surfaceArea(vtkPolyData* mesh) {
+    double area = 0.0;
+    double p0[3], p1[3], p2[3];
+    vtkIdType npts;
+    const vtkIdType* pts;
+    auto it = vtk::TakeSmartPointer(mesh->GetPolys()->NewIterator());
+    for (it->GoToFirstCell(); !it->IsDoneWithTraversal(); it->GoToNextCell()) {
+        it->GetCurrentCell(npts, pts);
+        if (npts != 3)
+            continue;
+        mesh->GetPoint(pts[0], p0);
+        mesh->GetPoint(pts[1], p1);
+        mesh->GetPoint(pts[2], p2);
+        area += vtkTriangle::TriangleArea(p0, p1, p2);
+    }
+    return area;
+}
+
+/**
+ * @brief Builds the node covering order[begin, end) and returns its index.
+ */
+int Builder::buildNode(size_t begin, size_t end) {
+    const int index = static_cast<int>(nodes->size());
+    nodes->emplace_back();
+
+    ClusterLod::Node node;
+    node.children[0] = node.children[1] = -1;
+    node.error = 0.0;
+
+    if (static_cast<vtkIdType>(end - begin) <= target) {
+        node.geometry = extract(begin, end);
+    }
+    else {
+        // Split at the median centroid along the longest axis of the centroid bounds
+        double lo[3] = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+        double hi[3] = { -lo[0], -lo[1], -lo[2] };
+        for (size_t i = begin; i < end; ++i) {
+            const double* c = &centroids[3 * order[i]];
+            for (int k = 0; k < 3; ++k) {
+                lo[k] = std::min(lo[k], c[k]);
+                hi[k] = std::max(hi[k], c[k]);
+            }
+        }
+        int axis = 0;
+        for (int k = 1; k < 3; ++k) {
+            if (hi[k] - lo[k] > hi[axis] - lo[axis])
+                axis = k;
+        }
+        const size_t mid = begin + (end - begin) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                         [this, axis](vtkIdType a, vtkIdType b) { return centroids[3 * a + axis] < centroids[3 * b + axis]; });
+
+        node.children[0] = buildNode(begin, mid);
+        node.children[1] = buildNode(mid, end);
+
+        const ClusterLod::Node& a = (*nodes)[node.children[0]];
+        const ClusterLod::Node& b = (*nodes)[node.children[1]];
+        double error = 0.0;
+        node.geometry = simplify(a.geometry, b.geometry, error);
+
+        // Errors add up level by level, so the parent never claims less than a child
+        node.error = std::max(a.error, b.error) + error;
+    }
+
+    double bounds[6];
+    node.geometry->GetBounds(bounds);
+    if (node.children[0] >= 0) {
+        // The sphere must cover the children, whose triangles can stick out of the simplified hull
+        for (int c = 0; c < 2; ++c) {
+            double childBounds[6];
+            (*nodes)[node.children[c]].geometry->GetBounds(childBounds);
+            for (int k = 0; k < 3; ++k) {
+                bounds[2 * k] = std::min(bounds[2 * k], childBounds[2 * k]);
+                bounds[2 * k + 1] = std::max(bounds[2 * k + 1], childBounds[2 * k + 1]);
+            }
+        }
+    }
+    double r2 = 0.0;
+    for (int k = 0; k < 3; ++k) {
+        node.center[k] = 0.5 * (bounds[2 * k] + bounds[2 * k + 1]);
+        r2 += 0.25 * (bounds[2 * k + 1] - bounds[2 * k]) * (bounds[2 * k + 1] - bounds[2 * k]);
+    }
+    node.radius = std::sqrt(r2);
+
+    (*nodes)[index] = node;
+    return index;
+}
+
+/**
+ * @brief Copies the triangles order[begin, end) and the points they use into a new mesh.
+ */
+vtkSmartPointer<vtkPolyData> Builder::extract(size_t begin, size_t end) {
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+    vtkDataArray* normals = mesh->GetPointData()->GetNormals();
+    vtkSmartPointer<vtkDataArray> clusterNormals;
+    if (normals) {
+        clusterNormals.TakeReference(normals->NewInstance());
+        clusterNormals->SetNumberOfComponents(3);
+        clusterNormals->SetName(normals->GetName());
+    }
+
+    std::vector<vtkIdType> touched;
+    polys->AllocateEstimate(static_cast<vtkIdType>(end - begin), 3);
+    for (size_t i = begin; i < end; ++i) {
+        vtkIdType ids[3];
+        for (int k = 0; k < 3; ++k) {
+            vtkIdType p = corners[3 * order[i] + k];
+            if (pointMap[p] < 0) {
+                pointMap[p] = points->InsertNextPoint(mesh->GetPoint(p));
+                if (clusterNormals)
+                    clusterNormals->InsertNextTuple(normals->GetTuple(p));
+                touched.push_back(p);
+            }
+            ids[k] = pointMap[p];
+        }
+        polys->InsertNextCell(3, ids);
+    }
+    for (vtkIdType p : touched)
+        pointMap[p] = -1;
+
+    vtkSmartPointer<vtkPolyData> cluster = vtkSmartPointer<vtkPolyData>::New();
+    cluster->SetPoints(points);
+    cluster->SetPolys(polys);
+    if (clusterNormals)
+        cluster->GetPointData()->SetNormals(clusterNormals);
+    return cluster;
+}
+
+/**
+ * @brief Merges two sibling clusters and simplifies them to about one cluster's size.
+ *
+ * Border vertices keep their original coordinates at every level, so the seam
+ * between the siblings welds exactly and becomes interior. Whatever is still open
+ * after welding borders clusters outside this node, which may be drawn at any
+ * level; decimation may not delete those vertices, so the border stays as it was.
+ * @param a The first child's geometry.
+ * @param b The second child's geometry.
+ * @param error Receives the largest distance of a child vertex from the result.
+ */
+vtkSmartPointer<vtkPolyData> Builder::simplify(vtkPolyData* a, vtkPolyData* b, double& error) {
+    vtkNew<vtkAppendPolyData> append;
+    append->AddInputData(a);
+    append->AddInputData(b);
+
+    vtkNew<vtkCleanPolyData> weld;
+    weld->SetInputConnection(append->GetOutputPort());
+    weld->PointMergingOn();
+    weld->SetTolerance(0.0);
+    weld->Update();
+    vtkPolyData* merged = weld->GetOutput();
+
+    vtkSmartPointer<vtkPolyData> result = vtkSmartPointer<vtkPolyData>::New();
+    error = 0.0;
+    const vtkIdType triangles = merged->GetNumberOfPolys();
+    if (triangles <= target) {
+        result->ShallowCopy(merged);
+        return result;
+    }
+
+    vtkNew<vtkDecimatePro> decimate;
+    decimate->SetInputData(merged);
+    decimate->SetTargetReduction(1.0 - static_cast<double>(target) / static_cast<double>(triangles));
+    decimate->PreserveTopologyOn();
+    decimate->SplittingOff();
+    decimate->BoundaryVertexDeletionOff();
+    decimate->Update();
+    result->ShallowCopy(decimate->GetOutput());
+
+    // Measure how far the removed vertices now lie from the surface
+    vtkNew<vtkStaticCellLocator> locator;
+    locator->SetDataSet(result);
+    locator->BuildLocator();
+    double p[3], closest[3], dist2;
+    vtkIdType cellId;
+    int subId;
+    for (vtkIdType i = 0; i < merged->GetNumberOfPoints(); ++i) {
+        merged->GetPoint(i, p);
+        locator->FindClosestPoint(p, closest, cellId, subId, dist2);
+        error = std::max(error, std::sqrt(dist2));
+    }
+    return result;
+}
+
+/** Identifies a serialized hierarchy, and its layout version. */
+const char lodMagic[8] = { 'S', 'T', 'L', 'C', 'L', 'O', 'D', '\0' };
+const quint32 lodVersion = 2;
+
+/**
+ * @brief Node table entry of a serialized hierarchy; meshes follow the table.
+ */
+struct SerializedNode {
+    double center[3];
+    double radius;
+    double error;
+    qint32 children[2];
+    quint64 meshOffset;     /**< Offset of the node's packed mesh from the start of the block */
+    quint64 meshSize;       /**< Size of the packed mesh */
+};
+
+/** Packed meshes start on 8-byte boundaries. */
+quint64 aligned(quint64 offset) {
+    return (offset + 7) & ~quint64(7);
+}
+
+} // namespace
+
+/**
+ * @brief Builds the hierarchy for a mesh.
+ * @param mesh The full-resolution mesh.
+ * @param trianglesPerCluster Target size of each cluster.
+ * @return The hierarchy.
+ */
+std::shared_ptr<const ClusterLod> ClusterLod::build(vtkPolyData* mesh, vtkIdType trianglesPerCluster) {
+    std::shared_ptr<ClusterLod> lod(new ClusterLod());
+    if (!mesh || mesh->GetNumberOfPolys() == 0)
+        return lod;
+
+    Builder builder;
+    builder.mesh = mesh;
+    builder.target = std::max<vtkIdType>(trianglesPerCluster, 256);
+    builder.nodes = &lod->nodes;
+    builder.pointMap.assign(mesh->GetNumberOfPoints(), -1);
+
+    // Gather triangles with their own iterator, so the shared mesh is only read
+    vtkIdType npts;
+    const vtkIdType* pts;
+    double p[3];
+    auto it = vtk::TakeSmartPointer(mesh->GetPolys()->NewIterator());
+    for (it->GoToFirstCell(); !it->IsDoneWithTraversal(); it->GoToNextCell()) {
+        it->GetCurrentCell(npts, pts);
+        if (npts != 3)
+            continue;
+        double c[3] = { 0.0, 0.0, 0.0 };
+        for (int k = 0; k < 3; ++k) {
+            builder.corners.push_back(pts[k]);
+            mesh->GetPoint(pts[k], p);
+            for (int j = 0; j < 3; ++j)
+                c[j] += p[j] / 3.0;
+        }
+        builder.centroids.insert(builder.centroids.end(), c, c + 3);
+    }
+
+    const size_t triangles = builder.corners.size() / 3;
+    builder.order.resize(triangles);
+    for (size_t i = 0; i < triangles; ++i)
+        builder.order[i] = static_cast<vtkIdType>(i);
+
+    builder.buildNode(0, triangles);
+    return lod;
+}
+
+/**
+ * @brief Simplifies a mesh by quadric clustering on a cubic grid.
+ * @param mesh The mesh to simplify.
+ * @param gridOrigin Origin of the clustering grid.
+ * @param targetTriangles Approximate number of triangles wanted.
+ * @param spacing Receives the grid spacing used.
+ * @return The simplified mesh.
+ */
+vtkSmartPointer<vtkPolyData> ClusterLod::simplify(vtkPolyData* mesh, const double gridOrigin[3],
+                                                  vtkIdType targetTriangles, double& spacing) {
+    // A surface of area A meshed on a grid of spacing s has about 2A/s^2 triangles
+    const double area = surfaceArea(mesh);
+    spacing = std::sqrt(2.0 * std::max(area, 1e-12) / static_cast<double>(std::max<vtkIdType>(targetTriangles, 1)));
+
+    vtkNew<vtkQuadricClustering> clustering;
+    clustering->SetInputData(mesh);
+    clustering->ComputeNumberOfDivisionsOn();
+    clustering->SetDivisionOrigin(gridOrigin[0], gridOrigin[1], gridOrigin[2]);
+    clustering->SetDivisionSpacing(spacing, spacing, spacing);
+    clustering->Update();
+
+    vtkSmartPointer<vtkPolyData> result = vtkSmartPointer<vtkPolyData>::New();
+    result->ShallowCopy(clustering->GetOutput());
+    return result;
+}
+
+/** @brief Gets the number of nodes. */
+int ClusterLod::nodeCount() const { return static_cast<int>(nodes.size()); }
+
+/** @brief Gets a node by index. */
+const ClusterLod::Node& ClusterLod::node(int index) const { return nodes[index]; }
+
+/**
+ * @brief Chooses the clusters to draw for a viewpoint.
+ * @param eye Viewer position in model coordinates.
+ * @param pixelsPerUnit Pixels per model unit at distance 1.
+ * @param maxPixelError Largest acceptable error on screen, in pixels.
+ * @param selected Receives the chosen node indices.
+ */
+void ClusterLod::select(const double eye[3], double pixelsPerUnit, double maxPixelError, std::vector<int>& selected) const {
+    selected.clear();
+    if (nodes.empty())
+        return;
+
+    std::vector<int> stack(1, 0);
+    while (!stack.empty()) {
+        const int index = stack.back();
+        stack.pop_back();
+        const Node& n = nodes[index];
+
+        const double dx = eye[0] - n.center[0];
+        const double dy = eye[1] - n.center[1];
+        const double dz = eye[2] - n.center[2];
+        const double distance = std::sqrt(dx * dx + dy * dy + dz * dz) - n.radius;
+
+        // Inside the bounding sphere the error is unbounded on screen, so refine
+        const bool leaf = n.children[0] < 0;
+        if (leaf || (distance > 0.0 && n.error * pixelsPerUnit <= maxPixelError * distance)) {
+            selected.push_back(index);
+        }
+        else {
+            stack.push_back(n.children[1]);
+            stack.push_back(n.children[0]);
+        }
+    }
+}
+
+/**
+ * @brief Writes the hierarchy as one block.
+ * @return The block, or an empty array.
+ */
+QByteArray ClusterLod::serialize() const {
+    std::vector<QByteArray> meshes;
+    std::vector<SerializedNode> table(nodes.size());
+    quint64 offset = aligned(sizeof(lodMagic) + 2 * sizeof(quint32) + nodes.size() * sizeof(SerializedNode));
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const Node& node = nodes[i];
+        meshes.push_back(PackedMesh::pack(node.geometry));
+        if (meshes.back().isEmpty())
+            return QByteArray();
+        SerializedNode& entry = table[i];
+        std::copy(node.center, node.center + 3, entry.center);
+        entry.radius = node.radius;
+        entry.error = node.error;
+        entry.children[0] = node.children[0];
+        entry.children[1] = node.children[1];
+        entry.meshOffset = offset;
+        entry.meshSize = static_cast<quint64>(meshes.back().size());
+        offset = aligned(offset + entry.meshSize);
+    }
+    if (offset > static_cast<quint64>(std::numeric_limits<int>::max()))
+        return QByteArray();
+
+    QByteArray block(static_cast<int>(offset), '\0');
+    char* out = block.data();
+    const quint32 count = static_cast<quint32>(nodes.size());
+    std::memcpy(out, lodMagic, sizeof(lodMagic));
+    std::memcpy(out + sizeof(lodMagic), &lodVersion, sizeof(quint32));
+    std::memcpy(out + sizeof(lodMagic) + sizeof(quint32), &count, sizeof(quint32));
+    std::memcpy(out + sizeof(lodMagic) + 2 * sizeof(quint32), table.data(), table.size() * sizeof(SerializedNode));
+    for (size_t i = 0; i < nodes.size(); ++i)
+        std::memcpy(out + table[i].meshOffset, meshes[i].constData(), meshes[i].size());
+    return block;
+}
+
+/**
+ * @brief Reads a serialized hierarchy.
+ *
+ * Blocks may come from a team cache written by other machines, so the tree is
+ * checked before it is used: nodes are stored parent first, so every child index
+ * must be greater than its parent's, and each node may have only one parent.
+ * select() then always ends, whatever the block held.
+ * @param data The block.
+ * @return The hierarchy, or null.
+ */
+std::shared_ptr<const ClusterLod> ClusterLod::deserialize(const QByteArray& data) {
+    const quint64 headerSize = sizeof(lodMagic) + 2 * sizeof(quint32);
+    if (static_cast<quint64>(data.size()) < headerSize || std::memcmp(data.constData(), lodMagic, sizeof(lodMagic)) != 0)
+        return nullptr;
+    quint32 version, count;
+    std::memcpy(&version, data.constData() + sizeof(lodMagic), sizeof(quint32));
+    std::memcpy(&count, data.constData() + sizeof(lodMagic) + sizeof(quint32), sizeof(quint32));
+    if (version != lodVersion || headerSize + static_cast<quint64>(count) * sizeof(SerializedNode) > static_cast<quint64>(data.size()))
+        return nullptr;
+
+    // The nodes' arrays borrow this copy, which lives as long as any of them
+    std::shared_ptr<const QByteArray> owner = std::make_shared<const QByteArray>(data);
+    const uchar* base = reinterpret_cast<const uchar*>(owner->constData());
+
+    std::shared_ptr<ClusterLod> lod(new ClusterLod());
+    lod->nodes.resize(count);
+    std::vector<bool> hasParent(count, false);
+    for (quint32 i = 0; i < count; ++i) {
+        SerializedNode entry;
+        std::memcpy(&entry, base + headerSize + i * sizeof(SerializedNode), sizeof(entry));
+        if (entry.meshOffset > static_cast<quint64>(owner->size())
+            || entry.meshSize > static_cast<quint64>(owner->size()) - entry.meshOffset)
+            return nullptr;
+
+        // Either a leaf, or two children stored after it that no other node claims
+        const bool leaf = entry.children[0] == -1 && entry.children[1] == -1;
+        if (!leaf) {
+            for (qint32 child : entry.children) {
+                if (child <= static_cast<qint32>(i) || child >= static_cast<qint32>(count) || hasParent[child])
+                    return nullptr;
+                hasParent[child] = true;
+            }
+        }
+        Node& node = lod->nodes[i];
+        node.geometry = PackedMesh::view(base + entry.meshOffset, static_cast<qint64>(entry.meshSize), owner);
+        if (!node.geometry)
+            return nullptr;
+        std::copy(entry.center, entry.center + 3, node.center);
+        node.radius = entry.radius;
+        node.error = entry.error;
+        node.children[0] = entry.children[0];
+        node.children[1] = entry.children[1];
+    }
+    return lod;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file ClusterLod.h
+ * @brief Declaration of the ClusterLod class.
+ *
+ * A cluster LOD splits one very large part into spatial clusters of a few tens of
+ * thousands of triangles and builds a hierarchy of simplified versions above them.
+ * Renderers pick, per frame, the coarsest clusters whose simplification error is
+ * below a pixel threshold on screen, so the full-resolution mesh is only drawn
+ * where the viewer is close to it.
+ */
+#ifndef CLUSTER_LOD_H
+#define CLUSTER_LOD_H
+
+#include <memory>
+#include <vector>
+
+#include <QByteArray>
+
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+
+/**
+ * @brief Immutable cluster hierarchy of one part.
+ *
+ * The hierarchy is a binary tree: leaves hold the original triangles of one
+ * spatial cluster, and every inner node holds its two children merged and
+ * simplified back to about one cluster's worth of triangles. Simplification keeps
+ * each node's outer border as it was in the original mesh, so any cut through the
+ * tree is watertight. Node errors never decrease towards the root, so cutting the
+ * tree where the projected error falls below a threshold gives a consistent selection. Once built it is never
+ * modified, so render threads share it without locking.
+ */
+class ClusterLod {
+public:
+    /**
+     * @brief A cluster at one level of detail.
+     */
+    struct Node {
+        vtkSmartPointer<vtkPolyData> geometry;  /**< Triangles of this cluster */
+        double center[3];                       /**< Centre of the bounding sphere */
+        double radius;                          /**< Radius of the bounding sphere */
+        double error;                           /**< Largest distance from the original surface, in model units */
+        int children[2];                        /**< Child node indices, or -1 for a leaf */
+    };
+
+    /**
+     * @brief Builds the hierarchy for a mesh. Slow; run it on a worker thread.
+     * @param mesh The full-resolution triangle mesh; it is only read.
+     * @param trianglesPerCluster Target size of each cluster.
+     * @return The hierarchy.
+     */
+    static std::shared_ptr<const ClusterLod> build(vtkPolyData* mesh, vtkIdType trianglesPerCluster = 65536);
+
+    /**
+     * @brief Simplifies a mesh to about a target number of triangles by quadric clustering.
+     *
+     * The clustering grid is cubic with its origin at @p gridOrigin, so meshes that
+     * share an origin and spacing are clustered on the same grid.
+     * @param mesh The mesh to simplify; it is only read.
+     * @param gridOrigin Origin of the clustering grid.
+     * @param targetTriangles Approximate number of triangles wanted.
+     * @param spacing Receives the grid spacing; every vertex moves by at most spacing * sqrt(3).
+     * @return The simplified mesh.
+     */
+    static vtkSmartPointer<vtkPolyData> simplify(vtkPolyData* mesh, const double gridOrigin[3],
+                                                 vtkIdType targetTriangles, double& spacing);
+
+    /**
+     * @brief Writes the hierarchy as one block, for the team cache.
+     * @return The block, or an empty array if a cluster is too large to pack.
+     */
+    QByteArray serialize() const;
+
+    /**
+     * @brief Reads a hierarchy written by serialize().
+     *
+     * The nodes' geometry borrows the block instead of copying it.
+     * @param data The block.
+     * @return The hierarchy, or null if the block is not valid.
+     */
+    static std::shared_ptr<const ClusterLod> deserialize(const QByteArray& data);
+
+    /**
+     * @brief Returns the number of nodes.
+     * @return The node count; node 0 is the root.
+     */
+    int nodeCount() const;
+
+    /**
+     * @brief Returns a node.
+     * @param index Node index.
+     * @return The node.
+     */
+    const Node& node(int index) const;
+
+    /**
+     * @brief Chooses the clusters to draw for a viewpoint.
+     *
+     * Descends from the root and stops at the first node whose error, projected at
+     * the nearest point of its bounding sphere, is at most @p maxPixelError.
+     * @param eye Viewer position in the part's model coordinates.
+     * @param pixelsPerUnit Screen pixels covered by one model unit at distance 1
+     *        (viewport height / (2 tan(view angle / 2))).
+     * @param maxPixelError Largest acceptable error on screen, in pixels.
+     * @param selected Receives the chosen node indices.
+     */
+    void select(const double eye[3], double pixelsPerUnit, double maxPixelError, std::vector<int>& selected) const;
+
+private:
+    ClusterLod() = default;
+
+    std::vector<Node> nodes;    /**< All nodes; node 0 is the root */
+};
+
+#endif // CLUSTER_LOD_H
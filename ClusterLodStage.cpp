@@ -0,0 +1,93 @@
+/**
+ * @file ClusterLodStage.cpp
+ * @brief Implementation of the ClusterLodStage class.
+ *
+ * Workers read a shallow copy of the geometry and hand the finished hierarchy back
+ * to the GUI thread, which owns the table of built hierarchies.
+ */
+
+#include "ClusterLodStage.h"
+#include "ClusterLod.h"
+#include "TeamCache.h"
+
+#include <QMetaObject>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+
+/**
+ * @brief Constructs the stage.
+ * @param parent The parent QObject.
+ */
+ClusterLodStage::ClusterLodStage(QObject* parent)
+    : QObject(parent), m_minimumTriangles(2000000) {
+}
+
+/**
+ * @brief Sets the smallest part given a cluster hierarchy.
+ * @param triangles The threshold in triangles.
+ */
+void ClusterLodStage::setMinimumTriangles(qint64 triangles) {
+    m_minimumTriangles = triangles;
+}
+
+/** @brief Gets the smallest part given a cluster hierarchy. */
+qint64 ClusterLodStage::minimumTriangles() const { return m_minimumTriangles; }
+
+/**
+ * @brief Sets the team cache hierarchies are read from and published to.
+ * @param cache The cache, or null.
+ */
+void ClusterLodStage::setTeamCache(TeamCache* cache) {
+    m_teamCache = cache;
+}
+
+/**
+ * @brief Queues a hierarchy build for one part's geometry.
+ * @param hash Content hash of the part's source file.
+ * @param polyData The part geometry.
+ */
+void ClusterLodStage::submit(const QByteArray& hash, vtkSmartPointer<vtkPolyData> polyData) {
+    if (hash.isEmpty() || !polyData || polyData->GetNumberOfPolys() < m_minimumTriangles || m_running.contains(hash))
+        return;
+    if (m_lods.contains(hash)) {
+        emit lodReady(hash);
+        return;
+    }
+
+    // The worker reads its own shallow copy, so array changes on the GUI side do not reach it
+    vtkSmartPointer<vtkPolyData> input = vtkSmartPointer<vtkPolyData>::New();
+    input->ShallowCopy(polyData);
+
+    m_running.insert(hash);
+    TeamCache* cache = m_teamCache;
+    QtConcurrent::run(QThreadPool::globalInstance(), [this, hash, input, cache]() {
+        // Another machine may have built it already
+        std::shared_ptr<const ClusterLod> built = cache ? ClusterLod::deserialize(cache->read(hash, "lod")) : nullptr;
+        if (!built) {
+            built = ClusterLod::build(input);
+            if (cache)
+                cache->publish(hash, "lod", built->serialize());
+        }
+        QMetaObject::invokeMethod(this, [this, hash, built]() {
+            m_running.remove(hash);
+            m_lods.insert(hash, built);
+            emit lodReady(hash);
+        }, Qt::QueuedConnection);
+    });
+}
+
+/**
+ * @brief Returns the hierarchy built for a content hash.
+ * @param hash Content hash of the geometry.
+ * @return The hierarchy, or null.
+ */
+std::shared_ptr<const ClusterLod> ClusterLodStage::lod(const QByteArray& hash) const {
+    return m_lods.value(hash);
+}
+
+/**
+ * @brief Drops all built hierarchies.
+ */
+void ClusterLodStage::clear() {
+    m_lods.clear();
+}
@@ -0,0 +1,96 @@
+/**
+ * @file ClusterLodStage.h
+ * @brief Declaration of the ClusterLodStage class.
+ *
+ * The cluster LOD stage is an optional preprocessing step for very large parts. It
+ * builds a ClusterLod for each submitted part on the global Qt thread pool and keeps
+ * the result by content hash, so render threads can draw the part by clusters
+ * chosen per view instead of uploading the whole mesh.
+ */
+#ifndef CLUSTER_LOD_STAGE_H
+#define CLUSTER_LOD_STAGE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+
+#include <memory>
+
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+
+class ClusterLod;
+class TeamCache;
+
+/**
+ * @brief Builds cluster hierarchies for large parts in the background.
+ *
+ * Only parts with at least minimumTriangles() triangles are processed; smaller
+ * parts are drawn whole, which is cheaper than drawing them by clusters.
+ */
+class ClusterLodStage : public QObject {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructs the stage.
+     * @param parent The parent QObject.
+     */
+    explicit ClusterLodStage(QObject* parent = nullptr);
+
+    /**
+     * @brief Sets the smallest part, in triangles, that is given a cluster hierarchy.
+     * @param triangles The threshold.
+     */
+    void setMinimumTriangles(qint64 triangles);
+
+    /**
+     * @brief Returns the smallest part, in triangles, that is given a cluster hierarchy.
+     * @return The threshold.
+     */
+    qint64 minimumTriangles() const;
+
+    /**
+     * @brief Reads hierarchies from, and publishes them to, a team cache directory.
+     * @param cache The cache, or nullptr (the default) for none; it must outlive the stage.
+     */
+    void setTeamCache(TeamCache* cache);
+
+    /**
+     * @brief Queues a hierarchy build for one part's geometry.
+     *
+     * Parts below the threshold, and hashes already built or running, are skipped.
+     * @param hash Content hash of the part's source file.
+     * @param polyData The part geometry; it is only read by the worker.
+     */
+    void submit(const QByteArray& hash, vtkSmartPointer<vtkPolyData> polyData);
+
+    /**
+     * @brief Returns the hierarchy built for a content hash.
+     * @param hash Content hash of the geometry.
+     * @return The hierarchy, or null if none has been built.
+     */
+    std::shared_ptr<const ClusterLod> lod(const QByteArray& hash) const;
+
+    /**
+     * @brief Drops all built hierarchies, e.g. when the tree is cleared.
+     * Builds still running are kept when they finish.
+     */
+    void clear();
+
+signals:
+    /**
+     * @brief Emitted on the GUI thread when a hierarchy has been built.
+     * @param hash Content hash of the geometry.
+     */
+    void lodReady(const QByteArray& hash);
+
+private:
+    qint64 m_minimumTriangles;                                      /**< Smallest part given a hierarchy */
+    TeamCache* m_teamCache = nullptr;                               /**< Shared cache of built hierarchies, or null */
+    QHash<QByteArray, std::shared_ptr<const ClusterLod>> m_lods;    /**< Built hierarchies (GUI thread only) */
+    QSet<QByteArray> m_running;                                     /**< Content hashes with a build in flight (GUI thread only) */
+};
+
+#endif // CLUSTER_LOD_STAGE_H
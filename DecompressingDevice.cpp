@@ -0,0 +1,330 @@
+/**
+ * @file DecompressingDevice.cpp
+ * @brief Implementation of the DecompressingDevice class.
+ *
+ * gzip is decoded with the zlib that VTK bundles, so it needs no extra dependency.
+ * Zstandard is decoded with libzstd when it is available at build time; without
+ * it, .zst files are recognised but fail to open.
+ */
+
+#include "DecompressingDevice.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QThread>
+#include <QtEndian>
+
+#include <vtk_zlib.h>
+
+#if defined(__has_include)
+#if __has_include(<zstd.h>)
+#define HAVE_ZSTD 1
+#include <zstd.h>
+#endif
+#endif
+
+#include <cstring>
+
+namespace {
+
+/** Bytes of compressed input read at a time. */
+const int inputSize = 256 * 1024;
+
+/** Bytes in one decompressed block. */
+const int blockSize = 1024 * 1024;
+
+/** Decompressed blocks that may wait in the queue; bounds the memory held. */
+const int maxQueuedBlocks = 4;
+
+} // namespace
+
+/**
+ * @brief Constructs a device for a compressed file.
+ * @param name The compressed file.
+ * @param parent The parent QObject.
+ */
+DecompressingDevice::DecompressingDevice(const QString& name, QObject* parent)
+    : QIODevice(parent), fileName(name), format(formatOf(name)), worker(nullptr),
+      position(0), finished(false), failed(false), stopping(false) {
+}
+
+/**
+ * @brief Destructor. Stops the decompression thread.
+ */
+DecompressingDevice::~DecompressingDevice() {
+    close();
+}
+
+/**
+ * @brief Returns the compression format of a file name.
+ * @param name A file name.
+ * @return The format.
+ */
+DecompressingDevice::Format DecompressingDevice::formatOf(const QString& name) {
+    if (name.endsWith(".gz", Qt::CaseInsensitive))
+        return Gzip;
+    if (name.endsWith(".zst", Qt::CaseInsensitive))
+        return Zstd;
+    return None;
+}
+
+/**
+ * @brief Checks whether a file name is an STL, compressed or not.
+ * @param name A file name.
+ * @return True for .stl, .stl.gz and .stl.zst.
+ */
+bool DecompressingDevice::isStlFile(const QString& name) {
+    return name.endsWith(".stl", Qt::CaseInsensitive)
+        || name.endsWith(".stl.gz", Qt::CaseInsensitive)
+        || name.endsWith(".stl.zst", Qt::CaseInsensitive);
+}
+
+/**
+ * @brief Estimates the decompressed size of a file.
+ * @param name The file.
+ * @return The estimate in bytes.
+ */
+qint64 DecompressingDevice::estimatedSize(const QString& name) {
+    const qint64 size = QFileInfo(name).size();
+    const Format fileFormat = formatOf(name);
+    if (fileFormat == None)
+        return size;
+
+    QFile file(name);
+    if (!file.open(QIODevice::ReadOnly))
+        return size;
+
+    if (fileFormat == Gzip && size < (qint64(1) << 29) && size >= 18) {
+        // The trailer holds the uncompressed size modulo 2^32; STL data compresses far
+        // less than 8:1, so below 512 MiB the value has not wrapped
+        file.seek(size - 4);
+        QByteArray trailer = file.read(4);
+        if (trailer.size() == 4)
+            return qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(trailer.constData()));
+    }
+#ifdef HAVE_ZSTD
+    if (fileFormat == Zstd) {
+        QByteArray header = file.read(ZSTD_FRAMEHEADERSIZE_MAX);
+        unsigned long long content = ZSTD_getFrameContentSize(header.constData(), header.size());
+        if (content != ZSTD_CONTENTSIZE_UNKNOWN && content != ZSTD_CONTENTSIZE_ERROR)
+            return static_cast<qint64>(content);
+    }
+#endif
+    return 4 * size;
+}
+
+/**
+ * @brief Opens the file and starts the decompression thread.
+ * @param mode Must be ReadOnly.
+ * @return True on success.
+ */
+bool DecompressingDevice::open(OpenMode mode) {
+    if (isOpen() || (mode & ~QIODevice::Text) != QIODevice::ReadOnly || format == None)
+        return false;
+#ifndef HAVE_ZSTD
+    if (format == Zstd) {
+        setErrorString(tr("Zstandard support was not built in"));
+        return false;
+    }
+#endif
+    if (!QFileInfo(fileName).isReadable()) {
+        setErrorString(tr("Cannot read %1").arg(fileName));
+        return false;
+    }
+
+    blocks.clear();
+    current.clear();
+    position = 0;
+    finished = false;
+    failed = false;
+    stopping = false;
+
+    QIODevice::open(QIODevice::ReadOnly);
+    worker = QThread::create([this]() { decompress(); });
+    worker->start();
+    return true;
+}
+
+/**
+ * @brief Stops the decompression thread and closes the device.
+ */
+void DecompressingDevice::close() {
+    if (worker) {
+        {
+            QMutexLocker locker(&mutex);
+            stopping = true;
+            changed.wakeAll();
+        }
+        worker->wait();
+        delete worker;
+        worker = nullptr;
+    }
+    blocks.clear();
+    current.clear();
+    position = 0;
+    if (isOpen())
+        QIODevice::close();
+}
+
+/** @brief The device is always sequential. */
+bool DecompressingDevice::isSequential() const { return true; }
+
+/**
+ * @brief Checks whether every decompressed byte has been read.
+ * @return True at the end of the stream.
+ */
+bool DecompressingDevice::atEnd() const {
+    QMutexLocker locker(&mutex);
+    return QIODevice::bytesAvailable() == 0 && position >= current.size() && blocks.isEmpty() && finished;
+}
+
+/**
+ * @brief Returns the bytes that can be read without waiting.
+ * @return The byte count.
+ */
+qint64 DecompressingDevice::bytesAvailable() const {
+    QMutexLocker locker(&mutex);
+    qint64 available = current.size() - position;
+    for (const QByteArray& block : blocks)
+        available += block.size();
+    return available + QIODevice::bytesAvailable();
+}
+
+/**
+ * @brief Copies decompressed bytes out, waiting for the next block if needed.
+ * @param data Destination.
+ * @param maxSize Largest number of bytes to copy.
+ * @return Bytes copied, 0 at the end, -1 on a decompression error.
+ */
+qint64 DecompressingDevice::readData(char* data, qint64 maxSize) {
+    QMutexLocker locker(&mutex);
+    qint64 copied = 0;
+    while (copied < maxSize) {
+        if (position >= current.size()) {
+            // Return what we have rather than wait, unless we have nothing
+            while (blocks.isEmpty() && !finished && copied == 0)
+                changed.wait(&mutex);
+            if (blocks.isEmpty())
+                break;
+            current = blocks.dequeue();
+            position = 0;
+            changed.wakeAll();
+        }
+        const qint64 n = qMin<qint64>(maxSize - copied, current.size() - position);
+        std::memcpy(data + copied, current.constData() + position, n);
+        position += static_cast<int>(n);
+        copied += n;
+    }
+    if (copied == 0 && failed)
+        return -1;
+    return copied;
+}
+
+/**
+ * @brief Writing is not supported.
+ * @return -1.
+ */
+qint64 DecompressingDevice::writeData(const char*, qint64) {
+    return -1;
+}
+
+/**
+ * @brief Hands a decompressed block to the reader.
+ * @param block The block.
+ * @return False if the device is being closed.
+ */
+bool DecompressingDevice::push(QByteArray block) {
+    QMutexLocker locker(&mutex);
+    while (blocks.size() >= maxQueuedBlocks && !stopping)
+        changed.wait(&mutex);
+    if (stopping)
+        return false;
+    blocks.enqueue(block);
+    changed.wakeAll();
+    return true;
+}
+
+/**
+ * @brief Decompression thread body.
+ *
+ * Concatenated members (gzip) and frames (zstd), as written by parallel
+ * compressors such as pigz and zstd -T, are decoded one after another.
+ */
+void DecompressingDevice::decompress() {
+    QFile file(fileName);
+    bool ok = file.open(QIODevice::ReadOnly);
+    QByteArray input;
+    QByteArray output(blockSize, Qt::Uninitialized);
+
+    if (ok && format == Gzip) {
+        z_stream stream;
+        std::memset(&stream, 0, sizeof(stream));
+        ok = inflateInit2(&stream, 16 + MAX_WBITS) == Z_OK;   // 16: expect a gzip header
+        int status = Z_OK;
+        while (ok) {
+            if (stream.avail_in == 0) {
+                input = file.read(inputSize);
+                if (input.isEmpty()) {
+                    ok = status == Z_STREAM_END;
+                    break;
+                }
+                stream.next_in = reinterpret_cast<Bytef*>(input.data());
+                stream.avail_in = static_cast<uInt>(input.size());
+            }
+            if (status == Z_STREAM_END) {
+                inflateReset(&stream);  // Next gzip member
+            }
+            stream.next_out = reinterpret_cast<Bytef*>(output.data());
+            stream.avail_out = static_cast<uInt>(output.size());
+            status = inflate(&stream, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+                ok = false;
+                break;
+            }
+            const int produced = output.size() - static_cast<int>(stream.avail_out);
+            if (produced > 0 && !push(output.left(produced)))
+                break;
+        }
+        inflateEnd(&stream);
+    }
+#ifdef HAVE_ZSTD
+    else if (ok && format == Zstd) {
+        ZSTD_DStream* stream = ZSTD_createDStream();
+        ok = stream && !ZSTD_isError(ZSTD_initDStream(stream));
+        size_t hint = 1;
+        while (ok) {
+            input = file.read(inputSize);
+            if (input.isEmpty()) {
+                ok = hint == 0;     // 0 means the last frame ended cleanly
+                break;
+            }
+            ZSTD_inBuffer in = { input.constData(), static_cast<size_t>(input.size()), 0 };
+            bool stopped = false;
+            bool more = true;
+            while (more && ok) {
+                ZSTD_outBuffer out = { output.data(), static_cast<size_t>(output.size()), 0 };
+                hint = ZSTD_decompressStream(stream, &out, &in);
+                if (ZSTD_isError(hint)) {
+                    ok = false;
+                    break;
+                }
+                if (out.pos > 0 && !push(output.left(static_cast<int>(out.pos)))) {
+                    stopped = true;
+                    break;
+                }
+                // A full output block may leave decoded data behind in the stream
+                more = in.pos < in.size || out.pos == out.size;
+            }
+            if (stopped)
+                break;
+        }
+        ZSTD_freeDStream(stream);
+    }
+#endif
+
+    QMutexLocker locker(&mutex);
+    failed = !ok && !stopping;
+    finished = true;
+    changed.wakeAll();
+}
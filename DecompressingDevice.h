@@ -0,0 +1,135 @@
+/**
+ * @file DecompressingDevice.h
+ * @brief Declaration of the DecompressingDevice class.
+ *
+ * Archived parts are stored as gzip (.stl.gz) or Zstandard (.stl.zst) files. The
+ * decompressing device reads such a file as a plain sequential stream, so the STL
+ * parser can consume it directly without a temporary file being written.
+ */
+#ifndef DECOMPRESSING_DEVICE_H
+#define DECOMPRESSING_DEVICE_H
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QMutex>
+#include <QQueue>
+#include <QString>
+#include <QWaitCondition>
+
+class QThread;
+
+/**
+ * @brief Sequential read-only device that decompresses a .gz or .zst file.
+ *
+ * Decompression runs on its own thread and hands blocks to the reader through a
+ * small bounded queue, so decompressing and parsing overlap while at most a few
+ * blocks are held in memory, whatever the size of the file.
+ */
+class DecompressingDevice : public QIODevice {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Supported compression formats.
+     */
+    enum Format {
+        None,   /**< Not a compressed file */
+        Gzip,   /**< gzip, decoded with zlib */
+        Zstd    /**< Zstandard */
+    };
+
+    /**
+     * @brief Constructs a device for a compressed file; call open() to start reading.
+     * @param fileName The compressed file.
+     * @param parent The parent QObject.
+     */
+    explicit DecompressingDevice(const QString& fileName, QObject* parent = nullptr);
+
+    /**
+     * @brief Stops the decompression thread and closes the device.
+     */
+    ~DecompressingDevice() override;
+
+    /**
+     * @brief Returns the format of a file, judged by its name.
+     * @param fileName A file name.
+     * @return Gzip for *.gz, Zstd for *.zst, otherwise None.
+     */
+    static Format formatOf(const QString& fileName);
+
+    /**
+     * @brief Returns whether a file name is an STL, compressed or not.
+     * @param fileName A file name.
+     * @return True for *.stl, *.stl.gz and *.stl.zst (any case).
+     */
+    static bool isStlFile(const QString& fileName);
+
+    /**
+     * @brief Estimates the decompressed size of a file without decompressing it.
+     *
+     * Uses the size recorded by the compressor where there is one (the zstd frame
+     * header, or the gzip trailer for files under 512 MiB), otherwise four times the
+     * compressed size.
+     * @param fileName The file.
+     * @return The estimate in bytes; the file size for uncompressed files.
+     */
+    static qint64 estimatedSize(const QString& fileName);
+
+    /**
+     * @brief Opens the file and starts decompressing it.
+     * @param mode Must be QIODevice::ReadOnly.
+     * @return False if the file cannot be opened or its format is not supported.
+     */
+    bool open(OpenMode mode) override;
+
+    /**
+     * @brief Stops decompressing and closes the device.
+     */
+    void close() override;
+
+    /** @brief Always true; the device can only be read front to back. */
+    bool isSequential() const override;
+
+    /** @brief Returns whether every decompressed byte has been read. */
+    bool atEnd() const override;
+
+    /** @brief Returns the bytes that can be read without waiting. */
+    qint64 bytesAvailable() const override;
+
+protected:
+    /**
+     * @brief Copies decompressed bytes out, waiting for the next block if needed.
+     * @return Bytes copied; 0 at the end of the stream, -1 if decompression failed.
+     */
+    qint64 readData(char* data, qint64 maxSize) override;
+
+    /** @brief Not supported; returns -1. */
+    qint64 writeData(const char* data, qint64 maxSize) override;
+
+private:
+    /**
+     * @brief Decompression thread body: fills the queue until the file ends or the device is closed.
+     */
+    void decompress();
+
+    /**
+     * @brief Hands a decompressed block to the reader, waiting while the queue is full.
+     * @return False if the device was closed meanwhile.
+     */
+    bool push(QByteArray block);
+
+    QString fileName;               /**< The compressed file */
+    Format format;                  /**< Its format */
+    QThread* worker;                /**< Runs decompress() */
+
+    mutable QMutex mutex;           /**< Guards the fields below */
+    QWaitCondition changed;         /**< Signalled when the queue changes or the stream ends */
+    QQueue<QByteArray> blocks;      /**< Decompressed blocks not yet read */
+    QByteArray current;             /**< Block being read */
+    int position;                   /**< Read position in current */
+    bool finished;                  /**< True once the decompression thread has stopped */
+    bool failed;                    /**< True if the file was truncated or corrupt */
+    bool stopping;                  /**< True once close() has been called */
+};
+
+#endif // DECOMPRESSING_DEVICE_H
@@ -0,0 +1,896 @@
+/**
+ * @file DesktopRenderThread.cpp
+ * @brief Implementation of the DesktopRenderThread class.
+ *
+ * The thread owns an offscreen render window. Scene snapshots and camera input from
+ * the GUI thread are stored under a mutex and picked up at the start of the next
+ * frame; the rendered image is read back and sent to the view widget.
+ */
+
+#include "DesktopRenderThread.h"
+#include "QuantisedPolyDataMapper.h"
+#include "ClusterLod.h"
+#include "OctreeFile.h"
+
+#include <QMutexLocker>
+#include <QSet>
+
+#include <vtkDataObject.h>
+#include <vtkMath.h>
+#include <vtkPolyDataMapper.h>
+#include <vtkProperty.h>
+#include <vtkUnsignedCharArray.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Copies a transform into a matrix unless the matrix already holds it.
+ *
+ * Leaving an unchanged matrix alone keeps its modification time, so the actors
+ * sharing it do not recompute their own matrices.
+ * @param matrix The matrix.
+ * @param transform 4x4 matrix in row-major order.
+ */
+void updateMatrix(vtkMatrix4x4* matrix, const double transform[16])
+{
+    if (!std::equal(transform, transform + 16, &matrix->Element[0][0]))
+        matrix->DeepCopy(transform);
+}
+
+/**
+ * @brief Takes the camera into a part's model coordinates, where its hierarchy is defined.
+ * @param transform The part's model to scene transform.
+ * @param eye Camera position in the scene.
+ * @param planes Six frustum planes in the scene, or null.
+ * @param modelEye Receives the camera position in model coordinates.
+ * @param modelPlanes Receives the six planes in model coordinates, unless planes is null.
+ * @return Scene units per model unit, to scale the pixels per unit by.
+ */
+double toModel(vtkMatrix4x4* transform, const double eye[3], const double* planes, double modelEye[3], double* modelPlanes)
+{
+    double inverse[16];
+    vtkMatrix4x4::Invert(&transform->Element[0][0], inverse);
+    const double in[4] = { eye[0], eye[1], eye[2], 1.0 };
+    double out[4];
+    vtkMatrix4x4::MultiplyPoint(inverse, in, out);
+    for (int k = 0; k < 3; ++k)
+        modelEye[k] = out[k] / out[3];
+
+    // A plane p in the scene is the plane M^T p in model coordinates
+    if (planes) {
+        for (int i = 0; i < 6; ++i) {
+            const double* p = planes + 4 * i;
+            double* q = modelPlanes + 4 * i;
+            for (int j = 0; j < 4; ++j)
+                q[j] = transform->Element[0][j] * p[0] + transform->Element[1][j] * p[1]
+                     + transform->Element[2][j] * p[2] + transform->Element[3][j] * p[3];
+            const double length = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2]);
+            if (length > 0.0) {
+                for (int j = 0; j < 4; ++j)
+                    q[j] /= length;
+            }
+        }
+    }
+    return std::cbrt(std::abs(transform->Determinant()));
+}
+
+} // namespace
+
+/**
+ * @brief Constructor. Initialises the pending state; VTK objects are created in run().
+ * @param parent The parent QObject.
+ */
+DesktopRenderThread::DesktopRenderThread(QObject* parent)
+    : QThread(parent),
+    sceneChanged(false),
+    dirty(false),
+    endRender(false),
+    azimuth(0.0),
+    elevation(0.0),
+    dolly(1.0),
+    panX(0.0),
+    panY(0.0),
+    resetCamera(false),
+    width(640),
+    height(480),
+    uploadBudget(32 * 1024 * 1024),
+    lodPixelError(1.0),
+    streamBudget(512 * 1024 * 1024),
+    lastCamera(vtkSmartPointer<vtkCamera>::New()),
+    idWidth(0),
+    idHeight(0),
+    idStale(false),
+    idRequested(false),
+    highlightHovered(0),
+    highlightChanged(false)
+{
+    vtkMath::UninitializeBounds(sceneBounds);
+}
+
+/**
+ * @brief Destructor. Ends the rendering loop and waits for the thread to finish.
+ */
+DesktopRenderThread::~DesktopRenderThread()
+{
+    issueCommand(END_RENDER, 0.0);
+    wait();
+}
+
+/**
+ * @brief Replaces the scene drawn by the thread.
+ * @param scene The new scene.
+ */
+void DesktopRenderThread::submitScene(const SceneSnapshot& scene)
+{
+    QMutexLocker locker(&mutex);
+
+    // A reset requested by a snapshot that is overtaken before it is drawn still applies
+    const bool keepReset = sceneChanged && pendingScene.resetCamera;
+    pendingScene = scene;
+    pendingScene.resetCamera = pendingScene.resetCamera || keepReset;
+    sceneChanged = true;
+    dirty = true;
+    condition.wakeOne();
+}
+
+/**
+ * @brief Issues a camera command; commands are accumulated until the next frame.
+ * @param cmd A value from the Command enum.
+ * @param value The amount associated with the command.
+ */
+void DesktopRenderThread::issueCommand(int cmd, double value)
+{
+    QMutexLocker locker(&mutex);
+
+    switch (cmd) {
+    case END_RENDER:
+        endRender = true;
+        break;
+    case AZIMUTH:
+        azimuth += value;
+        break;
+    case ELEVATION:
+        elevation += value;
+        break;
+    case DOLLY:
+        dolly *= value;
+        break;
+    case PAN_X:
+        panX += value;
+        break;
+    case PAN_Y:
+        panY += value;
+        break;
+    case RESET_CAMERA:
+        resetCamera = true;
+        break;
+    default:
+        return;
+    }
+
+    dirty = true;
+    condition.wakeOne();
+}
+
+/**
+ * @brief Sets the size of the rendered frames.
+ * @param w Width in pixels.
+ * @param h Height in pixels.
+ */
+void DesktopRenderThread::resize(int w, int h)
+{
+    QMutexLocker locker(&mutex);
+    width = qMax(1, w);
+    height = qMax(1, h);
+    dirty = true;
+    condition.wakeOne();
+}
+
+/**
+ * @brief Sets the per-frame upload budget.
+ * @param bytes The budget in bytes.
+ */
+void DesktopRenderThread::setUploadBudget(qint64 bytes)
+{
+    QMutexLocker locker(&mutex);
+    uploadBudget = bytes;
+}
+
+/**
+ * @brief Sets the largest cluster error allowed on screen.
+ * @param pixels The threshold in pixels.
+ */
+void DesktopRenderThread::setLodPixelError(double pixels)
+{
+    QMutexLocker locker(&mutex);
+    lodPixelError = qMax(0.1, pixels);
+    dirty = true;
+    condition.wakeOne();
+}
+
+/**
+ * @brief Sets the memory each out-of-core part may use.
+ * @param bytes The budget in bytes.
+ */
+void DesktopRenderThread::setStreamBudget(qint64 bytes)
+{
+    QMutexLocker locker(&mutex);
+    streamBudget = bytes;
+    dirty = true;
+    condition.wakeOne();
+}
+
+/**
+ * @brief Copies the camera used for the most recent frame.
+ * @param camera The camera to copy into.
+ */
+void DesktopRenderThread::copyCamera(vtkCamera* camera)
+{
+    QMutexLocker locker(&mutex);
+    camera->DeepCopy(lastCamera);
+}
+
+/**
+ * @brief Sets the parts drawn with an outline.
+ * @param selected Ids of the selected parts.
+ * @param hovered Id of the part under the cursor, or 0.
+ */
+void DesktopRenderThread::setHighlight(const QSet<quintptr>& selected, quintptr hovered)
+{
+    QMutexLocker locker(&mutex);
+    if (selected == highlightSelected && hovered == highlightHovered)
+        return;
+    highlightSelected = selected;
+    highlightHovered = hovered;
+    highlightChanged = true;
+    condition.wakeOne();
+}
+
+/**
+ * @brief Returns the part seen at a pixel of the most recent frame.
+ * @param x Column, in frame pixels from the left.
+ * @param y Row, in frame pixels from the top.
+ * @param id Receives the part's id, or 0.
+ * @return False if the ID buffer is out of date; idBufferReady() follows.
+ */
+bool DesktopRenderThread::partAt(int x, int y, quintptr& id)
+{
+    QMutexLocker locker(&mutex);
+    id = 0;
+    if (idStale) {
+        // Draw it now rather than waiting for the camera to settle
+        idRequested = true;
+        condition.wakeOne();
+        return false;
+    }
+    if (x >= 0 && y >= 0 && x < idWidth && y < idHeight)
+        id = idBuffer[y * idWidth + x];
+    return true;
+}
+
+/**
+ * @brief Rendering loop. Renders one frame whenever new work has arrived.
+ */
+void DesktopRenderThread::run()
+{
+    renderer = vtkSmartPointer<vtkRenderer>::New();
+    renderer->SetBackground(0.1, 0.1, 0.1);
+
+    // Translucent parts are blended with weighted order-independent transparency:
+    // one extra pass whatever the number of parts, with no per-frame sorting or peeling
+    renderer->SetUseDepthPeeling(false);
+    renderer->SetUseOIT(true);
+
+    window = vtkSmartPointer<vtkRenderWindow>::New();
+    window->SetOffScreenRendering(1);
+    window->AddRenderer(renderer);
+
+    // Only the actor pass is needed to tell parts apart
+    selector = vtkSmartPointer<vtkHardwareSelector>::New();
+    selector->SetRenderer(renderer);
+    selector->SetFieldAssociation(vtkDataObject::FIELD_ASSOCIATION_CELLS);
+    selector->SetActorPassOnly(true);
+
+    QImage cleanFrame;
+    while (true) {
+        SceneSnapshot scene;
+        bool haveScene;
+        bool render;
+        int w, h;
+        qint64 budget;
+        double pixelError;
+        qint64 chunkBudget;
+        QSet<quintptr> selected;
+        quintptr hovered;
+
+        bool drawIds = false;
+
+        /* Wait for work, then take the scene out so the GUI can queue the next one */
+        {
+            QMutexLocker locker(&mutex);
+            while (!dirty && !highlightChanged && !idRequested && !endRender) {
+                // The ID buffer waits until the camera has been still for a moment,
+                // so orbiting or zooming never pays for the extra pass
+                if (idStale && !cleanFrame.isNull()) {
+                    if (!condition.wait(&mutex, IdSettleTime)) {
+                        drawIds = true;
+                        break;
+                    }
+                }
+                else
+                    condition.wait(&mutex);
+            }
+            if (endRender)
+                break;
+
+            // A highlight change alone only redraws the outlines over the last frame
+            render = dirty || cleanFrame.isNull();
+            selected = highlightSelected;
+            hovered = highlightHovered;
+            // A new highlight over a stale buffer needs this frame's IDs to be outlined
+            const bool highlighted = !selected.isEmpty() || hovered;
+            drawIds = !render && (drawIds || idRequested || (idStale && highlighted));
+            idRequested = false;
+            highlightChanged = false;
+
+            haveScene = sceneChanged;
+            if (haveScene)
+                scene = std::move(pendingScene);
+            sceneChanged = false;
+            dirty = false;
+            w = width;
+            h = height;
+            budget = uploadBudget;
+            pixelError = lodPixelError;
+            chunkBudget = streamBudget;
+        }
+
+        if (!render) {
+            // The last frame's scene and camera are still current, so its IDs can be drawn
+            if (drawIds)
+                renderIdBuffer(cleanFrame.width(), cleanFrame.height());
+            emit frameReady(outlineFrame(cleanFrame, selected, hovered));
+            if (drawIds)
+                emit idBufferReady();
+            continue;
+        }
+
+        if (haveScene)
+            applyScene(scene);
+        uploads.setBudget(budget);
+        admitUploads();
+
+        /* Camera state is small, so it is updated under the lock */
+        {
+            QMutexLocker locker(&mutex);
+            vtkCamera* camera = renderer->GetActiveCamera();
+            // Fit to the whole scene, not just the parts uploaded so far
+            if ((haveScene && scene.resetCamera) || resetCamera) {
+                if (vtkMath::AreBoundsInitialized(sceneBounds))
+                    renderer->ResetCamera(sceneBounds);
+                resetCamera = false;
+            }
+            applyCameraCommands(camera);
+        }
+        selectClusters(h, pixelError);
+        streamChunks(w, h, pixelError, chunkBudget);
+
+        window->SetSize(w, h);
+        renderer->ResetCameraClippingRange();
+        window->Render();
+        cleanFrame = grabFrame();
+
+        // Outlines follow the parts while the camera moves, so frames with a highlight
+        // pay for the ID pass at once; the others leave it until the camera settles
+        const bool highlighted = !selected.isEmpty() || hovered;
+        if (highlighted)
+            renderIdBuffer(w, h);
+
+        {
+            QMutexLocker locker(&mutex);
+            lastCamera->DeepCopy(renderer->GetActiveCamera());
+            idStale = !highlighted;
+
+            // Keep drawing frames until every staged part has been uploaded
+            if (!uploads.isEmpty())
+                dirty = true;
+        }
+        emit frameReady(outlineFrame(cleanFrame, selected, hovered));
+        if (highlighted)
+            emit idBufferReady();
+    }
+
+    /* The OpenGL resources belong to this thread, so release them here */
+    selector = nullptr;
+    actors.clear();
+    staged.clear();
+    mappers.clear();
+    lodParts.clear();
+    streamedParts.clear();
+    renderer->RemoveAllViewProps();
+    window->Finalize();
+    window = nullptr;
+    renderer = nullptr;
+}
+
+/**
+ * @brief Brings the renderer's actors in line with a scene snapshot.
+ *
+ * Parts whose geometry is already on the GPU are updated in place. New parts, and
+ * parts whose geometry copy changed, are staged for upload; a changed part keeps
+ * showing its old geometry until its upload is admitted.
+ * @param scene The scene to show.
+ */
+void DesktopRenderThread::applyScene(const SceneSnapshot& scene)
+{
+    renderer->SetBackground(scene.background[0], scene.background[1], scene.background[2]);
+    vtkMath::UninitializeBounds(sceneBounds);
+
+    QHash<quintptr, vtkSmartPointer<vtkActor>> current;
+    QHash<quintptr, PartSnapshot> stillStaged;
+    QHash<quintptr, LodPart> currentLod;
+    QHash<quintptr, StreamedPart> currentStreamed;
+    QSet<vtkPolyData*> stagedGeometry;
+    for (const PartSnapshot& part : scene.parts) {
+        if (!part.geometry && !part.octree)
+            continue;
+
+        // Bounds come in scene coordinates, already placed by the part's transform
+        const double* bounds = part.bounds;
+        if (vtkMath::AreBoundsInitialized(bounds) && !vtkMath::AreBoundsInitialized(sceneBounds)) {
+            for (int k = 0; k < 6; ++k)
+                sceneBounds[k] = bounds[k];
+        }
+        else if (vtkMath::AreBoundsInitialized(bounds)) {
+            for (int k = 0; k < 3; ++k) {
+                sceneBounds[2 * k] = qMin(sceneBounds[2 * k], bounds[2 * k]);
+                sceneBounds[2 * k + 1] = qMax(sceneBounds[2 * k + 1], bounds[2 * k + 1]);
+            }
+        }
+
+        // Out-of-core parts have no whole mesh; their chunks are streamed per frame
+        if (part.octree) {
+            StreamedPart streamed = streamedParts.take(part.id);
+            if (streamed.chunks && streamed.chunks->octree() != part.octree) {
+                for (const vtkSmartPointer<vtkActor>& actor : streamed.chunks->actors())
+                    renderer->RemoveActor(actor);
+                streamed.chunks.reset();
+            }
+            if (!streamed.chunks) {
+                streamed.chunks = std::make_shared<OctreeChunkCache>(part.octree, vtkSmartPointer<vtkProperty>::New());
+                streamed.transform = vtkSmartPointer<vtkMatrix4x4>::New();
+            }
+            streamed.chunks->property()->SetColor(part.colour[0], part.colour[1], part.colour[2]);
+            streamed.chunks->property()->SetOpacity(part.opacity);
+            updateMatrix(streamed.transform, part.transform);
+            currentStreamed.insert(part.id, streamed);
+            continue;
+        }
+
+        // Cluster-drawn parts skip the whole-mesh actor; their clusters are chosen per frame
+        if (part.lod) {
+            LodPart lodPart = lodParts.take(part.id);
+            if (lodPart.lod != part.lod) {
+                for (const vtkSmartPointer<vtkActor>& node : lodPart.nodes)
+                    renderer->RemoveActor(node);
+                lodPart.nodes.clear();
+                lodPart.lod = part.lod;
+            }
+            if (!lodPart.property) {
+                lodPart.property = vtkSmartPointer<vtkProperty>::New();
+                lodPart.transform = vtkSmartPointer<vtkMatrix4x4>::New();
+            }
+            lodPart.property->SetColor(part.colour[0], part.colour[1], part.colour[2]);
+            lodPart.property->SetOpacity(part.opacity);
+            updateMatrix(lodPart.transform, part.transform);
+            currentLod.insert(part.id, lodPart);
+            continue;
+        }
+
+        vtkSmartPointer<vtkActor> actor = actors.take(part.id);
+        if (actor)
+            current.insert(part.id, actor);
+
+        // Scalar colouring lives on the mapper, so an overlaid part never draws with a shared one
+        vtkPolyDataMapper* mapper = part.scalarVisibility ? nullptr : mappers.value(part.geometry).Get();
+        if (actor && actor->GetMapper()->GetInputDataObject(0, 0) == part.geometry) {
+            const bool shared = actor->GetMapper() == mappers.value(part.geometry);
+            if (shared && part.scalarVisibility)
+                actor->SetMapper(vtkSmartPointer<QuantisedPolyDataMapper>::New());
+            else if (!shared && mapper)
+                actor->SetMapper(mapper);
+            applyPart(actor, part, true);
+            uploads.remove(part.id);
+            continue;
+        }
+
+        // Another instance of the geometry is already uploaded, so there is nothing to wait for
+        if (mapper) {
+            if (!actor) {
+                actor = vtkSmartPointer<vtkActor>::New();
+                renderer->AddActor(actor);
+                current.insert(part.id, actor);
+            }
+            actor->SetMapper(mapper);
+            applyPart(actor, part, true);
+            uploads.remove(part.id);
+            continue;
+        }
+
+        // Colour, opacity and placement do not wait for the upload
+        if (actor)
+            applyPart(actor, part, false);
+        stillStaged.insert(part.id, part);
+
+        // Only the first plain instance of a geometry counts against the budget; the rest share its upload
+        const qint64 bytes = !part.scalarVisibility && stagedGeometry.contains(part.geometry)
+            ? 0 : GpuUploadQueue::estimateBytes(part.geometry, part.scalarVisibility);
+        if (!part.scalarVisibility)
+            stagedGeometry.insert(part.geometry);
+        uploads.enqueue(part.id, bytes);
+    }
+
+    // Whatever is left was hidden or unloaded since the last snapshot
+    for (const vtkSmartPointer<vtkActor>& actor : actors)
+        renderer->RemoveActor(actor);
+    for (const LodPart& lodPart : lodParts) {
+        for (const vtkSmartPointer<vtkActor>& node : lodPart.nodes)
+            renderer->RemoveActor(node);
+    }
+    for (const StreamedPart& streamed : streamedParts) {
+        for (const vtkSmartPointer<vtkActor>& actor : streamed.chunks->actors())
+            renderer->RemoveActor(actor);
+    }
+    for (auto it = staged.constBegin(); it != staged.constEnd(); ++it) {
+        if (!stillStaged.contains(it.key()))
+            uploads.remove(it.key());
+    }
+    actors.swap(current);
+    staged.swap(stillStaged);
+
+    // Forget the mappers of geometry no longer drawn by any actor
+    QHash<vtkPolyData*, vtkSmartPointer<vtkPolyDataMapper>> used;
+    for (const vtkSmartPointer<vtkActor>& actor : actors) {
+        vtkPolyDataMapper* mapper = static_cast<vtkPolyDataMapper*>(actor->GetMapper());
+        if (mappers.value(mapper->GetInput()) == mapper)
+            used.insert(mapper->GetInput(), mapper);
+    }
+    mappers.swap(used);
+    lodParts.swap(currentLod);
+    streamedParts.swap(currentStreamed);
+}
+
+/**
+ * @brief Shows the staged parts that fit in this frame's upload budget.
+ *
+ * VTK uploads an actor's buffers the first time it is drawn with new input, so
+ * admitting a part here means its upload happens during this frame.
+ */
+void DesktopRenderThread::admitUploads()
+{
+    for (quintptr id : uploads.admit()) {
+        auto it = staged.find(id);
+        if (it == staged.end())
+            continue;
+
+        vtkSmartPointer<vtkActor> actor = actors.value(id);
+        if (!actor) {
+            actor = vtkSmartPointer<vtkActor>::New();
+            renderer->AddActor(actor);
+            actors.insert(id, actor);
+        }
+
+        // The first plain instance admitted creates the mapper the others will share;
+        // overlaid parts get a mapper of their own
+        vtkSmartPointer<vtkPolyDataMapper> mapper = it->scalarVisibility ? nullptr : mappers.value(it->geometry);
+        if (!mapper) {
+            mapper = vtkSmartPointer<QuantisedPolyDataMapper>::New();
+            if (!it->scalarVisibility)
+                mappers.insert(it->geometry, mapper);
+        }
+        actor->SetMapper(mapper);
+        applyPart(actor, it.value(), true);
+        staged.erase(it);
+    }
+}
+
+/**
+ * @brief Copies a part's render state onto its actor.
+ *
+ * Setting the same input, colour or table again leaves the mapper's buffers alone.
+ * @param actor The actor showing the part.
+ * @param part The part's state.
+ * @param withGeometry Also set the geometry and the overlay that depends on it.
+ */
+void DesktopRenderThread::applyPart(vtkActor* actor, const PartSnapshot& part, bool withGeometry)
+{
+    actor->GetProperty()->SetColor(part.colour[0], part.colour[1], part.colour[2]);
+    actor->GetProperty()->SetOpacity(part.opacity);
+    if (!actor->GetUserMatrix()) {
+        vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+        actor->SetUserMatrix(matrix);
+    }
+    updateMatrix(actor->GetUserMatrix(), part.transform);
+    if (!withGeometry)
+        return;
+
+    vtkPolyDataMapper* mapper = static_cast<vtkPolyDataMapper*>(actor->GetMapper());
+    mapper->SetInputData(part.geometry);
+    mapper->SetScalarVisibility(part.scalarVisibility);
+    if (part.scalarVisibility) {
+        mapper->SetScalarModeToUsePointFieldData();
+        mapper->SelectColorArray(part.colorArray.c_str());
+        mapper->SetLookupTable(part.lut);
+        mapper->SetScalarRange(part.scalarRange[0], part.scalarRange[1]);
+    }
+}
+
+/**
+ * @brief Shows the clusters of each cluster-drawn part that suit the current camera.
+ *
+ * Cluster actors are created the first time their cluster is selected and then kept,
+ * hidden while not selected, so moving back and forth does not upload them again.
+ * @param viewHeight Frame height in pixels.
+ * @param pixelError Largest simplification error allowed on screen, in pixels.
+ */
+void DesktopRenderThread::selectClusters(int viewHeight, double pixelError)
+{
+    if (lodParts.isEmpty())
+        return;
+
+    vtkCamera* camera = renderer->GetActiveCamera();
+    double eye[3];
+    camera->GetPosition(eye);
+    const double pixelsPerUnit = viewHeight / (2.0 * std::tan(vtkMath::RadiansFromDegrees(camera->GetViewAngle()) / 2.0));
+
+    std::vector<int> selected;
+    for (LodPart& lodPart : lodParts) {
+        double modelEye[3];
+        const double scale = toModel(lodPart.transform, eye, nullptr, modelEye, nullptr);
+        lodPart.lod->select(modelEye, pixelsPerUnit * scale, pixelError, selected);
+
+        for (const vtkSmartPointer<vtkActor>& node : lodPart.nodes)
+            node->VisibilityOff();
+        for (int index : selected) {
+            vtkSmartPointer<vtkActor>& node = lodPart.nodes[index];
+            if (!node) {
+                vtkSmartPointer<QuantisedPolyDataMapper> mapper = vtkSmartPointer<QuantisedPolyDataMapper>::New();
+                mapper->SetInputData(lodPart.lod->node(index).geometry);
+                mapper->ScalarVisibilityOff();
+                node = vtkSmartPointer<vtkActor>::New();
+                node->SetMapper(mapper);
+                node->SetProperty(lodPart.property);
+                node->SetUserMatrix(lodPart.transform);
+                renderer->AddActor(node);
+            }
+            node->VisibilityOn();
+        }
+    }
+}
+
+/**
+ * @brief Streams in the chunks of each out-of-core part that are in view and needed.
+ *
+ * Chunks outside the view frustum are skipped. A new chunk's points are paged in
+ * from the mapped octree file when its buffers are uploaded during this frame.
+ * @param viewWidth Frame width in pixels.
+ * @param viewHeight Frame height in pixels.
+ * @param pixelError Largest simplification error allowed on screen, in pixels.
+ * @param budget Memory each part may use, in bytes.
+ */
+void DesktopRenderThread::streamChunks(int viewWidth, int viewHeight, double pixelError, qint64 budget)
+{
+    if (streamedParts.isEmpty())
+        return;
+
+    vtkCamera* camera = renderer->GetActiveCamera();
+    double eye[3];
+    camera->GetPosition(eye);
+    double planes[24];
+    camera->GetFrustumPlanes(static_cast<double>(viewWidth) / viewHeight, planes);
+    const double pixelsPerUnit = viewHeight / (2.0 * std::tan(vtkMath::RadiansFromDegrees(camera->GetViewAngle()) / 2.0));
+
+    std::vector<int> selected;
+    std::vector<vtkSmartPointer<vtkActor>> added, evicted;
+    for (const StreamedPart& streamed : streamedParts) {
+        double modelEye[3], modelPlanes[24];
+        const double scale = toModel(streamed.transform, eye, planes, modelEye, modelPlanes);
+        streamed.chunks->octree()->select(modelEye, modelPlanes, pixelsPerUnit * scale, pixelError, budget, selected);
+        streamed.chunks->show(selected, budget, added, evicted);
+        for (const vtkSmartPointer<vtkActor>& actor : evicted)
+            renderer->RemoveActor(actor);
+        for (const vtkSmartPointer<vtkActor>& actor : added) {
+            actor->SetUserMatrix(streamed.transform);
+            renderer->AddActor(actor);
+        }
+    }
+}
+
+/**
+ * @brief Applies the accumulated camera commands. Called with the mutex held.
+ * @param camera The camera to move.
+ */
+void DesktopRenderThread::applyCameraCommands(vtkCamera* camera)
+{
+    if (azimuth != 0.0)
+        camera->Azimuth(azimuth);
+    if (elevation != 0.0) {
+        camera->Elevation(elevation);
+        camera->OrthogonalizeViewUp();
+    }
+    if (dolly != 1.0 && dolly > 0.0)
+        camera->Dolly(dolly);
+
+    if (panX != 0.0 || panY != 0.0) {
+        // World units per pixel at the focal point
+        double scale = camera->GetParallelProjection()
+            ? 2.0 * camera->GetParallelScale() / height
+            : 2.0 * camera->GetDistance() * std::tan(vtkMath::RadiansFromDegrees(camera->GetViewAngle()) / 2.0) / height;
+
+        double up[3], direction[3], right[3];
+        camera->GetViewUp(up);
+        camera->GetDirectionOfProjection(direction);
+        vtkMath::Cross(direction, up, right);
+        vtkMath::Normalize(right);
+
+        // Dragging moves the scene with the cursor, so the camera moves the other way
+        double focalPoint[3], position[3];
+        camera->GetFocalPoint(focalPoint);
+        camera->GetPosition(position);
+        for (int k = 0; k < 3; ++k) {
+            double offset = (-panX * right[k] + panY * up[k]) * scale;
+            focalPoint[k] += offset;
+            position[k] += offset;
+        }
+        camera->SetFocalPoint(focalPoint);
+        camera->SetPosition(position);
+    }
+
+    azimuth = 0.0;
+    elevation = 0.0;
+    dolly = 1.0;
+    panX = 0.0;
+    panY = 0.0;
+}
+
+/**
+ * @brief Reads the rendered frame back from the render window.
+ * @return The frame as an image, top row first.
+ */
+QImage DesktopRenderThread::grabFrame()
+{
+    int* size = window->GetSize();
+    const int w = size[0];
+    const int h = size[1];
+
+    vtkSmartPointer<vtkUnsignedCharArray> pixels = vtkSmartPointer<vtkUnsignedCharArray>::New();
+    window->GetRGBACharPixelData(0, 0, w - 1, h - 1, 0, pixels);
+
+    // VTK images start at the bottom row
+    QImage image(w, h, QImage::Format_RGBA8888);
+    for (int y = 0; y < h; ++y) {
+        std::memcpy(image.scanLine(h - 1 - y), pixels->GetPointer(4 * y * w), 4 * w);
+    }
+    return image;
+}
+
+/**
+ * @brief Draws the ID buffer of the current frame and makes it the one partAt() reads.
+ *
+ * The hardware selector draws every prop in a flat colour encoding its index, in
+ * one extra pass over the frame's actors. The pass is decoded straight from the
+ * selector's pixel buffer in a single loop; each pixel's prop is mapped to the
+ * part that owns it, and consecutive pixels of the same prop reuse the last lookup.
+ * @param w Frame width in pixels.
+ * @param h Frame height in pixels.
+ */
+void DesktopRenderThread::renderIdBuffer(int w, int h)
+{
+    // Whole-mesh, cluster and chunk actors all resolve to the part they draw
+    QHash<vtkProp*, quintptr> owners;
+    for (auto it = actors.constBegin(); it != actors.constEnd(); ++it)
+        owners.insert(it.value(), it.key());
+    for (auto it = lodParts.constBegin(); it != lodParts.constEnd(); ++it) {
+        for (const vtkSmartPointer<vtkActor>& actor : it->nodes)
+            owners.insert(actor, it.key());
+    }
+    for (auto it = streamedParts.constBegin(); it != streamedParts.constEnd(); ++it) {
+        for (const vtkSmartPointer<vtkActor>& actor : it->chunks->actors())
+            owners.insert(actor, it.key());
+    }
+
+    idScratch.fill(0, w * h);
+    selector->SetArea(0, 0, w - 1, h - 1);
+    if (w > 0 && h > 0 && selector->CaptureBuffers()) {
+        // Three bytes per pixel, most significant first, bottom row first
+        const unsigned char* pixels = selector->GetPixelBuffer(vtkHardwareSelector::ACTOR_PASS);
+        if (pixels) {
+            int lastValue = 0;
+            quintptr lastPart = 0;
+            for (int y = 0; y < h; ++y) {
+                // Selector rows start at the bottom, the buffer's at the top like the frame
+                quintptr* row = idScratch.data() + (h - 1 - y) * w;
+                const unsigned char* pixel = pixels + 3 * y * w;
+                for (int x = 0; x < w; ++x, pixel += 3) {
+                    // Zero is the background; props are numbered from one
+                    const int value = (pixel[0] << 16) | (pixel[1] << 8) | pixel[2];
+                    if (value == 0)
+                        continue;
+                    if (value != lastValue) {
+                        lastValue = value;
+                        lastPart = owners.value(selector->GetPropFromID(value - 1), 0);
+                    }
+                    row[x] = lastPart;
+                }
+            }
+        }
+        selector->ClearBuffers();
+    }
+
+    QMutexLocker locker(&mutex);
+    idBuffer.swap(idScratch);
+    idWidth = w;
+    idHeight = h;
+    idStale = false;
+}
+
+/**
+ * @brief Draws the outlines of the highlighted parts over a frame.
+ *
+ * A pixel is on a part's outline when it belongs to the part and a pixel within
+ * OutlineWidth of it does not, as read from the ID buffer of the same frame. The
+ * cost is one pass over the frame's pixels, whatever the scene or the selection.
+ * @param frame The frame as rendered.
+ * @param selected Ids of the selected parts.
+ * @param hovered Id of the part under the cursor, or 0.
+ * @return The frame with outlines, or @p frame itself if nothing is highlighted.
+ */
+QImage DesktopRenderThread::outlineFrame(const QImage& frame, const QSet<quintptr>& selected, quintptr hovered) const
+{
+    // A stale buffer would put the outlines where the parts were before the camera moved
+    if ((selected.isEmpty() && !hovered) || idStale || idWidth != frame.width() || idHeight != frame.height())
+        return frame;
+
+    const int w = idWidth;
+    const int h = idHeight;
+    const quintptr* ids = idBuffer.constData();
+    // Frames are RGBA8888, so colours are written byte by byte
+    const uchar selectedColour[4] = { 255, 160, 0, 255 };
+    const uchar hoveredColour[4] = { 120, 220, 255, 255 };
+
+    QImage outlined = frame;
+    quintptr lastId = 0;
+    bool lastHighlighted = false;
+    for (int y = 0; y < h; ++y) {
+        uchar* line = outlined.scanLine(y);
+        for (int x = 0; x < w; ++x) {
+            const quintptr id = ids[y * w + x];
+            if (!id)
+                continue;
+            if (id != lastId) {
+                lastId = id;
+                lastHighlighted = id == hovered || selected.contains(id);
+            }
+            if (!lastHighlighted)
+                continue;
+
+            bool edge = false;
+            for (int dy = -OutlineWidth; dy <= OutlineWidth && !edge; ++dy) {
+                for (int dx = -OutlineWidth; dx <= OutlineWidth && !edge; ++dx) {
+                    const int nx = x + dx;
+                    const int ny = y + dy;
+                    edge = nx < 0 || ny < 0 || nx >= w || ny >= h || ids[ny * w + nx] != id;
+                }
+            }
+            // Hovering wins so the part under the cursor stands out within a selection
+            if (edge)
+                std::memcpy(line + 4 * x, id == hovered ? hoveredColour : selectedColour, 4);
+        }
+    }
+    return outlined;
+}
@@ -0,0 +1,350 @@
+/**
+ * @file DesktopRenderThread.h
+ * @brief Declaration of the DesktopRenderThread class.
+ *
+ * The desktop 3D view is rendered on this thread rather than on the GUI thread, in
+ * the same way VRRenderThread renders the headset view. The GUI thread only builds
+ * scene snapshots and forwards camera input, so the tree, menus and dialogs stay
+ * responsive however long a frame of a large scene takes.
+ */
+#ifndef DESKTOP_RENDER_THREAD_H
+#define DESKTOP_RENDER_THREAD_H
+
+/* Project headers */
+#include "SceneSnapshot.h"
+#include "GpuUploadQueue.h"
+#include "OctreeChunkCache.h"
+
+/* Qt headers */
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QImage>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+
+#include <memory>
+
+/* Vtk headers */
+#include <vtkSmartPointer.h>
+#include <vtkActor.h>
+#include <vtkCamera.h>
+#include <vtkHardwareSelector.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPolyDataMapper.h>
+#include <vtkProperty.h>
+#include <vtkRenderWindow.h>
+#include <vtkRenderer.h>
+
+/**
+ * @brief Renders the desktop view offscreen on its own thread.
+ *
+ * The thread sleeps until it is given a new scene snapshot, a camera command or a new
+ * view size. Everything that arrives while a frame is being drawn is merged and drawn
+ * in the next frame, so a slow frame never builds up a backlog of work. Finished
+ * frames are delivered to the GUI thread as images through frameReady().
+ *
+ * New or changed geometry goes through a GpuUploadQueue: each frame only takes on
+ * as many parts as fit in the upload budget, and keeps rendering until the queue
+ * is empty, so a burst of newly loaded parts fades in over several frames.
+ *
+ * Parts with a ClusterLod are drawn by clusters instead: every frame picks the
+ * coarsest clusters whose error stays below a pixel threshold from the current
+ * camera, so only the region near the viewer is drawn at full resolution.
+ *
+ * Each part is placed by the world transform in its snapshot, set as the user
+ * matrix of its actors. A matrix is only replaced when the transform changed, so
+ * moving a subassembly touches just the actors of the parts in it.
+ *
+ * Instances of one part share their snapshot geometry. Their actors share one
+ * mapper, so the geometry is uploaded, and held on the GPU, once for all of them.
+ * Overlay colouring is mapper state, so an instance showing an overlay gets a
+ * mapper of its own and never colours the others.
+ *
+ * Once the camera has settled, or when partAt() is asked about a newer frame, the
+ * scene is drawn once more into an ID buffer, which holds the id of the part seen
+ * at each pixel. partAt() reads it, so the GUI can resolve clicks and hovering to a
+ * part without a CPU ray cast through the scene. Frames drawn while the camera
+ * moves skip the extra pass, unless a part is outlined in them.
+ *
+ * The same ID buffer draws the outlines of the selected and hovered parts over the
+ * finished frame, so highlighting never touches the parts' actors or properties,
+ * which are shared with the VR view. Changing only the highlight redraws the
+ * outlines over the last frame without rendering the scene again.
+ */
+class DesktopRenderThread : public QThread {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief List of command names
+     */
+    enum Command {
+        END_RENDER,     /**< Command to end the rendering loop */
+        AZIMUTH,        /**< Orbit about the view-up axis, in degrees */
+        ELEVATION,      /**< Orbit about the horizontal axis, in degrees */
+        DOLLY,          /**< Move towards the focal point by a factor (>1 moves closer) */
+        PAN_X,          /**< Move the camera sideways, in pixels */
+        PAN_Y,          /**< Move the camera up or down, in pixels */
+        RESET_CAMERA    /**< Fit the camera to the scene */
+    };
+
+    /**
+     * @brief Constructor
+     *
+     * The render window is created in run(), so its OpenGL context belongs to the render thread.
+     *
+     * @param parent The parent QObject (optional).
+     */
+    explicit DesktopRenderThread(QObject* parent = nullptr);
+
+    /**
+     * @brief Destructor
+     *
+     * Stops the rendering loop and waits for the thread to finish.
+     */
+    ~DesktopRenderThread() override;
+
+    /**
+     * @brief Replaces the scene drawn by the thread.
+     *
+     * If a snapshot is already waiting it is replaced, except that a pending camera reset is kept.
+     *
+     * @param scene The new scene.
+     */
+    void submitScene(const SceneSnapshot& scene);
+
+    /**
+     * @brief Issues a camera command to the render thread in a thread-safe manner.
+     *
+     * Commands of the same kind that arrive before the next frame are accumulated.
+     *
+     * @param cmd A value from the Command enum.
+     * @param value The amount associated with the command.
+     */
+    void issueCommand(int cmd, double value);
+
+    /**
+     * @brief Sets the size of the rendered frames.
+     * @param width Width in pixels.
+     * @param height Height in pixels.
+     */
+    void resize(int width, int height);
+
+    /**
+     * @brief Sets how many bytes of geometry may be uploaded to the GPU per frame.
+     * @param bytes The budget in bytes.
+     */
+    void setUploadBudget(qint64 bytes);
+
+    /**
+     * @brief Sets the largest simplification error allowed on screen for parts drawn by clusters.
+     * @param pixels The threshold in pixels.
+     */
+    void setLodPixelError(double pixels);
+
+    /**
+     * @brief Sets the memory each out-of-core part may use for its streamed chunks.
+     * @param bytes The budget in bytes.
+     */
+    void setStreamBudget(qint64 bytes);
+
+    /**
+     * @brief Copies the camera used for the most recent frame.
+     * @param camera The camera to copy into.
+     */
+    void copyCamera(vtkCamera* camera);
+
+    /**
+     * @brief Returns the part seen at a pixel of the most recent frame.
+     *
+     * Reads one entry of the ID buffer, so it costs the same for any scene. If the
+     * buffer is older than the frame, the thread is asked to draw it and the query
+     * fails; idBufferReady() is emitted once it can be asked again.
+     *
+     * @param x Column, in frame pixels from the left.
+     * @param y Row, in frame pixels from the top.
+     * @param id Receives the part's id, or 0 for the background or outside the frame.
+     * @return True if the ID buffer matches the most recent frame.
+     */
+    bool partAt(int x, int y, quintptr& id);
+
+    /**
+     * @brief Sets the parts drawn with an outline, in a thread-safe manner.
+     * @param selected Ids of the selected parts.
+     * @param hovered Id of the part under the cursor, or 0 for none.
+     */
+    void setHighlight(const QSet<quintptr>& selected, quintptr hovered);
+
+signals:
+    /**
+     * @brief Emitted after every frame with the rendered image.
+     * @param frame The rendered frame.
+     */
+    void frameReady(const QImage& frame);
+
+    /**
+     * @brief Emitted when the ID buffer has been drawn for the most recent frame.
+     */
+    void idBufferReady();
+
+protected:
+    /**
+     * @brief Re-implementation of the QThread::run() function.
+     *
+     * Creates the offscreen renderer and render window, then renders one frame each
+     * time new work arrives until END_RENDER is issued.
+     */
+    void run() override;
+
+private:
+    /**
+     * @brief Brings the renderer's actors in line with a scene snapshot.
+     *
+     * Actors are kept between snapshots by part id, so an unchanged part keeps its
+     * mapper and the buffers already uploaded for it.
+     *
+     * @param scene The scene to show.
+     */
+    void applyScene(const SceneSnapshot& scene);
+
+    /**
+     * @brief Shows the staged parts that fit in this frame's upload budget.
+     */
+    void admitUploads();
+
+    /**
+     * @brief Copies a part's render state onto its actor.
+     * @param actor The actor showing the part.
+     * @param part The part's state.
+     * @param withGeometry Also set the geometry and the overlay that depends on it.
+     */
+    void applyPart(vtkActor* actor, const PartSnapshot& part, bool withGeometry);
+
+    /**
+     * @brief Shows the clusters of each cluster-drawn part that suit the current camera.
+     * @param viewHeight Frame height in pixels.
+     * @param pixelError Largest simplification error allowed on screen, in pixels.
+     */
+    void selectClusters(int viewHeight, double pixelError);
+
+    /**
+     * @brief Streams in the chunks of each out-of-core part that are in view and needed at its distance.
+     * @param viewWidth Frame width in pixels.
+     * @param viewHeight Frame height in pixels.
+     * @param pixelError Largest simplification error allowed on screen, in pixels.
+     * @param budget Memory each part may use, in bytes.
+     */
+    void streamChunks(int viewWidth, int viewHeight, double pixelError, qint64 budget);
+
+    /**
+     * @brief Applies the accumulated camera commands.
+     * @param camera The camera to move.
+     */
+    void applyCameraCommands(vtkCamera* camera);
+
+    /**
+     * @brief Reads the rendered frame back from the render window.
+     * @return The frame as an image, top row first.
+     */
+    QImage grabFrame();
+
+    /**
+     * @brief Draws the ID buffer of the current frame and makes it the one partAt() reads.
+     * @param w Frame width in pixels.
+     * @param h Frame height in pixels.
+     */
+    void renderIdBuffer(int w, int h);
+
+    /**
+     * @brief Draws the outlines of the highlighted parts over a frame, using the current ID buffer.
+     *
+     * Nothing is drawn while the ID buffer is out of date.
+     * @param frame The frame as rendered.
+     * @param selected Ids of the selected parts.
+     * @param hovered Id of the part under the cursor, or 0.
+     * @return The frame with outlines.
+     */
+    QImage outlineFrame(const QImage& frame, const QSet<quintptr>& selected, quintptr hovered) const;
+
+    /**
+     * @brief Width of the highlight outlines, in pixels.
+     */
+    static const int OutlineWidth = 2;
+
+    /**
+     * @brief Time the scene must stay unchanged before its ID buffer is drawn, in milliseconds.
+     */
+    static const int IdSettleTime = 150;
+
+    /* Render objects; only used on the render thread */
+    vtkSmartPointer<vtkRenderWindow>    window;     /**< The offscreen render window */
+    vtkSmartPointer<vtkRenderer>        renderer;   /**< The renderer */
+    QHash<quintptr, vtkSmartPointer<vtkActor>> actors; /**< Actors of the current scene by part id */
+    QHash<quintptr, PartSnapshot>       staged;     /**< Parts waiting for their geometry upload */
+    QHash<vtkPolyData*, vtkSmartPointer<vtkPolyDataMapper>> mappers; /**< Mapper of each uploaded geometry, shared by its instances without an overlay */
+    GpuUploadQueue                      uploads;    /**< Upload order and budget of the staged parts */
+    double                              sceneBounds[6]; /**< Bounds of every part in the scene, uploaded or not */
+    vtkSmartPointer<vtkHardwareSelector> selector;  /**< Draws the actor-id pass the ID buffer is read from */
+    QVector<quintptr>                   idScratch;  /**< ID buffer being filled, swapped with idBuffer when done */
+
+    /**
+     * @brief A part drawn by clusters.
+     */
+    struct LodPart {
+        std::shared_ptr<const ClusterLod> lod;          /**< The part's hierarchy */
+        vtkSmartPointer<vtkProperty> property;          /**< Shared by all cluster actors of the part */
+        vtkSmartPointer<vtkMatrix4x4> transform;        /**< Shared by all cluster actors of the part */
+        QHash<int, vtkSmartPointer<vtkActor>> nodes;    /**< Actors of the clusters drawn so far, by node index */
+    };
+    QHash<quintptr, LodPart>            lodParts;   /**< Parts drawn by clusters, by part id */
+
+    /**
+     * @brief An out-of-core part.
+     */
+    struct StreamedPart {
+        std::shared_ptr<OctreeChunkCache> chunks;       /**< The part's streamed chunks */
+        vtkSmartPointer<vtkMatrix4x4> transform;        /**< Shared by all chunk actors of the part */
+    };
+    QHash<quintptr, StreamedPart>       streamedParts; /**< Out-of-core parts, by part id */
+
+    /* Use to synchronise passing of data to the render thread */
+    QMutex                              mutex;      /**< Mutex for thread synchronization */
+    QWaitCondition                      condition;  /**< Wakes the render thread when work arrives */
+
+    SceneSnapshot                       pendingScene;   /**< Scene waiting to be applied */
+    bool                                sceneChanged;   /**< True if pendingScene has not been applied */
+    bool                                dirty;          /**< True if a new frame is needed */
+
+    /**
+     * @brief Flag to indicate if the rendering loop should end.
+     */
+    bool                                endRender;
+
+    /* Camera movement accumulated since the last frame */
+    double azimuth;     /**< Degrees to orbit about the view-up axis */
+    double elevation;   /**< Degrees to orbit about the horizontal axis */
+    double dolly;       /**< Dolly factor */
+    double panX;        /**< Pixels to pan sideways */
+    double panY;        /**< Pixels to pan up or down */
+    bool resetCamera;   /**< Fit the camera to the scene */
+
+    int width;          /**< Frame width in pixels */
+    int height;         /**< Frame height in pixels */
+    qint64 uploadBudget; /**< Bytes of geometry uploaded per frame */
+    double lodPixelError; /**< Largest cluster error allowed on screen, in pixels */
+    qint64 streamBudget; /**< Bytes of streamed chunks per out-of-core part */
+
+    vtkSmartPointer<vtkCamera> lastCamera; /**< Camera of the last frame, guarded by the mutex */
+    QVector<quintptr> idBuffer; /**< Part id at each pixel of the last frame, top row first, guarded by the mutex */
+    int idWidth;        /**< Width of idBuffer in pixels */
+    int idHeight;       /**< Height of idBuffer in pixels */
+    bool idStale;       /**< True if idBuffer is older than the last frame, guarded by the mutex */
+    bool idRequested;   /**< True if partAt() asked for the ID buffer of the last frame */
+    QSet<quintptr> highlightSelected; /**< Parts outlined as selected, guarded by the mutex */
+    quintptr highlightHovered; /**< Part outlined as hovered, or 0, guarded by the mutex */
+    bool highlightChanged; /**< True if the highlight changed since the last frame */
+};
+
+#endif // DESKTOP_RENDER_THREAD_H
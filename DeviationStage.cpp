@@ -0,0 +1,277 @@
+/**
+ * @file DeviationStage.cpp
+ * @brief Implementation of the DeviationStage class.
+ *
+ * Like the analysis stage, workers only read a shallow copy of the part and hand
+ * back a plain array through the GeometryCache.
+ */
+
+#include "DeviationStage.h"
+#include "GeometryCache.h"
+#include "DecompressingDevice.h"
+#include "StlTriangleReader.h"
+
+#include <QFile>
+#include <QMetaObject>
+#include <QThreadPool>
+#include <QVector>
+#include <QtConcurrent/QtConcurrent>
+
+#include <vtkFloatArray.h>
+#include <vtkGenericCell.h>
+#include <vtkIdList.h>
+#include <vtkNew.h>
+#include <vtkStaticCellLocator.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+
+namespace {
+
+/**
+ * @brief Points per parallel block of closest-point queries.
+ */
+const vtkIdType BlockSize = 4096;
+
+/**
+ * @brief Reads a whole STL file, compressed or not, into a mesh.
+ */
+vtkSmartPointer<vtkPolyData> readMesh(const QString& path) {
+    std::unique_ptr<QIODevice> device;
+    if (DecompressingDevice::formatOf(path) != DecompressingDevice::None)
+        device.reset(new DecompressingDevice(path));
+    else
+        device.reset(new QFile(path));
+    if (!device->open(QIODevice::ReadOnly))
+        return nullptr;
+    return StlTriangleReader::readPolyData(device.get());
+}
+
+/**
+ * @brief Computes the signed distance of every vertex to a reference surface.
+ *
+ * VTK's BSP tree has no closest-point query, so the reference is indexed with a
+ * static cell locator, whose queries are thread-safe once it is built. The vertices
+ * are then split into blocks that run on the global pool. The sign comes from the
+ * winding of the closest reference triangle: positive outside, negative inside.
+ * @param mesh The part geometry.
+ * @param reference The same part in the other revision.
+ * @param maximum Receives the largest absolute deviation.
+ * @return A float array named after DeviationStage::arrayName().
+ */
+vtkSmartPointer<vtkDataArray> computeDeviation(vtkPolyData* mesh, vtkPolyData* reference, double& maximum) {
+    const vtkIdType count = mesh->GetNumberOfPoints();
+    vtkSmartPointer<vtkFloatArray> result = vtkSmartPointer<vtkFloatArray>::New();
+    result->SetName(DeviationStage::arrayName().toUtf8().constData());
+    result->SetNumberOfTuples(count);
+    maximum = 0.0;
+    if (reference->GetNumberOfCells() == 0) {
+        result->Fill(std::numeric_limits<float>::quiet_NaN());
+        return result;
+    }
+
+    vtkNew<vtkStaticCellLocator> locator;
+    locator->SetDataSet(reference);
+    locator->BuildLocator();
+
+    QVector<vtkIdType> blocks;
+    for (vtkIdType first = 0; first < count; first += BlockSize)
+        blocks.append(first);
+
+    QVector<double> blockMaximum(blocks.size(), 0.0);
+    QtConcurrent::blockingMap(blocks, [&](const vtkIdType& first) {
+        vtkNew<vtkGenericCell> cell;
+        vtkNew<vtkIdList> ids;
+        double largest = 0.0;
+        for (vtkIdType i = first; i < std::min(first + BlockSize, count); ++i) {
+            double p[3], closest[3], distance2;
+            vtkIdType cellId;
+            int subId;
+            mesh->GetPoint(i, p);
+            locator->FindClosestPoint(p, closest, cell, cellId, subId, distance2);
+
+            // Triangle normal from its winding, so no normals are needed on the reference
+            vtkIdType npts;
+            const vtkIdType* pts;
+            reference->GetCellPoints(cellId, npts, pts, ids);
+            double sign = 1.0;
+            if (npts >= 3) {
+                double a[3], b[3], c[3];
+                reference->GetPoint(pts[0], a);
+                reference->GetPoint(pts[1], b);
+                reference->GetPoint(pts[2], c);
+                const double u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+                const double v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+                const double n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+                if ((p[0] - closest[0]) * n[0] + (p[1] - closest[1]) * n[1] + (p[2] - closest[2]) * n[2] < 0.0)
+                    sign = -1.0;
+            }
+
+            const double distance = std::sqrt(distance2);
+            largest = std::max(largest, distance);
+            result->SetValue(i, static_cast<float>(sign * distance));
+        }
+        blockMaximum[static_cast<int>(first / BlockSize)] = largest;
+    });
+
+    for (double largest : blockMaximum)
+        maximum = std::max(maximum, largest);
+    return result;
+}
+
+/**
+ * @brief Returns the largest distance from a vertex of a mesh to a reference surface.
+ * The queries run in parallel blocks, as in computeDeviation(), but no array is kept.
+ * @param mesh The mesh whose vertices are measured.
+ * @param reference The surface measured to.
+ * @return The distance, or infinity if the reference has no cells.
+ */
+double largestDistance(vtkPolyData* mesh, vtkPolyData* reference) {
+    if (reference->GetNumberOfCells() == 0)
+        return std::numeric_limits<double>::infinity();
+
+    vtkNew<vtkStaticCellLocator> locator;
+    locator->SetDataSet(reference);
+    locator->BuildLocator();
+
+    const vtkIdType count = mesh->GetNumberOfPoints();
+    QVector<vtkIdType> blocks;
+    for (vtkIdType first = 0; first < count; first += BlockSize)
+        blocks.append(first);
+
+    QVector<double> blockMaximum(blocks.size(), 0.0);
+    QtConcurrent::blockingMap(blocks, [&](const vtkIdType& first) {
+        vtkNew<vtkGenericCell> cell;
+        double largest = 0.0;
+        for (vtkIdType i = first; i < std::min(first + BlockSize, count); ++i) {
+            double p[3], closest[3], distance2;
+            vtkIdType cellId;
+            int subId;
+            mesh->GetPoint(i, p);
+            locator->FindClosestPoint(p, closest, cell, cellId, subId, distance2);
+            largest = std::max(largest, distance2);
+        }
+        blockMaximum[static_cast<int>(first / BlockSize)] = std::sqrt(largest);
+    });
+
+    double maximum = 0.0;
+    for (double largest : blockMaximum)
+        maximum = std::max(maximum, largest);
+    return maximum;
+}
+
+} // namespace
+
+/**
+ * @brief Constructs the stage.
+ * @param cache The cache that receives results.
+ * @param parent The parent QObject.
+ */
+DeviationStage::DeviationStage(GeometryCache* cache, QObject* parent)
+    : QObject(parent), m_cache(cache) {
+}
+
+/**
+ * @brief Returns the name of the point array the stage produces.
+ * @return The array name.
+ */
+QString DeviationStage::arrayName() {
+    return QStringLiteral("Deviation");
+}
+
+/**
+ * @brief Returns the cache entry name for deviations from a reference.
+ * @param referenceHash Content hash of the reference file.
+ * @return The name used with GeometryCache.
+ */
+QString DeviationStage::cacheName(const QByteArray& referenceHash) {
+    return arrayName() + '/' + QString::fromLatin1(referenceHash);
+}
+
+/**
+ * @brief Returns the symmetric Hausdorff distance between two meshes, over their vertices.
+ *
+ * Measuring both ways matters: material added to one mesh leaves the other's
+ * vertices on its surface, so only the distances from the larger mesh show it.
+ * @param a One mesh.
+ * @param b The other mesh.
+ * @return The largest distance from a vertex of either mesh to the other's surface.
+ */
+double DeviationStage::hausdorffDistance(vtkPolyData* a, vtkPolyData* b) {
+    return std::max(largestDistance(a, b), largestDistance(b, a));
+}
+
+/**
+ * @brief Queues the comparison of a part with its reference file on the global thread pool.
+ * @param hash Content hash of the part's source file.
+ * @param polyData The part geometry.
+ * @param referenceFile The same part in the other revision.
+ */
+void DeviationStage::submit(const QByteArray& hash, vtkSmartPointer<vtkPolyData> polyData, const QString& referenceFile) {
+    const QString key = QString::fromLatin1(hash) + '\t' + referenceFile;
+    if (hash.isEmpty() || !polyData || m_running.contains(key))
+        return;
+
+    // Workers read a private shallow copy, so attaching arrays to the part later is safe
+    vtkSmartPointer<vtkPolyData> input = vtkSmartPointer<vtkPolyData>::New();
+    input->ShallowCopy(polyData);
+
+    m_running.insert(key);
+    GeometryCache* cache = m_cache;
+    QtConcurrent::run(QThreadPool::globalInstance(), [this, cache, hash, input, referenceFile, key]() {
+        const QByteArray referenceHash = run(cache, hash, input, referenceFile);
+        QMetaObject::invokeMethod(this, [this, hash, referenceFile, referenceHash, key]() {
+            m_running.remove(key);
+            emit deviationFinished(hash, referenceFile, referenceHash);
+        }, Qt::QueuedConnection);
+    });
+}
+
+/**
+ * @brief Worker body: reads the reference and stores the deviations in the cache.
+ *
+ * The reference is hashed first, so a pair compared before, in this session or under
+ * another path, costs one file read. Identical files are not read at all.
+ *
+ * The vertex values measure the part against the reference, but the cached range
+ * is the Hausdorff distance, the larger of both directions, so a part that only lost
+ * material is not reported as unchanged.
+ * @param cache The cache to store results in.
+ * @param hash Content hash of the geometry.
+ * @param polyData The geometry to compare.
+ * @param referenceFile The reference file.
+ * @return Content hash of the reference, or empty if it could not be read.
+ */
+QByteArray DeviationStage::run(GeometryCache* cache, const QByteArray& hash, vtkSmartPointer<vtkPolyData> polyData,
+                               const QString& referenceFile) {
+    const QByteArray referenceHash = GeometryCache::contentHash(referenceFile);
+    if (referenceHash.isEmpty() || cache->contains(hash, cacheName(referenceHash)))
+        return referenceHash;
+
+    GeometryCache::PointArray entry;
+    double maximum = 0.0;
+    if (referenceHash == hash) {
+        vtkSmartPointer<vtkFloatArray> zero = vtkSmartPointer<vtkFloatArray>::New();
+        zero->SetName(arrayName().toUtf8().constData());
+        zero->SetNumberOfTuples(polyData->GetNumberOfPoints());
+        zero->Fill(0.0);
+        entry.values = zero;
+    }
+    else {
+        vtkSmartPointer<vtkPolyData> reference = readMesh(referenceFile);
+        if (!reference)
+            return QByteArray();
+        entry.values = computeDeviation(polyData, reference, maximum);
+
+        // Material the part lost leaves its vertices on the reference surface, so
+        // only the reference's vertices show it
+        if (reference->GetNumberOfCells() > 0)
+            maximum = std::max(maximum, largestDistance(reference, polyData));
+    }
+    entry.range[0] = -maximum;
+    entry.range[1] = maximum;
+    cache->storePointArray(hash, cacheName(referenceHash), entry);
+    return referenceHash;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file DeviationStage.h
+ * @brief Declaration of the DeviationStage class.
+ *
+ * When a new revision of a repository arrives, most changed files differ only in
+ * bytes (re-exports, reordered triangles). The deviation stage measures how far
+ * each vertex of a part lies from the same part in another revision, so the parts
+ * whose geometry actually changed stand out.
+ */
+#ifndef DEVIATION_STAGE_H
+#define DEVIATION_STAGE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QSet>
+#include <QString>
+
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+
+class GeometryCache;
+
+/**
+ * @brief Computes per-vertex deviation from a reference revision in the background.
+ *
+ * Each submitted part is compared by one pool task, which builds a cell locator over
+ * the reference mesh and answers the closest-point queries of the part's vertices in
+ * parallel blocks. Results are stored in the GeometryCache under cacheName() of the
+ * reference, so each pair of content hashes is compared once.
+ */
+class DeviationStage : public QObject {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructs the stage.
+     * @param cache The cache that receives results; must outlive the stage.
+     * @param parent The parent QObject.
+     */
+    explicit DeviationStage(GeometryCache* cache, QObject* parent = nullptr);
+
+    /**
+     * @brief Returns the name of the point array the stage produces.
+     * @return The array name.
+     */
+    static QString arrayName();
+
+    /**
+     * @brief Returns the cache entry name for deviations from a reference.
+     * @param referenceHash Content hash of the reference file.
+     * @return The name used with GeometryCache.
+     */
+    static QString cacheName(const QByteArray& referenceHash);
+
+    /**
+     * @brief Returns the symmetric Hausdorff distance between two meshes, over their vertices.
+     * Runs on the calling thread and the global pool; both meshes are only read.
+     * @param a One mesh.
+     * @param b The other mesh.
+     * @return The largest distance from a vertex of either mesh to the other's surface.
+     */
+    static double hausdorffDistance(vtkPolyData* a, vtkPolyData* b);
+
+    /**
+     * @brief Queues the comparison of a part with its reference file.
+     *
+     * The comparison is skipped if it is already cached or running. Values are signed
+     * distances to the reference surface, positive outside it; the cached range is
+     * symmetric about zero and bounded by the Hausdorff distance between the meshes,
+     * measured both ways.
+     * @param hash Content hash of the part's source file.
+     * @param polyData The part geometry; it is only read by the worker.
+     * @param referenceFile The same part in the other revision, plain or compressed.
+     */
+    void submit(const QByteArray& hash, vtkSmartPointer<vtkPolyData> polyData, const QString& referenceFile);
+
+signals:
+    /**
+     * @brief Emitted on the GUI thread when a comparison has been cached.
+     * @param hash Content hash of the compared geometry.
+     * @param referenceFile The reference file it was compared with.
+     * @param referenceHash Content hash of the reference, or empty if it could not be read.
+     */
+    void deviationFinished(const QByteArray& hash, const QString& referenceFile, const QByteArray& referenceHash);
+
+private:
+    /**
+     * @brief Worker body: reads the reference and stores the deviations in the cache.
+     * @param cache The cache to store results in.
+     * @param hash Content hash of the geometry.
+     * @param polyData The geometry to compare.
+     * @param referenceFile The reference file.
+     * @return Content hash of the reference, or empty if it could not be read.
+     */
+    static QByteArray run(GeometryCache* cache, const QByteArray& hash, vtkSmartPointer<vtkPolyData> polyData,
+                          const QString& referenceFile);
+
+    GeometryCache* m_cache;         /**< Destination for results */
+    QSet<QString> m_running;        /**< Hash and reference file of each task in flight (GUI thread only) */
+};
+
+#endif // DEVIATION_STAGE_H
@@ -0,0 +1,84 @@
+/**
+ * @file GeometryCache.cpp
+ * @brief Implementation of the GeometryCache class.
+ */
+
+#include "GeometryCache.h"
+
+#include <QCryptographicHash>
+#include <QFile>
+#include <QMutexLocker>
+
+/**
+ * @brief Computes the SHA-1 of a file's contents.
+ * @param fileName Path of the file to hash.
+ * @return The hash, or an empty array if the file cannot be opened.
+ */
+QByteArray GeometryCache::contentHash(const QString& fileName) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    if (!hash.addData(&file))
+        return QByteArray();
+    return hash.result().toHex();
+}
+
+/**
+ * @brief Computes the content hash of file contents in memory.
+ * @param contents The file contents.
+ * @return The hex SHA-1 of the contents.
+ */
+QByteArray GeometryCache::contentHash(const QByteArray& contents) {
+    return QCryptographicHash::hash(contents, QCryptographicHash::Sha1).toHex();
+}
+
+/**
+ * @brief Looks up a per-vertex array.
+ * @param hash Content hash of the part's source file.
+ * @param name Name of the array.
+ * @param out Receives the array if found.
+ * @return True if the array is cached.
+ */
+bool GeometryCache::pointArray(const QByteArray& hash, const QString& name, PointArray* out) const {
+    QMutexLocker lock(&mutex);
+    auto entry = entries.constFind(hash);
+    if (entry == entries.constEnd())
+        return false;
+    auto array = entry->constFind(name);
+    if (array == entry->constEnd())
+        return false;
+    if (out)
+        *out = *array;
+    return true;
+}
+
+/**
+ * @brief Checks whether a per-vertex array is cached.
+ * @param hash Content hash of the part's source file.
+ * @param name Name of the array.
+ * @return True if the array is cached.
+ */
+bool GeometryCache::contains(const QByteArray& hash, const QString& name) const {
+    return pointArray(hash, name, nullptr);
+}
+
+/**
+ * @brief Stores a per-vertex array.
+ * @param hash Content hash of the part's source file.
+ * @param name Name of the array.
+ * @param array The array and its display range.
+ */
+void GeometryCache::storePointArray(const QByteArray& hash, const QString& name, const PointArray& array) {
+    QMutexLocker lock(&mutex);
+    entries[hash].insert(name, array);
+}
+
+/**
+ * @brief Removes every entry from the cache.
+ */
+void GeometryCache::clear() {
+    QMutexLocker lock(&mutex);
+    entries.clear();
+}
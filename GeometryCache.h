@@ -0,0 +1,85 @@
+/**
+ * @file GeometryCache.h
+ * @brief Declaration of the GeometryCache class.
+ *
+ * The geometry cache holds data derived from a part's geometry (for example the
+ * per-vertex analysis arrays) keyed by the content hash of the source file, so
+ * identical files share results and nothing is computed twice.
+ */
+#ifndef GEOMETRY_CACHE_H
+#define GEOMETRY_CACHE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+#include <vtkSmartPointer.h>
+#include <vtkDataArray.h>
+
+/**
+ * @brief Thread-safe cache of derived per-vertex data, keyed by file content hash.
+ *
+ * Worker threads store results; the GUI thread reads them. Arrays are immutable
+ * once stored, so they can be attached to several parts' polydata at once.
+ */
+class GeometryCache {
+public:
+    /**
+     * @brief A cached per-vertex array and the value range to use when colour mapping it.
+     */
+    struct PointArray {
+        vtkSmartPointer<vtkDataArray> values;   /**< One value per point, named after the analysis */
+        double range[2] = { 0.0, 0.0 };         /**< Robust (outlier-clipped) display range */
+    };
+
+    /**
+     * @brief Computes the content hash used as the cache key for a file.
+     * @param fileName Path of the file to hash.
+     * @return The SHA-1 of the file contents, or an empty array if it cannot be read.
+     */
+    static QByteArray contentHash(const QString& fileName);
+
+    /**
+     * @brief Computes the content hash of file contents already in memory.
+     * @param contents The whole file.
+     * @return The same hash contentHash(const QString&) gives for the file.
+     */
+    static QByteArray contentHash(const QByteArray& contents);
+
+    /**
+     * @brief Looks up a per-vertex array.
+     * @param hash Content hash of the part's source file.
+     * @param name Name of the array.
+     * @param out Receives the array if found.
+     * @return True if the array is cached.
+     */
+    bool pointArray(const QByteArray& hash, const QString& name, PointArray* out) const;
+
+    /**
+     * @brief Checks whether a per-vertex array is cached.
+     * @param hash Content hash of the part's source file.
+     * @param name Name of the array.
+     * @return True if the array is cached.
+     */
+    bool contains(const QByteArray& hash, const QString& name) const;
+
+    /**
+     * @brief Stores a per-vertex array, replacing any previous entry of the same name.
+     * @param hash Content hash of the part's source file.
+     * @param name Name of the array.
+     * @param array The array and its display range.
+     */
+    void storePointArray(const QByteArray& hash, const QString& name, const PointArray& array);
+
+    /**
+     * @brief Removes every entry from the cache.
+     */
+    void clear();
+
+private:
+    mutable QMutex mutex;                                   /**< Guards entries */
+    QHash<QByteArray, QHash<QString, PointArray>> entries;  /**< Arrays per content hash */
+};
+
+#endif // GEOMETRY_CACHE_H
@@ -0,0 +1,122 @@
+/**
+ * @file GpuUploadQueue.cpp
+ * @brief Implementation of the GpuUploadQueue class.
+ */
+
+#include "GpuUploadQueue.h"
+
+#include <vtkPointData.h>
+
+/**
+ * @brief Constructs an empty queue.
+ * @param budget Bytes that may be admitted per frame.
+ */
+GpuUploadQueue::GpuUploadQueue(qint64 budget)
+    : nextSequence(0), budgetBytes(budget) {
+}
+
+/**
+ * @brief Sets the per-frame budget.
+ * @param budget The budget in bytes.
+ */
+void GpuUploadQueue::setBudget(qint64 budget) {
+    budgetBytes = budget;
+}
+
+/** @brief Gets the per-frame budget in bytes. */
+qint64 GpuUploadQueue::budget() const { return budgetBytes; }
+
+/**
+ * @brief Queues an upload, or updates its size if already queued.
+ * @param id Identifies the upload.
+ * @param bytes Estimated size of the upload.
+ */
+void GpuUploadQueue::enqueue(quintptr id, qint64 bytes) {
+    auto it = entries.find(id);
+    if (it != entries.end()) {
+        it->bytes = bytes;
+        return;
+    }
+    entries.insert(id, { bytes, nextSequence });
+    order.append({ id, nextSequence });
+    ++nextSequence;
+}
+
+/**
+ * @brief Drops a queued upload.
+ *
+ * Its place in the order list is left behind and skipped when reached. Once most
+ * places are stale the list is compacted, so it never grows beyond twice the queue.
+ * @param id Identifies the upload.
+ */
+void GpuUploadQueue::remove(quintptr id) {
+    if (!entries.remove(id))
+        return;
+    if (order.size() > 2 * entries.size() + 64) {
+        QList<Slot> live;
+        live.reserve(entries.size());
+        for (const Slot& slot : order) {
+            auto it = entries.constFind(slot.id);
+            if (it != entries.constEnd() && it->sequence == slot.sequence)
+                live.append(slot);
+        }
+        order.swap(live);
+    }
+}
+
+/**
+ * @brief Checks whether an upload is queued.
+ * @param id Identifies the upload.
+ * @return True if queued.
+ */
+bool GpuUploadQueue::contains(quintptr id) const {
+    return entries.contains(id);
+}
+
+/** @brief Checks whether the queue is empty. */
+bool GpuUploadQueue::isEmpty() const { return entries.isEmpty(); }
+
+/**
+ * @brief Takes this frame's uploads from the front of the queue.
+ * @return Ids of the uploads to perform this frame.
+ */
+QVector<quintptr> GpuUploadQueue::admit() {
+    QVector<quintptr> admitted;
+    qint64 used = 0;
+    while (!order.isEmpty()) {
+        const Slot next = order.first();
+        // A removed upload, or one removed and queued again further back
+        auto it = entries.find(next.id);
+        if (it == entries.end() || it->sequence != next.sequence) {
+            order.removeFirst();
+            continue;
+        }
+        if (!admitted.isEmpty() && used + it->bytes > budgetBytes)
+            break;
+        used += it->bytes;
+        admitted.append(next.id);
+        entries.erase(it);
+        order.removeFirst();
+    }
+    return admitted;
+}
+
+/**
+ * @brief Estimates the GPU memory VTK's OpenGL mapper uses for a dataset.
+ * @param polyData The geometry.
+ * @param colours True if per-vertex colours will be uploaded.
+ * @return The estimate in bytes.
+ */
+qint64 GpuUploadQueue::estimateBytes(vtkPolyData* polyData, bool colours) {
+    if (!polyData)
+        return 0;
+
+    const qint64 points = polyData->GetNumberOfPoints();
+    qint64 bytes = points * 3 * sizeof(quint16);
+    if (polyData->GetPointData()->GetNormals())
+        bytes += points * 2 * sizeof(qint16);
+    if (colours)
+        bytes += points * 4;
+    bytes += static_cast<qint64>(polyData->GetNumberOfPolys()) * 3 * sizeof(quint32);
+    return bytes;
+}
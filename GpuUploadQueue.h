@@ -0,0 +1,119 @@
+/**
+ * @file GpuUploadQueue.h
+ * @brief Declaration of the GpuUploadQueue class.
+ *
+ * VTK uploads a mapper's vertex and index buffers the first time it draws the
+ * actor, so adding many freshly loaded parts to a renderer at once makes the next
+ * frame upload all of them. The upload queue lets a render thread admit parts a few
+ * at a time instead, under a per-frame byte budget, so each frame only uploads
+ * what fits and the parts appear as their buffers arrive.
+ */
+#ifndef GPU_UPLOAD_QUEUE_H
+#define GPU_UPLOAD_QUEUE_H
+
+#include <QtGlobal>
+#include <QHash>
+#include <QList>
+#include <QVector>
+
+#include <vtkPolyData.h>
+
+/**
+ * @brief First-in first-out queue of pending GPU uploads with a per-frame byte budget.
+ *
+ * Entries are identified by an id chosen by the render thread (a part or actor
+ * address). Queued entries are looked up by id in a hash, so enqueue(), remove()
+ * and contains() take constant time however many parts are waiting. The queue is
+ * not thread-safe; it belongs to one render thread.
+ */
+class GpuUploadQueue {
+public:
+    /**
+     * @brief Constructs an empty queue.
+     * @param budgetBytes Bytes that may be admitted per frame.
+     */
+    explicit GpuUploadQueue(qint64 budgetBytes = 32 * 1024 * 1024);
+
+    /**
+     * @brief Sets the number of bytes that may be admitted per frame.
+     * @param budgetBytes The budget; at least one entry is admitted per frame regardless.
+     */
+    void setBudget(qint64 budgetBytes);
+
+    /**
+     * @brief Returns the per-frame budget.
+     * @return The budget in bytes.
+     */
+    qint64 budget() const;
+
+    /**
+     * @brief Queues an upload, or updates its size if the id is already queued.
+     * @param id Identifies the upload.
+     * @param bytes Estimated size of the upload.
+     */
+    void enqueue(quintptr id, qint64 bytes);
+
+    /**
+     * @brief Drops a queued upload, e.g. because the part was hidden before it was admitted.
+     * @param id Identifies the upload.
+     */
+    void remove(quintptr id);
+
+    /**
+     * @brief Returns whether an upload is queued.
+     * @param id Identifies the upload.
+     * @return True if it is queued.
+     */
+    bool contains(quintptr id) const;
+
+    /**
+     * @brief Returns whether no uploads are queued.
+     * @return True if the queue is empty.
+     */
+    bool isEmpty() const;
+
+    /**
+     * @brief Takes the uploads for this frame from the front of the queue.
+     *
+     * Uploads are taken in order until the next one would exceed the budget. The
+     * first is always taken, so a part larger than the budget is not stuck forever.
+     * @return Ids of the uploads to perform this frame.
+     */
+    QVector<quintptr> admit();
+
+    /**
+     * @brief Estimates the GPU memory VTK's OpenGL mapper uses for a dataset.
+     *
+     * Counts 16-bit quantised positions and octahedral normals (see
+     * QuantisedPolyDataMapper), RGBA colours when scalars are shown, and 32-bit
+     * triangle indices.
+     * @param polyData The geometry.
+     * @param colours True if per-vertex colours will be uploaded.
+     * @return The estimate in bytes.
+     */
+    static qint64 estimateBytes(vtkPolyData* polyData, bool colours);
+
+private:
+    /**
+     * @brief A queued upload.
+     */
+    struct Entry {
+        qint64 bytes;       /**< Estimated size */
+        quint64 sequence;   /**< Position in the queue, matching one entry of order */
+    };
+
+    /**
+     * @brief A place in the queue.
+     */
+    struct Slot {
+        quintptr id;        /**< Identifies the upload */
+        quint64 sequence;   /**< Matches Entry::sequence while the upload is still queued there */
+    };
+
+    QHash<quintptr, Entry> entries; /**< Pending uploads by id */
+    QList<Slot> order;      /**< Pending uploads, oldest first; removed ones are skipped by admit() */
+    quint64 nextSequence;   /**< Sequence number of the next enqueued upload */
+    qint64 budgetBytes;     /**< Bytes admitted per frame */
+};
+
+#endif // GPU_UPLOAD_QUEUE_H
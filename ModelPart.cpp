@@ -15,6 +15,27 @@
 #include <vtkProperty.h>
 #include <vtkPolyData.h>
 #include <vtkDataSetMapper.h>
+#include <vtkPointData.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include "GeometryCache.h"
+#include "QuantisedPolyDataMapper.h"
+#include "OctreeFile.h"
+#include "DecompressingDevice.h"
+#include "StlTriangleReader.h"
+#include "SharedGeometryStore.h"
+#include "TeamCache.h"
+#include "PackedMesh.h"
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+
+#include <algorithm>
+
+SharedGeometryStore* ModelPart::sharedGeometry = nullptr;
+TeamCache* ModelPart::teamCache = nullptr;
 
  /**
   * @brief Constructs a ModelPart object.
@@ -22,7 +43,12 @@
   * @param parent The parent ModelPart in the hierarchy.
   */
 ModelPart::ModelPart(const QList<QVariant>& data, ModelPart* parent)
-    : m_itemData(data), m_parentItem(parent) {
+    : m_itemData(data), m_parentItem(parent), isVisible(true),
+      renderGeometry(std::make_shared<RenderGeometry>()), vrGeometry(std::make_shared<RenderGeometry>()),
+      m_triangleCount(0), m_boundingVolume(0.0), m_fileSize(0), m_loadTime(0.0),
+      m_worldDirty(true), m_worldBoundsDirty(true),
+      colourR(255), colourG(255), colourB(255), m_opacity(1.0) {
+    vtkMatrix4x4::Identity(m_localTransform);
 }
 
 /**
@@ -40,6 +66,28 @@ ModelPart::~ModelPart() {
 void ModelPart::appendChild(ModelPart* item) {
     item->m_parentItem = this;  // Set this as the parent
     m_childItems.append(item);  // Add child to list
+    item->invalidateWorldTransform();
+}
+
+/**
+ * @brief Inserts a child item at the specified row.
+ * @param row The row the child will have.
+ * @param item The child ModelPart to insert.
+ */
+void ModelPart::insertChild(int row, ModelPart* item) {
+    item->m_parentItem = this;
+    m_childItems.insert(qBound(0, row, m_childItems.size()), item);
+    item->invalidateWorldTransform();
+}
+
+/**
+ * @brief Removes and deletes the child item at the specified row.
+ * @param row The row index of the child item.
+ */
+void ModelPart::removeChild(int row) {
+    if (row < 0 || row >= m_childItems.size())
+        return;
+    delete m_childItems.takeAt(row);
 }
 
 /**
@@ -121,9 +169,7 @@ void ModelPart::setColour(const unsigned char R, const unsigned char G, const un
     colourB = B;
 
     // Apply the color to the actor if it exists
-    if (stlActor) {
-        stlActor->GetProperty()->SetColor(R / 255.0, G / 255.0, B / 255.0);
-    }
+    setDisplayColour(R / 255.0, G / 255.0, B / 255.0);
 }
 
 /** @brief Gets the red component of the color. */
@@ -158,21 +204,593 @@ bool ModelPart::visible() const {
 
 /**
  * @brief Loads an STL file and creates the VTK actor.
+ *
+ * A mesh already in the shared geometry store or the team cache is used from there
+ * without parsing the file; a newly loaded mesh is published to both.
  * @param fileName The path to the STL file.
  */
 void ModelPart::loadSTL(QString fileName) {
-    stlReader = vtkSmartPointer<vtkSTLReader>::New();
-    stlReader->SetFileName(fileName.toStdString().c_str());
-    stlReader->Update();
+    const QByteArray hash = GeometryCache::contentHash(fileName);
+    QElapsedTimer timer;
+    timer.start();
+
+    stlReader = nullptr;
+    if (!loadCachedGeometry(hash)) {
+        polyData = vtkSmartPointer<vtkPolyData>::New();
+        if (DecompressingDevice::formatOf(fileName) != DecompressingDevice::None) {
+            // Compressed files are parsed as they are decompressed; there is no reader to keep
+            DecompressingDevice device(fileName);
+            vtkSmartPointer<vtkPolyData> mesh;
+            if (device.open(QIODevice::ReadOnly))
+                mesh = StlTriangleReader::readPolyData(&device);
+            if (mesh)
+                polyData->ShallowCopy(mesh);
+        }
+        else {
+            stlReader = vtkSmartPointer<vtkSTLReader>::New();
+            stlReader->SetFileName(fileName.toStdString().c_str());
+            stlReader->Update();
+
+            // Keep our own copy of the output so arrays can be attached without re-running the reader
+            polyData->ShallowCopy(stlReader->GetOutput());
+        }
+        publishGeometry(hash);
+    }
+
+    const double loadTime = timer.nsecsElapsed() / 1.0e6;
+    finishLoading(loadTime, QFileInfo(fileName).size(), hash);
+}
+
+/**
+ * @brief Loads an STL file whose contents have already been read into memory.
+ * @param contents The whole file, binary or ASCII.
+ */
+void ModelPart::loadSTLFromMemory(const QByteArray& contents) {
+    const QByteArray hash = GeometryCache::contentHash(contents);
+    QElapsedTimer timer;
+    timer.start();
+
+    stlReader = nullptr;
+    if (!loadCachedGeometry(hash)) {
+        polyData = vtkSmartPointer<vtkPolyData>::New();
+        QBuffer buffer;
+        buffer.setData(contents);
+        vtkSmartPointer<vtkPolyData> mesh;
+        if (buffer.open(QIODevice::ReadOnly))
+            mesh = StlTriangleReader::readPolyData(&buffer);
+        if (mesh)
+            polyData->ShallowCopy(mesh);
+        publishGeometry(hash);
+    }
+
+    const double loadTime = timer.nsecsElapsed() / 1.0e6;
+    finishLoading(loadTime, contents.size(), hash);
+}
+
+/**
+ * @brief Takes the geometry from the shared store or the team cache, if either has it.
+ *
+ * Geometry from the team cache is then published to the shared store, so other
+ * instances on this machine do not fetch it again.
+ * @param hash Content hash of the source file.
+ * @return True if polyData was set.
+ */
+bool ModelPart::loadCachedGeometry(const QByteArray& hash) {
+    polyData = sharedGeometry ? sharedGeometry->find(hash) : nullptr;
+    if (polyData)
+        return true;
+    if (!teamCache)
+        return false;
+
+    std::shared_ptr<const QByteArray> block = std::make_shared<const QByteArray>(teamCache->read(hash, "mesh"));
+    polyData = PackedMesh::view(reinterpret_cast<const uchar*>(block->constData()), block->size(), block);
+    if (!polyData)
+        return false;
+    if (sharedGeometry) {
+        vtkSmartPointer<vtkPolyData> shared = sharedGeometry->publish(hash, polyData);
+        if (shared)
+            polyData = shared;
+    }
+    return true;
+}
+
+/**
+ * @brief Publishes newly loaded geometry to the shared store and the team cache.
+ *
+ * With a shared store, polyData is replaced by the shared copy, so this instance
+ * does not keep a private copy as well. The team cache is written in the
+ * background, as it is usually on a network file system.
+ * @param hash Content hash of the source file.
+ */
+void ModelPart::publishGeometry(const QByteArray& hash) {
+    if (polyData->GetNumberOfPolys() == 0)
+        return;
+    if (sharedGeometry) {
+        vtkSmartPointer<vtkPolyData> shared = sharedGeometry->publish(hash, polyData);
+        if (shared) {
+            polyData = shared;
+            stlReader = nullptr;
+        }
+    }
+    if (teamCache && !hash.isEmpty()) {
+        const QByteArray block = PackedMesh::pack(polyData);
+        TeamCache* cache = teamCache;
+        if (!block.isEmpty())
+            QtConcurrent::run(QThreadPool::globalInstance(), [cache, hash, block]() { cache->publish(hash, "mesh", block); });
+    }
+}
+
+/**
+ * @brief Sets the store loaded geometry is shared through.
+ * @param store The store, or null to stop sharing.
+ */
+void ModelPart::setSharedGeometryStore(SharedGeometryStore* store) {
+    sharedGeometry = store;
+}
+
+/**
+ * @brief Sets the team cache welded geometry is read from and published to.
+ * @param cache The cache, or null for none.
+ */
+void ModelPart::setTeamCache(TeamCache* cache) {
+    teamCache = cache;
+}
+
+/**
+ * @brief Records the statistics of newly loaded geometry and creates the actor.
+ * @param loadTime Time taken to parse the file, in milliseconds.
+ * @param fileSize Size of the file in bytes.
+ * @param hash Content hash of the file.
+ */
+void ModelPart::finishLoading(double loadTime, qint64 fileSize, const QByteArray& hash) {
+    // Record statistics used by the "colour by" modes
+    m_loadTime = loadTime;
+    m_fileSize = fileSize;
+    m_triangleCount = polyData->GetNumberOfCells();
+    double bounds[6];
+    polyData->GetBounds(bounds);
+    m_boundingVolume = m_triangleCount > 0
+        ? (bounds[1] - bounds[0]) * (bounds[3] - bounds[2]) * (bounds[5] - bounds[4])
+        : 0.0;
+    m_contentHash = hash;
+    m_worldBoundsDirty = true;
 
     // Create mapper and actor
     stlMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
-    stlMapper->SetInputConnection(stlReader->GetOutputPort());
+    stlMapper->SetInputData(polyData);
+    stlMapper->ScalarVisibilityOff();
+
+    vtkSmartPointer<vtkActor> actor = vtkSmartPointer<vtkActor>::New();
+    actor->SetMapper(stlMapper);
+
+    this->stlActor = actor;
+    restoreColour();    // A colour may have been assigned before loading
+}
+
+/**
+ * @brief Makes the part another instance of a loaded part.
+ *
+ * Out-of-core prototypes have no geometry yet; their octree is attached to every
+ * instance when ready, as all share the streamed file.
+ * @param prototype A loaded part of the same file.
+ */
+void ModelPart::loadInstance(const ModelPart& prototype) {
+    setGeometry(*prototype.geometry());
+}
+
+/**
+ * @brief Returns the part's geometry and everything derived from it.
+ * @return The geometry.
+ */
+std::shared_ptr<const PartGeometry> ModelPart::geometry() const {
+    std::shared_ptr<PartGeometry> geometry = std::make_shared<PartGeometry>();
+    geometry->polyData = polyData;
+    geometry->render = renderGeometry;
+    geometry->vr = vrGeometry;
+    geometry->octree = m_octree;
+    geometry->clusterLod = m_clusterLod;
+    geometry->streamedFile = m_streamedFile;
+    geometry->contentHash = m_contentHash;
+    geometry->triangleCount = m_triangleCount;
+    geometry->boundingVolume = m_boundingVolume;
+    geometry->fileSize = m_fileSize;
+    return geometry;
+}
+
+/**
+ * @brief Shows a geometry taken with geometry().
+ *
+ * The part gets a new actor with an empty overlay state; its user colour, opacity
+ * and visibility are applied to it.
+ * @param geometry The geometry.
+ */
+void ModelPart::setGeometry(const PartGeometry& geometry) {
+    stlReader = nullptr;
+    polyData = geometry.polyData;
+    renderGeometry = geometry.render ? geometry.render : std::make_shared<RenderGeometry>();
+    vrGeometry = geometry.vr ? geometry.vr : std::make_shared<RenderGeometry>();
+    m_octree = geometry.octree;
+    m_streamedFile = geometry.streamedFile;
+    m_clusterLod = geometry.clusterLod;
+    m_contentHash = geometry.contentHash;
+    m_triangleCount = geometry.triangleCount;
+    m_boundingVolume = geometry.boundingVolume;
+    m_fileSize = geometry.fileSize;
+    m_loadTime = 0.0;
+    m_worldBoundsDirty = true;
+    occlusionLut = nullptr;
+
+    stlMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+    stlMapper->SetInputData(polyData ? polyData : vtkSmartPointer<vtkPolyData>::New());
+    stlMapper->ScalarVisibilityOff();
 
     vtkSmartPointer<vtkActor> actor = vtkSmartPointer<vtkActor>::New();
     actor->SetMapper(stlMapper);
+    actor->SetVisibility(isVisible);
 
     this->stlActor = actor;
+    restoreColour();
+}
+
+/**
+ * @brief Prepares the part for an STL file too large to load into memory.
+ *
+ * The actor gets an empty mapper so colour, opacity and visibility work as for
+ * other parts; render threads draw the geometry from the octree instead.
+ * @param fileName The path to the STL file.
+ */
+void ModelPart::loadOutOfCore(QString fileName) {
+    QElapsedTimer timer;
+    timer.start();
+
+    // Hashing reads the whole file, so it is left to the background conversion
+    m_fileSize = QFileInfo(fileName).size();
+    m_streamedFile = fileName;
+    m_loadTime = timer.nsecsElapsed() / 1.0e6;
+
+    stlMapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+    stlMapper->SetInputData(vtkSmartPointer<vtkPolyData>::New());
+    stlMapper->ScalarVisibilityOff();
+
+    vtkSmartPointer<vtkActor> actor = vtkSmartPointer<vtkActor>::New();
+    actor->SetMapper(stlMapper);
+
+    this->stlActor = actor;
+    restoreColour();
+}
+
+/** @brief Gets the STL file the part is streamed from, or an empty string. */
+QString ModelPart::streamedFile() const { return m_streamedFile; }
+
+/**
+ * @brief Attaches the octree the part is streamed from.
+ * @param tree The octree.
+ * @param hash Content hash of the STL file.
+ */
+void ModelPart::setOctree(std::shared_ptr<const OctreeFile> tree, const QByteArray& hash) {
+    m_octree = std::move(tree);
+    if (!m_octree)
+        return;
+    m_contentHash = hash;
+
+    double bounds[6];
+    m_octree->bounds(bounds);
+    m_triangleCount = static_cast<qint64>(m_octree->triangleCount());
+    m_boundingVolume = (bounds[1] - bounds[0]) * (bounds[3] - bounds[2]) * (bounds[5] - bounds[4]);
+    m_worldBoundsDirty = true;
+}
+
+/** @brief Gets the octree the part is streamed from, or null. */
+std::shared_ptr<const OctreeFile> ModelPart::octree() const { return m_octree; }
+
+/**
+ * @brief Shows a temporary colour on the actor without touching the stored user colour.
+ * The property is shared with the VR actor, so both views change together.
+ * @param r Red component (0-1).
+ * @param g Green component (0-1).
+ * @param b Blue component (0-1).
+ */
+void ModelPart::setDisplayColour(double r, double g, double b) {
+    if (stlActor) {
+        stlActor->GetProperty()->SetColor(r, g, b);
+    }
+
+    // The occlusion ramp is built from the actor colour, so keep it in step
+    if (occlusionLut) {
+        const int entries = occlusionLut->GetNumberOfTableValues();
+        for (int i = 0; i < entries; ++i) {
+            double shade = 0.25 + 0.75 * i / (entries - 1);
+            occlusionLut->SetTableValue(i, r * shade, g * shade, b * shade, 1.0);
+        }
+        occlusionLut->Modified();
+    }
+}
+
+/**
+ * @brief Re-applies the user-assigned colour and opacity to the actor.
+ */
+void ModelPart::restoreColour() {
+    setDisplayColour(colourR / 255.0, colourG / 255.0, colourB / 255.0);
+    if (stlActor) {
+        stlActor->GetProperty()->SetOpacity(m_opacity);
+    }
+}
+
+/**
+ * @brief Adds a named per-vertex array to the part's geometry.
+ * @param array The array to attach; it must have one tuple per point.
+ */
+void ModelPart::addPointArray(vtkDataArray* array) {
+    if (!polyData || !array || array->GetNumberOfTuples() != polyData->GetNumberOfPoints())
+        return;
+    polyData->GetPointData()->AddArray(array);
+}
+
+/**
+ * @brief Adds a named per-vertex array to this instance's geometry only.
+ * @param array The array to attach; it must have one tuple per point.
+ */
+void ModelPart::addInstancePointArray(vtkDataArray* array) {
+    if (!polyData || !array || array->GetNumberOfTuples() != polyData->GetNumberOfPoints())
+        return;
+
+    // Instances and undo commands hold the render copies along with the geometry
+    if (renderGeometry.use_count() > 1) {
+        vtkSmartPointer<vtkPolyData> own = vtkSmartPointer<vtkPolyData>::New();
+        own->ShallowCopy(polyData);
+        polyData = own;
+        renderGeometry = std::make_shared<RenderGeometry>();
+        vrGeometry = std::make_shared<RenderGeometry>();
+        stlMapper->SetInputDataObject(polyData);
+    }
+    polyData->GetPointData()->AddArray(array);
+}
+
+/**
+ * @brief Checks whether a named per-vertex array is attached.
+ * @param name The array name.
+ * @return True if attached.
+ */
+bool ModelPart::hasPointArray(const QString& name) const {
+    return polyData && polyData->GetPointData()->HasArray(name.toUtf8().constData());
+}
+
+/**
+ * @brief Colours the part by a per-vertex array.
+ * Only mapper state changes; no geometry is recomputed or re-read.
+ * @param name Name of an attached point array.
+ * @param lut The lookup table.
+ * @param lo The value mapped to the start of the table.
+ * @param hi The value mapped to the end of the table.
+ */
+void ModelPart::setOverlay(const QString& name, vtkScalarsToColors* lut, double lo, double hi) {
+    if (lut != occlusionLut)
+        occlusionLut = nullptr;
+
+    if (!stlMapper)
+        return;
+    stlMapper->SetScalarModeToUsePointFieldData();
+    stlMapper->SelectColorArray(name.toUtf8().constData());
+    stlMapper->SetLookupTable(lut);
+    stlMapper->SetScalarRange(lo, hi);
+    stlMapper->ScalarVisibilityOn();
+}
+
+/**
+ * @brief Shades the part by a baked ambient occlusion array.
+ * Only a small per-part lookup table is built; the bake itself costs nothing per frame.
+ * @param name Name of an attached point array with values in [0, 1].
+ */
+void ModelPart::setOcclusionOverlay(const QString& name) {
+    if (!stlActor)
+        return;
+
+    occlusionLut = vtkSmartPointer<vtkLookupTable>::New();
+    occlusionLut->SetNumberOfTableValues(64);
+    occlusionLut->SetTableRange(0.0, 1.0);
+    double colour[3];
+    stlActor->GetProperty()->GetColor(colour);
+    setDisplayColour(colour[0], colour[1], colour[2]);
+
+    setOverlay(name, occlusionLut, 0.0, 1.0);
+}
+
+/**
+ * @brief Turns off any per-vertex overlay.
+ */
+void ModelPart::clearOverlay() {
+    occlusionLut = nullptr;
+    if (stlMapper)
+        stlMapper->ScalarVisibilityOff();
+}
+
+/**
+ * @brief Captures the part's current render state for a render thread.
+ *
+ * The render thread gets its own shallow copy of the geometry, so arrays attached
+ * here later never change a dataset it may be drawing. A new copy is only taken after
+ * such a change, so an unchanged part keeps the buffers already uploaded for it.
+ * @return The snapshot; its geometry is null if nothing is loaded.
+ */
+PartSnapshot ModelPart::snapshot() {
+    return captureState(*renderGeometry, renderLut);
+}
+
+/**
+ * @brief Captures the part's current render state for the VR thread.
+ * @return The snapshot; its geometry is null if nothing is loaded.
+ */
+PartSnapshot ModelPart::vrSnapshot() {
+    return captureState(*vrGeometry, vrLut);
+}
+
+/**
+ * @brief Captures the part's render state, refreshing the given copies if the part changed.
+ * @param render Geometry copy to hand over.
+ * @param lut Lookup table copy to hand over.
+ * @return The snapshot.
+ */
+PartSnapshot ModelPart::captureState(RenderGeometry& render, RenderLut& lut) {
+    PartSnapshot state;
+    state.id = reinterpret_cast<quintptr>(this);
+    std::copy(worldTransform(), worldTransform() + 16, state.transform);
+    worldBounds(state.bounds);
+    if (stlActor && m_octree) {
+        state.octree = m_octree;
+        stlActor->GetProperty()->GetColor(state.colour);
+        state.opacity = stlActor->GetProperty()->GetOpacity();
+        return state;
+    }
+    if (!stlActor || !polyData)
+        return state;
+
+    if (!render.copy || polyData->GetMTime() > render.time) {
+        render.copy = vtkSmartPointer<vtkPolyData>::New();
+        render.copy->ShallowCopy(polyData);
+        render.time = polyData->GetMTime();
+    }
+    state.geometry = render.copy;
+    state.lod = m_clusterLod;
+
+    stlActor->GetProperty()->GetColor(state.colour);
+    state.opacity = stlActor->GetProperty()->GetOpacity();
+
+    state.scalarVisibility = stlMapper->GetScalarVisibility();
+    if (state.scalarVisibility) {
+        state.colorArray = stlMapper->GetArrayName() ? stlMapper->GetArrayName() : "";
+        stlMapper->GetScalarRange(state.scalarRange);
+
+        // The occlusion table is edited in place when the colour changes, so copy it
+        vtkScalarsToColors* source = stlMapper->GetLookupTable();
+        if (!lut.copy || source != lut.source || source->GetMTime() > lut.time) {
+            lut.copy.TakeReference(source->NewInstance());
+            lut.copy->DeepCopy(source);
+            lut.source = source;
+            lut.time = source->GetMTime();
+        }
+        state.lut = lut.copy;
+    }
+    return state;
+}
+
+/**
+ * @brief Attaches a cluster hierarchy for render threads to draw the part with.
+ * @param lod The hierarchy, or null to draw the part whole.
+ */
+void ModelPart::setClusterLod(std::shared_ptr<const ClusterLod> lod) {
+    m_clusterLod = std::move(lod);
+}
+
+/** @brief Gets the attached cluster hierarchy, or null. */
+std::shared_ptr<const ClusterLod> ModelPart::clusterLod() const { return m_clusterLod; }
+
+/** @brief Gets the content hash of the loaded STL. */
+QByteArray ModelPart::contentHash() const { return m_contentHash; }
+
+/** @brief Gets the number of triangles in the loaded STL. */
+qint64 ModelPart::triangleCount() const { return m_triangleCount; }
+
+/** @brief Gets the bounding box volume of the loaded STL. */
+double ModelPart::boundingVolume() const { return m_boundingVolume; }
+
+/** @brief Gets the STL file size in bytes. */
+qint64 ModelPart::fileSize() const { return m_fileSize; }
+
+/** @brief Gets the STL load time in milliseconds. */
+double ModelPart::loadTime() const { return m_loadTime; }
+
+/**
+ * @brief Gets the depth of this part in the tree.
+ * @return 0 for top-level parts, increasing by one per folder level.
+ */
+int ModelPart::depth() const {
+    int level = 0;
+    // The root item holds the column headers and is not counted
+    for (const ModelPart* p = m_parentItem; p && p->m_parentItem; p = p->m_parentItem)
+        ++level;
+    return level;
+}
+
+/**
+ * @brief Sets the transform relative to the parent.
+ * @param matrix A 4x4 matrix in row-major order.
+ */
+void ModelPart::setLocalTransform(const double matrix[16]) {
+    std::copy(matrix, matrix + 16, m_localTransform);
+    m_worldDirty = false;   // Forces the walk below past this part
+    invalidateWorldTransform();
+}
+
+/**
+ * @brief Gets the transform relative to the parent.
+ * @param matrix Receives a 4x4 matrix in row-major order.
+ */
+void ModelPart::localTransform(double matrix[16]) const {
+    std::copy(m_localTransform, m_localTransform + 16, matrix);
+}
+
+/**
+ * @brief Gets the transform to scene coordinates, recomputing it if the part or an ancestor moved.
+ * @return A 4x4 matrix in row-major order.
+ */
+const double* ModelPart::worldTransform() const {
+    if (m_worldDirty) {
+        // The root item holds the column headers and has no placement of its own
+        if (m_parentItem)
+            vtkMatrix4x4::Multiply4x4(m_parentItem->worldTransform(), m_localTransform, m_worldTransform);
+        else
+            std::copy(m_localTransform, m_localTransform + 16, m_worldTransform);
+        m_worldDirty = false;
+    }
+    return m_worldTransform;
+}
+
+/**
+ * @brief Gets the bounds of the geometry in scene coordinates.
+ *
+ * The eight corners of the model-space box are transformed, so the result encloses
+ * the part but is not the tightest box once the part is rotated.
+ * @param bounds Receives xmin, xmax, ymin, ymax, zmin, zmax.
+ */
+void ModelPart::worldBounds(double bounds[6]) const {
+    if (m_worldBoundsDirty || m_worldDirty) {
+        double local[6];
+        vtkMath::UninitializeBounds(local);
+        if (m_octree)
+            m_octree->bounds(local);
+        else if (polyData && polyData->GetNumberOfPoints() > 0)
+            polyData->GetBounds(local);
+
+        vtkMath::UninitializeBounds(m_worldBounds);
+        if (vtkMath::AreBoundsInitialized(local)) {
+            const double* world = worldTransform();
+            for (int corner = 0; corner < 8; ++corner) {
+                const double in[4] = { local[corner & 1], local[2 + ((corner >> 1) & 1)], local[4 + ((corner >> 2) & 1)], 1.0 };
+                double out[4];
+                vtkMatrix4x4::MultiplyPoint(world, in, out);
+                for (int k = 0; k < 3; ++k) {
+                    if (corner == 0 || out[k] < m_worldBounds[2 * k])
+                        m_worldBounds[2 * k] = out[k];
+                    if (corner == 0 || out[k] > m_worldBounds[2 * k + 1])
+                        m_worldBounds[2 * k + 1] = out[k];
+                }
+            }
+        }
+        m_worldBoundsDirty = false;
+    }
+    std::copy(m_worldBounds, m_worldBounds + 6, bounds);
+}
+
+/**
+ * @brief Marks the world transform of this part and its descendants out of date.
+ */
+void ModelPart::invalidateWorldTransform() {
+    if (m_worldDirty)
+        return;
+    m_worldDirty = true;
+    m_worldBoundsDirty = true;
+    for (ModelPart* child : m_childItems)
+        child->invalidateWorldTransform();
 }
 
 /**
@@ -207,21 +825,56 @@ void ModelPart::setColor(const QColor& color) {
     setColour(color.red(), color.green(), color.blue());
 }
 
+/**
+ * @brief Sets how opaque the part is drawn.
+ * The property is shared with the VR actor, so both views change together.
+ * @param opacity The opacity, clamped to 0 (invisible) to 1 (opaque).
+ */
+void ModelPart::setOpacity(double opacity) {
+    m_opacity = qBound(0.0, opacity, 1.0);
+    if (stlActor) {
+        stlActor->GetProperty()->SetOpacity(m_opacity);
+    }
+}
+
+/** @brief Gets the user-assigned opacity. */
+double ModelPart::opacity() const { return m_opacity; }
+
 /**
  * @brief Gets a new VTK actor for VR rendering.
+ * @param sharedMapper Mapper of another instance of the same geometry to draw with, or null.
  * @return A new VTK actor, or nullptr if there's no original actor.
  *
  * This function creates a separate actor for VR rendering.
  * The original actor is used for GUI rendering.
  */
-vtkActor* ModelPart::getNewActor() {
+vtkActor* ModelPart::getNewActor(vtkPolyDataMapper* sharedMapper) {
     if (!this->stlActor) {
         return nullptr;
     }
 
-    // Create a new mapper and actor using the same data source
-    newMapper = vtkSmartPointer<vtkDataSetMapper>::New();
-    newMapper->SetInputConnection(stlReader->GetOutputPort());
+    // Instances draw with one mapper, which holds the buffers uploaded for the geometry
+    if (sharedMapper) {
+        newMapper = sharedMapper;
+        newActor = vtkSmartPointer<vtkActor>::New();
+        newActor->SetMapper(newMapper);
+        newActor->SetProperty(this->stlActor->GetProperty());
+        return newActor;
+    }
+
+    // Create a new mapper over the VR copy of the geometry, quantised on the GPU
+    const PartSnapshot state = vrSnapshot();
+    newMapper = vtkSmartPointer<QuantisedPolyDataMapper>::New();
+    newMapper->SetInputData(state.geometry);
+
+    // Carry over any overlay that is active on the GUI mapper, through the VR copy of its table
+    newMapper->SetScalarVisibility(state.scalarVisibility);
+    if (state.scalarVisibility) {
+        newMapper->SetScalarModeToUsePointFieldData();
+        newMapper->SelectColorArray(state.colorArray.c_str());
+        newMapper->SetLookupTable(state.lut);
+        newMapper->SetScalarRange(state.scalarRange);
+    }
 
     newActor = vtkSmartPointer<vtkActor>::New();
     newActor->SetMapper(newMapper);
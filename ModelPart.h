@@ -9,8 +9,19 @@
 #include <vtkMapper.h>
 #include <vtkActor.h>
 #include <vtkDataSetMapper.h>
+#include <vtkPolyDataMapper.h>
 #include <vtkSmartPointer.h> // Added for vtkSmartPointer usage
 #include <vtkPolyData.h>
+#include <vtkDataArray.h>
+#include <vtkScalarsToColors.h>
+#include <vtkLookupTable.h>
+#include <QByteArray>
+#include "SceneSnapshot.h"
+#include <memory>
+
+class SharedGeometryStore;
+class TeamCache;
+struct PartGeometry;
 
 /**
  * @file ModelPart.h
@@ -39,6 +50,17 @@ public:
      * @param item The child ModelPart to add.  The ownership of the child is transferred to this ModelPart.
      */
     void appendChild(ModelPart* item);
+    /**
+     * @brief Inserts a child ModelPart at a given row.
+     * @param row The row the child will have; clamped to the valid range.
+     * @param item The child ModelPart to add.  The ownership of the child is transferred to this ModelPart.
+     */
+    void insertChild(int row, ModelPart* item);
+    /**
+     * @brief Removes and deletes the child ModelPart at a given row, with all its descendants.
+     * @param row The row of the child to remove.
+     */
+    void removeChild(int row);
     /**
      * @brief Returns the child ModelPart at the specified row.
      * @param row The index of the child to retrieve.
@@ -71,9 +93,15 @@ public:
      * @brief Returns a new VTK actor for rendering (e.g., in VR).
      * This creates a separate actor, potentially with a different mapper.
      * The caller is responsible for managing the lifetime of the returned actor.
+     * The actor draws the part's VR copy of its geometry, so later changes to the part
+     * reach it only through VRRenderThread::setPartOverlay().
+     * @param sharedMapper The mapper of another instance's new actor, drawn with the same
+     *        geometry, so its buffers are uploaded once; or nullptr for a mapper of its own.
+     *        Only pass one for parts without an overlay: a shared mapper is kept plain, and
+     *        a later overlay gives the part a mapper of its own on the VR thread.
      * @return A new vtkActor, or nullptr if no STL data is loaded.
      */
-    vtkActor* getNewActor();
+    vtkActor* getNewActor(vtkPolyDataMapper* sharedMapper = nullptr);
     /**
      * @brief Returns the parent ModelPart.
      * @return The parent ModelPart, or nullptr if this is the root.
@@ -103,6 +131,66 @@ public:
      * @param fileName The path to the STL file to load.
      */
     void loadSTL(QString fileName);
+    /**
+     * @brief Loads an STL file that has already been read into memory, as the batch loader does.
+     * @param contents The whole contents of the STL file.
+     */
+    void loadSTLFromMemory(const QByteArray& contents);
+    /**
+     * @brief Makes the part another instance of an already loaded part.
+     * The geometry, its render copy and its statistics are shared rather than loaded
+     * again, so render threads upload it once for all instances. Colour, visibility
+     * and transform stay the part's own.
+     * @param prototype A loaded part of the same file.
+     */
+    void loadInstance(const ModelPart& prototype);
+    /**
+     * @brief Returns the part's geometry and everything derived from it.
+     * @return A snapshot that keeps the geometry alive for as long as it is held.
+     */
+    std::shared_ptr<const PartGeometry> geometry() const;
+    /**
+     * @brief Shows a geometry taken from this or another part with geometry().
+     * As for loadInstance(), colour, visibility and transform stay the part's own.
+     * @param geometry The geometry.
+     */
+    void setGeometry(const PartGeometry& geometry);
+    /**
+     * @brief Shares loaded geometry with other viewer instances through a shared memory store.
+     * Affects parts loaded afterwards; the store must outlive them.
+     * @param store The store, or nullptr (the default) to keep geometry private.
+     */
+    static void setSharedGeometryStore(SharedGeometryStore* store);
+    /**
+     * @brief Reads welded geometry from, and publishes it to, a team cache directory.
+     * Affects parts loaded afterwards; the cache must outlive them.
+     * @param cache The cache, or nullptr (the default) for none.
+     */
+    static void setTeamCache(TeamCache* cache);
+    /**
+     * @brief Prepares the part for an STL file too large to load into memory.
+     * Only the file size is read; the content hash is computed in the background and
+     * the geometry is drawn from an octree file, both attached with setOctree().
+     * @param fileName The path to the STL file.
+     */
+    void loadOutOfCore(QString fileName);
+    /**
+     * @brief Returns the STL file an out-of-core part is streamed from.
+     * @return The path, or an empty string for parts loaded into memory.
+     */
+    QString streamedFile() const;
+    /**
+     * @brief Attaches the octree an out-of-core part is streamed from.
+     * Also fills in the content hash, triangle count and bounding volume.
+     * @param octree The octree converted from the part's STL file.
+     * @param hash Content hash of the STL file.
+     */
+    void setOctree(std::shared_ptr<const OctreeFile> octree, const QByteArray& hash);
+    /**
+     * @brief Returns the octree an out-of-core part is streamed from.
+     * @return The octree, or null for parts loaded into memory.
+     */
+    std::shared_ptr<const OctreeFile> octree() const;
     /**
      * @brief Returns the primary VTK actor associated with this ModelPart.
      * This actor is typically used for GUI rendering.  The returned pointer is managed
@@ -152,11 +240,203 @@ public:
     void setColor(const QColor& color);
 
     /**
-     * @brief Holds the polygonal data of the model (potentially for more advanced manipulation).
+     * @brief Sets how opaque the part is drawn.
+     * Parts below 1 are drawn with order-independent transparency, so parts inside
+     * them show through.
+     * @param opacity The opacity, from 0 (invisible) to 1 (opaque).
+     */
+    void setOpacity(double opacity);
+    /**
+     * @brief Returns the user-assigned opacity.
+     * @return The opacity (0-1).
+     */
+    double opacity() const;
+
+    /**
+     * @brief Shows a temporary colour on the actor without changing the user-assigned colour.
+     * Used by the "colour by" modes; restoreColour() puts the user colour back.
+     * @param r Red component (0-1).
+     * @param g Green component (0-1).
+     * @param b Blue component (0-1).
+     */
+    void setDisplayColour(double r, double g, double b);
+    /**
+     * @brief Re-applies the user-assigned colour and opacity to the actor.
+     */
+    void restoreColour();
+
+    // Per-vertex overlays
+    /**
+     * @brief Adds (or replaces) a named per-vertex array on the part's geometry.
+     * Must be called on the GUI thread; the array must have one tuple per point.
+     * @param array The array to attach.
+     */
+    void addPointArray(vtkDataArray* array);
+    /**
+     * @brief Adds (or replaces) a named per-vertex array on this instance only.
+     * If other parts may share the geometry, the part is first given its own shallow
+     * copy, so points and cells stay shared and only the arrays differ.
+     * Must be called on the GUI thread; the array must have one tuple per point.
+     * @param array The array to attach.
+     */
+    void addInstancePointArray(vtkDataArray* array);
+    /**
+     * @brief Returns whether the part's geometry has a named per-vertex array.
+     * @param name The array name.
+     * @return True if the array is attached.
+     */
+    bool hasPointArray(const QString& name) const;
+    /**
+     * @brief Colours the part by a per-vertex array.
+     * Only the GUI mapper is changed; a running VR view is sent vrSnapshot() instead.
+     * @param name Name of an attached point array.
+     * @param lut The lookup table to map values through.
+     * @param lo The value mapped to the start of the table.
+     * @param hi The value mapped to the end of the table.
+     */
+    void setOverlay(const QString& name, vtkScalarsToColors* lut, double lo, double hi);
+    /**
+     * @brief Shades the part by a baked ambient occlusion array.
+     * The lookup table ramps from a darkened to the full actor colour, so the part
+     * keeps its colour and only the occluded areas darken. It follows later colour changes.
+     * @param name Name of an attached point array with values in [0, 1].
+     */
+    void setOcclusionOverlay(const QString& name);
+    /**
+     * @brief Turns off any per-vertex overlay so the part shows its actor colour again.
+     */
+    void clearOverlay();
+    /**
+     * @brief Returns the content hash of the loaded STL, used as the geometry cache key.
+     * @return The hex-encoded hash, or an empty array if nothing is loaded.
+     */
+    QByteArray contentHash() const;
+    /**
+     * @brief Captures the part's current render state for a render thread.
+     * The geometry and lookup table in the snapshot are private copies that are
+     * replaced, not modified, when the part changes.
+     * @return The snapshot; its geometry is null if nothing is loaded.
+     */
+    PartSnapshot snapshot();
+    /**
+     * @brief Captures the part's current render state for the VR thread.
+     * Like snapshot(), but with copies of its own, so the VR and desktop threads
+     * never draw the same dataset.
+     * @return The snapshot; its geometry is null if nothing is loaded.
+     */
+    PartSnapshot vrSnapshot();
+    /**
+     * @brief Attaches a cluster hierarchy, so render threads draw the part by clusters.
+     * Overlays are not shown on parts drawn by clusters.
+     * @param lod The hierarchy built from this part's geometry, or null to draw it whole.
+     */
+    void setClusterLod(std::shared_ptr<const ClusterLod> lod);
+    /**
+     * @brief Returns the cluster hierarchy attached to the part.
+     * @return The hierarchy, or null if the part is drawn whole.
+     */
+    std::shared_ptr<const ClusterLod> clusterLod() const;
+
+    // Per-part statistics gathered while loading
+    /**
+     * @brief Returns the number of triangles in the loaded STL.
+     * @return The triangle count, or 0 if nothing is loaded.
+     */
+    qint64 triangleCount() const;
+    /**
+     * @brief Returns the volume of the axis-aligned bounding box of the loaded STL.
+     * @return The bounding volume in model units cubed, or 0 if nothing is loaded.
+     */
+    double boundingVolume() const;
+    /**
+     * @brief Returns the size of the STL file on disk.
+     * @return The file size in bytes, or 0 if nothing is loaded.
+     */
+    qint64 fileSize() const;
+    /**
+     * @brief Returns how long the STL took to read.
+     * @return The load time in milliseconds.
+     */
+    double loadTime() const;
+    /**
+     * @brief Returns the depth of this part in the tree (top-level parts are depth 0).
+     * @return The number of ancestors below the root item.
+     */
+    int depth() const;
+
+    // Placement in the assembly
+    /**
+     * @brief Sets the part's transform relative to its parent.
+     * Only the world transforms of this part and its descendants are marked out of
+     * date; they are recomputed when next asked for.
+     * @param matrix A 4x4 matrix in row-major order.
+     */
+    void setLocalTransform(const double matrix[16]);
+    /**
+     * @brief Returns the part's transform relative to its parent.
+     * @param matrix Receives a 4x4 matrix in row-major order.
+     */
+    void localTransform(double matrix[16]) const;
+    /**
+     * @brief Returns the transform from the part's model coordinates to the scene.
+     * Cached; only recomputed after this part or one of its ancestors moved.
+     * @return A 4x4 matrix in row-major order, valid until the part or an ancestor moves.
+     */
+    const double* worldTransform() const;
+    /**
+     * @brief Returns the axis-aligned bounds of the part's geometry in scene coordinates.
+     * Cached like worldTransform().
+     * @param bounds Receives xmin, xmax, ymin, ymax, zmin, zmax; uninitialised if nothing is loaded.
+     */
+    void worldBounds(double bounds[6]) const;
+
+    /**
+     * @brief Holds the polygonal data of the model.
+     * The GUI mapper reads from it; render threads draw shallow copies taken by
+     * snapshot() and vrSnapshot(), so point arrays attached here (e.g. analysis
+     * overlays) reach them with their next snapshot.
      */
     vtkSmartPointer<vtkPolyData> polyData;
 
 private:
+    /**
+     * @brief Records the statistics of newly loaded polyData and creates the mapper and actor.
+     * @param loadTime Parse time in milliseconds.
+     * @param fileSize Size of the source file in bytes.
+     * @param hash Content hash of the source file.
+     */
+    void finishLoading(double loadTime, qint64 fileSize, const QByteArray& hash);
+
+    /**
+     * @brief Publishes polyData to the shared geometry store and switches to the shared copy.
+     * @param hash Content hash of the source file.
+     */
+    void publishGeometry(const QByteArray& hash);
+
+    /**
+     * @brief Sets polyData from the shared geometry store or the team cache.
+     * @param hash Content hash of the source file.
+     * @return False if neither has the geometry.
+     */
+    bool loadCachedGeometry(const QByteArray& hash);
+
+    /**
+     * @brief Marks the world transform of this part and of its descendants out of date.
+     * A part whose transform is already out of date has out-of-date descendants too,
+     * so the walk stops there.
+     */
+    void invalidateWorldTransform();
+
+    /**
+     * @brief Store loaded geometry is shared through, or null.
+     */
+    static SharedGeometryStore* sharedGeometry;
+
+    /**
+     * @brief Team cache directory welded geometry is read from and published to, or null.
+     */
+    static TeamCache* teamCache;
+
     /**
      * @brief List of child ModelPart objects.
      * This list stores the child nodes in the tree structure.
@@ -191,13 +471,105 @@ private:
     vtkSmartPointer<vtkActor> stlActor;
     /**
      * @brief VTK mapper for creating a potentially different representation (e.g., for VR).
+     * It stores vertices in quantised form on the GPU.
      */
-    vtkSmartPointer<vtkDataSetMapper> newMapper;
+    vtkSmartPointer<vtkPolyDataMapper> newMapper;
     /**
      * @brief VTK actor for rendering the model (potentially in VR).
      */
     vtkSmartPointer<vtkActor> newActor;
 
+    /**
+     * @brief Lookup table used while an ambient occlusion overlay is shown, otherwise null.
+     */
+    vtkSmartPointer<vtkLookupTable> occlusionLut;
+
+    /**
+     * @brief Shallow copy of polyData handed to render threads, and the polyData time it was taken at.
+     * Shared by every instance of the geometry, so render threads see one dataset for all of them.
+     */
+    struct RenderGeometry {
+        vtkSmartPointer<vtkPolyData> copy;
+        vtkMTimeType time = 0;
+    };
+    std::shared_ptr<RenderGeometry> renderGeometry;
+    /**
+     * @brief Shallow copy of polyData handed to the VR thread, shared by every instance like renderGeometry.
+     */
+    std::shared_ptr<RenderGeometry> vrGeometry;
+    /**
+     * @brief Copy of the overlay lookup table handed to a render thread, its source, and when it was taken.
+     */
+    struct RenderLut {
+        vtkSmartPointer<vtkScalarsToColors> copy;
+        vtkSmartPointer<vtkScalarsToColors> source;
+        vtkMTimeType time = 0;
+    };
+    RenderLut renderLut;    /**< For the desktop render thread */
+    RenderLut vrLut;        /**< For the VR thread */
+    /**
+     * @brief Captures the part's render state with the given copies.
+     * @param render Geometry copy to refresh and hand over.
+     * @param lut Lookup table copy to refresh and hand over.
+     * @return The snapshot.
+     */
+    PartSnapshot captureState(RenderGeometry& render, RenderLut& lut);
+    /**
+     * @brief Cluster hierarchy used by render threads for very large parts, or null.
+     */
+    std::shared_ptr<const ClusterLod> m_clusterLod;
+    /**
+     * @brief Octree an out-of-core part is streamed from, or null.
+     */
+    std::shared_ptr<const OctreeFile> m_octree;
+    /**
+     * @brief STL file an out-of-core part is streamed from, or empty.
+     */
+    QString m_streamedFile;
+
+    /**
+     * @brief Content hash of the loaded STL file.
+     */
+    QByteArray m_contentHash;
+
+    /**
+     * @brief Number of triangles in the loaded STL.
+     */
+    qint64 m_triangleCount;
+    /**
+     * @brief Volume of the bounding box of the loaded STL.
+     */
+    double m_boundingVolume;
+    /**
+     * @brief Size of the STL file in bytes.
+     */
+    qint64 m_fileSize;
+    /**
+     * @brief Time taken to read the STL, in milliseconds.
+     */
+    double m_loadTime;
+
+    /**
+     * @brief Transform relative to the parent, row-major.
+     */
+    double m_localTransform[16];
+    /**
+     * @brief Cached transform to scene coordinates, row-major; valid unless m_worldDirty.
+     */
+    mutable double m_worldTransform[16];
+    /**
+     * @brief Cached bounds in scene coordinates; valid unless m_worldBoundsDirty.
+     */
+    mutable double m_worldBounds[6];
+    /**
+     * @brief True if the part or an ancestor moved since m_worldTransform was computed.
+     */
+    mutable bool m_worldDirty;
+    /**
+     * @brief True if the part moved or its geometry changed since m_worldBounds was computed.
+     */
+    mutable bool m_worldBoundsDirty;
+
     /**
      * @brief Red color component (0-255).
      */
@@ -210,6 +582,29 @@ private:
      * @brief Blue color component (0-255).
      */
     unsigned char colourB;
+    /**
+     * @brief User-assigned opacity (0-1).
+     */
+    double m_opacity;
+
+    friend struct PartGeometry;
+};
+
+/**
+ * @brief The geometry of a part and everything derived from it, as shared by its instances.
+ * Undo commands hold these, so geometry replaced by an edit is released with the command.
+ */
+struct PartGeometry {
+    vtkSmartPointer<vtkPolyData> polyData;                  /**< The mesh, or null */
+    std::shared_ptr<ModelPart::RenderGeometry> render;      /**< Copy handed to the desktop render thread */
+    std::shared_ptr<ModelPart::RenderGeometry> vr;          /**< Copy handed to the VR thread */
+    std::shared_ptr<const OctreeFile> octree;               /**< Octree of an out-of-core part, or null */
+    std::shared_ptr<const ClusterLod> clusterLod;           /**< Cluster hierarchy, or null */
+    QString streamedFile;                                   /**< STL file of an out-of-core part, or empty */
+    QByteArray contentHash;                                 /**< Content hash of the source file */
+    qint64 triangleCount = 0;                               /**< Number of triangles */
+    double boundingVolume = 0.0;                            /**< Volume of the bounding box */
+    qint64 fileSize = 0;                                    /**< Size of the source file */
 };
 
 #endif // VIEWER_MODELPART_H
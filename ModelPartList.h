@@ -18,8 +18,10 @@
 #include <QVariant>
 #include <QString>
 #include <QList>
+#include <QHash>
 
 class ModelPart;
+class ThumbnailCache;
 
 class ModelPartList : public QAbstractItemModel {
     Q_OBJECT        /**< A special Qt tag used to indicate that this is a special Qt class that might require preprocessing before compiling. */
@@ -97,9 +99,41 @@ public:
       */
     QModelIndex appendChild( QModelIndex& parent, const QList<QVariant>& data );
 
+    /** Remove a part and everything under it from the tree, and delete them
+      * @param part is the part to remove, it must not be the root item
+      */
+    void removePart( ModelPart* part );
+
+    /** Put a new part in the tree in place of an existing one, which is deleted
+      * @param part is the part to replace, it must not be the root item
+      * @param replacement is the new part, ownership passes to the tree
+      */
+    void replacePart( ModelPart* part, ModelPart* replacement );
+
+    /** Get the QModelIndex of an existing part, e.g. to emit dataChanged() for it
+      * @param part is the part to look up, the root item gives an invalid index
+      * @param column is 0 = "Part" or 1 = "Visible"
+      * @return the QModelIndex structure
+      */
+    QModelIndex indexForPart( ModelPart* part, int column = 0 ) const;
+
+    /** Set where part thumbnails for the "Part" column's decoration role come from
+      * @param cache is the thumbnail cache, or nullptr for no icons
+      */
+    void setThumbnailCache( ThumbnailCache* cache );
+
+    /** Colour the "Part" column of compared parts by how far their geometry moved
+      * @param deviations is the largest deviation of each compared part, parts not listed are not coloured
+      * @param tolerance is the deviation shown in full red, smaller ones fade towards green
+      */
+    void setDeviations( const QHash<ModelPart*, double>& deviations, double tolerance );
+
 
 private:
     ModelPart *rootItem;    /**< This is a pointer to the item at the base of the tree */
+    ThumbnailCache *thumbnails = nullptr;   /**< Source of part icons, may be null */
+    QHash<ModelPart*, double> deviations;    /**< Largest deviation of each compared part */
+    double deviationTolerance = 0.0;        /**< Deviation shown in full red */
 };
 #endif
 
@@ -0,0 +1,95 @@
+/**
+ * @file OctreeChunkCache.cpp
+ * @brief Implementation of the OctreeChunkCache class.
+ */
+
+#include "OctreeChunkCache.h"
+#include "OctreeFile.h"
+#include "QuantisedPolyDataMapper.h"
+
+#include <algorithm>
+
+/**
+ * @brief Constructs an empty cache.
+ * @param octree The part's octree.
+ * @param property Display property shared by all chunk actors.
+ */
+OctreeChunkCache::OctreeChunkCache(std::shared_ptr<const OctreeFile> octree, vtkProperty* property)
+    : file(std::move(octree)), shared(property), residentBytes(0), frame(0) {
+}
+
+/** @brief Gets the part's octree. */
+const std::shared_ptr<const OctreeFile>& OctreeChunkCache::octree() const { return file; }
+
+/** @brief Gets the property shared by the chunk actors. */
+vtkProperty* OctreeChunkCache::property() const { return shared; }
+
+/**
+ * @brief Shows exactly the given chunks and evicts hidden ones over the budget.
+ *
+ * Hidden chunks are kept while they fit, so turning back to a region does not read
+ * it from disk and upload it again.
+ * @param selected Node indices to show.
+ * @param budgetBytes Memory that shown and hidden chunks together may use.
+ * @param added Receives new actors.
+ * @param evicted Receives dropped actors.
+ */
+void OctreeChunkCache::show(const std::vector<int>& selected, qint64 budgetBytes,
+                            std::vector<vtkSmartPointer<vtkActor>>& added,
+                            std::vector<vtkSmartPointer<vtkActor>>& evicted) {
+    added.clear();
+    evicted.clear();
+    ++frame;
+
+    for (Entry& entry : entries)
+        entry.actor->VisibilityOff();
+
+    for (int index : selected) {
+        auto it = entries.find(index);
+        if (it == entries.end()) {
+            vtkSmartPointer<QuantisedPolyDataMapper> mapper = vtkSmartPointer<QuantisedPolyDataMapper>::New();
+            mapper->SetInputData(file->geometry(index));
+            mapper->ScalarVisibilityOff();
+
+            Entry entry;
+            entry.actor = vtkSmartPointer<vtkActor>::New();
+            entry.actor->SetMapper(mapper);
+            entry.actor->SetProperty(shared);
+            entry.bytes = file->chunkBytes(index);
+            residentBytes += entry.bytes;
+            it = entries.insert(index, entry);
+            added.push_back(entry.actor);
+        }
+        it->lastUsed = frame;
+        it->actor->VisibilityOn();
+    }
+
+    if (residentBytes <= budgetBytes)
+        return;
+
+    // Drop hidden chunks, least recently shown first, until the rest fit
+    std::vector<std::pair<quint64, int>> hidden;
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+        if (it->lastUsed != frame)
+            hidden.push_back({ it->lastUsed, it.key() });
+    }
+    std::sort(hidden.begin(), hidden.end());
+    for (const std::pair<quint64, int>& h : hidden) {
+        if (residentBytes <= budgetBytes)
+            break;
+        Entry entry = entries.take(h.second);
+        residentBytes -= entry.bytes;
+        evicted.push_back(entry.actor);
+    }
+}
+
+/**
+ * @brief Returns every actor held.
+ * @return The actors.
+ */
+std::vector<vtkSmartPointer<vtkActor>> OctreeChunkCache::actors() const {
+    std::vector<vtkSmartPointer<vtkActor>> all;
+    for (const Entry& entry : entries)
+        all.push_back(entry.actor);
+    return all;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file OctreeChunkCache.h
+ * @brief Declaration of the OctreeChunkCache class.
+ *
+ * The chunk cache keeps the actors of one out-of-core part on a render thread. Each
+ * frame the thread passes it the chunks OctreeFile::select() chose; the cache
+ * shows those, hides the rest, and drops the least recently used hidden chunks
+ * when the total exceeds the memory budget, releasing their CPU and GPU copies.
+ */
+#ifndef OCTREE_CHUNK_CACHE_H
+#define OCTREE_CHUNK_CACHE_H
+
+#include <QtGlobal>
+#include <QHash>
+
+#include <memory>
+#include <vector>
+
+#include <vtkSmartPointer.h>
+#include <vtkActor.h>
+#include <vtkProperty.h>
+
+class OctreeFile;
+
+/**
+ * @brief Actors of the streamed chunks of one out-of-core part.
+ *
+ * The cache is not thread-safe; it belongs to one render thread.
+ */
+class OctreeChunkCache {
+public:
+    /**
+     * @brief Constructs an empty cache.
+     * @param octree The part's octree.
+     * @param property Display property shared by all chunk actors.
+     */
+    OctreeChunkCache(std::shared_ptr<const OctreeFile> octree, vtkProperty* property);
+
+    /**
+     * @brief Returns the part's octree.
+     * @return The octree.
+     */
+    const std::shared_ptr<const OctreeFile>& octree() const;
+
+    /**
+     * @brief Returns the display property shared by the chunk actors.
+     * @return The property.
+     */
+    vtkProperty* property() const;
+
+    /**
+     * @brief Shows exactly the given chunks, creating actors for new ones.
+     * @param selected Node indices to show, from OctreeFile::select().
+     * @param budgetBytes Memory that shown and hidden chunks together may use.
+     * @param added Receives actors created by this call, which the caller must add to its scene.
+     * @param evicted Receives actors dropped by this call, which the caller must remove from its scene.
+     */
+    void show(const std::vector<int>& selected, qint64 budgetBytes,
+              std::vector<vtkSmartPointer<vtkActor>>& added,
+              std::vector<vtkSmartPointer<vtkActor>>& evicted);
+
+    /**
+     * @brief Returns every actor held, shown or hidden.
+     * @return The actors.
+     */
+    std::vector<vtkSmartPointer<vtkActor>> actors() const;
+
+private:
+    /**
+     * @brief A chunk with an actor.
+     */
+    struct Entry {
+        vtkSmartPointer<vtkActor> actor;    /**< Draws the chunk */
+        qint64 bytes;                       /**< OctreeFile::chunkBytes() of the chunk */
+        quint64 lastUsed;                   /**< Frame the chunk was last shown in */
+    };
+
+    std::shared_ptr<const OctreeFile> file;     /**< The part's octree */
+    vtkSmartPointer<vtkProperty> shared;        /**< Property of every chunk actor */
+    QHash<int, Entry> entries;                  /**< Chunks with actors, by node index */
+    qint64 residentBytes;                       /**< Total bytes of the entries */
+    quint64 frame;                              /**< Number of show() calls so far */
+};
+
+#endif // OCTREE_CHUNK_CACHE_H
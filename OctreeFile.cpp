@@ -0,0 +1,608 @@
+/**
+ * @file OctreeFile.cpp
+ * @brief Implementation of the OctreeFile class.
+ *
+ * Conversion sorts triangles into leaf cells by the Morton code of their centroid,
+ * with a counting sort over three streaming passes, so that each leaf's triangles
+ * are contiguous and siblings are neighbours. Inner nodes are then built level by
+ * level from the bottom: each parent reads its children back from the file, merges
+ * and simplifies them with ClusterLod::simplify(), and appends the result.
+ */
+
+#include "OctreeFile.h"
+#include "ClusterLod.h"
+#include "StlTriangleReader.h"
+#include "DecompressingDevice.h"
+
+#include <QDebug>
+
+#include <vtkAppendPolyData.h>
+#include <vtkCellArray.h>
+#include <vtkCellArrayIterator.h>
+#include <vtkFloatArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkNew.h>
+#include <vtkPoints.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <queue>
+#include <utility>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+/**
+ * @brief Fixed-size header at the start of an octree file.
+ */
+struct Header {
+    char magic[8];              /**< "STLOCT" followed by two zero bytes */
+    quint32 version;            /**< Layout version */
+    qint32 root;                /**< Index of the root node */
+    quint32 nodeCount;          /**< Number of entries in the node table */
+    quint32 reserved;           /**< Keeps the 64-bit fields aligned */
+    quint64 triangleCount;      /**< Triangles in the original mesh */
+    quint64 nodeTableOffset;    /**< File offset of the node table */
+};
+
+const char fileMagic[8] = { 'S', 'T', 'L', 'O', 'C', 'T', 0, 0 };
+const quint32 fileVersion = 1;
+
+/** Bytes of one stored triangle: three corners of three floats. */
+const qint64 triangleBytes = 9 * sizeof(float);
+
+/** Deepest leaf level; 8^7 cells already gives 64k-triangle chunks for 100G-triangle parts. */
+const int maxDepth = 7;
+
+/**
+ * @brief Interleaves the bits of three cell coordinates into a Morton code.
+ */
+quint64 mortonCode(quint32 x, quint32 y, quint32 z, int depth) {
+    quint64 code = 0;
+    for (int bit = depth - 1; bit >= 0; --bit) {
+        code = (code << 3) | (((x >> bit) & 1u) << 2) | (((y >> bit) & 1u) << 1) | ((z >> bit) & 1u);
+    }
+    return code;
+}
+
+/**
+ * @brief Wraps triangle-soup coordinates in a vtkPolyData.
+ * @param coords Nine floats per triangle.
+ * @param count Number of triangles.
+ * @param borrow True to use @p coords in place (it must outlive the result); false to copy.
+ */
+vtkSmartPointer<vtkPolyData> soupToPolyData(const float* coords, quint64 count, bool borrow) {
+    const vtkIdType values = static_cast<vtkIdType>(9 * count);
+
+    vtkSmartPointer<vtkFloatArray> array = vtkSmartPointer<vtkFloatArray>::New();
+    array->SetNumberOfComponents(3);
+    if (borrow) {
+        // The mapping is read-only; VTK never writes to point arrays it only draws
+        array->SetArray(const_cast<float*>(coords), values, 1);
+    }
+    else {
+        array->SetNumberOfTuples(3 * static_cast<vtkIdType>(count));
+        std::memcpy(array->GetPointer(0), coords, values * sizeof(float));
+    }
+
+    vtkNew<vtkIdTypeArray> offsets;
+    vtkNew<vtkIdTypeArray> connectivity;
+    offsets->SetNumberOfValues(static_cast<vtkIdType>(count) + 1);
+    connectivity->SetNumberOfValues(3 * static_cast<vtkIdType>(count));
+    for (vtkIdType i = 0; i <= static_cast<vtkIdType>(count); ++i)
+        offsets->SetValue(i, 3 * i);
+    for (vtkIdType i = 0; i < 3 * static_cast<vtkIdType>(count); ++i)
+        connectivity->SetValue(i, i);
+
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    points->SetData(array);
+    vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+    polys->SetData(offsets, connectivity);
+
+    vtkSmartPointer<vtkPolyData> soup = vtkSmartPointer<vtkPolyData>::New();
+    soup->SetPoints(points);
+    soup->SetPolys(polys);
+    return soup;
+}
+
+/**
+ * @brief Opens an STL file for one reading pass, decompressing it if needed.
+ * @return The open device, or null.
+ */
+std::unique_ptr<QIODevice> openStl(const QString& path) {
+    std::unique_ptr<QIODevice> device;
+    if (DecompressingDevice::formatOf(path) != DecompressingDevice::None)
+        device.reset(new DecompressingDevice(path));
+    else
+        device.reset(new QFile(path));
+    if (!device->open(QIODevice::ReadOnly))
+        device.reset();
+    return device;
+}
+
+/**
+ * @brief Reads a chunk back from a file being written.
+ */
+vtkSmartPointer<vtkPolyData> readChunk(QFile& file, quint64 offset, quint64 count) {
+    file.seek(static_cast<qint64>(offset));
+    QByteArray bytes = file.read(static_cast<qint64>(count) * triangleBytes);
+    if (bytes.size() != static_cast<int>(count * triangleBytes))
+        return soupToPolyData(nullptr, 0, false);
+    return soupToPolyData(reinterpret_cast<const float*>(bytes.constData()), count, false);
+}
+
+/**
+ * @brief Appends the triangles of a mesh to the end of a file as a triangle soup.
+ * @return The number of triangles written.
+ */
+quint64 appendChunk(QFile& file, vtkPolyData* mesh) {
+    file.seek(file.size());
+
+    QByteArray buffer;
+    quint64 count = 0;
+    double p[3];
+    vtkIdType npts;
+    const vtkIdType* pts;
+    auto it = vtk::TakeSmartPointer(mesh->GetPolys()->NewIterator());
+    for (it->GoToFirstCell(); !it->IsDoneWithTraversal(); it->GoToNextCell()) {
+        it->GetCurrentCell(npts, pts);
+        if (npts != 3)
+            continue;
+        float corners[9];
+        for (int k = 0; k < 3; ++k) {
+            mesh->GetPoint(pts[k], p);
+            for (int j = 0; j < 3; ++j)
+                corners[3 * k + j] = static_cast<float>(p[j]);
+        }
+        buffer.append(reinterpret_cast<const char*>(corners), sizeof(corners));
+        ++count;
+        if (buffer.size() >= (1 << 20)) {
+            file.write(buffer);
+            buffer.clear();
+        }
+    }
+    file.write(buffer);
+    return count;
+}
+
+/**
+ * @brief Grows bounds to include other bounds.
+ */
+void unionBounds(double bounds[6], const double other[6]) {
+    for (int k = 0; k < 3; ++k) {
+        bounds[2 * k] = std::min(bounds[2 * k], other[2 * k]);
+        bounds[2 * k + 1] = std::max(bounds[2 * k + 1], other[2 * k + 1]);
+    }
+}
+
+/**
+ * @brief Empty bounds that any union replaces.
+ */
+void emptyBounds(double bounds[6]) {
+    for (int k = 0; k < 3; ++k) {
+        bounds[2 * k] = std::numeric_limits<double>::max();
+        bounds[2 * k + 1] = -std::numeric_limits<double>::max();
+    }
+}
+
+} // namespace
+
+/**
+ * @brief Converts an STL file into an octree file.
+ * @param stlPath The STL file.
+ * @param octreePath The octree file to write.
+ * @param trianglesPerChunk Target size of each chunk.
+ * @return True on success.
+ */
+bool OctreeFile::convert(const QString& stlPath, const QString& octreePath, quint64 trianglesPerChunk) {
+    // Compressed input cannot seek, so each pass opens the file afresh
+    std::unique_ptr<QIODevice> input = openStl(stlPath);
+    if (!input)
+        return false;
+    trianglesPerChunk = std::max<quint64>(trianglesPerChunk, 256);
+
+    /* Pass 1: count the triangles and find the bounds */
+    float t[9];
+    quint64 count = 0;
+    double lo[3] = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+    double hi[3] = { -lo[0], -lo[1], -lo[2] };
+    {
+        StlTriangleReader reader(input.get());
+        if (!reader.readHeader())
+            return false;
+        while (reader.next(t)) {
+            for (int c = 0; c < 3; ++c) {
+                for (int k = 0; k < 3; ++k) {
+                    lo[k] = std::min(lo[k], static_cast<double>(t[3 * c + k]));
+                    hi[k] = std::max(hi[k], static_cast<double>(t[3 * c + k]));
+                }
+            }
+            ++count;
+        }
+    }
+    if (count == 0)
+        return false;
+
+    int depth = 0;
+    while (depth < maxDepth && (count >> (3 * depth)) > trianglesPerChunk)
+        ++depth;
+    const quint32 cells = 1u << depth;
+    double cellScale[3];
+    for (int k = 0; k < 3; ++k)
+        cellScale[k] = hi[k] > lo[k] ? cells / (hi[k] - lo[k]) : 0.0;
+
+    auto leafOf = [&](const float* tri) {
+        quint32 c[3];
+        for (int k = 0; k < 3; ++k) {
+            double centroid = (tri[k] + tri[3 + k] + tri[6 + k]) / 3.0;
+            c[k] = static_cast<quint32>(std::min<double>(cells - 1, std::max(0.0, (centroid - lo[k]) * cellScale[k])));
+        }
+        return mortonCode(c[0], c[1], c[2], depth);
+    };
+
+    /* Pass 2: count the triangles in each leaf cell */
+    std::vector<quint64> cellCounts(static_cast<size_t>(1) << (3 * depth), 0);
+    {
+        input = openStl(stlPath);
+        if (!input)
+            return false;
+        StlTriangleReader reader(input.get());
+        reader.readHeader();
+        while (reader.next(t))
+            ++cellCounts[leafOf(t)];
+    }
+
+    // Occupied cells in Morton order, with their first triangle slot
+    std::vector<qint32> leafIndex(cellCounts.size(), -1);
+    std::vector<quint64> leafCodes;
+    std::vector<quint64> cursor;
+    quint64 slot = 0;
+    for (size_t code = 0; code < cellCounts.size(); ++code) {
+        if (cellCounts[code] == 0)
+            continue;
+        leafIndex[code] = static_cast<qint32>(leafCodes.size());
+        leafCodes.push_back(code);
+        cursor.push_back(slot);
+        slot += cellCounts[code];
+    }
+    cellCounts.clear();
+    cellCounts.shrink_to_fit();
+
+    input.reset();
+
+    /* Pass 3: place each triangle in its leaf's slot range through a writable mapping */
+    const QString partPath = octreePath + ".part";
+    QFile output(partPath);
+    if (!output.open(QIODevice::ReadWrite | QIODevice::Truncate))
+        return false;
+    const qint64 dataStart = sizeof(Header);
+    if (!output.resize(dataStart + static_cast<qint64>(count) * triangleBytes))
+        return false;
+
+    std::vector<Node> nodes(leafCodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        Node& leaf = nodes[i];
+        emptyBounds(leaf.bounds);
+        leaf.error = 0.0;
+        leaf.offset = dataStart + cursor[i] * triangleBytes;
+        leaf.triangleCount = 0;
+        std::fill(leaf.children, leaf.children + 8, -1);
+    }
+    {
+        uchar* mapped = output.map(0, output.size());
+        if (!mapped) {
+            output.remove();
+            return false;
+        }
+
+        input = openStl(stlPath);
+        if (!input) {
+            output.unmap(mapped);
+            output.remove();
+            return false;
+        }
+        StlTriangleReader reader(input.get());
+        reader.readHeader();
+        while (reader.next(t)) {
+            const qint32 leaf = leafIndex[leafOf(t)];
+            Node& node = nodes[leaf];
+            std::memcpy(mapped + dataStart + cursor[leaf] * triangleBytes, t, triangleBytes);
+            ++cursor[leaf];
+            ++node.triangleCount;
+            for (int c = 0; c < 3; ++c) {
+                for (int k = 0; k < 3; ++k) {
+                    node.bounds[2 * k] = std::min(node.bounds[2 * k], static_cast<double>(t[3 * c + k]));
+                    node.bounds[2 * k + 1] = std::max(node.bounds[2 * k + 1], static_cast<double>(t[3 * c + k]));
+                }
+            }
+        }
+        output.unmap(mapped);
+    }
+    input.reset();
+    leafIndex.clear();
+    leafIndex.shrink_to_fit();
+
+    /* Inner levels: merge each group of siblings and simplify it back to one chunk */
+    std::vector<quint64> levelCodes = leafCodes;
+    std::vector<int> levelNodes(nodes.size());
+    for (size_t i = 0; i < levelNodes.size(); ++i)
+        levelNodes[i] = static_cast<int>(i);
+
+    for (int level = depth; level > 0; --level) {
+        std::vector<quint64> parentCodes;
+        std::vector<int> parentNodes;
+        size_t begin = 0;
+        while (begin < levelCodes.size()) {
+            const quint64 parentCode = levelCodes[begin] >> 3;
+            size_t end = begin;
+            while (end < levelCodes.size() && (levelCodes[end] >> 3) == parentCode)
+                ++end;
+
+            Node parent;
+            emptyBounds(parent.bounds);
+            parent.error = 0.0;
+            std::fill(parent.children, parent.children + 8, -1);
+
+            vtkNew<vtkAppendPolyData> append;
+            quint64 childTriangles = 0;
+            for (size_t i = begin; i < end; ++i) {
+                const Node& child = nodes[levelNodes[i]];
+                parent.children[levelCodes[i] & 7u] = levelNodes[i];
+                unionBounds(parent.bounds, child.bounds);
+                parent.error = std::max(parent.error, child.error);
+                childTriangles += child.triangleCount;
+                append->AddInputData(readChunk(output, child.offset, child.triangleCount));
+            }
+            append->Update();
+
+            // Sparse regions may already fit in one chunk, in which case nothing is lost
+            vtkSmartPointer<vtkPolyData> chunk = append->GetOutput();
+            if (childTriangles > trianglesPerChunk) {
+                double spacing = 0.0;
+                chunk = ClusterLod::simplify(chunk, lo, static_cast<vtkIdType>(trianglesPerChunk), spacing);
+                parent.error += spacing * std::sqrt(3.0);
+            }
+            parent.offset = static_cast<quint64>(output.size());
+            parent.triangleCount = appendChunk(output, chunk);
+
+            parentCodes.push_back(parentCode);
+            parentNodes.push_back(static_cast<int>(nodes.size()));
+            nodes.push_back(parent);
+            begin = end;
+        }
+        levelCodes.swap(parentCodes);
+        levelNodes.swap(parentNodes);
+    }
+
+    /* Node table, then the header last so an interrupted conversion is never valid */
+    Header header;
+    std::memcpy(header.magic, fileMagic, sizeof(header.magic));
+    header.version = fileVersion;
+    header.root = levelNodes.front();
+    header.nodeCount = static_cast<quint32>(nodes.size());
+    header.reserved = 0;
+    header.triangleCount = count;
+    header.nodeTableOffset = static_cast<quint64>((output.size() + 7) & ~qint64(7));
+
+    output.resize(static_cast<qint64>(header.nodeTableOffset));
+    output.seek(static_cast<qint64>(header.nodeTableOffset));
+    output.write(reinterpret_cast<const char*>(nodes.data()), static_cast<qint64>(nodes.size() * sizeof(Node)));
+    output.seek(0);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!output.flush() || output.error() != QFileDevice::NoError) {
+        output.remove();
+        return false;
+    }
+    output.close();
+
+    QFile::remove(octreePath);
+    return QFile::rename(partPath, octreePath);
+}
+
+/**
+ * @brief Opens and maps an octree file.
+ * @param octreePath The file to open.
+ * @return The octree, or null if the file is not valid.
+ */
+std::shared_ptr<const OctreeFile> OctreeFile::open(const QString& octreePath) {
+    std::shared_ptr<OctreeFile> octree(new OctreeFile());
+    octree->file.setFileName(octreePath);
+    if (!octree->file.open(QIODevice::ReadOnly))
+        return nullptr;
+
+    octree->size = octree->file.size();
+    if (octree->size < static_cast<qint64>(sizeof(Header)))
+        return nullptr;
+    octree->data = octree->file.map(0, octree->size);
+    if (!octree->data)
+        return nullptr;
+
+    Header header;
+    std::memcpy(&header, octree->data, sizeof(header));
+    if (std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0 || header.version != fileVersion)
+        return nullptr;
+    const quint64 tableBytes = static_cast<quint64>(header.nodeCount) * sizeof(Node);
+    if (header.nodeTableOffset + tableBytes > static_cast<quint64>(octree->size)
+        || header.root < 0 || static_cast<quint32>(header.root) >= header.nodeCount)
+        return nullptr;
+
+    octree->nodes.resize(header.nodeCount);
+    std::memcpy(octree->nodes.data(), octree->data + header.nodeTableOffset, tableBytes);
+    for (const Node& node : octree->nodes) {
+        if (node.offset + node.triangleCount * triangleBytes > static_cast<quint64>(octree->size)) {
+            qWarning() << "Corrupt octree file" << octreePath;
+            return nullptr;
+        }
+    }
+    octree->rootIndex = header.root;
+    octree->triangles = header.triangleCount;
+    return octree;
+}
+
+/**
+ * @brief Suggests the STL size above which parts are loaded out of core.
+ *
+ * vtkSTLReader needs several times the file size while merging points, so a file
+ * of a quarter of the physical memory is about the largest that loads without swapping.
+ * @return The threshold in bytes.
+ */
+qint64 OctreeFile::suggestedThreshold() {
+    qint64 memory = 0;
+#if defined(Q_OS_WIN)
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (GlobalMemoryStatusEx(&status))
+        memory = static_cast<qint64>(status.ullTotalPhys);
+#else
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGE_SIZE);
+    if (pages > 0 && pageSize > 0)
+        memory = static_cast<qint64>(pages) * pageSize;
+#endif
+    return memory > 0 ? memory / 4 : qint64(2) * 1024 * 1024 * 1024;
+}
+
+/** @brief Gets the number of nodes. */
+int OctreeFile::nodeCount() const { return static_cast<int>(nodes.size()); }
+
+/** @brief Gets the root node index. */
+int OctreeFile::root() const { return rootIndex; }
+
+/** @brief Gets a node by index. */
+const OctreeFile::Node& OctreeFile::node(int index) const { return nodes[index]; }
+
+/** @brief Gets the number of triangles in the original mesh. */
+quint64 OctreeFile::triangleCount() const { return triangles; }
+
+/**
+ * @brief Gets the bounds of the whole part.
+ * @param out Receives the bounds.
+ */
+void OctreeFile::bounds(double out[6]) const {
+    std::copy(nodes[rootIndex].bounds, nodes[rootIndex].bounds + 6, out);
+}
+
+/**
+ * @brief Estimates the memory a chunk takes while drawn.
+ * @param index Node index.
+ * @return The estimate in bytes.
+ */
+qint64 OctreeFile::chunkBytes(int index) const {
+    // Mapped floats, VTK cell offsets and connectivity, quantised positions and indices on the GPU
+    const qint64 perTriangle = triangleBytes + 4 * sizeof(vtkIdType) + 9 * sizeof(quint16) + 3 * sizeof(quint32);
+    return static_cast<qint64>(nodes[index].triangleCount) * perTriangle;
+}
+
+/**
+ * @brief Makes a chunk's geometry over the mapped file.
+ * @param index Node index.
+ * @return The chunk.
+ */
+vtkSmartPointer<vtkPolyData> OctreeFile::geometry(int index) const {
+    const Node& n = nodes[index];
+    return soupToPolyData(reinterpret_cast<const float*>(data + n.offset), n.triangleCount, true);
+}
+
+/**
+ * @brief Chooses the chunks to draw for a viewpoint within a memory budget.
+ * @param eye Viewer position in model coordinates.
+ * @param planes Six frustum planes with inward normals, or null.
+ * @param pixelsPerUnit Screen pixels per model unit at distance 1.
+ * @param maxPixelError Largest acceptable error on screen, in pixels.
+ * @param budgetBytes Largest total chunkBytes() of the selection.
+ * @param selected Receives the chosen node indices.
+ */
+void OctreeFile::select(const double eye[3], const double* planes, double pixelsPerUnit, double maxPixelError,
+                        qint64 budgetBytes, std::vector<int>& selected) const {
+    selected.clear();
+    if (nodes.empty() || !visible(rootIndex, planes))
+        return;
+
+    std::vector<char> chosen(nodes.size(), 0);
+    std::priority_queue<std::pair<double, int>> refine;
+    chosen[rootIndex] = 1;
+    qint64 used = chunkBytes(rootIndex);
+    refine.push({ screenError(rootIndex, eye, pixelsPerUnit), rootIndex });
+
+    while (!refine.empty()) {
+        const std::pair<double, int> next = refine.top();
+        refine.pop();
+        if (next.first <= maxPixelError)
+            break;
+
+        const Node& n = nodes[next.second];
+        int children[8];
+        int childCount = 0;
+        qint64 childBytes = 0;
+        for (int c : n.children) {
+            if (c >= 0 && visible(c, planes)) {
+                children[childCount++] = c;
+                childBytes += chunkBytes(c);
+            }
+        }
+        bool leaf = std::all_of(n.children, n.children + 8, [](qint32 c) { return c < 0; });
+        if (leaf || used - chunkBytes(next.second) + childBytes > budgetBytes)
+            continue;
+
+        used += childBytes - chunkBytes(next.second);
+        chosen[next.second] = 0;
+        for (int i = 0; i < childCount; ++i) {
+            chosen[children[i]] = 1;
+            refine.push({ screenError(children[i], eye, pixelsPerUnit), children[i] });
+        }
+    }
+
+    for (size_t i = 0; i < chosen.size(); ++i) {
+        if (chosen[i])
+            selected.push_back(static_cast<int>(i));
+    }
+}
+
+/**
+ * @brief Checks a node's bounds against the frustum planes.
+ * @param index Node index.
+ * @param planes Six planes with inward normals, or null.
+ * @return False only if the bounds are entirely outside one plane.
+ */
+bool OctreeFile::visible(int index, const double* planes) const {
+    if (!planes)
+        return true;
+
+    const double* b = nodes[index].bounds;
+    for (int p = 0; p < 6; ++p) {
+        const double* plane = planes + 4 * p;
+        // The corner furthest along the plane normal decides
+        double x = plane[0] >= 0.0 ? b[1] : b[0];
+        double y = plane[1] >= 0.0 ? b[3] : b[2];
+        double z = plane[2] >= 0.0 ? b[5] : b[4];
+        if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < 0.0)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Projects a node's error to the screen from the eye.
+ * @param index Node index.
+ * @param eye Viewer position in model coordinates.
+ * @param pixelsPerUnit Screen pixels per model unit at distance 1.
+ * @return The error in pixels; infinite if the eye is inside the node's bounds.
+ */
+double OctreeFile::screenError(int index, const double eye[3], double pixelsPerUnit) const {
+    const Node& n = nodes[index];
+    double d2 = 0.0;
+    for (int k = 0; k < 3; ++k) {
+        double d = std::max({ n.bounds[2 * k] - eye[k], 0.0, eye[k] - n.bounds[2 * k + 1] });
+        d2 += d * d;
+    }
+    if (d2 <= 0.0)
+        return n.error > 0.0 ? std::numeric_limits<double>::infinity() : 0.0;
+    return n.error * pixelsPerUnit / std::sqrt(d2);
+}
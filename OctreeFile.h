@@ -0,0 +1,157 @@
+/**
+ * @file OctreeFile.h
+ * @brief Declaration of the OctreeFile class.
+ *
+ * An octree file holds one part as an octree of mesh chunks: the leaves hold the
+ * original triangles of one cell each and every inner node holds its children
+ * merged and simplified to about one chunk's size. The file is memory mapped, and
+ * a chunk's geometry points straight into the mapping, so only the chunks being
+ * drawn are ever read from disk. This lets parts larger than RAM be viewed.
+ *
+ * File layout (native byte order; the file is a local cache, not an exchange format):
+ * a Header, the triangle data of all chunks as nine floats per triangle, and the
+ * node table at Header::nodeTableOffset.
+ */
+#ifndef OCTREE_FILE_H
+#define OCTREE_FILE_H
+
+#include <QtGlobal>
+#include <QFile>
+#include <QString>
+
+#include <memory>
+#include <vector>
+
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+
+/**
+ * @brief Read-only, memory-mapped octree of mesh chunks.
+ *
+ * Once opened it is never modified, so render threads share it without locking.
+ */
+class OctreeFile {
+public:
+    /**
+     * @brief One node of the octree as stored in the file.
+     */
+    struct Node {
+        double bounds[6];       /**< Bounds of the node's triangles and all its descendants' */
+        double error;           /**< Largest distance from the original surface, in model units */
+        quint64 offset;         /**< File offset of the chunk's triangles */
+        quint64 triangleCount;  /**< Number of triangles in the chunk */
+        qint32 children[8];     /**< Child node indices, or -1 */
+    };
+
+    /**
+     * @brief Converts an STL file into an octree file.
+     *
+     * The STL is streamed three times (bounds, cell counts, placement) and never
+     * held in memory; the triangles are placed in the output through a writable
+     * mapping. The output is written under a temporary name and renamed when complete.
+     * @param stlPath The STL file to convert.
+     * @param octreePath The octree file to write.
+     * @param trianglesPerChunk Target size of each chunk.
+     * @return True on success.
+     */
+    static bool convert(const QString& stlPath, const QString& octreePath, quint64 trianglesPerChunk = 65536);
+
+    /**
+     * @brief Opens and maps an octree file.
+     * @param octreePath The file to open.
+     * @return The octree, or null if the file is missing or not a valid octree file.
+     */
+    static std::shared_ptr<const OctreeFile> open(const QString& octreePath);
+
+    /**
+     * @brief Suggests the STL file size above which parts should be loaded out of core.
+     * @return A quarter of the physical memory, or 2 GiB if that cannot be determined.
+     */
+    static qint64 suggestedThreshold();
+
+    /**
+     * @brief Returns the number of nodes.
+     * @return The node count.
+     */
+    int nodeCount() const;
+
+    /**
+     * @brief Returns the root node index.
+     * @return The index of the node covering the whole part.
+     */
+    int root() const;
+
+    /**
+     * @brief Returns a node.
+     * @param index Node index.
+     * @return The node.
+     */
+    const Node& node(int index) const;
+
+    /**
+     * @brief Returns the total number of triangles in the original mesh.
+     * @return The number of leaf triangles.
+     */
+    quint64 triangleCount() const;
+
+    /**
+     * @brief Gets the bounds of the whole part.
+     * @param bounds Receives xmin, xmax, ymin, ymax, zmin, zmax.
+     */
+    void bounds(double bounds[6]) const;
+
+    /**
+     * @brief Returns the memory a chunk takes once it is being drawn.
+     *
+     * Counts the mapped triangle data, the connectivity VTK needs on the CPU and the
+     * quantised buffers on the GPU.
+     * @param index Node index.
+     * @return The estimate in bytes.
+     */
+    qint64 chunkBytes(int index) const;
+
+    /**
+     * @brief Makes a chunk's geometry; its points are read from the mapping as they are used.
+     * @param index Node index.
+     * @return The chunk as a triangle soup.
+     */
+    vtkSmartPointer<vtkPolyData> geometry(int index) const;
+
+    /**
+     * @brief Chooses the chunks to draw for a viewpoint within a memory budget.
+     *
+     * Starting from the root, the chunk with the largest error on screen is replaced
+     * by its visible children until every chunk is below @p maxPixelError or the next
+     * refinement would exceed @p budgetBytes.
+     * @param eye Viewer position in the part's model coordinates.
+     * @param planes Six view frustum planes (a, b, c, d) with inward normals, or null to skip culling.
+     * @param pixelsPerUnit Screen pixels covered by one model unit at distance 1.
+     * @param maxPixelError Largest acceptable error on screen, in pixels.
+     * @param budgetBytes Largest total chunkBytes() of the selection.
+     * @param selected Receives the chosen node indices.
+     */
+    void select(const double eye[3], const double* planes, double pixelsPerUnit, double maxPixelError,
+                qint64 budgetBytes, std::vector<int>& selected) const;
+
+private:
+    OctreeFile() = default;
+
+    /**
+     * @brief Checks whether a node's bounds are at least partly inside the frustum.
+     */
+    bool visible(int index, const double* planes) const;
+
+    /**
+     * @brief Returns a node's error in pixels as seen from the eye; infinite inside its bounds.
+     */
+    double screenError(int index, const double eye[3], double pixelsPerUnit) const;
+
+    mutable QFile file;         /**< The open file; keeps the mapping alive */
+    const uchar* data = nullptr; /**< Start of the mapping */
+    qint64 size = 0;            /**< Length of the mapping */
+    std::vector<Node> nodes;    /**< Copy of the node table */
+    int rootIndex = -1;         /**< Index of the root node */
+    quint64 triangles = 0;      /**< Triangles in the original mesh */
+};
+
+#endif // OCTREE_FILE_H
@@ -0,0 +1,136 @@
+/**
+ * @file OutOfCoreStage.cpp
+ * @brief Implementation of the OutOfCoreStage class.
+ */
+
+#include "OutOfCoreStage.h"
+#include "GeometryCache.h"
+#include "OctreeFile.h"
+#include "TeamCache.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+
+/**
+ * @brief Constructs the stage.
+ * @param directory Directory for the octree files; defaults to the user cache location.
+ * @param parent The parent QObject.
+ */
+OutOfCoreStage::OutOfCoreStage(const QString& directory, QObject* parent)
+    : QObject(parent), m_directory(directory) {
+    if (m_directory.isEmpty())
+        m_directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/octrees";
+    QDir().mkpath(m_directory);
+    QDir().mkpath(m_directory + "/stamps");
+}
+
+/**
+ * @brief Returns the octree file path for a content hash.
+ * @param hash Content hash of the STL file.
+ * @return The path.
+ */
+QString OutOfCoreStage::filePath(const QByteArray& hash) const {
+    return m_directory + '/' + QString::fromLatin1(hash) + ".oct";
+}
+
+/**
+ * @brief Returns the content hash of an STL file.
+ *
+ * Hashing a file too large to load takes minutes, so the hash is stored in a stamp
+ * file named after the file's path, size and modification time, and read back from
+ * there while the file is unchanged.
+ * @param stampDirectory Directory holding the stamp files.
+ * @param stlPath The STL file.
+ * @return The hash, or an empty array if the file cannot be read.
+ */
+QByteArray OutOfCoreStage::contentHash(const QString& stampDirectory, const QString& stlPath) {
+    const QFileInfo info(stlPath);
+    const QByteArray stamp = info.absoluteFilePath().toUtf8() + '\n' + QByteArray::number(info.size())
+                           + '\n' + QByteArray::number(info.lastModified().toMSecsSinceEpoch());
+    const QString stampPath = stampDirectory + '/'
+                            + QString::fromLatin1(QCryptographicHash::hash(stamp, QCryptographicHash::Sha1).toHex());
+
+    QFile stampFile(stampPath);
+    if (stampFile.open(QIODevice::ReadOnly)) {
+        const QByteArray hash = stampFile.readAll().trimmed();
+        if (!hash.isEmpty())
+            return hash;
+    }
+
+    const QByteArray hash = GeometryCache::contentHash(stlPath);
+    if (!hash.isEmpty()) {
+        QSaveFile out(stampPath);
+        if (out.open(QIODevice::WriteOnly) && out.write(hash) == hash.size())
+            out.commit();
+    }
+    return hash;
+}
+
+/**
+ * @brief Makes the octree of an STL file available.
+ *
+ * Returns immediately; octreeReady() is emitted once the cached file is open,
+ * after hashing the STL and converting it first if needed.
+ * @param stlPath The STL file.
+ */
+void OutOfCoreStage::submit(const QString& stlPath) {
+    if (m_running.contains(stlPath))
+        return;
+
+    m_running.insert(stlPath);
+    TeamCache* cache = m_teamCache;
+    QtConcurrent::run(QThreadPool::globalInstance(), [this, stlPath, cache]() {
+        // Only reads the file when its stamp is missing or out of date
+        const QByteArray hash = contentHash(m_directory + "/stamps", stlPath);
+        const QString path = filePath(hash);
+
+        // Octrees are used from local disk, so a team cache entry is copied here first
+        std::shared_ptr<const OctreeFile> octree;
+        if (!hash.isEmpty()) {
+            octree = OctreeFile::open(path);
+            if (!octree && cache && cache->fetch(hash, "oct", path))
+                octree = OctreeFile::open(path);
+            if (!octree && OctreeFile::convert(stlPath, path)) {
+                octree = OctreeFile::open(path);
+                if (octree && cache)
+                    cache->publishFile(hash, "oct", path);
+            }
+        }
+
+        QMetaObject::invokeMethod(this, [this, hash, stlPath, octree]() {
+            m_running.remove(stlPath);
+            if (!octree) {
+                emit conversionFailed(stlPath);
+                return;
+            }
+            // Files with the same contents share the octree opened first
+            if (!m_octrees.contains(hash))
+                m_octrees.insert(hash, octree);
+            emit octreeReady(stlPath, hash);
+        }, Qt::QueuedConnection);
+    });
+}
+
+/**
+ * @brief Sets the team cache octree files are fetched from and published to.
+ * @param cache The cache, or null.
+ */
+void OutOfCoreStage::setTeamCache(TeamCache* cache) {
+    m_teamCache = cache;
+}
+
+/**
+ * @brief Returns the opened octree for a content hash.
+ * @param hash Content hash of the STL file.
+ * @return The octree, or null.
+ */
+std::shared_ptr<const OctreeFile> OutOfCoreStage::octree(const QByteArray& hash) const {
+    return m_octrees.value(hash);
+}
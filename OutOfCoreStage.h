@@ -0,0 +1,90 @@
+/**
+ * @file OutOfCoreStage.h
+ * @brief Declaration of the OutOfCoreStage class.
+ *
+ * Parts whose STL is too large to load are converted once, on the global Qt thread
+ * pool, into an OctreeFile in a persistent cache directory keyed by content hash.
+ * The content hash itself is computed on the pool too, since it reads the whole
+ * file, and is remembered by path, size and modification time so later sessions
+ * open the cached octree straight away.
+ */
+#ifndef OUT_OF_CORE_STAGE_H
+#define OUT_OF_CORE_STAGE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+#include <QString>
+
+#include <memory>
+
+class OctreeFile;
+class TeamCache;
+
+/**
+ * @brief Converts and opens octree files for out-of-core parts in the background.
+ */
+class OutOfCoreStage : public QObject {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructs the stage.
+     * @param directory Directory for the octree files; a default location is used if empty.
+     * @param parent The parent QObject.
+     */
+    explicit OutOfCoreStage(const QString& directory = QString(), QObject* parent = nullptr);
+
+    /**
+     * @brief Makes the octree of an STL file available, converting it if it is not cached.
+     * @param stlPath The STL file; its content hash is computed in the background.
+     */
+    void submit(const QString& stlPath);
+
+    /**
+     * @brief Returns the opened octree for a content hash.
+     * @param hash Content hash of the STL file.
+     * @return The octree, or null if it is not ready.
+     */
+    std::shared_ptr<const OctreeFile> octree(const QByteArray& hash) const;
+
+    /**
+     * @brief Fetches octree files from, and publishes them to, a team cache directory.
+     * @param cache The cache, or nullptr (the default) for none; it must outlive the stage.
+     */
+    void setTeamCache(TeamCache* cache);
+
+signals:
+    /**
+     * @brief Emitted on the GUI thread when an octree has been opened.
+     * @param stlPath The STL file as submitted.
+     * @param hash Content hash of the STL file.
+     */
+    void octreeReady(const QString& stlPath, const QByteArray& hash);
+
+    /**
+     * @brief Emitted on the GUI thread when a conversion failed.
+     * @param stlPath The STL file as submitted.
+     */
+    void conversionFailed(const QString& stlPath);
+
+private:
+    /**
+     * @brief Returns the path of the octree file for a content hash.
+     */
+    QString filePath(const QByteArray& hash) const;
+
+    /**
+     * @brief Returns the content hash of an STL file, reusing the one remembered for it if unchanged.
+     * Reads the whole file the first time, so it is only called on the thread pool.
+     */
+    static QByteArray contentHash(const QString& stampDirectory, const QString& stlPath);
+
+    QString m_directory;                                            /**< Directory holding the octree files */
+    TeamCache* m_teamCache = nullptr;                               /**< Shared cache of octree files, or null */
+    QHash<QByteArray, std::shared_ptr<const OctreeFile>> m_octrees; /**< Opened octrees (GUI thread only) */
+    QSet<QString> m_running;                                        /**< STL files with a task in flight (GUI thread only) */
+};
+
+#endif // OUT_OF_CORE_STAGE_H
@@ -0,0 +1,246 @@
+/**
+ * @file PackedMesh.cpp
+ * @brief Implementation of the PackedMesh class.
+ *
+ * Layout: a 32-byte header (magic "STLMESH\0", version, reserved word, point
+ * count, triangle count), then 3 floats per point, triangleCount + 1 offsets and
+ * 3 connectivity entries per triangle, all little-endian as on every platform the
+ * viewer runs on.
+ */
+
+#include "PackedMesh.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <vtkCellArray.h>
+#include <vtkCellArrayIterator.h>
+#include <vtkFloatArray.h>
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <vtkTypeInt32Array.h>
+
+#include <atomic>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+const char meshMagic[8] = { 'S', 'T', 'L', 'M', 'E', 'S', 'H', '\0' };
+const quint32 meshVersion = 1;
+
+/**
+ * @brief Header at the start of a packed mesh.
+ */
+struct Header {
+    char magic[8];
+    quint32 version;
+    quint32 reserved;
+    quint64 pointCount;
+    quint64 triangleCount;
+};
+
+/**
+ * @brief Byte size of a packed mesh with the given counts.
+ */
+qint64 sizeFor(quint64 points, quint64 triangles) {
+    return static_cast<qint64>(sizeof(Header) + points * 3 * sizeof(float)
+                               + (triangles + 1) * sizeof(qint32) + triangles * 3 * sizeof(qint32));
+}
+
+/**
+ * @brief Owners of borrowed blocks, by the address of each array borrowing them.
+ *
+ * VTK frees an array through a plain function pointer with no context, so the
+ * owner is looked up by address when an array is released. A block viewed twice
+ * has two entries at each address.
+ */
+QMutex borrowMutex;
+QMultiHash<const void*, std::shared_ptr<const void>> borrowed;
+
+/**
+ * @brief Free function for borrowed arrays: drops one reference to the block's owner.
+ */
+void releaseBorrowed(void* array) {
+    std::shared_ptr<const void> owner;
+    {
+        QMutexLocker locker(&borrowMutex);
+        auto it = borrowed.find(array);
+        if (it == borrowed.end())
+            return;
+        owner = it.value();
+        borrowed.erase(it);
+    }
+    // owner is released here, outside the lock, as it may detach a segment
+}
+
+/**
+ * @brief Points a VTK array at borrowed memory.
+ */
+template <typename Array, typename Value>
+void borrow(Array* array, const Value* data, vtkIdType values, const std::shared_ptr<const void>& owner) {
+    {
+        QMutexLocker locker(&borrowMutex);
+        borrowed.insert(data, owner);
+    }
+    array->SetArray(const_cast<Value*>(data), values, 0, Array::VTK_DATA_ARRAY_USER_DEFINED);
+    array->SetArrayFreeFunction(releaseBorrowed);
+}
+
+} // namespace
+
+/**
+ * @brief Computes the packed size of a mesh.
+ * @param mesh The mesh.
+ * @return The size in bytes, or -1 if too large.
+ */
+qint64 PackedMesh::packedSize(vtkPolyData* mesh) {
+    const quint64 points = static_cast<quint64>(mesh->GetNumberOfPoints());
+    const quint64 triangles = static_cast<quint64>(mesh->GetNumberOfPolys());
+    if (3 * triangles >= static_cast<quint64>(std::numeric_limits<qint32>::max())
+        || points >= static_cast<quint64>(std::numeric_limits<qint32>::max()))
+        return -1;
+    return sizeFor(points, triangles);
+}
+
+/**
+ * @brief Writes a mesh into memory in the packed layout.
+ * @param mesh The mesh.
+ * @param destination At least packedSize() bytes.
+ * @return True on success.
+ */
+bool PackedMesh::pack(vtkPolyData* mesh, uchar* destination) {
+    if (packedSize(mesh) < 0)
+        return false;
+
+    const vtkIdType points = mesh->GetNumberOfPoints();
+    float* coords = reinterpret_cast<float*>(destination + sizeof(Header));
+    for (vtkIdType i = 0; i < points; ++i) {
+        double p[3];
+        mesh->GetPoint(i, p);
+        for (int k = 0; k < 3; ++k)
+            coords[3 * i + k] = static_cast<float>(p[k]);
+    }
+
+    qint32* offsets = reinterpret_cast<qint32*>(coords + 3 * points);
+    qint32* connectivity = offsets + mesh->GetNumberOfPolys() + 1;
+    quint64 triangles = 0;
+    offsets[0] = 0;
+    auto cells = vtk::TakeSmartPointer(mesh->GetPolys()->NewIterator());
+    for (cells->GoToFirstCell(); !cells->IsDoneWithTraversal(); cells->GoToNextCell()) {
+        vtkIdType count;
+        const vtkIdType* ids;
+        cells->GetCurrentCell(count, ids);
+        if (count != 3)
+            continue;
+        for (int c = 0; c < 3; ++c)
+            connectivity[3 * triangles + c] = static_cast<qint32>(ids[c]);
+        ++triangles;
+        offsets[triangles] = static_cast<qint32>(3 * triangles);
+    }
+    // Non-triangle cells were skipped; close the gap so the blocks stay contiguous
+    if (triangles < static_cast<quint64>(mesh->GetNumberOfPolys()))
+        std::memmove(offsets + triangles + 1, connectivity, 3 * triangles * sizeof(qint32));
+
+    Header header;
+    std::memcpy(header.magic, meshMagic, sizeof(meshMagic));
+    header.version = meshVersion;
+    header.reserved = 0;
+    header.pointCount = static_cast<quint64>(points);
+    header.triangleCount = triangles;
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(destination, &header, sizeof(header));
+    return true;
+}
+
+/**
+ * @brief Packs a mesh into a new byte array.
+ * @param mesh The mesh.
+ * @return The block, or an empty array.
+ */
+QByteArray PackedMesh::pack(vtkPolyData* mesh) {
+    const qint64 size = packedSize(mesh);
+    if (size < 0 || size > std::numeric_limits<int>::max())
+        return QByteArray();
+    QByteArray block(static_cast<int>(size), Qt::Uninitialized);
+    if (!pack(mesh, reinterpret_cast<uchar*>(block.data())))
+        return QByteArray();
+    Header header;
+    std::memcpy(&header, block.constData(), sizeof(header));
+    block.truncate(static_cast<int>(sizeFor(header.pointCount, header.triangleCount)));
+    return block;
+}
+
+/**
+ * @brief Checks a packed block.
+ * @param data The block.
+ * @param size Its size.
+ * @return True if it is complete.
+ */
+bool PackedMesh::isValid(const uchar* data, qint64 size) {
+    if (!data || size < static_cast<qint64>(sizeof(Header)))
+        return false;
+    Header header;
+    std::memcpy(&header, data, sizeof(header));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return std::memcmp(header.magic, meshMagic, sizeof(meshMagic)) == 0
+        && header.version == meshVersion
+        && header.pointCount < static_cast<quint64>(std::numeric_limits<qint32>::max())
+        && header.triangleCount < static_cast<quint64>(std::numeric_limits<qint32>::max() / 3)
+        && sizeFor(header.pointCount, header.triangleCount) <= size;
+}
+
+/**
+ * @brief Makes a mesh borrowing a packed block.
+ *
+ * Blocks may come from a team cache written by other machines, so the cells are
+ * checked once here as well as the header: every offset must be three times its
+ * index, and every point id must name a point of the block. Renderers index with
+ * them unchecked, so a truncated or corrupt block must never get that far.
+ * @param data The block.
+ * @param size Its size.
+ * @param owner Keeps the block alive while the arrays exist.
+ * @return The mesh, or null.
+ */
+vtkSmartPointer<vtkPolyData> PackedMesh::view(const uchar* data, qint64 size, std::shared_ptr<const void> owner) {
+    if (!isValid(data, size))
+        return nullptr;
+
+    Header header;
+    std::memcpy(&header, data, sizeof(header));
+    const vtkIdType points = static_cast<vtkIdType>(header.pointCount);
+    const vtkIdType triangles = static_cast<vtkIdType>(header.triangleCount);
+    const float* coords = reinterpret_cast<const float*>(data + sizeof(Header));
+    const qint32* offsetData = reinterpret_cast<const qint32*>(coords + 3 * points);
+    const qint32* connectivityData = offsetData + triangles + 1;
+
+    for (vtkIdType i = 0; i <= triangles; ++i) {
+        if (offsetData[i] != 3 * i)
+            return nullptr;
+    }
+    for (vtkIdType i = 0; i < 3 * triangles; ++i) {
+        if (connectivityData[i] < 0 || connectivityData[i] >= points)
+            return nullptr;
+    }
+
+    vtkNew<vtkFloatArray> coordArray;
+    coordArray->SetNumberOfComponents(3);
+    vtkNew<vtkTypeInt32Array> offsets;
+    vtkNew<vtkTypeInt32Array> connectivity;
+    if (points > 0)
+        borrow(coordArray.GetPointer(), coords, 3 * points, owner);
+    borrow(offsets.GetPointer(), offsetData, triangles + 1, owner);
+    if (triangles > 0)
+        borrow(connectivity.GetPointer(), connectivityData, 3 * triangles, owner);
+
+    vtkSmartPointer<vtkPoints> pointSet = vtkSmartPointer<vtkPoints>::New();
+    pointSet->SetData(coordArray);
+    vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+    polys->SetData(offsets, connectivity);
+
+    vtkSmartPointer<vtkPolyData> mesh = vtkSmartPointer<vtkPolyData>::New();
+    mesh->SetPoints(pointSet);
+    mesh->SetPolys(polys);
+    return mesh;
+}
@@ -0,0 +1,74 @@
+/**
+ * @file PackedMesh.h
+ * @brief Declaration of the PackedMesh class.
+ *
+ * A packed mesh is a welded triangle mesh laid out as one flat block of memory:
+ * a header, the points as floats and the triangle cells as 32-bit offsets and
+ * connectivity. The block can be written to shared memory or a file and later
+ * turned back into a vtkPolyData whose arrays point straight into it, so a mesh
+ * can be used by several processes, or loaded from disk, without a copy.
+ */
+#ifndef PACKED_MESH_H
+#define PACKED_MESH_H
+
+#include <QByteArray>
+#include <QtGlobal>
+
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+
+#include <memory>
+
+/**
+ * @brief Converts triangle meshes to and from the packed layout.
+ */
+class PackedMesh {
+public:
+    /**
+     * @brief Returns the size of a mesh in the packed layout.
+     * @param mesh A triangle mesh.
+     * @return The size in bytes, or -1 if the mesh is too large to pack.
+     */
+    static qint64 packedSize(vtkPolyData* mesh);
+
+    /**
+     * @brief Writes a mesh in the packed layout.
+     *
+     * Only triangles are kept. The header is written last, so a reader that checks
+     * it never accepts a block that is still being written.
+     * @param mesh A triangle mesh.
+     * @param destination Memory of at least packedSize() bytes.
+     * @return False if the mesh is too large to pack.
+     */
+    static bool pack(vtkPolyData* mesh, uchar* destination);
+
+    /**
+     * @brief Returns a mesh in the packed layout.
+     * @param mesh A triangle mesh.
+     * @return The packed block, or an empty array if the mesh is too large to pack.
+     */
+    static QByteArray pack(vtkPolyData* mesh);
+
+    /**
+     * @brief Checks that a block holds a complete packed mesh.
+     * @param data The block.
+     * @param size Its size in bytes.
+     * @return True if the header is valid and the block is large enough.
+     */
+    static bool isValid(const uchar* data, qint64 size);
+
+    /**
+     * @brief Makes a mesh whose arrays borrow a packed block instead of copying it.
+     *
+     * The mesh must not be modified. @p owner is kept alive until every borrowed
+     * array has been released, however long other code holds on to them. Unlike
+     * isValid(), this also checks every cell, in one pass over the block.
+     * @param data The block.
+     * @param size Its size in bytes.
+     * @param owner Whatever keeps the block mapped, such as a shared memory segment.
+     * @return The mesh, or null if the block or any of its cells is not valid.
+     */
+    static vtkSmartPointer<vtkPolyData> view(const uchar* data, qint64 size, std::shared_ptr<const void> owner);
+};
+
+#endif // PACKED_MESH_H
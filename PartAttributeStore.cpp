@@ -0,0 +1,174 @@
+/**
+ * @file PartAttributeStore.cpp
+ * @brief Implementation of the PartAttributeStore class.
+ *
+ * Colour mapping works on plain float arrays with no per-part branching, so the
+ * normalisation and table lookup loops can be vectorised by the compiler.
+ */
+
+#include "PartAttributeStore.h"
+#include "ModelPart.h"
+
+#include <QtGlobal>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const int colourTableSize = 256;    /**< Number of entries in the colour table */
+
+/**
+ * @brief A colour table stored as separate red, green and blue arrays.
+ */
+struct ColourTable {
+    float red[colourTableSize];
+    float green[colourTableSize];
+    float blue[colourTableSize];
+};
+
+/**
+ * @brief Returns a viridis-style colour table built from a few control points.
+ * @return The shared colour table.
+ */
+const ColourTable& viridisTable() {
+    static const ColourTable table = [] {
+        const float stops[5][3] = {
+            { 0.267f, 0.005f, 0.329f },
+            { 0.229f, 0.322f, 0.546f },
+            { 0.128f, 0.567f, 0.551f },
+            { 0.369f, 0.789f, 0.383f },
+            { 0.993f, 0.906f, 0.144f }
+        };
+        ColourTable t;
+        for (int i = 0; i < colourTableSize; ++i) {
+            float x = 4.0f * i / (colourTableSize - 1);
+            int k = std::min(3, static_cast<int>(x));
+            float f = x - k;
+            t.red[i]   = stops[k][0] + f * (stops[k + 1][0] - stops[k][0]);
+            t.green[i] = stops[k][1] + f * (stops[k + 1][1] - stops[k][1]);
+            t.blue[i]  = stops[k][2] + f * (stops[k + 1][2] - stops[k][2]);
+        }
+        return t;
+    }();
+    return table;
+}
+
+/**
+ * @brief Returns whether an attribute is better shown on a log scale.
+ * @param attribute The attribute.
+ * @return True for attributes that commonly span several orders of magnitude.
+ */
+bool isLogScaled(PartAttributeStore::Attribute attribute) {
+    return attribute == PartAttributeStore::TriangleCount
+        || attribute == PartAttributeStore::BoundingVolume
+        || attribute == PartAttributeStore::FileSize;
+}
+
+} // namespace
+
+/**
+ * @brief Returns a user-facing name for an attribute.
+ * @param attribute The attribute.
+ * @return The display name.
+ */
+QString PartAttributeStore::attributeName(Attribute attribute) {
+    switch (attribute) {
+    case TriangleCount:  return QStringLiteral("Triangle Count");
+    case BoundingVolume: return QStringLiteral("Bounding Volume");
+    case FolderDepth:    return QStringLiteral("Folder Depth");
+    case FileSize:       return QStringLiteral("File Size");
+    case LoadTime:       return QStringLiteral("Load Time");
+    default:             return QString();
+    }
+}
+
+/**
+ * @brief Rebuilds the store from the part tree.
+ * @param root The root of the part tree.
+ */
+void PartAttributeStore::rebuild(ModelPart* root) {
+    clear();
+    if (!root)
+        return;
+    for (int i = 0; i < root->childCount(); ++i)
+        collect(root->child(i));
+}
+
+/**
+ * @brief Removes all parts from the store.
+ */
+void PartAttributeStore::clear() {
+    m_parts.clear();
+    for (QVector<float>& column : m_columns)
+        column.clear();
+}
+
+/**
+ * @brief Returns the parts in store order.
+ * @return The parts.
+ */
+const QVector<ModelPart*>& PartAttributeStore::parts() const {
+    return m_parts;
+}
+
+/**
+ * @brief Collects parts and attribute values recursively.
+ * Folder items without geometry are skipped; their children are still visited.
+ * @param part The part to visit.
+ */
+void PartAttributeStore::collect(ModelPart* part) {
+    if (part->getActor()) {
+        m_parts.append(part);
+        m_columns[TriangleCount].append(static_cast<float>(part->triangleCount()));
+        m_columns[BoundingVolume].append(static_cast<float>(part->boundingVolume()));
+        m_columns[FolderDepth].append(static_cast<float>(part->depth()));
+        m_columns[FileSize].append(static_cast<float>(part->fileSize()));
+        m_columns[LoadTime].append(static_cast<float>(part->loadTime()));
+    }
+
+    for (int i = 0; i < part->childCount(); ++i)
+        collect(part->child(i));
+}
+
+/**
+ * @brief Maps an attribute through the colour table for every part.
+ * @param attribute The attribute to colour by.
+ * @param red Output red components.
+ * @param green Output green components.
+ * @param blue Output blue components.
+ */
+void PartAttributeStore::mapToColours(Attribute attribute, QVector<float>& red, QVector<float>& green, QVector<float>& blue) const {
+    const int n = m_parts.size();
+    red.resize(n);
+    green.resize(n);
+    blue.resize(n);
+    if (n == 0 || attribute < 0 || attribute >= AttributeCount)
+        return;
+
+    // Pass 1: optional log transform into the red array, used as scratch space
+    const float* values = m_columns[attribute].constData();
+    float* t = red.data();
+    if (isLogScaled(attribute)) {
+        for (int i = 0; i < n; ++i)
+            t[i] = std::log1p(std::max(values[i], 0.0f));
+    }
+    else {
+        std::copy(values, values + n, t);
+    }
+
+    auto range = std::minmax_element(t, t + n);
+    const float lo = *range.first;
+    const float scale = (*range.second > lo) ? (colourTableSize - 1) / (*range.second - lo) : 0.0f;
+
+    // Pass 2: normalise and look up the colour table
+    const ColourTable& table = viridisTable();
+    float* g = green.data();
+    float* b = blue.data();
+    for (int i = 0; i < n; ++i) {
+        int k = static_cast<int>((t[i] - lo) * scale + 0.5f);
+        k = qBound(0, k, colourTableSize - 1);
+        t[i] = table.red[k];
+        g[i] = table.green[k];
+        b[i] = table.blue[k];
+    }
+}
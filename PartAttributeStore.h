@@ -0,0 +1,83 @@
+/**
+ * @file PartAttributeStore.h
+ * @brief Declaration of the PartAttributeStore class.
+ *
+ * The store keeps per-part numeric attributes (triangle count, bounding volume,
+ * folder depth, file size, load time) in contiguous columns, one entry per loaded
+ * part, so that an attribute can be mapped to colours in a single pass.
+ */
+#ifndef PART_ATTRIBUTE_STORE_H
+#define PART_ATTRIBUTE_STORE_H
+
+#include <QVector>
+#include <QString>
+
+class ModelPart;
+
+/**
+ * @brief Column-oriented store of per-part attributes used by the "colour by" modes.
+ */
+class PartAttributeStore {
+public:
+    /**
+     * @brief Attributes that parts can be coloured by.
+     */
+    enum Attribute {
+        TriangleCount,      /**< Number of triangles in the part */
+        BoundingVolume,     /**< Volume of the part's bounding box */
+        FolderDepth,        /**< Depth of the part in the folder tree */
+        FileSize,           /**< Size of the STL file on disk */
+        LoadTime,           /**< Time taken to read the STL */
+        AttributeCount      /**< Number of attributes, not an attribute itself */
+    };
+
+    /**
+     * @brief Returns a user-facing name for an attribute.
+     * @param attribute The attribute.
+     * @return The display name.
+     */
+    static QString attributeName(Attribute attribute);
+
+    /**
+     * @brief Rebuilds the store from every part under @p root that has an actor.
+     * @param root The root of the part tree.
+     */
+    void rebuild(ModelPart* root);
+
+    /**
+     * @brief Removes all parts from the store.
+     */
+    void clear();
+
+    /**
+     * @brief Returns the parts in store order.
+     * @return The parts; entry i of every column belongs to parts()[i].
+     */
+    const QVector<ModelPart*>& parts() const;
+
+    /**
+     * @brief Maps an attribute through a colour map for every part in one pass.
+     *
+     * Values are normalised to the attribute's range over all parts (on a log scale
+     * for attributes that span orders of magnitude) and looked up in a 256-entry
+     * colour table. Results are written as separate red, green and blue arrays.
+     *
+     * @param attribute The attribute to colour by.
+     * @param red Output red components (0-1), resized to the number of parts.
+     * @param green Output green components (0-1), resized to the number of parts.
+     * @param blue Output blue components (0-1), resized to the number of parts.
+     */
+    void mapToColours(Attribute attribute, QVector<float>& red, QVector<float>& green, QVector<float>& blue) const;
+
+private:
+    /**
+     * @brief Collects parts and attribute values recursively.
+     * @param part The part to visit.
+     */
+    void collect(ModelPart* part);
+
+    QVector<ModelPart*> m_parts;                /**< Parts in store order */
+    QVector<float> m_columns[AttributeCount];   /**< One contiguous column per attribute */
+};
+
+#endif // PART_ATTRIBUTE_STORE_H
@@ -0,0 +1,170 @@
+/**
+ * @file PartEditCommand.cpp
+ * @brief Implementation of the PartEditCommand undo/redo command.
+ *
+ * Deltas are applied part by part without any rendering; the scene update callback
+ * supplied by MainWindow is then called once for the whole command.
+ */
+
+#include "PartEditCommand.h"
+#include "ModelPart.h"
+
+#include <algorithm>
+
+/**
+ * @brief Constructs a command from a set of deltas.
+ * @param text The text shown for the entry in undo/redo menus.
+ * @param deltas Per-part attribute deltas.
+ * @param update Scene update callback.
+ * @param mergeSession Merge session id, or -1 if the command should never merge.
+ */
+PartEditCommand::PartEditCommand(const QString& text, const QVector<PartDelta>& deltas,
+                                 const SceneUpdate& update, int mergeSession)
+    : m_deltas(deltas), m_update(update), m_mergeSession(mergeSession) {
+    setText(text);
+}
+
+/** @brief Applies the "after" values of every delta. */
+void PartEditCommand::redo() {
+    apply(true);
+}
+
+/** @brief Applies the "before" values of every delta. */
+void PartEditCommand::undo() {
+    apply(false);
+}
+
+/**
+ * @brief Applies one side of every delta and notifies the scene once.
+ *
+ * Attributes that already hold the target value are skipped, so pushing a command
+ * for an edit that was previewed live does not trigger another render.
+ * @param after True to apply the "after" values, false for the "before" values.
+ */
+void PartEditCommand::apply(bool after) {
+    QVector<ModelPart*> changedParts;
+    quint8 changedFields = 0;
+
+    for (const PartDelta& delta : m_deltas) {
+        quint8 changed = 0;
+
+        if (delta.fields & PartDelta::Name) {
+            const QString& name = after ? delta.nameAfter : delta.nameBefore;
+            if (delta.part->data(0).toString() != name) {
+                delta.part->setData(0, name);
+                changed |= PartDelta::Name;
+            }
+        }
+        if (delta.fields & PartDelta::Colour) {
+            QColor colour = QColor::fromRgb(after ? delta.colourAfter : delta.colourBefore);
+            if (delta.part->getColor() != colour) {
+                delta.part->setColor(colour);
+                changed |= PartDelta::Colour;
+            }
+        }
+        if (delta.fields & PartDelta::Visibility) {
+            bool visible = after ? delta.visibleAfter : delta.visibleBefore;
+            if (delta.part->visible() != visible) {
+                delta.part->setVisible(visible);
+                changed |= PartDelta::Visibility;
+            }
+        }
+        if ((delta.fields & PartDelta::Geometry) && delta.geometryBefore && delta.geometryAfter) {
+            const PartGeometry& geometry = after ? *delta.geometryAfter : *delta.geometryBefore;
+            if (delta.part->polyData != geometry.polyData || delta.part->contentHash() != geometry.contentHash) {
+                delta.part->setGeometry(geometry);
+                changed |= PartDelta::Geometry;
+            }
+        }
+        if (delta.fields & PartDelta::Opacity) {
+            double opacity = after ? delta.opacityAfter : delta.opacityBefore;
+            if (delta.part->opacity() != opacity) {
+                delta.part->setOpacity(opacity);
+                changed |= PartDelta::Opacity;
+            }
+        }
+        if ((delta.fields & PartDelta::Transform) && delta.transformBefore.size() == 16 && delta.transformAfter.size() == 16) {
+            const QVector<double>& transform = after ? delta.transformAfter : delta.transformBefore;
+            double current[16];
+            delta.part->localTransform(current);
+            if (!std::equal(transform.constBegin(), transform.constEnd(), current)) {
+                delta.part->setLocalTransform(transform.constData());
+                changed |= PartDelta::Transform;
+            }
+        }
+
+        if (changed) {
+            changedParts.append(delta.part);
+            changedFields |= changed;
+        }
+    }
+
+    if (changedFields && m_update)
+        m_update(changedParts, changedFields);
+}
+
+/**
+ * @brief Returns the merge id.
+ * @return 1 for commands created in a merge session, -1 otherwise.
+ */
+int PartEditCommand::id() const {
+    return m_mergeSession >= 0 ? 1 : -1;
+}
+
+/**
+ * @brief Folds a later command from the same session into this one.
+ *
+ * Both commands must come from the same session and touch the same parts in the
+ * same order. The merged command keeps this command's "before" values and takes
+ * the other command's "after" values.
+ * @param other The command pushed after this one.
+ * @return True if the command was merged.
+ */
+bool PartEditCommand::mergeWith(const QUndoCommand* other) {
+    const PartEditCommand* next = static_cast<const PartEditCommand*>(other);
+    if (next->m_mergeSession != m_mergeSession || next->m_deltas.size() != m_deltas.size())
+        return false;
+
+    for (int i = 0; i < m_deltas.size(); ++i) {
+        if (m_deltas[i].part != next->m_deltas[i].part)
+            return false;
+    }
+
+    for (int i = 0; i < m_deltas.size(); ++i) {
+        PartDelta& mine = m_deltas[i];
+        const PartDelta& theirs = next->m_deltas[i];
+
+        if (theirs.fields & PartDelta::Name) {
+            if (!(mine.fields & PartDelta::Name))
+                mine.nameBefore = theirs.nameBefore;
+            mine.nameAfter = theirs.nameAfter;
+        }
+        if (theirs.fields & PartDelta::Colour) {
+            if (!(mine.fields & PartDelta::Colour))
+                mine.colourBefore = theirs.colourBefore;
+            mine.colourAfter = theirs.colourAfter;
+        }
+        if (theirs.fields & PartDelta::Visibility) {
+            if (!(mine.fields & PartDelta::Visibility))
+                mine.visibleBefore = theirs.visibleBefore;
+            mine.visibleAfter = theirs.visibleAfter;
+        }
+        if (theirs.fields & PartDelta::Geometry) {
+            if (!(mine.fields & PartDelta::Geometry))
+                mine.geometryBefore = theirs.geometryBefore;
+            mine.geometryAfter = theirs.geometryAfter;
+        }
+        if (theirs.fields & PartDelta::Opacity) {
+            if (!(mine.fields & PartDelta::Opacity))
+                mine.opacityBefore = theirs.opacityBefore;
+            mine.opacityAfter = theirs.opacityAfter;
+        }
+        if (theirs.fields & PartDelta::Transform) {
+            if (!(mine.fields & PartDelta::Transform))
+                mine.transformBefore = theirs.transformBefore;
+            mine.transformAfter = theirs.transformAfter;
+        }
+        mine.fields |= theirs.fields;
+    }
+    return true;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file PartEditCommand.h
+ * @brief Declaration of the PartEditCommand undo/redo command.
+ *
+ * A PartEditCommand records the attributes that an edit changed on one or more
+ * ModelParts as compact before/after deltas, rather than snapshotting the tree.
+ * Commands are pushed onto a QUndoStack owned by MainWindow.
+ */
+#ifndef PART_EDIT_COMMAND_H
+#define PART_EDIT_COMMAND_H
+
+#include <QUndoCommand>
+#include <QVector>
+#include <QString>
+#include <QColor>
+
+#include <functional>
+#include <memory>
+
+class ModelPart;
+struct PartGeometry;
+
+/**
+ * @brief Before/after values of the attributes changed on a single part.
+ *
+ * Only the attributes flagged in @ref fields are meaningful; the rest are left
+ * default-constructed so an unchanged name costs nothing.
+ */
+struct PartDelta {
+    /**
+     * @brief Attributes that a delta can carry.
+     */
+    enum Field : quint8 {
+        Name       = 0x01,   /**< The part name (data column 0) */
+        Colour     = 0x02,   /**< The user-assigned colour */
+        Visibility = 0x04,   /**< The visible flag */
+        Transform  = 0x08,   /**< The transform relative to the parent */
+        Opacity    = 0x10,   /**< The user-assigned opacity */
+        Geometry   = 0x20    /**< The mesh shown, e.g. when a duplicate is merged */
+    };
+
+    ModelPart* part = nullptr;  /**< The part this delta applies to */
+    quint8 fields = 0;          /**< Bitmask of Field values present in this delta */
+
+    QString nameBefore;         /**< Name before the edit */
+    QString nameAfter;          /**< Name after the edit */
+    QRgb colourBefore = 0;      /**< Colour before the edit */
+    QRgb colourAfter = 0;       /**< Colour after the edit */
+    bool visibleBefore = true;  /**< Visibility before the edit */
+    bool visibleAfter = true;   /**< Visibility after the edit */
+    double opacityBefore = 1.0; /**< Opacity before the edit */
+    double opacityAfter = 1.0;  /**< Opacity after the edit */
+    std::shared_ptr<const PartGeometry> geometryBefore; /**< Geometry before the edit; kept alive for undo */
+    std::shared_ptr<const PartGeometry> geometryAfter;  /**< Geometry after the edit */
+    QVector<double> transformBefore;    /**< Local transform before the edit, 16 values row-major */
+    QVector<double> transformAfter;     /**< Local transform after the edit, 16 values row-major */
+};
+
+/**
+ * @brief Undoable edit of one or more ModelPart attributes.
+ *
+ * redo() and undo() apply every delta and then invoke the scene update callback
+ * exactly once, so undoing an edit of thousands of parts costs a single render.
+ * Commands created with the same merge session (for example the ticks of one
+ * colour slider drag) are merged by QUndoStack into a single entry.
+ */
+class PartEditCommand : public QUndoCommand {
+public:
+    /**
+     * @brief Callback used to refresh the tree and scene after deltas are applied.
+     * Receives the parts that actually changed and the union of changed fields.
+     */
+    using SceneUpdate = std::function<void(const QVector<ModelPart*>& parts, quint8 fields)>;
+
+    /**
+     * @brief Constructs a command from a set of deltas.
+     * @param text The text shown for the entry in undo/redo menus.
+     * @param deltas Per-part attribute deltas; the parts must outlive the command.
+     * @param update Scene update callback invoked once per redo()/undo().
+     * @param mergeSession Commands with the same non-negative session and parts are merged.
+     */
+    PartEditCommand(const QString& text, const QVector<PartDelta>& deltas,
+                    const SceneUpdate& update, int mergeSession = -1);
+
+    /**
+     * @brief Applies the "after" values of every delta.
+     */
+    void redo() override;
+
+    /**
+     * @brief Applies the "before" values of every delta.
+     */
+    void undo() override;
+
+    /**
+     * @brief Returns the merge id; only commands from a merge session can be merged.
+     * @return 1 for session commands, -1 otherwise.
+     */
+    int id() const override;
+
+    /**
+     * @brief Folds a later command from the same session into this one.
+     * @param other The command pushed after this one.
+     * @return True if the command was merged.
+     */
+    bool mergeWith(const QUndoCommand* other) override;
+
+private:
+    /**
+     * @brief Applies one side of every delta and notifies the scene once.
+     * @param after True to apply the "after" values, false for the "before" values.
+     */
+    void apply(bool after);
+
+    QVector<PartDelta> m_deltas;    /**< Compact per-part deltas */
+    SceneUpdate m_update;           /**< Batched scene update callback */
+    int m_mergeSession;             /**< Merge session id, or -1 if not mergeable */
+};
+
+#endif // PART_EDIT_COMMAND_H
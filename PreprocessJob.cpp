@@ -0,0 +1,351 @@
+/**
+ * @file PreprocessJob.cpp
+ * @brief Implementation of the PreprocessJob class.
+ *
+ * Results are content-addressed and written atomically by TeamCache, so a part
+ * processed twice (for example after a lock was wrongly judged stale) only costs
+ * the duplicated work; the job itself never needs more coordination than the
+ * per-part lock.
+ */
+
+#include "PreprocessJob.h"
+#include "ClusterLod.h"
+#include "ClusterLodStage.h"
+#include "DecompressingDevice.h"
+#include "GeometryCache.h"
+#include "OctreeFile.h"
+#include "PackedMesh.h"
+#include "RepositoryIndex.h"
+#include "StlTriangleReader.h"
+#include "TeamCache.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QSaveFile>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QTextStream>
+
+#include <memory>
+
+namespace {
+
+/** First line of a manifest. */
+const char manifestHeader[] = "stlviewer-preprocess 1";
+
+/**
+ * @brief Appends the STL files of an indexed folder and its subfolders to a list.
+ */
+void collectParts(const RepositoryIndex& index, const QString& relativePath, QStringList& parts) {
+    const RepositoryIndex::Directory* directory = index.directory(relativePath);
+    if (!directory)
+        return;
+    for (const QString& name : directory->subdirectories)
+        collectParts(index, RepositoryIndex::childPath(relativePath, name), parts);
+    for (const RepositoryIndex::File& file : directory->files)
+        parts.append(RepositoryIndex::childPath(relativePath, file.name));
+}
+
+/**
+ * @brief Reads a whole STL file, compressed or not, into a mesh.
+ */
+vtkSmartPointer<vtkPolyData> readMesh(const QString& path) {
+    std::unique_ptr<QIODevice> device;
+    if (DecompressingDevice::formatOf(path) != DecompressingDevice::None)
+        device.reset(new DecompressingDevice(path));
+    else
+        device.reset(new QFile(path));
+    if (!device->open(QIODevice::ReadOnly))
+        return nullptr;
+    return StlTriangleReader::readPolyData(device.get());
+}
+
+} // namespace
+
+/**
+ * @brief Constructs a job over a job directory.
+ * @param directory The job directory.
+ */
+PreprocessJob::PreprocessJob(const QString& directory)
+    : m_directory(QDir(directory).absolutePath()) {
+}
+
+/**
+ * @brief Writes the manifest of a new job.
+ * @param repository The repository folder.
+ * @return True on success.
+ */
+bool PreprocessJob::create(const QString& repository) {
+    const QString manifest = m_directory + "/manifest.txt";
+    if (QFileInfo::exists(manifest))
+        return false;
+    if (!QDir().mkpath(m_directory + "/locks") || !QDir().mkpath(m_directory + "/done")
+        || !QDir().mkpath(scratchPath()))
+        return false;
+
+    const RepositoryIndex index = RepositoryIndex::scan(repository);
+    if (index.isEmpty())
+        return false;
+    m_repository = index.root();
+    m_parts.clear();
+    collectParts(index, QString(), m_parts);
+
+    QSaveFile file(manifest);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        return false;
+    QTextStream out(&file);
+    out.setCodec("UTF-8");
+    out << manifestHeader << '\n' << m_repository << '\n';
+    for (const QString& part : m_parts)
+        out << part << '\n';
+    out.flush();
+    return file.commit();
+}
+
+/**
+ * @brief Reads the manifest of an existing job.
+ * @return True on success.
+ */
+bool PreprocessJob::open() {
+    QFile file(m_directory + "/manifest.txt");
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+    QTextStream in(&file);
+    in.setCodec("UTF-8");
+    if (in.readLine() != QLatin1String(manifestHeader))
+        return false;
+    m_repository = in.readLine();
+    m_parts.clear();
+    while (!in.atEnd()) {
+        const QString line = in.readLine();
+        if (!line.isEmpty())
+            m_parts.append(line);
+    }
+    return !m_repository.isEmpty();
+}
+
+/**
+ * @brief Claims and processes parts until none is left.
+ * @param cache Where results are published.
+ * @param log Receives a line per part.
+ * @return The number of parts processed by this worker.
+ */
+int PreprocessJob::work(TeamCache& cache, QTextStream& log) {
+    const int count = m_parts.size();
+    if (count == 0)
+        return 0;
+
+    // Spread the workers' starting points over the manifest
+    const QString worker = QSysInfo::machineHostName() + ':' + QString::number(QCoreApplication::applicationPid());
+    const int start = static_cast<int>(qHash(worker) % static_cast<uint>(count));
+    QDir().mkpath(scratchPath());
+
+    int processed = 0;
+    bool progressed = true;
+    while (progressed) {
+        // Another pass picks up parts whose worker died while this one was busy
+        progressed = false;
+        for (int k = 0; k < count; ++k) {
+            const int part = (start + k) % count;
+            if (QFileInfo::exists(donePath(part)))
+                continue;
+
+            QLockFile lock(lockPath(part));
+            lock.setStaleLockTime(staleLockTime());
+            if (!lock.tryLock(0))
+                continue;
+            if (QFileInfo::exists(donePath(part)))
+                continue;   // Finished between the check and the lock
+
+            QElapsedTimer timer;
+            timer.start();
+            QString details;
+            const bool ok = process(QDir(m_repository).filePath(m_parts[part]), cache, scratchPath(), details);
+
+            QSaveFile marker(donePath(part));
+            if (marker.open(QIODevice::WriteOnly | QIODevice::Text)) {
+                QTextStream out(&marker);
+                out.setCodec("UTF-8");
+                out << (ok ? "ok" : "failed") << '\t' << details << '\t' << worker << '\t' << timer.elapsed() << " ms\n";
+                out.flush();
+                marker.commit();
+            }
+            log << (ok ? "done   " : "FAILED ") << m_parts[part] << ": " << details << '\n';
+            log.flush();
+            ++processed;
+            progressed = true;
+        }
+    }
+    return processed;
+}
+
+/**
+ * @brief Reads the job's progress from its directory.
+ * @return The progress.
+ */
+PreprocessJob::Progress PreprocessJob::progress() const {
+    Progress progress;
+    progress.total = m_parts.size();
+
+    // One listing per directory rather than a stat per part
+    const QStringList done = QDir(m_directory + "/done").entryList(QDir::Files);
+    for (const QString& name : done) {
+        bool ok;
+        const int part = name.toInt(&ok);
+        if (!ok || part < 0 || part >= m_parts.size())
+            continue;
+        QFile marker(donePath(part));
+        if (!marker.open(QIODevice::ReadOnly | QIODevice::Text))
+            continue;
+        const QStringList fields = QString::fromUtf8(marker.readLine()).trimmed().split('\t');
+        if (fields.value(0) == "ok") {
+            ++progress.succeeded;
+        }
+        else {
+            ++progress.failed;
+            progress.failures.append(m_parts[part] + ": " + fields.value(1));
+        }
+    }
+    const QStringList locks = QDir(m_directory + "/locks").entryList({ "*.lock" }, QDir::Files);
+    for (const QString& name : locks) {
+        if (done.contains(QFileInfo(name).completeBaseName()))
+            continue;
+        // A worker that died leaves its lock file behind; only a lock that cannot
+        // be taken, by the same rules workers use, belongs to a live worker
+        QLockFile lock(m_directory + "/locks/" + name);
+        lock.setStaleLockTime(staleLockTime());
+        if (lock.tryLock(0))
+            lock.unlock();
+        else if (lock.error() == QLockFile::LockFailedError)
+            ++progress.running;
+    }
+    return progress;
+}
+
+/**
+ * @brief Removes the done markers of failed parts so workers process them again.
+ * @return The number of parts that will be retried.
+ */
+int PreprocessJob::retryFailed() {
+    int retried = 0;
+    const QStringList done = QDir(m_directory + "/done").entryList(QDir::Files);
+    for (const QString& name : done) {
+        QFile marker(m_directory + "/done/" + name);
+        if (!marker.open(QIODevice::ReadOnly | QIODevice::Text))
+            continue;
+        const QString status = QString::fromUtf8(marker.readLine()).trimmed().split('\t').value(0);
+        marker.close();
+        if (status != "ok" && marker.remove())
+            ++retried;
+    }
+    return retried;
+}
+
+/**
+ * @brief Gets the age after which another host's lock counts as stale.
+ * @return Milliseconds; longer than any single part should take.
+ */
+int PreprocessJob::staleLockTime() {
+    return 2 * 60 * 60 * 1000;
+}
+
+/**
+ * @brief Preprocesses one part.
+ *
+ * Produces what a viewer would build for the part: the octree for parts it would
+ * stream, otherwise the welded mesh and, for parts large enough to be drawn by
+ * clusters, the cluster hierarchy. Results already in the cache are skipped.
+ *
+ * An octree is converted in a private temporary directory under @p scratchDirectory,
+ * so workers never overwrite each other's files and the file, which can be as large
+ * as the part, lands on the job's file system rather than a small system temp.
+ * @param path The STL file.
+ * @param cache Where results are published.
+ * @param scratchDirectory Directory for temporary files.
+ * @param details Receives a summary or the failure reason.
+ * @return True on success.
+ */
+bool PreprocessJob::process(const QString& path, TeamCache& cache, const QString& scratchDirectory, QString& details) {
+    const QByteArray hash = GeometryCache::contentHash(path);
+    if (hash.isEmpty()) {
+        details = "cannot read file";
+        return false;
+    }
+
+    if (DecompressingDevice::estimatedSize(path) >= OctreeFile::suggestedThreshold()) {
+        if (cache.contains(hash, "oct")) {
+            details = "octree already cached";
+            return true;
+        }
+        QTemporaryDir scratch(scratchDirectory + "/XXXXXX");
+        if (!scratch.isValid()) {
+            details = "cannot create a scratch directory";
+            return false;
+        }
+        const QString local = scratch.filePath(QString::fromLatin1(hash) + ".oct");
+        const bool ok = OctreeFile::convert(path, local) && cache.publishFile(hash, "oct", local);
+        details = ok ? "octree" : "octree conversion failed";
+        return ok;
+    }
+
+    QStringList made;
+    vtkSmartPointer<vtkPolyData> mesh;
+    if (cache.contains(hash, "mesh")) {
+        std::shared_ptr<const QByteArray> block = std::make_shared<const QByteArray>(cache.read(hash, "mesh"));
+        mesh = PackedMesh::view(reinterpret_cast<const uchar*>(block->constData()), block->size(), block);
+    }
+    if (!mesh) {
+        mesh = readMesh(path);
+        if (!mesh || mesh->GetNumberOfPolys() == 0) {
+            details = "not a valid STL file";
+            return false;
+        }
+        if (!cache.publish(hash, "mesh", PackedMesh::pack(mesh))) {
+            details = "cannot write mesh to the team cache";
+            return false;
+        }
+        made << "mesh";
+    }
+
+    // Same threshold as the viewer's stage, so the viewer finds every hierarchy it would build
+    const qint64 minimumTriangles = ClusterLodStage().minimumTriangles();
+    if (mesh->GetNumberOfPolys() >= minimumTriangles && !cache.contains(hash, "lod")) {
+        if (!cache.publish(hash, "lod", ClusterLod::build(mesh)->serialize())) {
+            details = "cannot write cluster hierarchy to the team cache";
+            return false;
+        }
+        made << "lod";
+    }
+    details = made.isEmpty() ? QString("already cached") : made.join(", ");
+    return true;
+}
+
+/**
+ * @brief Gets the lock file of a part.
+ * @param part Index in the manifest.
+ * @return The path.
+ */
+QString PreprocessJob::lockPath(int part) const {
+    return m_directory + "/locks/" + QString::number(part) + ".lock";
+}
+
+/**
+ * @brief Gets the directory for workers' temporary files.
+ * @return The path.
+ */
+QString PreprocessJob::scratchPath() const {
+    return m_directory + "/scratch";
+}
+
+/**
+ * @brief Gets the done marker of a part.
+ * @param part Index in the manifest.
+ * @return The path.
+ */
+QString PreprocessJob::donePath(int part) const {
+    return m_directory + "/done/" + QString::number(part);
+}
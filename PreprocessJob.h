@@ -0,0 +1,126 @@
+/**
+ * @file PreprocessJob.h
+ * @brief Declaration of the PreprocessJob class.
+ *
+ * Preprocessing a release of many thousands of parts takes hours on one machine.
+ * A preprocessing job splits the work between any number of worker processes, on
+ * one machine or on several sharing a file system. They coordinate only through
+ * files in a job directory: a manifest of the parts, one lock file per part being
+ * processed and one marker per part finished. Results go to a TeamCache, where
+ * every viewer picks them up.
+ */
+#ifndef PREPROCESS_JOB_H
+#define PREPROCESS_JOB_H
+
+#include <QString>
+#include <QStringList>
+
+class QTextStream;
+class TeamCache;
+
+/**
+ * @brief A job directory shared by preprocessing workers.
+ *
+ * Layout of the job directory:
+ *   manifest.txt      the repository root, then one part path (relative) per line
+ *   locks/<n>.lock    held by the worker processing part n (a QLockFile)
+ *   done/<n>          written once part n is finished: "ok" or "failed", and details
+ *   scratch/          one temporary directory per part being converted
+ *
+ * A worker that dies leaves its lock behind without a done marker. QLockFile
+ * detects such stale locks (immediately on the same host, after staleLockTime()
+ * elsewhere), so the part is picked up again and a job can always be resumed by
+ * starting more workers. A failed part keeps its marker, so workers do not retry
+ * it over and over; retryFailed() clears those markers once the cause, such as a
+ * full disk or an unreachable team cache, has been fixed.
+ */
+class PreprocessJob {
+public:
+    /**
+     * @brief Progress of a job, as seen in its directory.
+     */
+    struct Progress {
+        int total = 0;          /**< Parts in the manifest */
+        int succeeded = 0;      /**< Parts finished successfully */
+        int failed = 0;         /**< Parts that could not be processed */
+        int running = 0;        /**< Parts locked by a worker but not finished */
+        QStringList failures;   /**< One line per failed part: path and reason */
+    };
+
+    /**
+     * @brief Constructs a job over a job directory; call create() or open() next.
+     * @param directory The job directory.
+     */
+    explicit PreprocessJob(const QString& directory);
+
+    /**
+     * @brief Writes the manifest of a new job, listing every STL file in a repository.
+     * @param repository The repository folder.
+     * @return False if the job directory already holds a manifest or cannot be written.
+     */
+    bool create(const QString& repository);
+
+    /**
+     * @brief Reads the manifest of an existing job.
+     * @return False if there is no valid manifest.
+     */
+    bool open();
+
+    /**
+     * @brief Processes parts until none is left to claim.
+     *
+     * Each part is claimed by taking its lock file; parts already done or locked by
+     * a live worker are skipped. Workers start at different points of the manifest
+     * so they rarely contend for the same lock.
+     * @param cache Where the results are published.
+     * @param log Receives one line per part processed.
+     * @return The number of parts this worker processed.
+     */
+    int work(TeamCache& cache, QTextStream& log);
+
+    /**
+     * @brief Reads the progress of the job from its directory.
+     *
+     * Lock files left by workers that died are not counted as running.
+     * @return The progress.
+     */
+    Progress progress() const;
+
+    /**
+     * @brief Makes the failed parts available to workers again.
+     * @return The number of parts that will be retried.
+     */
+    int retryFailed();
+
+    /**
+     * @brief Returns how old a lock held by a worker on another host must be to count as stale.
+     * @return The age in milliseconds.
+     */
+    static int staleLockTime();
+
+private:
+    /**
+     * @brief Preprocesses one part and publishes the results.
+     * @param path Absolute path of the STL file.
+     * @param cache Where the results are published.
+     * @param scratchDirectory Directory for temporary files, on the job's file system.
+     * @param details Receives a summary, or the reason for a failure.
+     * @return True on success.
+     */
+    static bool process(const QString& path, TeamCache& cache, const QString& scratchDirectory, QString& details);
+
+    /** @brief Returns the lock file of a part. */
+    QString lockPath(int part) const;
+
+    /** @brief Returns the directory for workers' temporary files. */
+    QString scratchPath() const;
+
+    /** @brief Returns the done marker of a part. */
+    QString donePath(int part) const;
+
+    QString m_directory;        /**< The job directory */
+    QString m_repository;       /**< Repository root from the manifest */
+    QStringList m_parts;        /**< Part paths from the manifest, relative to the root */
+};
+
+#endif // PREPROCESS_JOB_H
@@ -0,0 +1,238 @@
+/**
+ * @file QuantisedPolyDataMapper.cpp
+ * @brief Implementation of the QuantisedPolyDataMapper class.
+ *
+ * The mapper replaces VTK's float vertexMC buffer with its own buffers and
+ * rewrites the vertex shader so that vertexMC (and the normal, if present) are
+ * decoded from them. Everything downstream of vertexMC is VTK's standard code.
+ */
+
+#include "QuantisedPolyDataMapper.h"
+
+#include <vtkDataArray.h>
+#include <vtkObjectFactory.h>
+#include <vtkOpenGLHelper.h>
+#include <vtkOpenGLVertexArrayObject.h>
+#include <vtkOpenGLVertexBufferObjectGroup.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkShaderProgram.h>
+#include <vtkUnsignedCharArray.h>
+
+#include <algorithm>
+#include <cmath>
+
+vtkStandardNewMacro(QuantisedPolyDataMapper);
+
+namespace {
+
+/** GLSL that turns two octahedral coordinates back into a unit vector. */
+const char* octahedralDecode =
+    "vec3 octDecode(vec2 e)\n"
+    "{\n"
+    "  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n"
+    "  float t = max(-n.z, 0.0);\n"
+    "  n.x += n.x >= 0.0 ? -t : t;\n"
+    "  n.y += n.y >= 0.0 ? -t : t;\n"
+    "  return normalize(n);\n"
+    "}\n";
+
+/**
+ * @brief Converts a value in [-1, 1] to a signed normalised 16-bit integer.
+ */
+short toSnorm16(double v) {
+    return static_cast<short>(std::lround(std::max(-1.0, std::min(1.0, v)) * 32767.0));
+}
+
+} // namespace
+
+/**
+ * @brief Constructor.
+ */
+QuantisedPolyDataMapper::QuantisedPolyDataMapper()
+    : positionBuffer(vtkSmartPointer<vtkOpenGLBufferObject>::New()),
+      normalBuffer(vtkSmartPointer<vtkOpenGLBufferObject>::New()),
+      haveNormals(false) {
+    std::fill(origin, origin + 3, 0.0f);
+    std::fill(scale, scale + 3, 0.0f);
+}
+
+/**
+ * @brief Destructor.
+ */
+QuantisedPolyDataMapper::~QuantisedPolyDataMapper() = default;
+
+/**
+ * @brief Quantises point positions to 16 bits per component.
+ * @param points The points to encode.
+ * @param bounds Bounds of the points.
+ * @param originOut Receives the position that code 0 decodes to.
+ * @param scaleOut Receives the extent that code 65535 decodes to, per axis.
+ * @return Three values per point.
+ */
+std::vector<unsigned short> QuantisedPolyDataMapper::encodePositions(vtkPoints* points, const double bounds[6],
+                                                                     float originOut[3], float scaleOut[3]) {
+    double inverse[3];
+    for (int k = 0; k < 3; ++k) {
+        originOut[k] = static_cast<float>(bounds[2 * k]);
+        scaleOut[k] = static_cast<float>(bounds[2 * k + 1] - bounds[2 * k]);
+        inverse[k] = scaleOut[k] > 0.0f ? 65535.0 / (bounds[2 * k + 1] - bounds[2 * k]) : 0.0;
+    }
+
+    const vtkIdType count = points->GetNumberOfPoints();
+    std::vector<unsigned short> codes(3 * count);
+    double p[3];
+    for (vtkIdType i = 0; i < count; ++i) {
+        points->GetPoint(i, p);
+        for (int k = 0; k < 3; ++k) {
+            long q = std::lround((p[k] - bounds[2 * k]) * inverse[k]);
+            codes[3 * i + k] = static_cast<unsigned short>(std::max(0L, std::min(65535L, q)));
+        }
+    }
+    return codes;
+}
+
+/**
+ * @brief Encodes unit normals as octahedral coordinates.
+ *
+ * The normal is projected onto the octahedron |x| + |y| + |z| = 1, and the lower
+ * half is folded over the upper half, giving two coordinates in [-1, 1].
+ * @param normals Three-component normals.
+ * @return Two values per normal.
+ */
+std::vector<short> QuantisedPolyDataMapper::encodeNormals(vtkDataArray* normals) {
+    const vtkIdType count = normals->GetNumberOfTuples();
+    std::vector<short> codes(2 * count);
+    double n[3];
+    for (vtkIdType i = 0; i < count; ++i) {
+        normals->GetTuple(i, n);
+        double l1 = std::abs(n[0]) + std::abs(n[1]) + std::abs(n[2]);
+        if (l1 <= 0.0) {
+            codes[2 * i] = 0;
+            codes[2 * i + 1] = 0;
+            continue;
+        }
+        double x = n[0] / l1;
+        double y = n[1] / l1;
+        if (n[2] < 0.0) {
+            double fx = (1.0 - std::abs(y)) * (x >= 0.0 ? 1.0 : -1.0);
+            double fy = (1.0 - std::abs(x)) * (y >= 0.0 ? 1.0 : -1.0);
+            x = fx;
+            y = fy;
+        }
+        codes[2 * i] = toSnorm16(x);
+        codes[2 * i + 1] = toSnorm16(y);
+    }
+    return codes;
+}
+
+/**
+ * @brief Releases the quantised buffers along with VTK's own.
+ * @param window The window whose context owns the resources.
+ */
+void QuantisedPolyDataMapper::ReleaseGraphicsResources(vtkWindow* window) {
+    positionBuffer->ReleaseGraphicsResources();
+    normalBuffer->ReleaseGraphicsResources();
+    this->Superclass::ReleaseGraphicsResources(window);
+}
+
+/**
+ * @brief Uploads quantised positions and normals, mapped scalars and index buffers.
+ *
+ * Nothing is cached under "vertexMC" or "normalMC", so VTK never uploads the float copies.
+ */
+void QuantisedPolyDataMapper::BuildBufferObjects(vtkRenderer* ren, vtkActor* act) {
+    vtkPolyData* poly = this->CurrentInput;
+    if (!poly || !poly->GetPoints())
+        return;
+
+    // Overlay colours are mapped and uploaded the standard way
+    this->MapScalars(poly, 1.0);
+    this->HaveCellScalars = false;
+    this->HaveCellNormals = false;
+    this->VBOs->CacheDataArray("scalarColor", this->Colors, ren, VTK_UNSIGNED_CHAR);
+    this->VBOs->BuildAllVBOs(ren);
+
+    double bounds[6];
+    poly->GetPoints()->GetBounds(bounds);
+    positionBuffer->Upload(encodePositions(poly->GetPoints(), bounds, origin, scale), vtkOpenGLBufferObject::ArrayBuffer);
+
+    vtkDataArray* normals = poly->GetPointData()->GetNormals();
+    haveNormals = normals && normals->GetNumberOfComponents() == 3;
+    if (haveNormals)
+        normalBuffer->Upload(encodeNormals(normals), vtkOpenGLBufferObject::ArrayBuffer);
+
+    this->BuildIBO(ren, act, poly);
+    this->VBOBuildTime.Modified();
+}
+
+/**
+ * @brief Declares the quantised attributes and decodes them into vertexMC.
+ */
+void QuantisedPolyDataMapper::ReplaceShaderValues(std::map<vtkShader::Type, vtkShader*> shaders,
+                                                  vtkRenderer* ren, vtkActor* act) {
+    this->Superclass::ReplaceShaderValues(shaders, ren, act);
+
+    std::string source = shaders[vtkShader::Vertex]->GetSource();
+    vtkShaderProgram::Substitute(source, "in vec4 vertexMC;",
+        "in vec3 quantisedPosition;\n"
+        "uniform vec3 quantisedOrigin;\n"
+        "uniform vec3 quantisedScale;\n"
+        "vec4 vertexMC;");
+    vtkShaderProgram::Substitute(source, "//VTK::CustomBegin::Impl",
+        "//VTK::CustomBegin::Impl\n"
+        "  vertexMC = vec4(quantisedOrigin + quantisedScale * quantisedPosition, 1.0);");
+    shaders[vtkShader::Vertex]->SetSource(source);
+}
+
+/**
+ * @brief Uses the decoded normals when the geometry has them.
+ */
+void QuantisedPolyDataMapper::ReplaceShaderNormal(std::map<vtkShader::Type, vtkShader*> shaders,
+                                                  vtkRenderer* ren, vtkActor* act) {
+    if (!haveNormals || !this->LastLightComplexity[this->LastBoundBO]) {
+        this->Superclass::ReplaceShaderNormal(shaders, ren, act);
+        return;
+    }
+
+    std::string vs = shaders[vtkShader::Vertex]->GetSource();
+    std::string fs = shaders[vtkShader::Fragment]->GetSource();
+
+    vtkShaderProgram::Substitute(vs, "//VTK::Normal::Dec",
+        std::string("in vec2 quantisedNormal;\n"
+                    "uniform mat3 normalMatrix;\n"
+                    "out vec3 normalVCVSOutput;\n") + octahedralDecode);
+    vtkShaderProgram::Substitute(vs, "//VTK::Normal::Impl",
+        "normalVCVSOutput = normalMatrix * octDecode(quantisedNormal);");
+
+    vtkShaderProgram::Substitute(fs, "//VTK::Normal::Dec",
+        "in vec3 normalVCVSOutput;");
+    vtkShaderProgram::Substitute(fs, "//VTK::Normal::Impl",
+        "vec3 normalVCVSOutput = normalize(normalVCVSOutput);\n"
+        "  if (gl_FrontFacing == false) { normalVCVSOutput = -normalVCVSOutput; }");
+
+    shaders[vtkShader::Vertex]->SetSource(vs);
+    shaders[vtkShader::Fragment]->SetSource(fs);
+}
+
+/**
+ * @brief Binds the quantised buffers and their decode uniforms.
+ */
+void QuantisedPolyDataMapper::SetMapperShaderParameters(vtkOpenGLHelper& cellBO, vtkRenderer* ren, vtkActor* act) {
+    this->Superclass::SetMapperShaderParameters(cellBO, ren, act);
+    if (cellBO.IBO->IndexCount == 0)
+        return;
+
+    vtkShaderProgram* program = cellBO.Program;
+    cellBO.VAO->Bind();
+    cellBO.VAO->AddAttributeArray(program, positionBuffer, "quantisedPosition", 0,
+                                  3 * sizeof(unsigned short), VTK_UNSIGNED_SHORT, 3, true);
+    if (haveNormals && program->IsAttributeUsed("quantisedNormal")) {
+        cellBO.VAO->AddAttributeArray(program, normalBuffer, "quantisedNormal", 0,
+                                      2 * sizeof(short), VTK_SHORT, 2, true);
+    }
+
+    program->SetUniform3f("quantisedOrigin", origin);
+    program->SetUniform3f("quantisedScale", scale);
+}
@@ -0,0 +1,93 @@
+/**
+ * @file QuantisedPolyDataMapper.h
+ * @brief Declaration of the QuantisedPolyDataMapper class.
+ *
+ * An OpenGL polydata mapper that keeps vertex data on the GPU in compact form:
+ * positions as three 16-bit values relative to the part's bounding box, and
+ * normals (when the geometry has them) as two 16-bit octahedral coordinates. The
+ * vertex shader decodes both, so the rest of VTK's shading is unchanged.
+ */
+#ifndef QUANTISED_POLYDATA_MAPPER_H
+#define QUANTISED_POLYDATA_MAPPER_H
+
+#include <vtkOpenGLPolyDataMapper.h>
+#include <vtkSmartPointer.h>
+#include <vtkOpenGLBufferObject.h>
+
+#include <vector>
+
+class vtkDataArray;
+class vtkPoints;
+
+/**
+ * @brief Polydata mapper that uploads 16-bit quantised positions and octahedral normals.
+ *
+ * A vertex costs 6 bytes of position and 4 bytes of normal instead of 12 + 12 bytes
+ * of floats. Positions are quantised over the part's own bounds, so the error is at
+ * most 1/131070 of the part's size along each axis. Point scalars (overlays) and
+ * index buffers go through the standard VTK path.
+ */
+class QuantisedPolyDataMapper : public vtkOpenGLPolyDataMapper {
+public:
+    static QuantisedPolyDataMapper* New();
+    vtkTypeMacro(QuantisedPolyDataMapper, vtkOpenGLPolyDataMapper);
+
+    /**
+     * @brief Quantises point positions to 16 bits per component.
+     * @param points The points to encode.
+     * @param bounds Bounds of the points (xmin, xmax, ymin, ymax, zmin, zmax).
+     * @param origin Receives the position that code 0 decodes to.
+     * @param scale Receives the extent that code 65535 decodes to, per axis.
+     * @return Three values per point.
+     */
+    static std::vector<unsigned short> encodePositions(vtkPoints* points, const double bounds[6], float origin[3], float scale[3]);
+
+    /**
+     * @brief Encodes unit normals as two signed 16-bit octahedral coordinates.
+     * @param normals Three-component normals.
+     * @return Two values per normal.
+     */
+    static std::vector<short> encodeNormals(vtkDataArray* normals);
+
+    /**
+     * @brief Releases the quantised buffers along with VTK's own.
+     * @param window The window whose context owns the resources.
+     */
+    void ReleaseGraphicsResources(vtkWindow* window) override;
+
+protected:
+    QuantisedPolyDataMapper();
+    ~QuantisedPolyDataMapper() override;
+
+    /**
+     * @brief Uploads quantised positions and normals, mapped scalars and index buffers.
+     */
+    void BuildBufferObjects(vtkRenderer* ren, vtkActor* act) override;
+
+    /**
+     * @brief Declares the quantised attributes and decodes them into vertexMC and the normal.
+     */
+    void ReplaceShaderValues(std::map<vtkShader::Type, vtkShader*> shaders, vtkRenderer* ren, vtkActor* act) override;
+
+    /**
+     * @brief Uses the decoded normals when the geometry has them, VTK's derivative normals otherwise.
+     */
+    void ReplaceShaderNormal(std::map<vtkShader::Type, vtkShader*> shaders, vtkRenderer* ren, vtkActor* act) override;
+
+    /**
+     * @brief Binds the quantised buffers and their decode uniforms.
+     */
+    void SetMapperShaderParameters(vtkOpenGLHelper& cellBO, vtkRenderer* ren, vtkActor* act) override;
+
+private:
+    QuantisedPolyDataMapper(const QuantisedPolyDataMapper&) = delete;
+    void operator=(const QuantisedPolyDataMapper&) = delete;
+
+    vtkSmartPointer<vtkOpenGLBufferObject> positionBuffer;  /**< 3 x uint16 per vertex */
+    vtkSmartPointer<vtkOpenGLBufferObject> normalBuffer;    /**< 2 x int16 per vertex */
+    bool haveNormals;                                       /**< True if normalBuffer holds data */
+    float origin[3];                                        /**< Decoded position of code 0 */
+    float scale[3];                                         /**< Decoded extent of code 65535 */
+};
+
+#endif // QUANTISED_POLYDATA_MAPPER_H
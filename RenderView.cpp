@@ -0,0 +1,225 @@
+/**
+ * @file RenderView.cpp
+ * @brief Implementation of the RenderView class.
+ */
+
+#include "RenderView.h"
+#include "DesktopRenderThread.h"
+
+#include <QApplication>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QResizeEvent>
+#include <QWheelEvent>
+
+#include <cmath>
+
+/**
+ * @brief Constructs the view.
+ * @param thread The render thread to show and control.
+ * @param parent The parent widget.
+ */
+RenderView::RenderView(DesktopRenderThread* thread, QWidget* parent)
+    : QWidget(parent), renderThread(thread), hoveredPart(0), dragButton(Qt::NoButton), panning(false),
+      hoverPending(false), clickPending(false), clickExtend(false)
+{
+    setFocusPolicy(Qt::StrongFocus);
+    setMinimumSize(64, 64);
+
+    // Hovering is reported without a button held
+    setMouseTracking(true);
+
+    // Frames are opaque and fill the widget, so Qt need not clear it first
+    setAttribute(Qt::WA_OpaquePaintEvent);
+
+    connect(renderThread, &DesktopRenderThread::frameReady, this, &RenderView::showFrame);
+    connect(renderThread, &DesktopRenderThread::idBufferReady, this, &RenderView::resolvePending);
+}
+
+/**
+ * @brief Answers the hover and click that arrived while the ID buffer was out of date.
+ */
+void RenderView::resolvePending()
+{
+    quintptr part;
+    if (clickPending && partUnder(clickPos, part)) {
+        clickPending = false;
+        emit partClicked(part, clickExtend);
+    }
+    if (hoverPending && dragButton == Qt::NoButton && partUnder(hoverPos, part)) {
+        hoverPending = false;
+        if (part != hoveredPart) {
+            hoveredPart = part;
+            emit partHovered(part);
+        }
+    }
+}
+
+/**
+ * @brief Shows a newly rendered frame.
+ * @param newFrame The frame.
+ */
+void RenderView::showFrame(const QImage& newFrame)
+{
+    frame = newFrame;
+    frame.setDevicePixelRatio(devicePixelRatioF());
+    update();
+}
+
+/**
+ * @brief Paints the latest frame.
+ * @param event The paint event.
+ */
+void RenderView::paintEvent(QPaintEvent* event)
+{
+    Q_UNUSED(event);
+
+    QPainter painter(this);
+    if (frame.isNull()) {
+        painter.fillRect(rect(), QColor::fromRgbF(0.1, 0.1, 0.1));
+        return;
+    }
+    painter.drawImage(rect(), frame);
+}
+
+/**
+ * @brief Tells the render thread the new frame size, in device pixels.
+ * @param event The resize event.
+ */
+void RenderView::resizeEvent(QResizeEvent* event)
+{
+    const qreal ratio = devicePixelRatioF();
+    renderThread->resize(qRound(event->size().width() * ratio), qRound(event->size().height() * ratio));
+}
+
+/**
+ * @brief Starts a camera drag.
+ * @param event The mouse event.
+ */
+void RenderView::mousePressEvent(QMouseEvent* event)
+{
+    if (dragButton != Qt::NoButton)
+        return;
+
+    dragButton = event->button();
+    panning = dragButton == Qt::MiddleButton
+        || (dragButton == Qt::LeftButton && (event->modifiers() & Qt::ShiftModifier));
+    lastPos = event->pos();
+    pressPos = event->pos();
+}
+
+/**
+ * @brief Turns drag movement into camera commands.
+ * @param event The mouse event.
+ */
+void RenderView::mouseMoveEvent(QMouseEvent* event)
+{
+    if (dragButton == Qt::NoButton) {
+        quintptr part;
+        hoverPending = !partUnder(event->pos(), part);
+        hoverPos = event->pos();
+        if (!hoverPending && part != hoveredPart) {
+            hoveredPart = part;
+            emit partHovered(part);
+        }
+        return;
+    }
+
+    const QPoint delta = event->pos() - lastPos;
+    lastPos = event->pos();
+    const qreal ratio = devicePixelRatioF();
+
+    if (panning) {
+        renderThread->issueCommand(DesktopRenderThread::PAN_X, delta.x() * ratio);
+        renderThread->issueCommand(DesktopRenderThread::PAN_Y, delta.y() * ratio);
+    }
+    else if (dragButton == Qt::LeftButton) {
+        // A drag across the whole view turns the model by 200 degrees, as in vtkInteractorStyleTrackballCamera
+        renderThread->issueCommand(DesktopRenderThread::AZIMUTH, -200.0 * delta.x() / width());
+        renderThread->issueCommand(DesktopRenderThread::ELEVATION, 200.0 * delta.y() / height());
+    }
+    else if (dragButton == Qt::RightButton) {
+        renderThread->issueCommand(DesktopRenderThread::DOLLY, std::pow(1.1, -10.0 * delta.y() / height()));
+    }
+}
+
+/**
+ * @brief Ends a camera drag.
+ * @param event The mouse event.
+ */
+void RenderView::mouseReleaseEvent(QMouseEvent* event)
+{
+    if (event->button() != dragButton)
+        return;
+    dragButton = Qt::NoButton;
+
+    // A left press and release in about the same place is a click rather than an orbit
+    if (event->button() == Qt::LeftButton && !panning
+        && (event->pos() - pressPos).manhattanLength() < QApplication::startDragDistance()) {
+        const bool extend = event->modifiers() & Qt::ControlModifier;
+        quintptr part;
+        if (partUnder(event->pos(), part)) {
+            emit partClicked(part, extend);
+        }
+        else {
+            // Picked once the ID buffer of the frame on screen has been drawn
+            clickPending = true;
+            clickPos = event->pos();
+            clickExtend = extend;
+        }
+    }
+}
+
+/**
+ * @brief Zooms the camera by 10% per wheel step.
+ * @param event The wheel event.
+ */
+void RenderView::wheelEvent(QWheelEvent* event)
+{
+    renderThread->issueCommand(DesktopRenderThread::DOLLY, std::pow(1.1, event->angleDelta().y() / 120.0));
+    event->accept();
+}
+
+/**
+ * @brief Resets the camera on R; other keys are passed on.
+ * @param event The key event.
+ */
+void RenderView::keyPressEvent(QKeyEvent* event)
+{
+    if (event->key() == Qt::Key_R)
+        renderThread->issueCommand(DesktopRenderThread::RESET_CAMERA, 0.0);
+    else
+        QWidget::keyPressEvent(event);
+}
+
+/**
+ * @brief Clears the hovered part when the cursor leaves the view.
+ * @param event The leave event.
+ */
+void RenderView::leaveEvent(QEvent* event)
+{
+    hoverPending = false;
+    if (hoveredPart) {
+        hoveredPart = 0;
+        emit partHovered(0);
+    }
+    QWidget::leaveEvent(event);
+}
+
+/**
+ * @brief Returns the part under a point of the widget.
+ *
+ * The point is scaled to the frame, which differs from the widget size in device
+ * pixels and while a resize is pending.
+ * @param pos The point, in widget coordinates.
+ * @param id Receives the part's id, or 0.
+ * @return False if the render thread has not drawn the ID buffer of the latest frame yet.
+ */
+bool RenderView::partUnder(const QPoint& pos, quintptr& id) const
+{
+    id = 0;
+    if (frame.isNull() || width() <= 0 || height() <= 0)
+        return true;
+    return renderThread->partAt(pos.x() * frame.width() / width(), pos.y() * frame.height() / height(), id);
+}
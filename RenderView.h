@@ -0,0 +1,104 @@
+/**
+ * @file RenderView.h
+ * @brief Declaration of the RenderView class.
+ *
+ * The widget that shows the desktop 3D view. It paints the latest frame produced by
+ * a DesktopRenderThread and forwards mouse, wheel, key and resize input to that
+ * thread as camera commands. Clicks and hovering are resolved to parts through
+ * the thread's ID buffer.
+ */
+#ifndef RENDER_VIEW_H
+#define RENDER_VIEW_H
+
+#include <QWidget>
+#include <QImage>
+#include <QPoint>
+
+class DesktopRenderThread;
+
+/**
+ * @brief Displays frames rendered on a DesktopRenderThread.
+ *
+ * Mouse controls follow VTK's trackball camera style: left drag orbits, middle drag
+ * (or shift + left drag) pans, right drag and the wheel zoom, and R resets the camera.
+ * A left click without a drag picks the part under the cursor.
+ */
+class RenderView : public QWidget {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructs the view.
+     * @param thread The render thread to show and control; it is not owned.
+     * @param parent The parent widget.
+     */
+    explicit RenderView(DesktopRenderThread* thread, QWidget* parent = nullptr);
+
+signals:
+    /**
+     * @brief Emitted when the view is clicked without dragging.
+     * @param id Id of the part under the cursor, or 0 for the background.
+     * @param extend True if Ctrl was held, to add to or remove from the selection.
+     */
+    void partClicked(quintptr id, bool extend);
+
+    /**
+     * @brief Emitted when the part under the cursor changes while no button is held.
+     * @param id Id of the part now under the cursor, or 0 for none.
+     */
+    void partHovered(quintptr id);
+
+public slots:
+    /**
+     * @brief Shows a newly rendered frame.
+     * @param frame The frame.
+     */
+    void showFrame(const QImage& frame);
+
+    /**
+     * @brief Answers the hover and click that arrived while the ID buffer was out of date.
+     */
+    void resolvePending();
+
+protected:
+    /** @brief Paints the latest frame, scaled to the widget while a resize is pending. */
+    void paintEvent(QPaintEvent* event) override;
+    /** @brief Tells the render thread the new frame size. */
+    void resizeEvent(QResizeEvent* event) override;
+    /** @brief Starts a camera drag. */
+    void mousePressEvent(QMouseEvent* event) override;
+    /** @brief Turns drag movement into camera commands. */
+    void mouseMoveEvent(QMouseEvent* event) override;
+    /** @brief Ends a camera drag. */
+    void mouseReleaseEvent(QMouseEvent* event) override;
+    /** @brief Zooms the camera. */
+    void wheelEvent(QWheelEvent* event) override;
+    /** @brief Resets the camera on R. */
+    void keyPressEvent(QKeyEvent* event) override;
+    /** @brief Clears the hovered part when the cursor leaves the view. */
+    void leaveEvent(QEvent* event) override;
+
+private:
+    /**
+     * @brief Returns the part under a point of the widget.
+     * @param pos The point, in widget coordinates.
+     * @param id Receives the part's id, or 0.
+     * @return False if the answer must wait for DesktopRenderThread::idBufferReady().
+     */
+    bool partUnder(const QPoint& pos, quintptr& id) const;
+
+    DesktopRenderThread* renderThread;  /**< Thread that renders this view */
+    QImage frame;                       /**< Latest rendered frame */
+    QPoint lastPos;                     /**< Cursor position at the previous drag event */
+    QPoint pressPos;                    /**< Cursor position where the current drag started */
+    quintptr hoveredPart;               /**< Part under the cursor, or 0 */
+    Qt::MouseButton dragButton;         /**< Button of the current drag, or Qt::NoButton */
+    bool panning;                       /**< True if the current drag pans */
+    bool hoverPending;                  /**< True if the hovered part waits for the ID buffer */
+    QPoint hoverPos;                    /**< Cursor position of the pending hover */
+    bool clickPending;                  /**< True if a click waits for the ID buffer */
+    QPoint clickPos;                    /**< Cursor position of the pending click */
+    bool clickExtend;                   /**< Ctrl state of the pending click */
+};
+
+#endif // RENDER_VIEW_H
@@ -0,0 +1,312 @@
+/**
+ * @file RepositoryIndex.cpp
+ * @brief Implementation of the RepositoryIndex class.
+ *
+ * Folders are listed by a dedicated pool of I/O threads: each listed folder queues
+ * its subfolders, so the walk fans out as deep and wide as the tree allows instead
+ * of waiting on one stat at a time.
+ */
+
+#include "RepositoryIndex.h"
+#include "DecompressingDevice.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QSet>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+
+#include <functional>
+
+namespace {
+
+/** Threads listing folders at once; the work waits on the file system, not the CPU. */
+const int scanThreads = 16;
+
+/** Identifies an index file, and its layout version. */
+const quint32 indexMagic = 0x52494458;     // "RIDX"
+const quint32 indexVersion = 1;
+
+/**
+ * @brief Returns the absolute path of a folder or file given relative to a root.
+ */
+QString absolutePath(const QString& root, const QString& relativePath) {
+    return relativePath.isEmpty() ? root : root + '/' + relativePath;
+}
+
+/**
+ * @brief Checks whether a path lies at or below a folder.
+ */
+bool isWithin(const QString& path, const QString& folder) {
+    return path == folder || path.startsWith(folder + '/');
+}
+
+} // namespace
+
+/**
+ * @brief Lists a folder tree in parallel.
+ * @param root The folder to index.
+ * @return The index.
+ */
+RepositoryIndex RepositoryIndex::scan(const QString& root) {
+    RepositoryIndex index;
+    index.m_root = QDir(root).absolutePath();
+    if (!QFileInfo(index.m_root).isDir())
+        return index;
+
+    QMutex mutex;
+    QThreadPool pool;
+    pool.setMaxThreadCount(scanThreads);
+
+    // Tasks queue their subfolders before finishing, so waitForDone() covers the whole tree
+    std::function<void(const QString&)> visit = [&](const QString& relativePath) {
+        Directory directory = list(absolutePath(index.m_root, relativePath));
+        for (const QString& name : directory.subdirectories) {
+            const QString child = childPath(relativePath, name);
+            QtConcurrent::run(&pool, [&visit, child]() { visit(child); });
+        }
+        QMutexLocker locker(&mutex);
+        index.m_directories.insert(relativePath, directory);
+    };
+    visit(QString());
+    pool.waitForDone();
+    return index;
+}
+
+/**
+ * @brief Loads a saved index.
+ * @param root The indexed folder.
+ * @param cacheDirectory Directory holding the indexes.
+ * @return The index, or an empty one.
+ */
+RepositoryIndex RepositoryIndex::load(const QString& root, const QString& cacheDirectory) {
+    RepositoryIndex index;
+    const QString absoluteRoot = QDir(root).absolutePath();
+    QFile file(indexPath(absoluteRoot, cacheDirectory));
+    if (!file.open(QIODevice::ReadOnly))
+        return index;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_12);
+    quint32 magic, version;
+    QString storedRoot;
+    quint32 count;
+    stream >> magic >> version >> storedRoot >> count;
+    if (stream.status() != QDataStream::Ok || magic != indexMagic || version != indexVersion || storedRoot != absoluteRoot)
+        return index;
+
+    index.m_root = absoluteRoot;
+    index.m_directories.reserve(static_cast<int>(count));
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString path;
+        Directory directory;
+        quint32 files;
+        stream >> path >> directory.modified >> directory.subdirectories >> files;
+        for (quint32 j = 0; j < files && stream.status() == QDataStream::Ok; ++j) {
+            File entry;
+            stream >> entry.name >> entry.size >> entry.modified;
+            directory.files.append(entry);
+        }
+        index.m_directories.insert(path, directory);
+    }
+    if (stream.status() != QDataStream::Ok)
+        return RepositoryIndex();
+    return index;
+}
+
+/**
+ * @brief Saves the index.
+ * @param cacheDirectory Directory holding the indexes.
+ * @return True on success.
+ */
+bool RepositoryIndex::save(const QString& cacheDirectory) const {
+    if (isEmpty())
+        return false;
+
+    // QSaveFile renames into place, so a concurrent load never sees half an index
+    QSaveFile file(indexPath(m_root, cacheDirectory));
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_12);
+    stream << indexMagic << indexVersion << m_root << static_cast<quint32>(m_directories.size());
+    for (auto it = m_directories.constBegin(); it != m_directories.constEnd(); ++it) {
+        stream << it.key() << it->modified << it->subdirectories << static_cast<quint32>(it->files.size());
+        for (const File& entry : it->files)
+            stream << entry.name << entry.size << entry.modified;
+    }
+    return stream.status() == QDataStream::Ok && file.commit();
+}
+
+/**
+ * @brief Checks the index against the file system and updates the folders that changed.
+ *
+ * A folder's modification time changes when entries are added, removed or renamed
+ * in it, but not when a file in it is rewritten in place, so the files are checked
+ * as well.
+ * @return Relative paths of the changed folders.
+ */
+QStringList RepositoryIndex::revalidate() {
+    QMutex mutex;
+    QSet<QString> changed;
+    QSet<QString> removed;
+    QThreadPool pool;
+    pool.setMaxThreadCount(scanThreads);
+
+    for (auto it = m_directories.constBegin(); it != m_directories.constEnd(); ++it) {
+        const QString relativePath = it.key();
+        const Directory* directory = &it.value();
+        QtConcurrent::run(&pool, [this, &mutex, &changed, &removed, relativePath, directory]() {
+            const QString path = absolutePath(m_root, relativePath);
+            QFileInfo info(path);
+            bool different = false;
+            if (!info.isDir()) {
+                QMutexLocker locker(&mutex);
+                removed.insert(relativePath);
+                return;
+            }
+            if (info.lastModified().toMSecsSinceEpoch() != directory->modified) {
+                different = true;
+            }
+            else {
+                for (const File& entry : directory->files) {
+                    QFileInfo file(path + '/' + entry.name);
+                    if (file.size() != entry.size || file.lastModified().toMSecsSinceEpoch() != entry.modified) {
+                        different = true;
+                        break;
+                    }
+                }
+            }
+            if (different) {
+                QMutexLocker locker(&mutex);
+                changed.insert(relativePath);
+            }
+        });
+    }
+    pool.waitForDone();
+
+    // Drop folders that have gone, with everything below them
+    for (const QString& gone : removed) {
+        for (auto it = m_directories.begin(); it != m_directories.end();) {
+            if (isWithin(it.key(), gone))
+                it = m_directories.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    // List the changed folders again; new subfolders are scanned whole
+    for (const QString& relativePath : changed) {
+        if (!m_directories.contains(relativePath))
+            continue;   // Below a folder that has gone
+        bool ok = true;
+        Directory directory = list(absolutePath(m_root, relativePath), &ok);
+        if (!ok) {
+            removed.insert(relativePath);
+            m_directories.remove(relativePath);
+            continue;
+        }
+        const QStringList before = m_directories.value(relativePath).subdirectories;
+        for (const QString& name : before) {
+            if (directory.subdirectories.contains(name))
+                continue;
+            const QString child = childPath(relativePath, name);
+            for (auto it = m_directories.begin(); it != m_directories.end();) {
+                if (isWithin(it.key(), child))
+                    it = m_directories.erase(it);
+                else
+                    ++it;
+            }
+        }
+        for (const QString& name : directory.subdirectories) {
+            if (before.contains(name))
+                continue;
+            const QString child = childPath(relativePath, name);
+            RepositoryIndex subtree = scan(absolutePath(m_root, child));
+            for (auto it = subtree.m_directories.constBegin(); it != subtree.m_directories.constEnd(); ++it)
+                m_directories.insert(childPath(child, it.key()), it.value());
+        }
+        m_directories.insert(relativePath, directory);
+    }
+
+    QStringList result = (changed + removed).values();
+    result.sort();
+    return result;
+}
+
+/** @brief Checks whether the index is empty. */
+bool RepositoryIndex::isEmpty() const { return m_directories.isEmpty(); }
+
+/** @brief Gets the indexed folder. */
+QString RepositoryIndex::root() const { return m_root; }
+
+/**
+ * @brief Looks up a folder by relative path.
+ * @param relativePath The folder, "" for the root.
+ * @return The folder or null.
+ */
+const RepositoryIndex::Directory* RepositoryIndex::directory(const QString& relativePath) const {
+    auto it = m_directories.constFind(relativePath);
+    return it == m_directories.constEnd() ? nullptr : &it.value();
+}
+
+/**
+ * @brief Joins a relative folder path and an entry name.
+ * @param relativePath The folder.
+ * @param name The entry.
+ * @return The entry's relative path.
+ */
+QString RepositoryIndex::childPath(const QString& relativePath, const QString& name) {
+    return relativePath.isEmpty() ? name : relativePath + '/' + name;
+}
+
+/**
+ * @brief Lists one folder.
+ * @param path Absolute path of the folder.
+ * @param ok Set to false if it is not a folder.
+ * @return Its subfolders and STL files.
+ */
+RepositoryIndex::Directory RepositoryIndex::list(const QString& path, bool* ok) {
+    Directory directory;
+    QFileInfo info(path);
+    if (ok)
+        *ok = info.isDir();
+    if (!info.isDir())
+        return directory;
+
+    directory.modified = info.lastModified().toMSecsSinceEpoch();
+    const QFileInfoList entries = QDir(path).entryInfoList(QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot,
+                                                           QDir::Name | QDir::DirsFirst);
+    for (const QFileInfo& entry : entries) {
+        if (entry.isDir()) {
+            directory.subdirectories.append(entry.fileName());
+        }
+        else if (DecompressingDevice::isStlFile(entry.fileName())) {
+            File file;
+            file.name = entry.fileName();
+            file.size = entry.size();
+            file.modified = entry.lastModified().toMSecsSinceEpoch();
+            directory.files.append(file);
+        }
+    }
+    return directory;
+}
+
+/**
+ * @brief Gets the file an index is saved in.
+ * @param root The indexed folder.
+ * @param cacheDirectory Directory holding the indexes.
+ * @return The path.
+ */
+QString RepositoryIndex::indexPath(const QString& root, const QString& cacheDirectory) {
+    const QByteArray key = QCryptographicHash::hash(root.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return cacheDirectory + '/' + QString::fromLatin1(key) + ".idx";
+}
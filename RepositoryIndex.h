@@ -0,0 +1,111 @@
+/**
+ * @file RepositoryIndex.h
+ * @brief Declaration of the RepositoryIndex class.
+ *
+ * Walking a large repository with QDir stats every entry in turn, which takes
+ * minutes on network file systems. The repository index records the folder
+ * structure with the size and modification time of every STL file. It is built by
+ * listing many folders in parallel and kept on disk, so a later open can build the
+ * tree from it straight away and check it against the file system afterwards.
+ */
+#ifndef REPOSITORY_INDEX_H
+#define REPOSITORY_INDEX_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/**
+ * @brief Snapshot of the STL files in a folder tree.
+ *
+ * Folders are keyed by their path relative to the root, with "" for the root
+ * itself. Entries keep the order QDir lists them in: by name, folders first.
+ */
+class RepositoryIndex {
+public:
+    /**
+     * @brief An STL file as last seen.
+     */
+    struct File {
+        QString name;           /**< File name within its folder */
+        qint64 size = 0;        /**< Size in bytes */
+        qint64 modified = 0;    /**< Modification time, ms since the epoch */
+    };
+
+    /**
+     * @brief A folder as last seen.
+     */
+    struct Directory {
+        qint64 modified = 0;            /**< Modification time, ms since the epoch */
+        QStringList subdirectories;     /**< Names of the folders it contains */
+        QVector<File> files;            /**< The STL files it contains */
+    };
+
+    /**
+     * @brief Lists a folder tree, many folders at a time.
+     * @param root The folder to index.
+     * @return The index; empty if the root does not exist.
+     */
+    static RepositoryIndex scan(const QString& root);
+
+    /**
+     * @brief Loads the index saved for a folder tree.
+     * @param root The indexed folder.
+     * @param cacheDirectory Directory the indexes are kept in.
+     * @return The index, or an empty one if none was saved or it cannot be read.
+     */
+    static RepositoryIndex load(const QString& root, const QString& cacheDirectory);
+
+    /**
+     * @brief Saves the index so load() can find it.
+     * @param cacheDirectory Directory the indexes are kept in.
+     * @return True on success.
+     */
+    bool save(const QString& cacheDirectory) const;
+
+    /**
+     * @brief Checks every folder and file against the file system, many at a time.
+     *
+     * Folders that were added, removed or whose entries changed are listed again
+     * and replaced in the index.
+     * @return Relative paths of the folders that changed; empty if nothing did.
+     */
+    QStringList revalidate();
+
+    /** @brief Returns whether the index holds no folders. */
+    bool isEmpty() const;
+
+    /** @brief Returns the indexed folder. */
+    QString root() const;
+
+    /**
+     * @brief Looks up a folder.
+     * @param relativePath Path relative to the root, "" for the root.
+     * @return The folder, or null if it is not in the index.
+     */
+    const Directory* directory(const QString& relativePath) const;
+
+    /**
+     * @brief Joins a folder's relative path and an entry name.
+     * @return The entry's path relative to the root.
+     */
+    static QString childPath(const QString& relativePath, const QString& name);
+
+private:
+    /**
+     * @brief Lists one folder.
+     * @param ok Set to false if the folder no longer exists.
+     */
+    static Directory list(const QString& absolutePath, bool* ok = nullptr);
+
+    /**
+     * @brief Returns the file an index is saved in.
+     */
+    static QString indexPath(const QString& root, const QString& cacheDirectory);
+
+    QString m_root;                             /**< The indexed folder */
+    QHash<QString, Directory> m_directories;    /**< Folders by relative path */
+};
+
+#endif // REPOSITORY_INDEX_H
@@ -0,0 +1,55 @@
+/**
+ * @file RepositoryScanner.cpp
+ * @brief Implementation of the RepositoryScanner class.
+ */
+
+#include "RepositoryScanner.h"
+
+#include <QDir>
+#include <QMetaObject>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+
+/**
+ * @brief Constructs the scanner.
+ * @param directory Directory for the saved indexes; defaults to the user cache location.
+ * @param parent The parent QObject.
+ */
+RepositoryScanner::RepositoryScanner(const QString& directory, QObject* parent)
+    : QObject(parent), m_directory(directory) {
+    if (m_directory.isEmpty())
+        m_directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/repositories";
+    QDir().mkpath(m_directory);
+}
+
+/**
+ * @brief Returns the index of a folder tree, from disk if it was saved before.
+ * @param root The folder.
+ * @return The index.
+ */
+RepositoryIndex RepositoryScanner::open(const QString& root) {
+    RepositoryIndex index = RepositoryIndex::load(root, m_directory);
+    if (index.isEmpty()) {
+        index = RepositoryIndex::scan(root);
+        index.save(m_directory);
+        return index;
+    }
+
+    const QString indexedRoot = index.root();
+    if (m_running.contains(indexedRoot))
+        return index;
+    m_running.insert(indexedRoot);
+    QtConcurrent::run(QThreadPool::globalInstance(), [this, index, indexedRoot]() mutable {
+        const QStringList changed = index.revalidate();
+        if (!changed.isEmpty())
+            index.save(m_directory);
+
+        QMetaObject::invokeMethod(this, [this, index, indexedRoot, changed]() {
+            m_running.remove(indexedRoot);
+            if (!changed.isEmpty())
+                emit repositoryChanged(index, changed);
+        }, Qt::QueuedConnection);
+    });
+    return index;
+}
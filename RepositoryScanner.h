@@ -0,0 +1,57 @@
+/**
+ * @file RepositoryScanner.h
+ * @brief Declaration of the RepositoryScanner class.
+ *
+ * Opening a folder that was opened before builds the tree from its saved
+ * RepositoryIndex without touching the file system; the index is then checked
+ * against the file system on the global Qt thread pool and saved again if anything
+ * changed.
+ */
+#ifndef REPOSITORY_SCANNER_H
+#define REPOSITORY_SCANNER_H
+
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+#include "RepositoryIndex.h"
+
+/**
+ * @brief Provides repository indexes, scanning or revalidating them as needed.
+ */
+class RepositoryScanner : public QObject {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructs the scanner.
+     * @param directory Directory for the saved indexes; a default location is used if empty.
+     * @param parent The parent QObject.
+     */
+    explicit RepositoryScanner(const QString& directory = QString(), QObject* parent = nullptr);
+
+    /**
+     * @brief Returns the index of a folder tree.
+     *
+     * A saved index is returned at once and revalidated in the background;
+     * otherwise the tree is scanned (in parallel, but blocking) and the index saved.
+     * @param root The folder.
+     * @return The index; empty if the folder does not exist.
+     */
+    RepositoryIndex open(const QString& root);
+
+signals:
+    /**
+     * @brief Emitted on the GUI thread when revalidation found changes on disk.
+     * @param index The revalidated index, as now saved.
+     * @param changedDirectories Folders, relative to the root, that were added, removed or changed.
+     */
+    void repositoryChanged(const RepositoryIndex& index, const QStringList& changedDirectories);
+
+private:
+    QString m_directory;        /**< Directory holding the saved indexes */
+    QSet<QString> m_running;    /**< Roots with a revalidation in flight (GUI thread only) */
+};
+
+#endif // REPOSITORY_SCANNER_H
@@ -0,0 +1,315 @@
+/**
+ * @file SceneExporter.cpp
+ * @brief Implementation of the SceneExporter class.
+ *
+ * Large images are produced with vtkRenderLargeImage, which renders the scene in
+ * framebuffer-sized tiles and stitches them. Sequence frames are copied off the
+ * render window and handed to the thread pool for PNG encoding, so the next frame
+ * renders while earlier ones are still being compressed.
+ */
+
+#include "SceneExporter.h"
+#include "ModelPart.h"
+#include "OctreeChunkCache.h"
+#include "OctreeFile.h"
+
+#include <QDir>
+#include <QFuture>
+#include <QList>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+
+#include <vtkMapper.h>
+#include <vtkMath.h>
+#include <vtkNew.h>
+#include <vtkPNGWriter.h>
+#include <vtkPolyDataMapper.h>
+#include <vtkRenderLargeImage.h>
+#include <vtkWindowToImageFilter.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+/**
+ * @brief Writes an image as a PNG; runs on a pool thread.
+ * @param image The image to write; it is not modified.
+ * @param fileName Output file path.
+ * @return True if the file was written.
+ */
+bool writePng(vtkSmartPointer<vtkImageData> image, const QString& fileName) {
+    vtkNew<vtkPNGWriter> writer;
+    writer->SetInputData(image);
+    writer->SetFileName(fileName.toStdString().c_str());
+    writer->Write();
+    return writer->GetErrorCode() == 0;
+}
+
+} // namespace
+
+/**
+ * @brief Constructs an exporter with an empty offscreen scene.
+ * @param tileWidth Width of the offscreen framebuffer, in pixels.
+ * @param tileHeight Height of the offscreen framebuffer, in pixels.
+ */
+SceneExporter::SceneExporter(int tileWidth, int tileHeight) {
+    renderer = vtkSmartPointer<vtkRenderer>::New();
+    renderer->SetBackground(0.1, 0.1, 0.1);
+
+    window = vtkSmartPointer<vtkRenderWindow>::New();
+    window->SetOffScreenRendering(1);
+    window->SetSize(tileWidth, tileHeight);
+    window->AddRenderer(renderer);
+}
+
+/**
+ * @brief Adds a part and its visible children to the export scene.
+ *
+ * Each actor is a clone: a new mapper over the part's polydata with the GUI mapper's
+ * scalar settings (so overlays export too) and the part's own vtkProperty. An
+ * out-of-core part gets a chunk cache over its octree instead.
+ * @param part The part to add.
+ */
+void SceneExporter::addPart(ModelPart* part) {
+    if (!part || !part->visible())
+        return;
+
+    vtkSmartPointer<vtkActor> source = part->getActor();
+    if (source && part->polyData) {
+        vtkSmartPointer<vtkPolyDataMapper> mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+        mapper->ShallowCopy(source->GetMapper());
+        mapper->SetInputData(part->polyData);
+
+        vtkSmartPointer<vtkActor> actor = vtkSmartPointer<vtkActor>::New();
+        actor->SetMapper(mapper);
+        actor->SetProperty(source->GetProperty());
+        vtkSmartPointer<vtkMatrix4x4> placement = vtkSmartPointer<vtkMatrix4x4>::New();
+        placement->DeepCopy(part->worldTransform());
+        actor->SetUserMatrix(placement);
+        renderer->AddActor(actor);
+    }
+    else if (source && part->octree()) {
+        // Chunks share the part's property, so they export in its colour and opacity
+        StreamedPart streamed;
+        streamed.chunks = std::make_shared<OctreeChunkCache>(part->octree(), source->GetProperty());
+        streamed.transform = vtkSmartPointer<vtkMatrix4x4>::New();
+        streamed.transform->DeepCopy(part->worldTransform());
+        streamedParts.push_back(streamed);
+    }
+
+    for (int i = 0; i < part->childCount(); ++i)
+        addPart(part->child(i));
+}
+
+/**
+ * @brief Copies a camera.
+ * @param camera The camera to copy.
+ */
+void SceneExporter::setCamera(vtkCamera* camera) {
+    renderer->GetActiveCamera()->DeepCopy(camera);
+}
+
+/**
+ * @brief Places the camera so that every added part is in view.
+ */
+void SceneExporter::resetCamera() {
+    // Chunk actors only exist once streamed, so fit out-of-core parts by their octree bounds
+    double bounds[6];
+    vtkMath::UninitializeBounds(bounds);
+    renderer->ComputeVisiblePropBounds(bounds);
+    for (const StreamedPart& streamed : streamedParts) {
+        double box[6];
+        streamed.chunks->octree()->bounds(box);
+        for (int corner = 0; corner < 8; ++corner) {
+            const double in[4] = { box[corner & 1], box[2 + ((corner >> 1) & 1)], box[4 + ((corner >> 2) & 1)], 1.0 };
+            double out[4];
+            streamed.transform->MultiplyPoint(in, out);
+            for (int k = 0; k < 3; ++k) {
+                if (!vtkMath::AreBoundsInitialized(bounds)) {
+                    bounds[2 * k] = bounds[2 * k + 1] = out[k];
+                    continue;
+                }
+                bounds[2 * k] = std::min(bounds[2 * k], out[k]);
+                bounds[2 * k + 1] = std::max(bounds[2 * k + 1], out[k]);
+            }
+        }
+    }
+    if (vtkMath::AreBoundsInitialized(bounds))
+        renderer->ResetCamera(bounds);
+    else
+        renderer->ResetCamera();
+}
+
+/**
+ * @brief Sets the background colour.
+ * @param r Red component (0-1).
+ * @param g Green component (0-1).
+ * @param b Blue component (0-1).
+ */
+void SceneExporter::setBackground(double r, double g, double b) {
+    renderer->SetBackground(r, g, b);
+}
+
+/**
+ * @brief Renders the scene at the current camera.
+ * @param magnification Tiles per image edge; 1 renders a single framebuffer.
+ * @return A copy of the rendered image.
+ */
+vtkSmartPointer<vtkImageData> SceneExporter::renderImage(int magnification) {
+    streamChunks(window->GetSize()[1] * magnification);
+    renderer->ResetCameraClippingRange();
+    vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+
+    if (magnification > 1) {
+        vtkNew<vtkRenderLargeImage> tiles;
+        tiles->SetInput(renderer);
+        tiles->SetMagnification(magnification);
+        tiles->Update();
+        image->DeepCopy(tiles->GetOutput());
+    }
+    else {
+        window->Render();
+        vtkNew<vtkWindowToImageFilter> grab;
+        grab->SetInput(window);
+        grab->ReadFrontBufferOff();
+        grab->Update();
+        image->DeepCopy(grab->GetOutput());
+    }
+    return image;
+}
+
+/**
+ * @brief Shows the chunks of each out-of-core part needed from the current camera.
+ *
+ * The camera is taken into each part's model coordinates, as on the render threads.
+ * No frustum culling is done: tiles of a magnified image each see part of the view,
+ * and the chunks kept for one tile are reused by the next.
+ * @param imageHeight Height of the final image in pixels.
+ */
+void SceneExporter::streamChunks(int imageHeight) {
+    if (streamedParts.empty())
+        return;
+
+    vtkCamera* camera = renderer->GetActiveCamera();
+    double eye[4] = { 0.0, 0.0, 0.0, 1.0 };
+    camera->GetPosition(eye);
+    const double pixelsPerUnit = imageHeight / (2.0 * std::tan(vtkMath::RadiansFromDegrees(camera->GetViewAngle()) / 2.0));
+
+    vtkNew<vtkMatrix4x4> toModel;
+    std::vector<int> selected;
+    std::vector<vtkSmartPointer<vtkActor>> added, evicted;
+    for (const StreamedPart& streamed : streamedParts) {
+        vtkMatrix4x4::Invert(streamed.transform, toModel);
+        double modelEye[4];
+        toModel->MultiplyPoint(eye, modelEye);
+        const double scale = std::cbrt(std::abs(streamed.transform->Determinant()));
+
+        streamed.chunks->octree()->select(modelEye, nullptr, pixelsPerUnit * scale, StreamPixelError, StreamBudget, selected);
+        streamed.chunks->show(selected, StreamBudget, added, evicted);
+        for (const vtkSmartPointer<vtkActor>& actor : evicted)
+            renderer->RemoveActor(actor);
+        for (const vtkSmartPointer<vtkActor>& actor : added) {
+            actor->SetUserMatrix(streamed.transform);
+            renderer->AddActor(actor);
+        }
+    }
+}
+
+/**
+ * @brief Renders a single image and writes it as a PNG.
+ * @param fileName Output file path.
+ * @param magnification Tiles per image edge.
+ * @return True if the image was written.
+ */
+bool SceneExporter::exportSnapshot(const QString& fileName, int magnification) {
+    return writePng(renderImage(qMax(1, magnification)), fileName);
+}
+
+/**
+ * @brief Renders a full orbit about the camera's view-up axis.
+ * @param directory Output directory.
+ * @param frames Number of frames.
+ * @param magnification Tiles per image edge.
+ * @return The number of frames written.
+ */
+int SceneExporter::exportTurntable(const QString& directory, int frames, int magnification) {
+    if (frames < 1)
+        return 0;
+
+    const double step = 360.0 / frames;
+    return exportSequence(directory, frames, magnification, [step](vtkCamera* camera, int frame) {
+        if (frame > 0)
+            camera->Azimuth(step);
+    });
+}
+
+/**
+ * @brief Renders a sequence that moves linearly between camera key frames.
+ * @param directory Output directory.
+ * @param keys At least two camera key frames.
+ * @param framesPerSegment Frames rendered between consecutive keys.
+ * @param magnification Tiles per image edge.
+ * @return The number of frames written.
+ */
+int SceneExporter::exportCameraPath(const QString& directory, const QVector<CameraKey>& keys, int framesPerSegment, int magnification) {
+    if (keys.size() < 2 || framesPerSegment < 1)
+        return 0;
+
+    const int frames = (keys.size() - 1) * framesPerSegment + 1;
+    return exportSequence(directory, frames, magnification, [&keys, framesPerSegment](vtkCamera* camera, int frame) {
+        int segment = qMin(frame / framesPerSegment, keys.size() - 2);
+        double t = static_cast<double>(frame - segment * framesPerSegment) / framesPerSegment;
+        const CameraKey& a = keys[segment];
+        const CameraKey& b = keys[segment + 1];
+
+        double position[3], focalPoint[3], viewUp[3];
+        for (int k = 0; k < 3; ++k) {
+            position[k] = a.position[k] + t * (b.position[k] - a.position[k]);
+            focalPoint[k] = a.focalPoint[k] + t * (b.focalPoint[k] - a.focalPoint[k]);
+            viewUp[k] = a.viewUp[k] + t * (b.viewUp[k] - a.viewUp[k]);
+        }
+        camera->SetPosition(position);
+        camera->SetFocalPoint(focalPoint);
+        camera->SetViewUp(viewUp);
+        camera->OrthogonalizeViewUp();
+    });
+}
+
+/**
+ * @brief Renders a numbered sequence, encoding frames on background threads.
+ *
+ * The number of frames waiting to be encoded is bounded, so a long sequence at a
+ * high magnification does not hold every image in memory at once.
+ * @param directory Output directory.
+ * @param frames Number of frames.
+ * @param magnification Tiles per image edge.
+ * @param placeCamera Called before each frame to position the camera.
+ * @return The number of frames written.
+ */
+int SceneExporter::exportSequence(const QString& directory, int frames, int magnification,
+                                  const std::function<void(vtkCamera*, int)>& placeCamera) {
+    if (!QDir().mkpath(directory))
+        return 0;
+
+    const int maxInFlight = 2 * qMax(1, QThread::idealThreadCount());
+    QList<QFuture<bool>> encoding;
+    int written = 0;
+
+    for (int frame = 0; frame < frames; ++frame) {
+        placeCamera(renderer->GetActiveCamera(), frame);
+        vtkSmartPointer<vtkImageData> image = renderImage(qMax(1, magnification));
+
+        const QString fileName = QDir(directory).filePath(QString("frame_%1.png").arg(frame, 5, 10, QChar('0')));
+        encoding.append(QtConcurrent::run(QThreadPool::globalInstance(), writePng, image, fileName));
+
+        while (encoding.size() >= maxInFlight) {
+            written += encoding.takeFirst().result() ? 1 : 0;
+        }
+    }
+
+    for (QFuture<bool>& future : encoding)
+        written += future.result() ? 1 : 0;
+    return written;
+}
@@ -0,0 +1,160 @@
+/**
+ * @file SceneExporter.h
+ * @brief Declaration of the SceneExporter class.
+ *
+ * The scene exporter renders the visible parts offscreen to produce review images
+ * larger than the GPU framebuffer (by rendering in tiles) and turntable or
+ * camera-path image sequences. It needs no visible window, so it also runs
+ * headlessly on a software (OSMesa/EGL) VTK build.
+ */
+#ifndef SCENE_EXPORTER_H
+#define SCENE_EXPORTER_H
+
+#include <QString>
+#include <QVector>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <vtkSmartPointer.h>
+#include <vtkActor.h>
+#include <vtkCamera.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkRenderWindow.h>
+#include <vtkRenderer.h>
+
+class ModelPart;
+class OctreeChunkCache;
+
+/**
+ * @brief Offscreen renderer for snapshots and image sequences.
+ *
+ * Parts are added as lightweight clones of their GUI actors: new mappers over the
+ * same polydata and the same vtkProperty, so the export shows exactly what
+ * MainWindow shows without sharing OpenGL resources with its render window.
+ *
+ * Out-of-core parts are drawn from their octree: before each image the chunks
+ * needed from the export camera are streamed in at a fixed pixel error, so every
+ * frame of a sequence shows the detail its own viewpoint needs.
+ */
+class SceneExporter {
+public:
+    /**
+     * @brief A camera placement used as a key frame of a camera path.
+     */
+    struct CameraKey {
+        double position[3];     /**< Camera position */
+        double focalPoint[3];   /**< Point the camera looks at */
+        double viewUp[3];       /**< Camera up direction */
+    };
+
+    /**
+     * @brief Constructs an exporter with an empty offscreen scene.
+     * @param tileWidth Width of the offscreen framebuffer (one tile), in pixels.
+     * @param tileHeight Height of the offscreen framebuffer (one tile), in pixels.
+     */
+    SceneExporter(int tileWidth = 1024, int tileHeight = 768);
+
+    /**
+     * @brief Adds a part (and, recursively, its visible children) to the export scene.
+     * @param part The part to add; parts with neither geometry nor an octree are skipped.
+     */
+    void addPart(ModelPart* part);
+
+    /**
+     * @brief Copies a camera, e.g. the one MainWindow is currently viewing through.
+     * @param camera The camera to copy.
+     */
+    void setCamera(vtkCamera* camera);
+
+    /**
+     * @brief Places the camera so that every added part is in view.
+     */
+    void resetCamera();
+
+    /**
+     * @brief Sets the background colour.
+     * @param r Red component (0-1).
+     * @param g Green component (0-1).
+     * @param b Blue component (0-1).
+     */
+    void setBackground(double r, double g, double b);
+
+    /**
+     * @brief Renders a single image and writes it as a PNG.
+     * @param fileName Output file path.
+     * @param magnification The image is this many tiles wide and high.
+     * @return True if the image was written.
+     */
+    bool exportSnapshot(const QString& fileName, int magnification = 1);
+
+    /**
+     * @brief Renders a full 360 degree orbit about the camera's view-up axis.
+     * @param directory Output directory; frames are named frame_00000.png onwards.
+     * @param frames Number of frames in the orbit.
+     * @param magnification Tiles per image edge, as for exportSnapshot().
+     * @return The number of frames written.
+     */
+    int exportTurntable(const QString& directory, int frames, int magnification = 1);
+
+    /**
+     * @brief Renders a sequence that moves linearly between camera key frames.
+     * @param directory Output directory; frames are named frame_00000.png onwards.
+     * @param keys At least two camera key frames.
+     * @param framesPerSegment Frames rendered between consecutive keys.
+     * @param magnification Tiles per image edge, as for exportSnapshot().
+     * @return The number of frames written.
+     */
+    int exportCameraPath(const QString& directory, const QVector<CameraKey>& keys, int framesPerSegment, int magnification = 1);
+
+private:
+    /**
+     * @brief Renders the scene at the current camera, tiling if magnified.
+     * @param magnification Tiles per image edge.
+     * @return A copy of the rendered image.
+     */
+    vtkSmartPointer<vtkImageData> renderImage(int magnification);
+
+    /**
+     * @brief Shows the chunks of each out-of-core part needed from the current camera.
+     * @param imageHeight Height of the final image in pixels.
+     */
+    void streamChunks(int imageHeight);
+
+    /**
+     * @brief Largest simplification error allowed in exported images, in pixels.
+     */
+    static constexpr double StreamPixelError = 0.5;
+
+    /**
+     * @brief Memory each out-of-core part may use while exporting, in bytes.
+     */
+    static const qint64 StreamBudget = 1024LL * 1024 * 1024;
+
+    /**
+     * @brief An out-of-core part in the export scene.
+     */
+    struct StreamedPart {
+        std::shared_ptr<OctreeChunkCache> chunks;   /**< The part's streamed chunks */
+        vtkSmartPointer<vtkMatrix4x4> transform;    /**< Shared by all chunk actors of the part */
+    };
+
+    /**
+     * @brief Renders a numbered sequence, encoding frames on background threads.
+     * @param directory Output directory.
+     * @param frames Number of frames.
+     * @param magnification Tiles per image edge.
+     * @param placeCamera Called before each frame to position the camera.
+     * @return The number of frames written.
+     */
+    int exportSequence(const QString& directory, int frames, int magnification,
+                       const std::function<void(vtkCamera*, int)>& placeCamera);
+
+    vtkSmartPointer<vtkRenderWindow> window;    /**< Offscreen render window (one tile) */
+    vtkSmartPointer<vtkRenderer> renderer;      /**< Renderer holding the cloned actors */
+    std::vector<StreamedPart> streamedParts;    /**< Out-of-core parts, drawn by chunks */
+};
+
+#endif // SCENE_EXPORTER_H
@@ -0,0 +1,58 @@
+/**
+ * @file SceneSnapshot.h
+ * @brief Declaration of the PartSnapshot and SceneSnapshot structures.
+ *
+ * A scene snapshot is a self-contained description of what a render thread should
+ * draw. It is built on the GUI thread and handed over by value, so the render
+ * thread never reads ModelPart, actor or mapper state that the GUI may be changing.
+ */
+#ifndef SCENE_SNAPSHOT_H
+#define SCENE_SNAPSHOT_H
+
+#include <QtGlobal>
+#include <QVector>
+
+#include <memory>
+#include <string>
+
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+#include <vtkScalarsToColors.h>
+
+class ClusterLod;
+class OctreeFile;
+
+/**
+ * @brief Render state of one part at the time the snapshot was taken.
+ *
+ * The geometry and lookup table are copies owned by the part that are replaced,
+ * never modified, when the part changes, so they are safe to read from another thread.
+ */
+struct PartSnapshot {
+    quintptr id = 0;                                /**< Identifies the part across snapshots */
+    vtkSmartPointer<vtkPolyData> geometry;          /**< Geometry to draw, or null if nothing is loaded */
+    std::shared_ptr<const OctreeFile> octree;       /**< If set, the part is out of core and streamed from this instead */
+    double colour[3] = { 1.0, 1.0, 1.0 };           /**< Actor colour (0-1) */
+    double opacity = 1.0;                           /**< Actor opacity (0-1) */
+    bool scalarVisibility = false;                  /**< True if an overlay array colours the part */
+    std::string colorArray;                         /**< Name of the point array used by the overlay */
+    vtkSmartPointer<vtkScalarsToColors> lut;        /**< Lookup table used by the overlay */
+    double scalarRange[2] = { 0.0, 1.0 };           /**< Values mapped to the ends of the lookup table */
+    std::shared_ptr<const ClusterLod> lod;          /**< If set, drawn by clusters instead of as one mesh */
+    double transform[16] = { 1.0, 0.0, 0.0, 0.0,
+                             0.0, 1.0, 0.0, 0.0,
+                             0.0, 0.0, 1.0, 0.0,
+                             0.0, 0.0, 0.0, 1.0 }; /**< Model to scene coordinates, row-major */
+    double bounds[6] = { 1.0, -1.0, 1.0, -1.0, 1.0, -1.0 }; /**< Bounds in scene coordinates; uninitialised if empty */
+};
+
+/**
+ * @brief Everything a render thread needs to draw one version of the scene.
+ */
+struct SceneSnapshot {
+    QVector<PartSnapshot> parts;                    /**< Visible parts */
+    double background[3] = { 0.1, 0.1, 0.1 };       /**< Background colour (0-1) */
+    bool resetCamera = false;                       /**< Fit the camera to the parts before drawing */
+};
+
+#endif // SCENE_SNAPSHOT_H
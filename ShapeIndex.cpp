@@ -0,0 +1,287 @@
+/**
+ * @file ShapeIndex.cpp
+ * @brief Implementation of the ShapeIndex class.
+ */
+
+#include "ShapeIndex.h"
+
+#include <QMetaObject>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+
+#include <vtkCellArray.h>
+#include <vtkCellArrayIterator.h>
+#include <vtkMath.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <random>
+
+namespace {
+
+/**
+ * @brief Surface points sampled per part.
+ */
+const int SamplePoints = 2048;
+
+/**
+ * @brief Point pairs whose distances make up the D2 histogram.
+ */
+const int SamplePairs = 16384;
+
+/**
+ * @brief The histogram covers distances up to this many times the mean pair distance.
+ */
+const double HistogramRange = 3.0;
+
+/**
+ * @brief Returns a uniform value in [0, 1) from a generator.
+ * Drawn by hand rather than with std::uniform_real_distribution, whose output
+ * differs between standard libraries, so descriptors match across platforms.
+ */
+double uniform(std::mt19937& random) {
+    return (random() >> 8) * (1.0 / 16777216.0);
+}
+
+} // namespace
+
+/**
+ * @brief Constructs an empty index.
+ * @param parent The parent QObject.
+ */
+ShapeIndex::ShapeIndex(QObject* parent)
+    : QObject(parent) {
+}
+
+/**
+ * @brief Computes the descriptor of a part's geometry.
+ *
+ * Points are sampled uniformly over the surface, with a fixed seed so the same
+ * geometry always gives the same descriptor. The moments are those of the triangles
+ * weighted by area, so they do not depend on how finely a face is triangulated.
+ * @param polyData The part geometry.
+ * @param descriptor Receives DescriptorSize values.
+ * @return False if the geometry has no surface area.
+ */
+bool ShapeIndex::describe(vtkPolyData* polyData, float descriptor[DescriptorSize]) {
+    vtkCellArray* polys = polyData->GetPolys();
+    if (!polys || polys->GetNumberOfCells() == 0)
+        return false;
+
+    // Triangles with their cumulative area, for area-weighted sampling
+    std::vector<std::array<vtkIdType, 3>> triangles;
+    std::vector<double> cumulative;
+    triangles.reserve(polys->GetNumberOfCells());
+    cumulative.reserve(polys->GetNumberOfCells());
+    double centroid[3] = { 0.0, 0.0, 0.0 };
+    double area = 0.0;
+
+    // The cell array is shared with the part and other workers, so it is walked with
+    // an iterator of our own rather than the array's built-in traversal state
+    vtkIdType npts;
+    const vtkIdType* pts;
+    auto it = vtk::TakeSmartPointer(polys->NewIterator());
+    for (it->GoToFirstCell(); !it->IsDoneWithTraversal(); it->GoToNextCell()) {
+        it->GetCurrentCell(npts, pts);
+        if (npts != 3)
+            continue;
+        double a[3], b[3], c[3], u[3], v[3], n[3];
+        polyData->GetPoint(pts[0], a);
+        polyData->GetPoint(pts[1], b);
+        polyData->GetPoint(pts[2], c);
+        vtkMath::Subtract(b, a, u);
+        vtkMath::Subtract(c, a, v);
+        vtkMath::Cross(u, v, n);
+        const double triangleArea = 0.5 * vtkMath::Norm(n);
+        if (triangleArea <= 0.0)
+            continue;
+
+        area += triangleArea;
+        for (int k = 0; k < 3; ++k)
+            centroid[k] += triangleArea * (a[k] + b[k] + c[k]) / 3.0;
+        triangles.push_back({ pts[0], pts[1], pts[2] });
+        cumulative.push_back(area);
+    }
+    if (area <= 0.0)
+        return false;
+    for (double& c : centroid)
+        c /= area;
+
+    // Area-weighted covariance of the triangles about the centroid
+    double covariance[3][3] = { { 0.0 } };
+    for (const std::array<vtkIdType, 3>& triangle : triangles) {
+        double a[3], b[3], c[3], u[3], v[3], n[3];
+        polyData->GetPoint(triangle[0], a);
+        polyData->GetPoint(triangle[1], b);
+        polyData->GetPoint(triangle[2], c);
+        vtkMath::Subtract(b, a, u);
+        vtkMath::Subtract(c, a, v);
+        vtkMath::Cross(u, v, n);
+        const double weight = 0.5 * vtkMath::Norm(n) / area;
+
+        // Exact second moment of a triangle about the centroid
+        double p[3][3];
+        for (int k = 0; k < 3; ++k) {
+            p[0][k] = a[k] - centroid[k];
+            p[1][k] = b[k] - centroid[k];
+            p[2][k] = c[k] - centroid[k];
+        }
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                const double sum = (p[0][i] + p[1][i] + p[2][i]) * (p[0][j] + p[1][j] + p[2][j]);
+                const double products = p[0][i] * p[0][j] + p[1][i] * p[1][j] + p[2][i] * p[2][j];
+                covariance[i][j] += weight * (sum + products) / 12.0;
+            }
+        }
+    }
+
+    double rows[3][3], vectors[3][3], moments[3];
+    double* matrix[3] = { rows[0], rows[1], rows[2] };
+    double* eigenvectors[3] = { vectors[0], vectors[1], vectors[2] };
+    for (int i = 0; i < 3; ++i)
+        std::copy(covariance[i], covariance[i] + 3, rows[i]);
+    vtkMath::Jacobi(matrix, moments, eigenvectors);
+    const double total = moments[0] + moments[1] + moments[2];
+    if (total <= 0.0)
+        return false;
+
+    // Sample surface points, then histogram the distances of random pairs of them
+    std::mt19937 random(2046);
+    std::vector<std::array<double, 3>> samples(SamplePoints);
+    for (std::array<double, 3>& sample : samples) {
+        const double pick = uniform(random) * area;
+        const size_t index = std::min<size_t>(std::upper_bound(cumulative.begin(), cumulative.end(), pick) - cumulative.begin(),
+                                              triangles.size() - 1);
+        double a[3], b[3], c[3];
+        polyData->GetPoint(triangles[index][0], a);
+        polyData->GetPoint(triangles[index][1], b);
+        polyData->GetPoint(triangles[index][2], c);
+        const double r1 = std::sqrt(uniform(random));
+        const double r2 = uniform(random);
+        for (int k = 0; k < 3; ++k)
+            sample[k] = (1.0 - r1) * a[k] + r1 * (1.0 - r2) * b[k] + r1 * r2 * c[k];
+    }
+
+    std::vector<double> distances(SamplePairs);
+    double mean = 0.0;
+    for (double& d : distances) {
+        const std::array<double, 3>& p = samples[random() % SamplePoints];
+        const std::array<double, 3>& q = samples[random() % SamplePoints];
+        d = std::sqrt(vtkMath::Distance2BetweenPoints(p.data(), q.data()));
+        mean += d;
+    }
+    mean /= SamplePairs;
+
+    std::fill(descriptor, descriptor + DescriptorSize, 0.0f);
+    for (double d : distances) {
+        const int bin = mean > 0.0 ? static_cast<int>(d / (HistogramRange * mean) * HistogramBins) : 0;
+        descriptor[std::min(bin, HistogramBins - 1)] += 1.0f / SamplePairs;
+    }
+
+    // Jacobi returns the moments largest first
+    for (int k = 0; k < 3; ++k)
+        descriptor[HistogramBins + k] = static_cast<float>(moments[k] / total);
+    descriptor[HistogramBins + 3] = static_cast<float>(std::sqrt(total));
+    return true;
+}
+
+/**
+ * @brief Returns how different two descriptors are.
+ * @param a One descriptor.
+ * @param b The other descriptor.
+ * @return The distance.
+ */
+double ShapeIndex::distance(const float a[DescriptorSize], const float b[DescriptorSize]) {
+    double sum = 0.0;
+    for (int k = 0; k < HistogramBins + 3; ++k)
+        sum += std::fabs(a[k] - b[k]);
+    const double radiusA = a[HistogramBins + 3];
+    const double radiusB = b[HistogramBins + 3];
+    return sum + std::fabs(std::log(radiusA / radiusB));
+}
+
+/**
+ * @brief Queues the descriptor of one part's geometry on the global thread pool.
+ * @param hash Content hash of the part's source file.
+ * @param polyData The part geometry.
+ */
+void ShapeIndex::submit(const QByteArray& hash, vtkSmartPointer<vtkPolyData> polyData) {
+    if (hash.isEmpty() || !polyData || m_rows.contains(hash) || m_running.contains(hash))
+        return;
+
+    // The worker reads its own shallow copy, so array changes on the GUI side do not reach it
+    vtkSmartPointer<vtkPolyData> input = vtkSmartPointer<vtkPolyData>::New();
+    input->ShallowCopy(polyData);
+
+    m_running.insert(hash);
+    QtConcurrent::run(QThreadPool::globalInstance(), [this, hash, input]() {
+        std::array<float, DescriptorSize> descriptor;
+        const bool described = describe(input, descriptor.data());
+        QMetaObject::invokeMethod(this, [this, hash, described, descriptor]() {
+            m_running.remove(hash);
+            if (!described || m_rows.contains(hash))
+                return;
+            m_rows.insert(hash, m_hashes.size());
+            m_hashes.append(hash);
+            m_table.insert(m_table.end(), descriptor.begin(), descriptor.end());
+            emit descriptorReady(hash);
+        }, Qt::QueuedConnection);
+    });
+}
+
+/**
+ * @brief Checks whether a content hash has a descriptor yet.
+ * @param hash Content hash of the geometry.
+ * @return True if it is indexed.
+ */
+bool ShapeIndex::contains(const QByteArray& hash) const {
+    return m_rows.contains(hash);
+}
+
+/**
+ * @brief Finds the indexed shapes most like one already indexed.
+ *
+ * A descriptor is a few dozen floats, so a linear scan of the flat table answers a
+ * query over tens of thousands of parts in well under a millisecond; a spatial
+ * tree would not pay for itself in 36 dimensions.
+ * @param hash Content hash of the shape to match.
+ * @param count Largest number of shapes to return.
+ * @param maximumDistance Only shapes at most this far away are returned.
+ * @return Content hashes with their distance, nearest first.
+ */
+QVector<QPair<QByteArray, double>> ShapeIndex::nearest(const QByteArray& hash, int count, double maximumDistance) const {
+    QVector<QPair<QByteArray, double>> found;
+    const int row = m_rows.value(hash, -1);
+    if (row < 0 || count <= 0)
+        return found;
+
+    const float* query = m_table.data() + static_cast<size_t>(row) * DescriptorSize;
+    for (int i = 0; i < m_hashes.size(); ++i) {
+        if (i == row)
+            continue;
+        const double d = distance(query, m_table.data() + static_cast<size_t>(i) * DescriptorSize);
+        if (d <= maximumDistance)
+            found.append(qMakePair(m_hashes[i], d));
+    }
+
+    auto nearer = [](const QPair<QByteArray, double>& a, const QPair<QByteArray, double>& b) { return a.second < b.second; };
+    if (found.size() > count) {
+        std::partial_sort(found.begin(), found.begin() + count, found.end(), nearer);
+        found.resize(count);
+    }
+    else {
+        std::sort(found.begin(), found.end(), nearer);
+    }
+    return found;
+}
+
+/**
+ * @brief Drops all descriptors.
+ * Descriptors still being computed are added when they finish.
+ */
+void ShapeIndex::clear() {
+    m_rows.clear();
+    m_hashes.clear();
+    m_table.clear();
+}
@@ -0,0 +1,117 @@
+/**
+ * @file ShapeIndex.h
+ * @brief Declaration of the ShapeIndex class.
+ *
+ * Content hashes only find byte-identical files. Large repositories also hold
+ * near-identical parts: revisions with a moved hole, re-exports with a different
+ * triangulation, mirrored variants. The shape index gives each part a small shape
+ * descriptor when it is loaded, so parts can be ranked by how alike they look.
+ */
+#ifndef SHAPE_INDEX_H
+#define SHAPE_INDEX_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QPair>
+#include <QSet>
+#include <QVector>
+
+#include <vector>
+
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+
+/**
+ * @brief Computes shape descriptors in the background and answers nearest-neighbour queries.
+ *
+ * A descriptor is the D2 shape distribution of the surface (a histogram of the
+ * distances between random surface point pairs, relative to their mean) followed by
+ * the principal moments of the surface relative to their sum, and the surface's RMS
+ * radius. All of these are unchanged by rotation, translation and mirroring, and
+ * only the radius depends on scale. Descriptors are kept by content hash, one row
+ * per hash in a flat table that queries scan without indirection.
+ */
+class ShapeIndex : public QObject {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Number of histogram bins in the D2 part of a descriptor.
+     */
+    static const int HistogramBins = 32;
+
+    /**
+     * @brief Number of values in a descriptor: the histogram, three moments and the radius.
+     */
+    static const int DescriptorSize = HistogramBins + 4;
+
+    /**
+     * @brief Constructs an empty index.
+     * @param parent The parent QObject.
+     */
+    explicit ShapeIndex(QObject* parent = nullptr);
+
+    /**
+     * @brief Computes the descriptor of a part's geometry.
+     * @param polyData The part geometry.
+     * @param descriptor Receives DescriptorSize values.
+     * @return False if the geometry has no surface area.
+     */
+    static bool describe(vtkPolyData* polyData, float descriptor[DescriptorSize]);
+
+    /**
+     * @brief Returns how different two descriptors are.
+     *
+     * The sum of the L1 distances of the histograms and of the moments, plus the
+     * absolute log ratio of the radii. 0 means the same shape at the same size.
+     * @param a One descriptor.
+     * @param b The other descriptor.
+     * @return The distance.
+     */
+    static double distance(const float a[DescriptorSize], const float b[DescriptorSize]);
+
+    /**
+     * @brief Queues the descriptor of one part's geometry.
+     * Hashes already indexed or running are skipped.
+     * @param hash Content hash of the part's source file.
+     * @param polyData The part geometry; it is only read by the worker.
+     */
+    void submit(const QByteArray& hash, vtkSmartPointer<vtkPolyData> polyData);
+
+    /**
+     * @brief Checks whether a content hash has a descriptor yet.
+     * @param hash Content hash of the geometry.
+     * @return True if it is indexed.
+     */
+    bool contains(const QByteArray& hash) const;
+
+    /**
+     * @brief Finds the indexed shapes most like one already indexed.
+     * @param hash Content hash of the shape to match; it is not returned itself.
+     * @param count Largest number of shapes to return.
+     * @param maximumDistance Only shapes at most this distance() away are returned.
+     * @return Content hashes with their distance, nearest first.
+     */
+    QVector<QPair<QByteArray, double>> nearest(const QByteArray& hash, int count, double maximumDistance) const;
+
+    /**
+     * @brief Drops all descriptors, e.g. when the tree is cleared.
+     */
+    void clear();
+
+signals:
+    /**
+     * @brief Emitted on the GUI thread when a descriptor has been added.
+     * @param hash Content hash of the geometry.
+     */
+    void descriptorReady(const QByteArray& hash);
+
+private:
+    QHash<QByteArray, int> m_rows;      /**< Row of each content hash in the table (GUI thread only) */
+    QVector<QByteArray> m_hashes;       /**< Content hash of each row */
+    std::vector<float> m_table;         /**< DescriptorSize values per row */
+    QSet<QByteArray> m_running;         /**< Content hashes with a task in flight (GUI thread only) */
+};
+
+#endif // SHAPE_INDEX_H
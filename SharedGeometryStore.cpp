@@ -0,0 +1,117 @@
+/**
+ * @file SharedGeometryStore.cpp
+ * @brief Implementation of the SharedGeometryStore class.
+ *
+ * A segment is created and filled under its QSharedMemory lock, and PackedMesh
+ * writes the header last; an instance that attaches while the segment is still
+ * being filled sees an invalid header and loads the file itself.
+ */
+
+#include "SharedGeometryStore.h"
+#include "PackedMesh.h"
+
+#include <QMutexLocker>
+#include <QSharedMemory>
+
+#include <limits>
+
+/**
+ * @brief Constructs a store.
+ * @param retainedBytes Budget for segments kept attached but unused.
+ * @param prefix Prefix of the segment names.
+ */
+SharedGeometryStore::SharedGeometryStore(qint64 retainedBytes, const QString& prefix)
+    : m_prefix(prefix), m_retainedBytes(retainedBytes) {
+}
+
+/**
+ * @brief Looks up a published mesh.
+ * @param hash Content hash of the source file.
+ * @return The mesh, or null.
+ */
+vtkSmartPointer<vtkPolyData> SharedGeometryStore::find(const QByteArray& hash) {
+    if (hash.isEmpty())
+        return nullptr;
+
+    std::shared_ptr<QSharedMemory> segment;
+    {
+        QMutexLocker locker(&m_mutex);
+        segment = m_retained.value(hash);
+    }
+    if (!segment) {
+        segment = std::make_shared<QSharedMemory>(key(hash));
+        if (!segment->attach(QSharedMemory::ReadOnly))
+            return nullptr;
+    }
+
+    segment->lock();
+    vtkSmartPointer<vtkPolyData> mesh = PackedMesh::view(static_cast<const uchar*>(segment->constData()),
+                                                         segment->size(), segment);
+    segment->unlock();
+    if (mesh)
+        retain(hash, segment);
+    return mesh;
+}
+
+/**
+ * @brief Publishes a mesh in a new segment.
+ * @param hash Content hash of the source file.
+ * @param mesh The mesh.
+ * @return A mesh backed by the segment, or null.
+ */
+vtkSmartPointer<vtkPolyData> SharedGeometryStore::publish(const QByteArray& hash, vtkPolyData* mesh) {
+    const qint64 size = PackedMesh::packedSize(mesh);
+    if (hash.isEmpty() || size < 0 || size > std::numeric_limits<int>::max())
+        return nullptr;
+
+    std::shared_ptr<QSharedMemory> segment = std::make_shared<QSharedMemory>(key(hash));
+    if (!segment->create(static_cast<int>(size))) {
+        // Another instance published it first
+        if (segment->error() == QSharedMemory::AlreadyExists)
+            return find(hash);
+        return nullptr;
+    }
+
+    segment->lock();
+    const bool packed = PackedMesh::pack(mesh, static_cast<uchar*>(segment->data()));
+    vtkSmartPointer<vtkPolyData> shared = packed
+        ? PackedMesh::view(static_cast<const uchar*>(segment->constData()), segment->size(), segment)
+        : nullptr;
+    segment->unlock();
+    if (shared)
+        retain(hash, segment);
+    return shared;
+}
+
+/**
+ * @brief Keeps a segment attached and evicts the least recently used ones over budget.
+ * @param hash Content hash of the segment's mesh.
+ * @param segment The segment.
+ */
+void SharedGeometryStore::retain(const QByteArray& hash, const std::shared_ptr<QSharedMemory>& segment) {
+    QMutexLocker locker(&m_mutex);
+    if (m_retained.contains(hash)) {
+        m_order.removeOne(hash);
+        m_order.append(hash);
+        return;
+    }
+    m_retained.insert(hash, segment);
+    m_order.append(hash);
+    m_retainedSize += segment->size();
+
+    // Evicted segments stay attached while meshes still borrow them
+    while (m_retainedSize > m_retainedBytes && m_order.size() > 1) {
+        const QByteArray oldest = m_order.takeFirst();
+        m_retainedSize -= m_retained.value(oldest)->size();
+        m_retained.remove(oldest);
+    }
+}
+
+/**
+ * @brief Gets the segment name for a content hash.
+ * @param hash The content hash.
+ * @return The name.
+ */
+QString SharedGeometryStore::key(const QByteArray& hash) const {
+    return m_prefix + '-' + QString::fromLatin1(hash);
+}
@@ -0,0 +1,82 @@
+/**
+ * @file SharedGeometryStore.h
+ * @brief Declaration of the SharedGeometryStore class.
+ *
+ * Several viewer instances on one workstation usually open the same repository,
+ * and each would otherwise hold its own copy of every mesh. The shared geometry
+ * store publishes each welded mesh once, as a PackedMesh in a shared memory
+ * segment named after its content hash; other instances attach to the segment
+ * read-only instead of loading the file again.
+ */
+#ifndef SHARED_GEOMETRY_STORE_H
+#define SHARED_GEOMETRY_STORE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+
+#include <memory>
+
+class QSharedMemory;
+
+/**
+ * @brief Cross-process store of immutable meshes, keyed by content hash.
+ *
+ * The operating system counts the processes attached to each segment and frees
+ * it when the last one detaches. A process stays attached while any mesh it was
+ * given still uses the segment; beyond that it keeps the most recently used
+ * segments attached up to a byte budget, so geometry outlives a closed tree for
+ * instances that open it next, and evicts the rest.
+ */
+class SharedGeometryStore {
+public:
+    /**
+     * @brief Constructs a store.
+     * @param retainedBytes Segments not used by any mesh are kept attached up to this many bytes.
+     * @param prefix Prefix of the segment names; instances with the same prefix share geometry.
+     */
+    explicit SharedGeometryStore(qint64 retainedBytes = qint64(1) << 30,
+                                 const QString& prefix = QStringLiteral("stlviewer-geometry"));
+
+    /**
+     * @brief Looks up a mesh published by this or another instance.
+     * @param hash Content hash of the part's source file.
+     * @return A read-only mesh backed by the segment, or null if none is published.
+     */
+    vtkSmartPointer<vtkPolyData> find(const QByteArray& hash);
+
+    /**
+     * @brief Publishes a mesh for other instances.
+     * @param hash Content hash of the part's source file.
+     * @param mesh The welded triangle mesh.
+     * @return A read-only mesh backed by the segment, to be used instead of @p mesh so
+     *         the process does not hold a second copy; null if it could not be published.
+     */
+    vtkSmartPointer<vtkPolyData> publish(const QByteArray& hash, vtkPolyData* mesh);
+
+private:
+    /**
+     * @brief Keeps a segment attached for reuse and evicts the least recently used beyond the budget.
+     */
+    void retain(const QByteArray& hash, const std::shared_ptr<QSharedMemory>& segment);
+
+    /**
+     * @brief Returns the segment name for a content hash.
+     */
+    QString key(const QByteArray& hash) const;
+
+    QString m_prefix;           /**< Prefix of the segment names */
+    qint64 m_retainedBytes;     /**< Budget for retained segments */
+
+    QMutex m_mutex;                                             /**< Guards the fields below */
+    QHash<QByteArray, std::shared_ptr<QSharedMemory>> m_retained;   /**< Retained segments */
+    QList<QByteArray> m_order;                                  /**< Retained hashes, least recently used first */
+    qint64 m_retainedSize = 0;                                  /**< Bytes in m_retained */
+};
+
+#endif // SHARED_GEOMETRY_STORE_H
@@ -0,0 +1,217 @@
+/**
+ * @file StlTriangleReader.cpp
+ * @brief Implementation of the StlTriangleReader class.
+ *
+ * A binary STL is an 80-byte header, a 32-bit triangle count and 50-byte records
+ * (normal, three corners, attribute word). Some exporters write binary files whose
+ * header begins with "solid", so a file is only treated as ASCII if it begins with
+ * "solid" and its size does not match the binary layout or, for streams whose size
+ * is unknown, a "facet" keyword follows.
+ */
+
+#include "StlTriangleReader.h"
+
+#include <QIODevice>
+#include <QtEndian>
+
+#include <vtkCellArray.h>
+#include <vtkPoints.h>
+
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+/** Bytes read from the device at a time. */
+const int readSize = 1 << 20;
+
+/** Bytes in one binary triangle record. */
+const int recordSize = 50;
+
+/**
+ * @brief Bit pattern of a corner, used to merge corners that are exactly equal.
+ */
+struct CornerKey {
+    quint32 bits[3];
+    bool operator==(const CornerKey& other) const {
+        return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+    }
+};
+
+struct CornerHash {
+    size_t operator()(const CornerKey& key) const {
+        quint64 h = key.bits[0];
+        h = h * 0x9E3779B97F4A7C15ull ^ key.bits[1];
+        h = h * 0x9E3779B97F4A7C15ull ^ key.bits[2];
+        return static_cast<size_t>(h ^ (h >> 32));
+    }
+};
+
+} // namespace
+
+/**
+ * @brief Constructs a reader.
+ * @param source The open device to read from.
+ */
+StlTriangleReader::StlTriangleReader(QIODevice* source)
+    : device(source), position(0), binary(true), declared(0), remaining(0) {
+}
+
+/**
+ * @brief Reads the header and detects the format.
+ * @return False if the stream is too short to be an STL.
+ */
+bool StlTriangleReader::readHeader() {
+    if (!fill(84))
+        return false;
+
+    const char* data = buffer.constData() + position;
+    quint32 count = qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(data + 80));
+
+    binary = true;
+    if (std::strncmp(data, "solid", 5) == 0) {
+        if (!device->isSequential()) {
+            binary = device->size() == 84 + static_cast<qint64>(count) * recordSize;
+        }
+        else {
+            fill(512);
+            binary = !buffer.mid(position, 512).contains("facet");
+        }
+    }
+
+    if (binary) {
+        declared = count;
+        remaining = count;
+        position += 84;
+    }
+    else {
+        declared = -1;
+    }
+    return true;
+}
+
+/** @brief Checks whether the stream is a binary STL. */
+bool StlTriangleReader::isBinary() const { return binary; }
+
+/** @brief Gets the triangle count from a binary header, or -1 for ASCII. */
+qint64 StlTriangleReader::declaredCount() const { return declared; }
+
+/**
+ * @brief Reads the next triangle.
+ * @param corners Receives nine coordinates.
+ * @return False at the end of the stream.
+ */
+bool StlTriangleReader::next(float corners[9]) {
+    if (!binary)
+        return nextAscii(corners);
+
+    if (remaining <= 0 || !fill(recordSize))
+        return false;
+
+    // Skip the 12-byte normal; the corners follow as little-endian floats
+    const uchar* record = reinterpret_cast<const uchar*>(buffer.constData() + position);
+    for (int k = 0; k < 9; ++k) {
+        quint32 bits = qFromLittleEndian<quint32>(record + 12 + 4 * k);
+        std::memcpy(&corners[k], &bits, sizeof(float));
+    }
+    position += recordSize;
+    --remaining;
+    return true;
+}
+
+/**
+ * @brief Reads the next ASCII triangle.
+ * @param corners Receives nine coordinates.
+ * @return False at the end of the stream.
+ */
+bool StlTriangleReader::nextAscii(float corners[9]) {
+    int vertices = 0;
+    while (vertices < 3) {
+        // Make sure a whole line is buffered, unless the stream ends first
+        int end;
+        while ((end = buffer.indexOf('\n', position)) < 0) {
+            if (!fill(buffer.size() - position + readSize))
+                break;
+        }
+        if (end < 0)
+            end = buffer.size();
+        if (position >= end && end == buffer.size())
+            return false;
+
+        QByteArray line = buffer.mid(position, end - position).trimmed();
+        position = end + 1;
+
+        if (!line.startsWith("vertex"))
+            continue;
+        QList<QByteArray> fields = line.simplified().split(' ');
+        if (fields.size() < 4)
+            return false;
+        for (int k = 0; k < 3; ++k)
+            corners[3 * vertices + k] = fields[k + 1].toFloat();
+        ++vertices;
+    }
+    return true;
+}
+
+/**
+ * @brief Makes bytes available in the buffer.
+ * @param bytes The number of unconsumed bytes needed.
+ * @return True if that many are available.
+ */
+bool StlTriangleReader::fill(int bytes) {
+    if (buffer.size() - position >= bytes)
+        return true;
+
+    // Drop consumed bytes before reading more, so the buffer stays small
+    buffer.remove(0, position);
+    position = 0;
+    while (buffer.size() < bytes) {
+        QByteArray more = device->read(qMax(readSize, bytes - buffer.size()));
+        if (more.isEmpty())
+            break;
+        buffer.append(more);
+    }
+    return buffer.size() >= bytes;
+}
+
+/**
+ * @brief Reads a whole STL stream into a mesh with merged points.
+ * @param device The open device.
+ * @return The mesh, or null if the stream is not an STL.
+ */
+vtkSmartPointer<vtkPolyData> StlTriangleReader::readPolyData(QIODevice* device) {
+    StlTriangleReader reader(device);
+    if (!reader.readHeader())
+        return nullptr;
+
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+    std::unordered_map<CornerKey, vtkIdType, CornerHash> merged;
+    if (reader.declaredCount() > 0) {
+        // Closed meshes have about half as many points as triangles
+        polys->AllocateEstimate(reader.declaredCount(), 3);
+        points->Allocate(reader.declaredCount() / 2);
+        merged.reserve(static_cast<size_t>(reader.declaredCount() / 2));
+    }
+
+    float t[9];
+    while (reader.next(t)) {
+        vtkIdType ids[3];
+        for (int c = 0; c < 3; ++c) {
+            CornerKey key;
+            std::memcpy(key.bits, t + 3 * c, sizeof(key.bits));
+            auto found = merged.find(key);
+            if (found == merged.end())
+                found = merged.emplace(key, points->InsertNextPoint(t + 3 * c)).first;
+            ids[c] = found->second;
+        }
+        // Skip triangles that collapse to a line or a point, as vtkSTLReader does
+        if (ids[0] != ids[1] && ids[1] != ids[2] && ids[0] != ids[2])
+            polys->InsertNextCell(3, ids);
+    }
+
+    vtkSmartPointer<vtkPolyData> mesh = vtkSmartPointer<vtkPolyData>::New();
+    mesh->SetPoints(points);
+    mesh->SetPolys(polys);
+    return mesh;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file StlTriangleReader.h
+ * @brief Declaration of the StlTriangleReader class.
+ *
+ * vtkSTLReader builds the whole mesh in memory, which is not possible for files
+ * larger than RAM. The triangle reader instead returns one triangle at a time from
+ * any QIODevice, binary or ASCII, so a file can be processed in passes with only a
+ * small read buffer in memory.
+ */
+#ifndef STL_TRIANGLE_READER_H
+#define STL_TRIANGLE_READER_H
+
+#include <QtGlobal>
+#include <QByteArray>
+
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+
+class QIODevice;
+
+/**
+ * @brief Reads the triangles of an STL stream one at a time.
+ *
+ * Normals stored in the file are skipped; only the three corners are returned.
+ * The device must already be open and is not owned by the reader.
+ */
+class StlTriangleReader {
+public:
+    /**
+     * @brief Constructs a reader for a device positioned at the start of the STL.
+     * @param device The open device to read from.
+     */
+    explicit StlTriangleReader(QIODevice* device);
+
+    /**
+     * @brief Reads the header and works out whether the stream is binary or ASCII.
+     * @return False if the stream is too short to be an STL.
+     */
+    bool readHeader();
+
+    /**
+     * @brief Returns whether the stream holds a binary STL.
+     * @return True for binary, false for ASCII; only valid after readHeader().
+     */
+    bool isBinary() const;
+
+    /**
+     * @brief Returns the triangle count stored in a binary header.
+     * @return The count, or -1 for ASCII files, whose count is only known once read.
+     */
+    qint64 declaredCount() const;
+
+    /**
+     * @brief Reads the next triangle.
+     * @param corners Receives three corners of three coordinates each.
+     * @return False at the end of the stream or on a read error.
+     */
+    bool next(float corners[9]);
+
+    /**
+     * @brief Reads a whole STL stream into a mesh.
+     *
+     * Coincident corners are merged into shared points, as vtkSTLReader does, so
+     * the result can be used wherever a vtkSTLReader output is expected.
+     * @param device The open device, positioned at the start of the STL.
+     * @return The mesh, or null if the stream is not an STL.
+     */
+    static vtkSmartPointer<vtkPolyData> readPolyData(QIODevice* device);
+
+private:
+    /**
+     * @brief Makes at least @p bytes bytes available in the buffer, if the stream has them.
+     * @return True if they are available.
+     */
+    bool fill(int bytes);
+
+    /**
+     * @brief Reads the next ASCII triangle.
+     */
+    bool nextAscii(float corners[9]);
+
+    QIODevice* device;      /**< Source stream */
+    QByteArray buffer;      /**< Bytes read but not consumed yet */
+    int position;           /**< Read position in buffer */
+    bool binary;            /**< True for a binary STL */
+    qint64 declared;        /**< Triangle count from the binary header */
+    qint64 remaining;       /**< Binary triangles still to be read */
+};
+
+#endif // STL_TRIANGLE_READER_H
@@ -0,0 +1,146 @@
+/**
+ * @file TeamCache.cpp
+ * @brief Implementation of the TeamCache class.
+ *
+ * QSaveFile writes to a uniquely named temporary file in the entry's directory,
+ * syncs it and renames it over the entry. Rename within a directory is atomic on
+ * local file systems and on NFS, so concurrent readers and writers never see a
+ * partial entry.
+ */
+
+#include "TeamCache.h"
+
+#include <QBuffer>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+namespace {
+
+/** Bytes copied at a time when publishing or fetching files. */
+const qint64 copySize = 4 * 1024 * 1024;
+
+} // namespace
+
+/**
+ * @brief Constructs a cache over a directory.
+ * @param root The shared directory.
+ */
+TeamCache::TeamCache(const QString& root)
+    : m_root(QDir(root).absolutePath()) {
+    QDir().mkpath(m_root);
+}
+
+/** @brief Gets the shared directory. */
+QString TeamCache::root() const { return m_root; }
+
+/**
+ * @brief Checks whether an entry exists.
+ * @param hash Content hash of the source file.
+ * @param kind Kind of result.
+ * @return True if it exists.
+ */
+bool TeamCache::contains(const QByteArray& hash, const QString& kind) const {
+    return !hash.isEmpty() && QFileInfo::exists(entryPath(hash, kind));
+}
+
+/**
+ * @brief Reads an entry.
+ * @param hash Content hash of the source file.
+ * @param kind Kind of result.
+ * @return The bytes, or an empty array.
+ */
+QByteArray TeamCache::read(const QByteArray& hash, const QString& kind) const {
+    if (hash.isEmpty())
+        return QByteArray();
+    QFile file(entryPath(hash, kind));
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    return file.readAll();
+}
+
+/**
+ * @brief Copies an entry to a local file.
+ * @param hash Content hash of the source file.
+ * @param kind Kind of result.
+ * @param localPath Destination.
+ * @return True on success.
+ */
+bool TeamCache::fetch(const QByteArray& hash, const QString& kind, const QString& localPath) const {
+    if (hash.isEmpty())
+        return false;
+    QFile file(entryPath(hash, kind));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    return copyAtomically(&file, localPath);
+}
+
+/**
+ * @brief Publishes an entry.
+ * @param hash Content hash of the source file.
+ * @param kind Kind of result.
+ * @param data The bytes.
+ * @return True if the entry exists afterwards.
+ */
+bool TeamCache::publish(const QByteArray& hash, const QString& kind, const QByteArray& data) const {
+    if (hash.isEmpty() || data.isEmpty())
+        return false;
+    if (contains(hash, kind))
+        return true;
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+    return copyAtomically(&buffer, entryPath(hash, kind));
+}
+
+/**
+ * @brief Publishes a local file as an entry.
+ * @param hash Content hash of the source file.
+ * @param kind Kind of result.
+ * @param localPath The file.
+ * @return True if the entry exists afterwards.
+ */
+bool TeamCache::publishFile(const QByteArray& hash, const QString& kind, const QString& localPath) const {
+    if (hash.isEmpty())
+        return false;
+    if (contains(hash, kind))
+        return true;
+    QFile file(localPath);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    return copyAtomically(&file, entryPath(hash, kind));
+}
+
+/**
+ * @brief Gets the path of an entry.
+ * @param hash Content hash of the source file.
+ * @param kind Kind of result.
+ * @return The path.
+ */
+QString TeamCache::entryPath(const QByteArray& hash, const QString& kind) const {
+    const QString name = QString::fromLatin1(hash);
+    return m_root + '/' + name.left(2) + '/' + name + '.' + kind;
+}
+
+/**
+ * @brief Copies a device into a file that only appears once complete.
+ * @param source Open device to copy from.
+ * @param destination The file to write.
+ * @return True on success.
+ */
+bool TeamCache::copyAtomically(QIODevice* source, const QString& destination) {
+    QDir().mkpath(QFileInfo(destination).absolutePath());
+    QSaveFile file(destination);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    while (!source->atEnd()) {
+        const QByteArray block = source->read(copySize);
+        if (block.isEmpty() || file.write(block) != block.size()) {
+            file.cancelWriting();
+            break;
+        }
+    }
+    // commit() returns false after cancelWriting(), and removes the temporary file
+    return file.commit();
+}
@@ -0,0 +1,96 @@
+/**
+ * @file TeamCache.h
+ * @brief Declaration of the TeamCache class.
+ *
+ * Every engineer's machine would otherwise repeat the same welding, cluster LOD
+ * and octree preprocessing for the same released parts. The team cache is a
+ * directory shared between machines, such as an NFS path, holding preprocessed
+ * results under the content hash of the source file: a result published by one
+ * viewer is picked up by every other one.
+ */
+#ifndef TEAM_CACHE_H
+#define TEAM_CACHE_H
+
+#include <QByteArray>
+#include <QString>
+
+class QIODevice;
+
+/**
+ * @brief Content-addressed directory of preprocessed geometry shared between machines.
+ *
+ * Entries live at <root>/<first two hash digits>/<hash>.<kind>, where kind names
+ * the result ("mesh", "lod", "oct"). Entries are never modified once written: a
+ * writer fills a temporary file next to the entry and renames it into place, so
+ * readers see either nothing or a complete entry, and concurrent writers of the
+ * same entry (which, being keyed by content, write the same bytes) are harmless.
+ * All methods are thread-safe.
+ */
+class TeamCache {
+public:
+    /**
+     * @brief Constructs a cache over a directory.
+     * @param root The shared directory; created if missing.
+     */
+    explicit TeamCache(const QString& root);
+
+    /** @brief Returns the shared directory. */
+    QString root() const;
+
+    /**
+     * @brief Returns whether an entry exists.
+     * @param hash Content hash of the source file.
+     * @param kind The kind of result.
+     */
+    bool contains(const QByteArray& hash, const QString& kind) const;
+
+    /**
+     * @brief Reads a whole entry.
+     * @param hash Content hash of the source file.
+     * @param kind The kind of result.
+     * @return The entry, or an empty array if there is none.
+     */
+    QByteArray read(const QByteArray& hash, const QString& kind) const;
+
+    /**
+     * @brief Copies an entry to a local file, for results that are used from disk.
+     * @param hash Content hash of the source file.
+     * @param kind The kind of result.
+     * @param localPath The file to write; it only appears once complete.
+     * @return False if there is no entry or it could not be copied.
+     */
+    bool fetch(const QByteArray& hash, const QString& kind, const QString& localPath) const;
+
+    /**
+     * @brief Publishes an entry; does nothing if it already exists.
+     * @param hash Content hash of the source file.
+     * @param kind The kind of result.
+     * @param data The entry.
+     * @return True if the entry exists afterwards.
+     */
+    bool publish(const QByteArray& hash, const QString& kind, const QByteArray& data) const;
+
+    /**
+     * @brief Publishes a local file as an entry; does nothing if it already exists.
+     * @param hash Content hash of the source file.
+     * @param kind The kind of result.
+     * @param localPath The file to publish.
+     * @return True if the entry exists afterwards.
+     */
+    bool publishFile(const QByteArray& hash, const QString& kind, const QString& localPath) const;
+
+private:
+    /**
+     * @brief Returns the path of an entry.
+     */
+    QString entryPath(const QByteArray& hash, const QString& kind) const;
+
+    /**
+     * @brief Copies a device into a file atomically.
+     */
+    static bool copyAtomically(QIODevice* source, const QString& destination);
+
+    QString m_root;     /**< The shared directory */
+};
+
+#endif // TEAM_CACHE_H
@@ -0,0 +1,187 @@
+/**
+ * @file ThumbnailCache.cpp
+ * @brief Implementation of the ThumbnailCache class.
+ *
+ * Each pool thread keeps its own offscreen render window, so thumbnails render in
+ * parallel without sharing an OpenGL context. Large parts are decimated first; a
+ * thumbnail does not need more than a few thousand triangles.
+ */
+
+#include "ThumbnailCache.h"
+
+#include <QDir>
+#include <QMetaObject>
+#include <QPixmap>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+
+#include <vtkActor.h>
+#include <vtkCamera.h>
+#include <vtkImageData.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkPolyDataMapper.h>
+#include <vtkProperty.h>
+#include <vtkQuadricClustering.h>
+#include <vtkRenderWindow.h>
+#include <vtkRenderer.h>
+#include <vtkUnsignedCharArray.h>
+#include <vtkWindowToImageFilter.h>
+
+#include <cstring>
+
+namespace {
+
+const vtkIdType maxThumbnailTriangles = 50000;  /**< Parts above this are decimated before rendering */
+
+} // namespace
+
+/**
+ * @brief Constructs the cache.
+ * @param directory Directory for the persistent cache; defaults to the user cache location.
+ * @param parent The parent QObject.
+ */
+ThumbnailCache::ThumbnailCache(const QString& directory, QObject* parent)
+    : QObject(parent), m_directory(directory) {
+    if (m_directory.isEmpty())
+        m_directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/thumbnails";
+    QDir().mkpath(m_directory);
+}
+
+/**
+ * @brief Returns the thumbnail for a content hash.
+ * @param hash Content hash of the part's STL file.
+ * @return The icon, or a null QIcon if not available yet.
+ */
+QIcon ThumbnailCache::icon(const QByteArray& hash) const {
+    return m_icons.value(hash);
+}
+
+/**
+ * @brief Returns the cache file path for a content hash.
+ * @param hash Content hash of the part's STL file.
+ * @return The path of the PNG file.
+ */
+QString ThumbnailCache::filePath(const QByteArray& hash) const {
+    return m_directory + '/' + QString::fromLatin1(hash) + ".png";
+}
+
+/**
+ * @brief Makes a thumbnail available for a part.
+ * @param hash Content hash of the part's STL file.
+ * @param polyData The part geometry.
+ */
+void ThumbnailCache::request(const QByteArray& hash, vtkSmartPointer<vtkPolyData> polyData) {
+    if (hash.isEmpty() || !polyData || m_icons.contains(hash) || m_pending.contains(hash))
+        return;
+
+    // Thumbnails rendered in an earlier session are small PNGs, so load them right away
+    const QString path = filePath(hash);
+    QImage cached(path);
+    if (!cached.isNull()) {
+        m_icons.insert(hash, QIcon(QPixmap::fromImage(cached)));
+        emit thumbnailReady(hash);
+        return;
+    }
+
+    vtkSmartPointer<vtkPolyData> input = vtkSmartPointer<vtkPolyData>::New();
+    input->ShallowCopy(polyData);
+
+    m_pending.insert(hash);
+    QtConcurrent::run(QThreadPool::globalInstance(), [this, hash, input, path]() {
+        QImage image = render(input);
+
+        // QSaveFile writes to a temporary file and renames it, so readers never see a partial PNG
+        if (!image.isNull()) {
+            QSaveFile file(path);
+            if (file.open(QIODevice::WriteOnly) && image.save(&file, "PNG"))
+                file.commit();
+        }
+
+        QMetaObject::invokeMethod(this, [this, hash, image]() {
+            m_pending.remove(hash);
+            if (image.isNull())
+                return;
+            m_icons.insert(hash, QIcon(QPixmap::fromImage(image)));
+            emit thumbnailReady(hash);
+        }, Qt::QueuedConnection);
+    });
+}
+
+/**
+ * @brief Renders a thumbnail offscreen.
+ *
+ * Runs on a pool thread. The render window is thread-local, so each worker owns its
+ * own context and reuses it for every thumbnail it renders.
+ * @param polyData The geometry to render.
+ * @return The rendered image with a transparent background.
+ */
+QImage ThumbnailCache::render(vtkPolyData* polyData) {
+    thread_local vtkSmartPointer<vtkRenderWindow> window;
+    thread_local vtkSmartPointer<vtkRenderer> renderer;
+    if (!window) {
+        renderer = vtkSmartPointer<vtkRenderer>::New();
+        renderer->SetBackground(0.0, 0.0, 0.0);
+        renderer->SetBackgroundAlpha(0.0);
+
+        window = vtkSmartPointer<vtkRenderWindow>::New();
+        window->SetOffScreenRendering(1);
+        window->SetAlphaBitPlanes(1);
+        window->SetMultiSamples(0);
+        window->SetSize(2 * thumbnailSize, 2 * thumbnailSize);
+        window->AddRenderer(renderer);
+    }
+
+    vtkSmartPointer<vtkPolyData> geometry = polyData;
+    if (polyData->GetNumberOfCells() > maxThumbnailTriangles) {
+        vtkNew<vtkQuadricClustering> decimate;
+        decimate->SetInputData(polyData);
+        decimate->SetNumberOfDivisions(64, 64, 64);
+        decimate->Update();
+        geometry = decimate->GetOutput();
+    }
+    if (geometry->GetNumberOfCells() == 0)
+        return QImage();
+
+    vtkNew<vtkPolyDataMapper> mapper;
+    mapper->SetInputData(geometry);
+    mapper->ScalarVisibilityOff();
+    vtkNew<vtkActor> actor;
+    actor->SetMapper(mapper);
+    actor->GetProperty()->SetColor(0.8, 0.8, 0.8);
+
+    renderer->RemoveAllViewProps();
+    renderer->AddActor(actor);
+
+    // Same isometric view for every part
+    vtkCamera* camera = renderer->GetActiveCamera();
+    camera->SetFocalPoint(0.0, 0.0, 0.0);
+    camera->SetPosition(1.0, -1.0, 1.0);
+    camera->SetViewUp(0.0, 0.0, 1.0);
+    renderer->ResetCamera();
+
+    window->Render();
+
+    vtkNew<vtkWindowToImageFilter> grab;
+    grab->SetInput(window);
+    grab->SetInputBufferTypeToRGBA();
+    grab->ReadFrontBufferOff();
+    grab->Update();
+    renderer->RemoveAllViewProps();
+
+    vtkImageData* pixels = grab->GetOutput();
+    int dims[3];
+    pixels->GetDimensions(dims);
+    vtkUnsignedCharArray* data = vtkUnsignedCharArray::SafeDownCast(pixels->GetPointData()->GetScalars());
+    if (!data)
+        return QImage();
+
+    // VTK images start at the bottom row
+    QImage image(dims[0], dims[1], QImage::Format_RGBA8888);
+    for (int y = 0; y < dims[1]; ++y) {
+        std::memcpy(image.scanLine(dims[1] - 1 - y), data->GetPointer(4 * y * dims[0]), 4 * dims[0]);
+    }
+    return image.scaled(thumbnailSize, thumbnailSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+}
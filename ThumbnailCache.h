@@ -0,0 +1,90 @@
+/**
+ * @file ThumbnailCache.h
+ * @brief Declaration of the ThumbnailCache class.
+ *
+ * Thumbnails of parts are rendered offscreen on worker threads and kept in a
+ * persistent on-disk cache keyed by the content hash of the part's STL file, so
+ * that reopening a repository shows the icons straight away.
+ */
+#ifndef THUMBNAIL_CACHE_H
+#define THUMBNAIL_CACHE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QIcon>
+#include <QImage>
+#include <QSet>
+#include <QString>
+
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+
+/**
+ * @brief Provides part thumbnails for the tree view's decoration role.
+ *
+ * Icons are served from memory, then from the cache directory, and only rendered
+ * when neither has them. Rendering runs on the global thread pool, with one
+ * offscreen render window per worker thread.
+ */
+class ThumbnailCache : public QObject {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Edge length, in pixels, of the rendered thumbnails.
+     */
+    static const int thumbnailSize = 64;
+
+    /**
+     * @brief Constructs the cache.
+     * @param directory Directory for the persistent cache; a default location is used if empty.
+     * @param parent The parent QObject.
+     */
+    explicit ThumbnailCache(const QString& directory = QString(), QObject* parent = nullptr);
+
+    /**
+     * @brief Returns the thumbnail for a content hash, if one is available.
+     * @param hash Content hash of the part's STL file.
+     * @return The icon, or a null QIcon if it has not been rendered yet.
+     */
+    QIcon icon(const QByteArray& hash) const;
+
+    /**
+     * @brief Makes a thumbnail available for a part.
+     *
+     * Returns immediately. If the thumbnail is on disk it is loaded now; otherwise it is
+     * rendered in the background and thumbnailReady() is emitted when done.
+     * @param hash Content hash of the part's STL file.
+     * @param polyData The part geometry; it is only read by the worker.
+     */
+    void request(const QByteArray& hash, vtkSmartPointer<vtkPolyData> polyData);
+
+signals:
+    /**
+     * @brief Emitted on the GUI thread when a thumbnail becomes available.
+     * @param hash Content hash of the part's STL file.
+     */
+    void thumbnailReady(const QByteArray& hash);
+
+private:
+    /**
+     * @brief Returns the cache file path for a content hash.
+     * @param hash Content hash of the part's STL file.
+     * @return The path of the PNG file.
+     */
+    QString filePath(const QByteArray& hash) const;
+
+    /**
+     * @brief Renders a thumbnail offscreen; runs on a worker thread.
+     * @param polyData The geometry to render.
+     * @return The rendered image, or a null image if rendering failed.
+     */
+    static QImage render(vtkPolyData* polyData);
+
+    QString m_directory;                /**< Persistent cache directory */
+    QHash<QByteArray, QIcon> m_icons;   /**< Icons already loaded (GUI thread only) */
+    QSet<QByteArray> m_pending;         /**< Hashes being rendered (GUI thread only) */
+};
+
+#endif // THUMBNAIL_CACHE_H
@@ -1,181 +1,491 @@
 /**
- * @file VRRenderThread.h
+ * @file VRRenderThread.cpp
  * @brief EEEE2046 - Software Engineering & VR Project
  * Template to add VR rendering to your application.
  * @author P Evans 2022
  */
 
-#pragma once
+#include "VRRenderThread.h"
+
+/* Vtk headers */
+#include "QuantisedPolyDataMapper.h"
+#include "OctreeFile.h"
 
-#include <QThread>
 #include <vtkActor.h>
-#include <vtkActorCollection.h>
-#include <vtkCallbackCommand.h>
-#include <vtkDataSetMapper.h>
+#include <vtkCamera.h>
+#include <vtkMapper.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
 #include <vtkNamedColors.h>
-#include <vtkOpenVRCamera.h>
-#include <vtkOpenVRRenderWindow.h>
-#include <vtkOpenVRRenderWindowInteractor.h>
-#include <vtkOpenVRRenderer.h>
-#include <vtkPolyDataMapper.h>
-#include <vtkProperty.h>
-#include <vtkSTLReader.h>
-#include <vtkSmartPointer.h>
-
-class VRRenderThread : public QThread
-{
-    Q_OBJECT
-
-public:
-    /**
-     * @brief Command to signal the VR rendering loop to terminate.
-     */
-    enum Command {
-        END_RENDER,
-        ROTATE_X,
-        ROTATE_Y,
-        ROTATE_Z
-        // Add more commands as needed
-    };
-
-    /**
-     * @brief Constructor for the VRRenderThread.
-     *
-     * This constructor is called by the MainWindow and runs in the primary program thread.
-     * It initializes the actor list and command variables. The OpenVR rendering components
-     * are initialized in the run() method, as the interactor needs to run in the VR thread.
-     *
-     * @param parent The parent QObject.
-     */
-    explicit VRRenderThread(QObject* parent = nullptr);
-
-    /**
-     * @brief Destructor for the VRRenderThread.
-     *
-     * This destructor is crucial for managing resources. It is called when the VR thread
-     * is stopped. Ensure that all dynamically allocated memory and VTK objects are properly
-     * released here to prevent memory leaks during repeated start/stop cycles of the VR thread.
-     */
-    ~VRRenderThread() override;
-
-    /**
-     * @brief Adds a VTK actor to the list of actors to be rendered in VR.
-     *
-     * This method adds a given vtkActor to the internal collection of actors that will be
-     * part of the VR scene. It also performs an initial transformation to position the
-     * actor in a sensible default location within the VR environment. This method is
-     * intended to be called from the main GUI thread *before* the VR rendering thread is started
-     * or when it's not running to avoid thread safety issues with VTK.
-     *
-     * @param actor A pointer to the vtkActor object to be added to the VR scene.
-     */
-    void addActorOffline(vtkSmartPointer<vtkActor> actor);
-
-    /**
-     * @brief Issues a command to the VR rendering thread to update rendering parameters.
-     *
-     * This method allows the main GUI thread to send commands to the VR rendering thread,
-     * such as rotation updates or a signal to end the rendering loop. This is a thread-safe
-     * way to control the VR scene from the GUI.
-     *
-     * @param cmd An integer representing the command to be executed (e.g., END_RENDER, ROTATE_X).
-     * @param value A double value associated with the command (e.g., rotation angle).
-     */
-    void issueCommand(int cmd, double value);
-
-protected:
-    /**
-     * @brief This function is the entry point for the VR rendering thread.
-     *
-     * It is executed when VRRenderThread::start() is called. This method initializes the
-     * VTK OpenVR rendering pipeline, including the renderer, render window, interactor, and camera.
-     * It then enters a rendering loop that continues until the interactor is done or an
-     * END_RENDER command is received. Within the loop, it updates the VR scene and handles
-     * VR events.
-     */
-    void run() override;
-
-private:
-    vtkSmartPointer<vtkActorCollection> actors;
-    double rotateX;
-    double rotateY;
-    double rotateZ;
-    volatile bool endRender; // volatile for thread-safe access
-    vtkSmartPointer<vtkOpenVRRenderer> renderer;
-    vtkSmartPointer<vtkOpenVRRenderWindow> window;
-    vtkSmartPointer<vtkOpenVRCamera> camera;
-    vtkSmartPointer<vtkOpenVRRenderWindowInteractor> interactor;
-    long long t_last;
-};
-
-// VRRenderThread.cpp
-#include "VRRenderThread.h"
+#include <vtkNew.h>
+#include <vtkPolyData.h>
+#include <vtkTransform.h>
 
-VRRenderThread::VRRenderThread(QObject* parent)
-    : QThread(parent),
-    actors(vtkSmartPointer<vtkActorCollection>::New()),
-    rotateX(0.0),
-    rotateY(0.0),
-    rotateZ(0.0),
-    endRender(false),
-    renderer(nullptr),
-    window(nullptr),
-    camera(nullptr),
-    interactor(nullptr),
-    t_last(0)
+#include <QMutexLocker>
+#include <QSet>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+/**
+ * @brief Constructor. Runs in the GUI thread; the VR objects are created in run().
+ * @param parent The parent QObject.
+ */
+VRRenderThread::VRRenderThread(QObject* parent) : QThread(parent)
 {
+    /* Initialise actor list */
+    actors = vtkSmartPointer<vtkActorCollection>::New();
+
+    /* Initialise command variables */
+    rotateX = 0.;
+    rotateY = 0.;
+    rotateZ = 0.;
+    endRender = false;
+
+    /* A VR frame has about 11 ms, so upload less per frame than the desktop view does */
+    uploadBudget = 16 * 1024 * 1024;
+    streamBudget = 512 * 1024 * 1024;
+
+    /* I have found that this placement will position the FS
+     * car model in a sensible position but you can experiment
+     */
+    vtkNew<vtkTransform> room;
+    room->Translate(0, -100, -200);
+    room->RotateX(-90);
+    placement = vtkSmartPointer<vtkMatrix4x4>::New();
+    placement->DeepCopy(room->GetMatrix());
 }
 
+/**
+ * @brief Destructor. Ends the rendering loop and waits for the thread to finish.
+ */
 VRRenderThread::~VRRenderThread()
 {
-    endRender = true;
-    wait(); // Wait for the thread to finish
+    issueCommand(END_RENDER, 0.);
+    wait();
 }
 
-void VRRenderThread::addActorOffline(vtkSmartPointer<vtkActor> actor)
+/**
+ * @brief Adds an actor to the VR scene; only valid before the thread is started.
+ * @param actor The actor to add.
+ * @param id The part's id.
+ * @param transform The part's model to scene transform.
+ */
+void VRRenderThread::addActorOffline(vtkActor* actor, quintptr id, const double transform[16])
 {
-    /* Check if the render thread is currently running. If not, it's safe to modify the actor list. */
-    if (!isRunning()) {
-        /* Get the original center (origin) of the actor's geometry. */
-        double ac[3];
-        actor->GetOrigin(ac);
+    /* Check to see if render thread is running */
+    if (!this->isRunning()) {
+        addPlaced(id, actor, transform);
+        actors->AddItem(actor);
+        ++mapperUsers[actor->GetMapper()];
+    }
+}
 
-        /* Apply initial transformations to position the actor in the VR scene.
-         * These transformations might need adjustment based on the specific model
-         * and desired orientation/position in VR.
-         */
-        actor->RotateX(-90);                                          /* Rotate the actor -90 degrees around the X-axis. */
-        actor->AddPosition(-ac[0] + 0,                               /* Translate along X, centering based on original X. */
-            -ac[1] - 100,                             /* Translate along Y, moving it back by 100 units. */
-            -ac[2] - 200);                             /* Translate along Z, moving it down by 200 units. */
+/**
+ * @brief Adds a part drawn by clusters; only valid before the thread is started.
+ * @param lod The part's cluster hierarchy.
+ * @param property The part's display property.
+ * @param id The part's id.
+ * @param transform The part's model to scene transform.
+ */
+void VRRenderThread::addLodOffline(std::shared_ptr<const ClusterLod> lod, vtkProperty* property, quintptr id, const double transform[16])
+{
+    if (this->isRunning() || !lod || lod->nodeCount() == 0)
+        return;
 
-        /* Add the transformed actor to the collection of actors to be rendered. */
-        actors->AddItem(actor);
+    LodPart part;
+    part.lod = std::move(lod);
+    part.property = property;
+    part.assembly = vtkSmartPointer<vtkAssembly>::New();
+    part.nodes.resize(part.lod->nodeCount());
+
+    addPlaced(id, part.assembly, transform);
+    lodParts.push_back(part);
+}
+
+/**
+ * @brief Adds an out-of-core part; only valid before the thread is started.
+ * @param octree The part's octree.
+ * @param property The part's display property.
+ * @param id The part's id.
+ * @param transform The part's model to scene transform.
+ */
+void VRRenderThread::addOctreeOffline(std::shared_ptr<const OctreeFile> octree, vtkProperty* property, quintptr id, const double transform[16])
+{
+    if (this->isRunning() || !octree)
+        return;
+
+    StreamedPart part;
+    part.chunks = std::make_shared<OctreeChunkCache>(std::move(octree), property);
+    part.assembly = vtkSmartPointer<vtkAssembly>::New();
+
+    addPlaced(id, part.assembly, transform);
+    streamedParts.push_back(part);
+}
+
+/**
+ * @brief Registers a part's prop and places it.
+ * @param id The part's id.
+ * @param prop The part's actor or assembly.
+ * @param transform The part's model to scene transform.
+ */
+void VRRenderThread::addPlaced(quintptr id, vtkProp3D* prop, const double transform[16])
+{
+    PlacedPart part;
+    part.prop = prop;
+    std::copy(transform, transform + 16, part.transform.begin());
+    prop->SetUserMatrix(vtkSmartPointer<vtkMatrix4x4>::New());
+    place(part);
+    placedParts.insert(id, part);
+}
+
+/**
+ * @brief Places a part's prop in the room.
+ * @param part The part.
+ */
+void VRRenderThread::place(const PlacedPart& part)
+{
+    double matrix[16];
+    vtkMatrix4x4::Multiply4x4(&placement->Element[0][0], part.transform.data(), matrix);
+    part.prop->GetUserMatrix()->DeepCopy(matrix);
+}
+
+/**
+ * @brief Moves a part; picked up by the VR thread at its next frame.
+ * @param id The part's id.
+ * @param transform The part's new model to scene transform.
+ */
+void VRRenderThread::setPartTransform(quintptr id, const double transform[16])
+{
+    QMutexLocker locker(&mutex);
+    std::array<double, 16>& pending = pendingTransforms[id];
+    std::copy(transform, transform + 16, pending.begin());
+}
+
+/**
+ * @brief Changes a part's overlay; picked up by the VR thread at its next frame.
+ * @param part The part's VR snapshot.
+ */
+void VRRenderThread::setPartOverlay(const PartSnapshot& part)
+{
+    QMutexLocker locker(&mutex);
+    pendingOverlays.insert(part.id, part);
+}
+
+/**
+ * @brief Colours a part's actor as given by a snapshot; runs on the VR thread.
+ *
+ * Overlay colours live on the mapper, so an instance sharing its mapper is given
+ * one of its own before it is coloured, and the other instances stay plain.
+ * @param part The part's state.
+ */
+void VRRenderThread::applyOverlay(const PartSnapshot& part)
+{
+    auto placed = placedParts.find(part.id);
+    vtkActor* actor = placed == placedParts.end() ? nullptr : vtkActor::SafeDownCast(placed->prop);
+    if (!actor || !part.geometry)
+        return;
+
+    vtkMapper* mapper = actor->GetMapper();
+    if (!part.scalarVisibility) {
+        // A shared mapper is always plain, and plain drawing needs none of the new arrays
+        if (mapperUsers.value(mapper) <= 1)
+            mapper->ScalarVisibilityOff();
+        return;
     }
-    /* If the thread is running, it's not safe to modify VTK objects from another thread.
-     * Consider using a signal/slot mechanism (or thread-safe data structures) to the VR thread for runtime modifications.
-     */
+
+    if (mapperUsers.value(mapper) > 1) {
+        --mapperUsers[mapper];
+        vtkSmartPointer<QuantisedPolyDataMapper> own = vtkSmartPointer<QuantisedPolyDataMapper>::New();
+        actor->SetMapper(own);
+        mapperUsers.insert(own, 1);
+        mapper = own;
+    }
+
+    if (mapper->GetInput() != part.geometry.GetPointer())
+        mapper->SetInputDataObject(part.geometry);
+    mapper->SetScalarModeToUsePointFieldData();
+    mapper->SelectColorArray(part.colorArray.c_str());
+    mapper->SetLookupTable(part.lut);
+    mapper->SetScalarRange(part.scalarRange);
+    mapper->ScalarVisibilityOn();
 }
 
+/**
+ * @brief Issues a command to the VR thread in a thread-safe manner.
+ * @param cmd A value from the Command enum.
+ * @param value A value associated with the command.
+ */
 void VRRenderThread::issueCommand(int cmd, double value)
 {
-    /* Update the corresponding class variables based on the received command. */
+    QMutexLocker locker(&mutex);
+
+    /* Update class variables according to command */
     switch (cmd) {
-        /* Command to signal the VR rendering loop to terminate. */
+        /* These are just a few basic examples */
     case END_RENDER:
         this->endRender = true;
         break;
 
-        /* Command to update the rotation angle around the X-axis. */
     case ROTATE_X:
         this->rotateX = value;
         break;
 
-        /* Command to update the rotation angle around the Y-axis. */
     case ROTATE_Y:
         this->rotateY = value;
         break;
 
-        /* Command to update the rotation angle around the Z-axis. */
     case ROTATE_Z:
-        this->rotateZ
\ No newline at end of file
+        this->rotateZ = value;
+        break;
+    }
+}
+
+/**
+ * @brief Sets the per-frame upload budget.
+ * @param bytes The budget in bytes.
+ */
+void VRRenderThread::setUploadBudget(qint64 bytes)
+{
+    QMutexLocker locker(&mutex);
+    uploadBudget = bytes;
+}
+
+/**
+ * @brief Sets the memory each out-of-core part may use.
+ * @param bytes The budget in bytes.
+ */
+void VRRenderThread::setStreamBudget(qint64 bytes)
+{
+    QMutexLocker locker(&mutex);
+    streamBudget = bytes;
+}
+
+/**
+ * @brief The VR rendering loop.
+ *
+ * Actors are queued for upload rather than added to the renderer up front; each
+ * pass of the loop adds only the ones that fit in the upload budget, so the
+ * headset keeps its frame rate while a large scene is being uploaded.
+ */
+void VRRenderThread::run()
+{
+    /* You might want to edit the 3D model once VR has started, however VTK is not "thread safe".
+     * This means if you try to edit the VR model from the GUI thread while the VR thread is
+     * running, the program could become corrupted and crash. The solution is to get the VR thread
+     * to edit the model. Any decision to change the VR model will come from the user via the GUI thread,
+     * so there needs to be a mechanism to pass data from the GUI thread to the VR thread.
+     */
+
+    vtkNew<vtkNamedColors> colors;
+
+    // Set the background color.
+    std::array<unsigned char, 4> bkg{ { 26, 51, 102, 255 } };
+    colors->SetColor("BkgColor", bkg.data());
+
+    // The renderer generates the image
+    // which is then displayed on the render window.
+    // It can be thought of as a scene to which the actor is added
+    renderer = vtkSmartPointer<vtkOpenVRRenderer>::New();
+    renderer->SetBackground(colors->GetColor3d("BkgColor").GetData());
+
+    /* Translucent parts use weighted order-independent transparency as on the desktop,
+     * since depth peeling would multiply the cost of each eye's frame */
+    renderer->SetUseDepthPeeling(false);
+    renderer->SetUseOIT(true);
+
+    /* Queue the actors for upload instead of adding them all at once. Instances
+     * sharing a mapper share its upload, so only the first one is counted. */
+    vtkActor* a;
+    QSet<vtkMapper*> counted;
+    actors->InitTraversal();
+    while ((a = (vtkActor*)actors->GetNextActor())) {
+        vtkMapper* mapper = a->GetMapper();
+        vtkPolyData* geometry = vtkPolyData::SafeDownCast(mapper->GetInput());
+        const qint64 bytes = counted.contains(mapper)
+            ? 0 : GpuUploadQueue::estimateBytes(geometry, mapper->GetScalarVisibility());
+        counted.insert(mapper);
+        uploads.enqueue(reinterpret_cast<quintptr>(a), bytes);
+    }
+
+    /* Cluster-drawn parts start empty; their clusters are added as they are selected */
+    for (const LodPart& part : lodParts)
+        renderer->AddActor(part.assembly);
+    for (const StreamedPart& part : streamedParts)
+        renderer->AddActor(part.assembly);
+
+    /* The render window is the actual GUI window
+     * that appears on the computer screen
+     */
+    window = vtkSmartPointer<vtkOpenVRRenderWindow>::New();
+
+    window->Initialize();
+    window->AddRenderer(renderer);
+
+    /* Create Open VR Camera */
+    camera = vtkSmartPointer<vtkOpenVRCamera>::New();
+    renderer->SetActiveCamera(camera);
+
+    /* The render window interactor captures mouse events
+     * and will perform appropriate camera or actor manipulation
+     * depending on the nature of the events.
+     */
+    interactor = vtkSmartPointer<vtkOpenVRRenderWindowInteractor>::New();
+    interactor->SetRenderWindow(window);
+    interactor->Initialize();
+    window->Render();
+
+    /* Now start the VR - we will implement the command loop manually
+     * so it can be interrupted to allow the user to make changes to the model
+     */
+    t_last = std::chrono::steady_clock::now();
+
+    while (!interactor->GetDone()) {
+        double rx, ry, rz;
+        qint64 chunkBudget;
+        QHash<quintptr, std::array<double, 16>> moved;
+        QHash<quintptr, PartSnapshot> overlaid;
+        {
+            QMutexLocker locker(&mutex);
+            if (this->endRender)
+                break;
+            uploads.setBudget(uploadBudget);
+            rx = rotateX;
+            ry = rotateY;
+            rz = rotateZ;
+            chunkBudget = streamBudget;
+            moved.swap(pendingTransforms);
+            overlaid.swap(pendingOverlays);
+        }
+
+        /* Only the parts that moved are placed again */
+        for (auto it = moved.constBegin(); it != moved.constEnd(); ++it) {
+            auto part = placedParts.find(it.key());
+            if (part == placedParts.end())
+                continue;
+            part->transform = it.value();
+            place(*part);
+        }
+
+        for (const PartSnapshot& part : overlaid)
+            applyOverlay(part);
+
+        /* Add this frame's share of the queued actors; their buffers upload as they are drawn */
+        for (quintptr id : uploads.admit())
+            renderer->AddActor(reinterpret_cast<vtkActor*>(id));
+
+        selectClusters();
+        streamChunks(chunkBudget);
+
+        interactor->DoOneEvent(window, renderer);
+
+        /* Check to see if enough time has elapsed since last update
+         * This looks overcomplicated (and it is C++, so it will be!!)
+         * but is just checking if it's more than 20ms (50Hz) since the last update.
+         */
+        if (std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t_last).count() > 20) {
+
+            /* Rotate the whole scene in the room, queued actors too, so they agree once all are shown */
+            if (rx != 0.0 || ry != 0.0 || rz != 0.0) {
+                vtkNew<vtkTransform> room;
+                room->SetMatrix(placement);
+                room->RotateX(rx);
+                room->RotateY(ry);
+                room->RotateZ(rz);
+                placement->DeepCopy(room->GetMatrix());
+                for (const PlacedPart& part : placedParts)
+                    place(part);
+            }
+
+            /* Remember time now */
+            t_last = std::chrono::steady_clock::now();
+        }
+    }
+}
+
+/**
+ * @brief Shows the clusters of each cluster-drawn part that suit the headset position.
+ *
+ * The head position is taken into each part's model coordinates, where the
+ * hierarchy's bounding spheres are defined, and the pixels per unit are scaled by
+ * the part's transform to match. Cluster actors are kept once created
+ * and hidden while not selected.
+ */
+void VRRenderThread::selectClusters()
+{
+    if (lodParts.empty())
+        return;
+
+    double head[4] = { 0.0, 0.0, 0.0, 1.0 };
+    camera->GetPosition(head);
+    const int* size = window->GetSize();
+    const double pixelsPerUnit = size[1] / (2.0 * std::tan(vtkMath::RadiansFromDegrees(camera->GetViewAngle()) / 2.0));
+
+    vtkNew<vtkMatrix4x4> toModel;
+    std::vector<int> selected;
+    for (LodPart& part : lodParts) {
+        vtkMatrix4x4::Invert(part.assembly->GetMatrix(), toModel);
+        double eye[4];
+        toModel->MultiplyPoint(head, eye);
+        // Errors are in model units, so a scaled part is refined as the desktop view does
+        const double scale = std::cbrt(std::abs(part.assembly->GetMatrix()->Determinant()));
+        part.lod->select(eye, pixelsPerUnit * scale, 1.0, selected);
+
+        for (const vtkSmartPointer<vtkActor>& node : part.nodes) {
+            if (node)
+                node->VisibilityOff();
+        }
+        for (int index : selected) {
+            vtkSmartPointer<vtkActor>& node = part.nodes[index];
+            if (!node) {
+                vtkSmartPointer<QuantisedPolyDataMapper> mapper = vtkSmartPointer<QuantisedPolyDataMapper>::New();
+                mapper->SetInputData(part.lod->node(index).geometry);
+                mapper->ScalarVisibilityOff();
+                node = vtkSmartPointer<vtkActor>::New();
+                node->SetMapper(mapper);
+                node->SetProperty(part.property);
+                part.assembly->AddPart(node);
+            }
+            node->VisibilityOn();
+        }
+    }
+}
+
+/**
+ * @brief Streams in the chunks of each out-of-core part needed from the headset position.
+ *
+ * No frustum culling is done: the user can turn their head faster than a chunk
+ * loads, so everything near enough is kept ready, within the budget.
+ * @param budget Memory each part may use, in bytes.
+ */
+void VRRenderThread::streamChunks(qint64 budget)
+{
+    if (streamedParts.empty())
+        return;
+
+    double head[4] = { 0.0, 0.0, 0.0, 1.0 };
+    camera->GetPosition(head);
+    const int* size = window->GetSize();
+    const double pixelsPerUnit = size[1] / (2.0 * std::tan(vtkMath::RadiansFromDegrees(camera->GetViewAngle()) / 2.0));
+
+    vtkNew<vtkMatrix4x4> toModel;
+    std::vector<int> selected;
+    std::vector<vtkSmartPointer<vtkActor>> added, evicted;
+    for (StreamedPart& part : streamedParts) {
+        vtkMatrix4x4::Invert(part.assembly->GetMatrix(), toModel);
+        double eye[4];
+        toModel->MultiplyPoint(head, eye);
+
+        const double scale = std::cbrt(std::abs(part.assembly->GetMatrix()->Determinant()));
+        part.chunks->octree()->select(eye, nullptr, pixelsPerUnit * scale, 1.0, budget, selected);
+        part.chunks->show(selected, budget, added, evicted);
+        for (const vtkSmartPointer<vtkActor>& actor : evicted) {
+            // Assemblies do not release their parts' buffers, so do it before the actor goes
+            actor->ReleaseGraphicsResources(window);
+            part.assembly->RemovePart(actor);
+        }
+        for (const vtkSmartPointer<vtkActor>& actor : added)
+            part.assembly->AddPart(actor);
+    }
+}
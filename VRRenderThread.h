@@ -8,11 +8,21 @@
 #define VR_RENDER_THREAD_H
 
  /* Project headers */
+#include "GpuUploadQueue.h"
+#include "ClusterLod.h"
+#include "OctreeChunkCache.h"
+#include "SceneSnapshot.h"
 
  /* Qt headers */
 #include <QThread>
 #include <QMutex>
 #include <QWaitCondition>
+#include <QHash>
+
+#include <array>
+#include <chrono>
+#include <memory>
+#include <vector>
 
 /* Vtk headers */
 #include <vtkActor.h>
@@ -21,6 +31,9 @@
 #include <vtkOpenVRRenderer.h>
 #include <vtkOpenVRCamera.h>
 #include <vtkActorCollection.h>
+#include <vtkAssembly.h>
+#include <vtkMatrix4x4.h>
+#include <vtkProperty.h>
 #include <vtkCommand.h>
 
 /**
@@ -68,8 +81,66 @@ public:
      * for setting up the initial VR scene.
      *
      * @param actor A pointer to the vtkActor to be added.
+     * @param id Identifies the part in later setPartTransform() calls.
+     * @param transform The part's model to scene transform, row-major.
+     */
+    void addActorOffline(vtkActor* actor, quintptr id, const double transform[16]);
+
+    /**
+     * @brief Adds a part drawn by clusters to the VR scene before the VR interactor starts.
+     *
+     * The part is placed like an actor passed to addActorOffline(). Each frame the
+     * clusters are chosen from the headset position, so the region the user is close
+     * to is drawn at full resolution and the rest is simplified.
+     *
+     * @param lod The part's cluster hierarchy.
+     * @param property The part's display property, shared with its desktop actor.
+     * @param id Identifies the part in later setPartTransform() calls.
+     * @param transform The part's model to scene transform, row-major.
+     */
+    void addLodOffline(std::shared_ptr<const ClusterLod> lod, vtkProperty* property, quintptr id, const double transform[16]);
+
+    /**
+     * @brief Adds an out-of-core part to the VR scene before the VR interactor starts.
+     *
+     * The part is placed like an actor passed to addActorOffline(). Its chunks are
+     * streamed from the octree file as the headset moves, within the stream budget.
+     *
+     * @param octree The part's octree.
+     * @param property The part's display property, shared with its desktop actor.
+     * @param id Identifies the part in later setPartTransform() calls.
+     * @param transform The part's model to scene transform, row-major.
+     */
+    void addOctreeOffline(std::shared_ptr<const OctreeFile> octree, vtkProperty* property, quintptr id, const double transform[16]);
+
+    /**
+     * @brief Moves a part of the VR scene in a thread-safe manner.
+     *
+     * Transforms set before the next frame are merged, and only the parts named are
+     * touched, so moving a subassembly costs one matrix per part in it.
+     *
+     * @param id The id the part was added with.
+     * @param transform The part's new model to scene transform, row-major.
+     */
+    void setPartTransform(quintptr id, const double transform[16]);
+
+    /**
+     * @brief Changes the overlay a part is coloured by, in a thread-safe manner.
+     *
+     * Only the latest overlay set for a part before the next frame is applied. A part
+     * drawn with a mapper shared by other instances is given one of its own there, so
+     * the others stay plain. Parts drawn by clusters or streamed chunks are not overlaid.
+     *
+     * @param part The part's state from ModelPart::vrSnapshot(); its geometry and
+     *        lookup table are copies the GUI thread no longer changes.
      */
-    void addActorOffline(vtkActor* actor);
+    void setPartOverlay(const PartSnapshot& part);
+
+    /**
+     * @brief Sets the memory each out-of-core part may use for its streamed chunks.
+     * @param bytes The budget in bytes.
+     */
+    void setStreamBudget(qint64 bytes);
 
     /**
      * @brief Issues a command to the VR thread in a thread-safe manner.
@@ -83,6 +154,16 @@ public:
      */
     void issueCommand(int cmd, double value);
 
+    /**
+     * @brief Sets how many bytes of geometry may be uploaded to the GPU per VR frame.
+     *
+     * Actors are added to the VR scene a few at a time within this budget, so a large
+     * scene appears over several frames instead of stalling the headset.
+     *
+     * @param bytes The budget in bytes.
+     */
+    void setUploadBudget(qint64 bytes);
+
 protected:
     /**
      * @brief Re-implementation of the QThread::run() function.
@@ -93,6 +174,45 @@ protected:
     void run() override;
 
 private:
+    /**
+     * @brief Shows the clusters of each cluster-drawn part that suit the headset position.
+     */
+    void selectClusters();
+
+    /**
+     * @brief Streams in the chunks of each out-of-core part needed from the headset position.
+     * @param budget Memory each part may use, in bytes.
+     */
+    void streamChunks(qint64 budget);
+
+    /**
+     * @brief A part's actor or assembly and the transform it is placed by.
+     */
+    struct PlacedPart {
+        vtkSmartPointer<vtkProp3D>                  prop;       /**< The part's actor or assembly */
+        std::array<double, 16>                      transform;  /**< Model to scene transform, row-major */
+    };
+
+    /**
+     * @brief Registers a part's prop so it can be placed and moved.
+     * @param id The part's id.
+     * @param prop The part's actor or assembly.
+     * @param transform The part's model to scene transform, row-major.
+     */
+    void addPlaced(quintptr id, vtkProp3D* prop, const double transform[16]);
+
+    /**
+     * @brief Sets a prop's user matrix to the room placement times the part's transform.
+     * @param part The part.
+     */
+    void place(const PlacedPart& part);
+
+    /**
+     * @brief Colours a part's actor as given by a snapshot.
+     * @param part The part's state.
+     */
+    void applyOverlay(const PartSnapshot& part);
+
     /* Standard VTK VR Classes */
     vtkSmartPointer<vtkOpenVRRenderWindow>         window;     /**< The OpenVR render window */
     vtkSmartPointer<vtkOpenVRRenderWindowInteractor> interactor; /**< The OpenVR render window interactor */
@@ -108,6 +228,59 @@ private:
      */
     vtkSmartPointer<vtkActorCollection>             actors;     /**< Collection of actors in the VR scene */
 
+    /**
+     * @brief Actors not yet added to the renderer, released within the per-frame upload budget
+     */
+    GpuUploadQueue                                  uploads;    /**< Pending actor uploads */
+
+    /**
+     * @brief A part drawn by clusters; its cluster actors are parts of one assembly so they move together.
+     */
+    struct LodPart {
+        std::shared_ptr<const ClusterLod>           lod;        /**< The part's hierarchy */
+        vtkSmartPointer<vtkProperty>                property;   /**< Shared by all cluster actors */
+        vtkSmartPointer<vtkAssembly>                assembly;   /**< Places the cluster actors in the scene */
+        std::vector<vtkSmartPointer<vtkActor>>      nodes;      /**< Cluster actors by node index, created when first selected */
+    };
+    std::vector<LodPart>                            lodParts;   /**< Parts drawn by clusters */
+
+    /**
+     * @brief An out-of-core part; its chunk actors are parts of one assembly so they move together.
+     */
+    struct StreamedPart {
+        std::shared_ptr<OctreeChunkCache>           chunks;     /**< The part's streamed chunks */
+        vtkSmartPointer<vtkAssembly>                assembly;   /**< Places the chunk actors in the scene */
+    };
+    std::vector<StreamedPart>                       streamedParts; /**< Out-of-core parts */
+
+    /**
+     * @brief Every part's prop by part id, for placing and moving it
+     */
+    QHash<quintptr, PlacedPart>                     placedParts;
+
+    /**
+     * @brief Part transforms set since the last frame, guarded by the mutex
+     */
+    QHash<quintptr, std::array<double, 16>>         pendingTransforms;
+
+    /**
+     * @brief Part overlays set since the last frame, guarded by the mutex
+     */
+    QHash<quintptr, PartSnapshot>                   pendingOverlays;
+
+    /**
+     * @brief Number of actors drawn with each mapper; only used on the VR thread once it has started
+     */
+    QHash<vtkMapper*, int>                          mapperUsers;
+
+    /**
+     * @brief Puts the scene in the room; applied after each part's own transform.
+     * Only used on the VR thread once it has started.
+     */
+    vtkSmartPointer<vtkMatrix4x4>                   placement;
+    qint64                                          streamBudget;  /**< Bytes of chunks per part, guarded by the mutex */
+    qint64                                          uploadBudget; /**< Bytes uploaded per frame, guarded by the mutex */
+
     /**
      * @brief A timer to help implement animations and visual effects
      */
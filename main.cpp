@@ -3,11 +3,236 @@
  * @brief Entry point for the application.
  *
  * This file contains the main function which initializes the Qt application,
- * creates and displays the main window, and starts the event loop.
+ * creates and displays the main window, and starts the event loop. When started
+ * with one of the export options it instead renders images offscreen and exits
+ * without creating any window; with one of the preprocess options it runs a
+ * step of a distributed preprocessing job.
  */
 
 #include "mainwindow.h"
+#include "DecompressingDevice.h"
+#include "ModelPart.h"
+#include "PreprocessJob.h"
+#include "SceneExporter.h"
+#include "SharedGeometryStore.h"
+#include "TeamCache.h"
 #include <QApplication>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QThreadPool>
+#include <cstring>
+#include <memory>
+
+/**
+ * @brief Returns whether a flag is present on the command line.
+ * @param argc Argument count from the command line.
+ * @param argv Argument vector from the command line.
+ * @param flag The flag, including its dashes.
+ * @return True if present.
+ */
+static bool hasFlag(int argc, char* argv[], const char* flag)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], flag) == 0)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Returns the value given after a flag on the command line.
+ * @param argc Argument count from the command line.
+ * @param argv Argument vector from the command line.
+ * @param flag The flag, including its dashes.
+ * @return The following argument, or an empty string if the flag is absent.
+ */
+static QString flagValue(int argc, char* argv[], const char* flag)
+{
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::strcmp(argv[i], flag) == 0)
+            return QString::fromLocal8Bit(argv[i + 1]);
+    }
+    return QString();
+}
+
+/**
+ * @brief Returns whether the command line asks for a headless export.
+ * @param argc Argument count from the command line.
+ * @param argv Argument vector from the command line.
+ * @return True if an export option is present.
+ */
+static bool isHeadlessExport(int argc, char* argv[])
+{
+    return hasFlag(argc, argv, "--export-snapshot") || hasFlag(argc, argv, "--export-turntable");
+}
+
+/**
+ * @brief Loads every STL under a folder and exports it offscreen.
+ *
+ * Usage:
+ *   viewer --export-snapshot out.png [--tiles N] <folder>
+ *   viewer --export-turntable out_dir [--frames N] [--tiles N] <folder>
+ *
+ * @param argc Argument count from the command line.
+ * @param argv Argument vector from the command line.
+ * @return 0 on success, non-zero on failure.
+ */
+static int runHeadlessExport(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream err(stderr);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Offscreen export of an STL repository");
+    parser.addHelpOption();
+    QCommandLineOption snapshotOption("export-snapshot", "Write a single image to <file>.", "file");
+    QCommandLineOption turntableOption("export-turntable", "Write a turntable sequence to <directory>.", "directory");
+    QCommandLineOption framesOption("frames", "Number of turntable frames.", "count", "120");
+    QCommandLineOption tilesOption("tiles", "Tiles per image edge (image size multiplier).", "count", "1");
+    QCommandLineOption sizeOption("tile-size", "Tile (framebuffer) size as WxH.", "size", "1024x768");
+    parser.addOptions({ snapshotOption, turntableOption, framesOption, tilesOption, sizeOption });
+    parser.addPositionalArgument("folder", "Folder of STL files to render.");
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1) {
+        err << "Expected exactly one folder to render\n";
+        return 1;
+    }
+
+    const QStringList size = parser.value(sizeOption).split('x');
+    int tileWidth = size.value(0).toInt();
+    int tileHeight = size.value(1).toInt();
+    if (tileWidth <= 0 || tileHeight <= 0) {
+        err << "Invalid tile size " << parser.value(sizeOption) << "\n";
+        return 1;
+    }
+
+    // Load every STL into a flat part list; the tree structure is not needed to render
+    ModelPart root({ "Part", "Visible?" });
+    // Compressed parts count too, as in the viewer's repository index
+    QDirIterator it(parser.positionalArguments().first(), QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        QString fileName = it.next();
+        if (!DecompressingDevice::isStlFile(it.fileName()))
+            continue;
+        ModelPart* part = new ModelPart({ QFileInfo(fileName).fileName(), QString("true") });
+        part->loadSTL(fileName);
+        root.appendChild(part);
+    }
+    if (root.childCount() == 0) {
+        err << "No STL files found in " << parser.positionalArguments().first() << "\n";
+        return 1;
+    }
+
+    SceneExporter exporter(tileWidth, tileHeight);
+    for (int i = 0; i < root.childCount(); ++i)
+        exporter.addPart(root.child(i));
+    exporter.resetCamera();
+
+    const int tiles = parser.value(tilesOption).toInt();
+    if (parser.isSet(snapshotOption)) {
+        if (!exporter.exportSnapshot(parser.value(snapshotOption), tiles)) {
+            err << "Could not write " << parser.value(snapshotOption) << "\n";
+            return 1;
+        }
+    }
+    if (parser.isSet(turntableOption)) {
+        const int frames = parser.value(framesOption).toInt();
+        if (exporter.exportTurntable(parser.value(turntableOption), frames, tiles) != frames) {
+            err << "Could not write every turntable frame\n";
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns whether the command line asks for a preprocessing job step.
+ * @param argc Argument count from the command line.
+ * @param argv Argument vector from the command line.
+ * @return True if a preprocess option is present.
+ */
+static bool isPreprocess(int argc, char* argv[])
+{
+    return hasFlag(argc, argv, "--preprocess-init") || hasFlag(argc, argv, "--preprocess-worker")
+        || hasFlag(argc, argv, "--preprocess-status");
+}
+
+/**
+ * @brief Creates, works on or reports a distributed preprocessing job.
+ *
+ * Usage:
+ *   viewer --preprocess-init <job dir> <folder>
+ *   viewer --preprocess-worker <job dir> [--team-cache <dir>] [--retry-failed]
+ *   viewer --preprocess-status <job dir>
+ *
+ * Start as many workers as wanted, on any machines that share the job directory
+ * and the team cache (which defaults to <job dir>/cache). A stopped job is resumed
+ * by starting workers again; --retry-failed also processes the parts that failed.
+ *
+ * @param argc Argument count from the command line.
+ * @param argv Argument vector from the command line.
+ * @return 0 on success, non-zero on failure or if any part failed.
+ */
+static int runPreprocess(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Distributed preprocessing of an STL repository");
+    parser.addHelpOption();
+    QCommandLineOption initOption("preprocess-init", "Create a job in <directory> for a folder.", "directory");
+    QCommandLineOption workerOption("preprocess-worker", "Process parts of the job in <directory>.", "directory");
+    QCommandLineOption statusOption("preprocess-status", "Report progress of the job in <directory>.", "directory");
+    QCommandLineOption cacheOption("team-cache", "Publish results to the team cache <directory>.", "directory");
+    QCommandLineOption retryOption("retry-failed", "Process the parts that failed earlier again.");
+    parser.addOptions({ initOption, workerOption, statusOption, cacheOption, retryOption });
+    parser.addPositionalArgument("folder", "Folder of STL files, for --preprocess-init.");
+    parser.process(app);
+
+    if (parser.isSet(initOption)) {
+        if (parser.positionalArguments().size() != 1) {
+            err << "Expected exactly one folder to preprocess\n";
+            return 1;
+        }
+        PreprocessJob job(parser.value(initOption));
+        if (!job.create(parser.positionalArguments().first())) {
+            err << "Could not create a job in " << parser.value(initOption) << "\n";
+            return 1;
+        }
+        out << "Created job of " << job.progress().total << " parts\n";
+        return 0;
+    }
+
+    const QString directory = parser.isSet(workerOption) ? parser.value(workerOption) : parser.value(statusOption);
+    PreprocessJob job(directory);
+    if (!job.open()) {
+        err << "No preprocessing job in " << directory << "\n";
+        return 1;
+    }
+
+    if (parser.isSet(workerOption)) {
+        if (parser.isSet(retryOption))
+            out << "Retrying " << job.retryFailed() << " failed parts\n";
+        TeamCache cache(parser.isSet(cacheOption) ? parser.value(cacheOption) : directory + "/cache");
+        const int processed = job.work(cache, out);
+        out << "Processed " << processed << " parts\n";
+    }
+
+    const PreprocessJob::Progress progress = job.progress();
+    const int remaining = progress.total - progress.succeeded - progress.failed;
+    out << progress.succeeded << " of " << progress.total << " parts done, "
+        << progress.failed << " failed, " << progress.running << " in progress, "
+        << remaining << " remaining\n";
+    for (const QString& failure : progress.failures)
+        out << "  failed: " << failure << "\n";
+    return progress.failed == 0 ? 0 : 2;
+}
 
  /**
   * @brief The main function for the application.
@@ -21,8 +246,34 @@
   */
 int main(int argc, char* argv[])
 {
+    if (isHeadlessExport(argc, argv))
+        return runHeadlessExport(argc, argv);  ///< Renders offscreen without a display
+    if (isPreprocess(argc, argv))
+        return runPreprocess(argc, argv);  ///< Runs without a display, possibly on a build server
+
     QApplication a(argc, argv);  ///< Initializes Qt application with command-line arguments
+
+    // With --shared-geometry, instances on this machine share loaded meshes; declared
+    // before the window so it outlives every part
+    std::unique_ptr<SharedGeometryStore> sharedGeometry;
+    if (hasFlag(argc, argv, "--shared-geometry")) {
+        sharedGeometry.reset(new SharedGeometryStore());
+        ModelPart::setSharedGeometryStore(sharedGeometry.get());
+    }
+
+    // With --team-cache <dir>, preprocessed geometry is shared through that directory
+    std::unique_ptr<TeamCache> teamCache;
+    const QString teamCacheDir = flagValue(argc, argv, "--team-cache");
+    if (!teamCacheDir.isEmpty())
+        teamCache.reset(new TeamCache(teamCacheDir));
+
     MainWindow w;                ///< Constructs the main application window
+    w.setTeamCache(teamCache.get());
     w.show();                    ///< Displays the main window on screen
-    return a.exec();             ///< Starts the Qt event loop
+    const int result = a.exec(); ///< Starts the Qt event loop
+
+    // Background tasks may still be publishing to the team cache or using the shared
+    // store; both, and the window, must outlive them
+    QThreadPool::globalInstance()->waitForDone();
+    return result;
 }
@@ -12,6 +12,20 @@
 #include "ModelPartList.h"
 #include "optiondialog.h"
 #include "VRRenderThread.h"
+#include "PartEditCommand.h"
+#include "AnalysisStage.h"
+#include "DeviationStage.h"
+#include "ShapeIndex.h"
+#include "ClusterLodStage.h"
+#include "OutOfCoreStage.h"
+#include "OctreeFile.h"
+#include "DecompressingDevice.h"
+#include "BatchFileReader.h"
+#include "RepositoryScanner.h"
+#include "ThumbnailCache.h"
+#include "SceneExporter.h"
+#include "DesktopRenderThread.h"
+#include "RenderView.h"
 
  // Qt includes
 #include <QFileDialog>
@@ -21,10 +35,22 @@
 #include <QDir>
 #include <QFileInfoList>
 #include <QDebug>
+#include <QUndoStack>
+#include <QMenuBar>
+#include <QActionGroup>
+#include <QThreadPool>
+#include <QInputDialog>
+#include <QLayout>
+#include <QSplitter>
+#include <QtConcurrent/QtConcurrent>
+#include <QItemSelectionModel>
+#include <QSet>
+#include <QGuiApplication>
+#include <QMetaObject>
+#include <QLineEdit>
+#include <QRegularExpression>
 
 // VTK includes
-#include <vtkGenericOpenGLRenderWindow.h>
-#include <vtkRenderer.h>
 #include <vtkPolyDataMapper.h>
 #include <vtkActor.h>
 #include <vtkProperty.h>
@@ -36,6 +62,52 @@
 #include <vtkSTLReader.h>
 #include <vtkDataSetMapper.h>
 #include <vtkCallbackCommand.h>
+#include <vtkLookupTable.h>
+#include <vtkMatrix4x4.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+/**
+ * @brief Returns the path of a part in the tree, from its top-level folder down to its own name.
+ */
+QString treePath(ModelPart* part) {
+    QString path = part->data(0).toString();
+    for (ModelPart* parent = part->parentItem(); parent && parent->parentItem(); parent = parent->parentItem())
+        path = parent->data(0).toString() + '/' + path;
+    return path;
+}
+
+/**
+ * @brief Returns the key a file is matched by between revisions: lower case, without a compression suffix.
+ */
+QString revisionKey(const QString& path) {
+    QString key = path.toLower();
+    if (key.endsWith(".gz"))
+        key.chop(3);
+    else if (key.endsWith(".zst"))
+        key.chop(4);
+    return key;
+}
+
+/**
+ * @brief Collects the files of an indexed folder and its subfolders by revisionKey() of their relative path.
+ */
+void collectRevisionFiles(const RepositoryIndex& index, const QString& relativePath, QHash<QString, QString>& files) {
+    const RepositoryIndex::Directory* directory = index.directory(relativePath);
+    if (!directory)
+        return;
+    for (const QString& name : directory->subdirectories)
+        collectRevisionFiles(index, RepositoryIndex::childPath(relativePath, name), files);
+    for (const RepositoryIndex::File& file : directory->files) {
+        const QString path = RepositoryIndex::childPath(relativePath, file.name);
+        files.insert(revisionKey(path), index.root() + '/' + path);
+    }
+}
+
+} // namespace
 
 /**
  * @brief Constructs the MainWindow and sets up UI components and signal connections.
@@ -62,14 +134,144 @@ MainWindow::MainWindow(QWidget* parent)
     this->partList = new ModelPartList("PartsList");
     ui->treeView->setModel(this->partList);
     ui->treeView->addAction(ui->actionItemOptions);
+    ui->treeView->setSelectionMode(QAbstractItemView::ExtendedSelection);
     ui->treeView->setContextMenuPolicy(Qt::CustomContextMenu);
     connect(ui->treeView, &QTreeView::customContextMenuRequested, this, &MainWindow::showContextMenu);
     connect(ui->treeView, &QTreeView::clicked, this, &MainWindow::handleTreeClicked);
 
+    // --- Part thumbnails in the tree view ---
+    thumbnailCache = new ThumbnailCache(QString(), this);
+    partList->setThumbnailCache(thumbnailCache);
+    ui->treeView->setIconSize(QSize(ThumbnailCache::thumbnailSize / 2, ThumbnailCache::thumbnailSize / 2));
+    connect(thumbnailCache, &ThumbnailCache::thumbnailReady, this, &MainWindow::handleThumbnailReady);
+
     // --- Setup menu actions ---
-    connect(ui->actionOpenSingleFile, &QAction::triggered, this, &MainWindow::on_actionOpenSingleFile_triggered);
+    // on_actionOpenSingleFile_triggered() is connected by name in setupUi()
     connect(ui->actionClearTreeView, &QAction::triggered, this, &MainWindow::on_actionClearTreeView_triggered);
 
+    // Opening an assembly sits next to opening a single file wherever that appears
+    QAction* openAssemblyAction = new QAction(tr("Open &Assembly..."), this);
+    connect(openAssemblyAction, &QAction::triggered, this, &MainWindow::openAssembly);
+    for (QWidget* widget : ui->actionOpenSingleFile->associatedWidgets()) {
+        const QList<QAction*> actions = widget->actions();
+        widget->insertAction(actions.value(actions.indexOf(ui->actionOpenSingleFile) + 1), openAssemblyAction);
+    }
+
+    // --- Undo/redo of part edits ---
+    undoStack = new QUndoStack(this);
+    QAction* undoAction = undoStack->createUndoAction(this, tr("&Undo"));
+    undoAction->setShortcuts(QKeySequence::Undo);
+    QAction* redoAction = undoStack->createRedoAction(this, tr("&Redo"));
+    redoAction->setShortcuts(QKeySequence::Redo);
+    QMenu* editMenu = menuBar()->addMenu(tr("&Edit"));
+    editMenu->addAction(undoAction);
+    editMenu->addAction(redoAction);
+    editMenu->addSeparator();
+    connect(editMenu->addAction(tr("Merge &Near-Duplicate Parts...")), &QAction::triggered, this, [this]() {
+        bool ok = false;
+        const double percent = QInputDialog::getDouble(this, "Merge Near-Duplicate Parts",
+                                                       "Tolerance (% of part size):", 0.1, 0.0, 10.0, 2, &ok);
+        if (!ok)
+            return;
+        mergeNearDuplicates(percent / 100.0);
+    });
+    connect(editMenu->addAction(tr("&Move Selected Parts...")), &QAction::triggered, this, [this]() {
+        bool ok = false;
+        const QString text = QInputDialog::getText(this, "Move Selected Parts", "Offset in scene units (x y z):",
+                                                   QLineEdit::Normal, "0 0 0", &ok);
+        if (!ok)
+            return;
+        const QStringList fields = text.split(QRegularExpression("[\\s,;]+"), Qt::SkipEmptyParts);
+        double offset[3];
+        bool valid = fields.size() == 3;
+        for (int k = 0; k < 3 && valid; ++k)
+            offset[k] = fields[k].toDouble(&valid);
+        if (!valid) {
+            QMessageBox::warning(this, "Move Selected Parts", "Enter three numbers: the x, y and z offsets.");
+            return;
+        }
+        const int moved = moveSelectedParts(offset);
+        emit statusUpdateMessageSignal(QString("Moved %1 parts").arg(moved), 3000);
+    });
+
+    // --- Colour-by modes (user colours plus one per part attribute) ---
+    QMenu* colourByMenu = menuBar()->addMenu(tr("Colour &By"));
+    QActionGroup* colourByGroup = new QActionGroup(this);
+    QAction* userColours = colourByMenu->addAction(tr("User Colours"));
+    userColours->setCheckable(true);
+    userColours->setChecked(true);
+    colourByGroup->addAction(userColours);
+    connect(userColours, &QAction::triggered, this, [this]() { colourBy(-1); });
+    for (int i = 0; i < PartAttributeStore::AttributeCount; ++i) {
+        QAction* action = colourByMenu->addAction(
+            PartAttributeStore::attributeName(static_cast<PartAttributeStore::Attribute>(i)));
+        action->setCheckable(true);
+        colourByGroup->addAction(action);
+        connect(action, &QAction::triggered, this, [this, i]() { colourBy(i); });
+    }
+
+    // --- Per-vertex analysis overlays ---
+    analysisStage = new AnalysisStage(&geometryCache, this);
+    connect(analysisStage, &AnalysisStage::analysisFinished, this, &MainWindow::handleAnalysisFinished);
+    connect(analysisStage, &AnalysisStage::assemblyOcclusionFinished, this, &MainWindow::handleAssemblyOcclusionFinished);
+    deviationStage = new DeviationStage(&geometryCache, this);
+    connect(deviationStage, &DeviationStage::deviationFinished, this, &MainWindow::handleDeviationFinished);
+    // --- Cluster LOD for parts too large to draw whole ---
+    clusterLodStage = new ClusterLodStage(this);
+    connect(clusterLodStage, &ClusterLodStage::lodReady, this, &MainWindow::handleLodReady);
+
+    // --- Shape descriptors for finding near-duplicate parts ---
+    shapeIndex = new ShapeIndex(this);
+
+    // --- Out-of-core streaming for parts too large to load ---
+    outOfCoreStage = new OutOfCoreStage(QString(), this);
+    outOfCoreThreshold = OctreeFile::suggestedThreshold();
+
+    // --- Repository indexes, so reopening a large folder does not walk it again ---
+    repositoryScanner = new RepositoryScanner(QString(), this);
+    connect(repositoryScanner, &RepositoryScanner::repositoryChanged, this, &MainWindow::applyRepositoryChanges);
+    connect(outOfCoreStage, &OutOfCoreStage::octreeReady, this, &MainWindow::handleOctreeReady);
+    connect(outOfCoreStage, &OutOfCoreStage::conversionFailed, this, [this](const QString& stlPath) {
+        emit statusUpdateMessageSignal("Could not convert " + QFileInfo(stlPath).fileName() + " for streaming", 5000);
+    });
+
+    overlayRefreshTimer.setSingleShot(true);
+    overlayRefreshTimer.setInterval(100);
+    connect(&overlayRefreshTimer, &QTimer::timeout, this, &MainWindow::applyOverlay);
+
+    overlayLut = vtkSmartPointer<vtkLookupTable>::New();
+    overlayLut->SetHueRange(0.667, 0.0);    // Blue (low) to red (high)
+    overlayLut->SetNanColor(0.5, 0.5, 0.5, 1.0);
+    overlayLut->Build();
+
+    QMenu* overlayMenu = menuBar()->addMenu(tr("&Overlay"));
+    QActionGroup* overlayGroup = new QActionGroup(this);
+    QAction* noOverlay = overlayMenu->addAction(tr("None"));
+    noOverlay->setCheckable(true);
+    noOverlay->setChecked(true);
+    overlayGroup->addAction(noOverlay);
+    connect(noOverlay, &QAction::triggered, this, [this]() { showOverlay(0); });
+    for (AnalysisStage::Analysis analysis : { AnalysisStage::Curvature, AnalysisStage::Thickness,
+                                              AnalysisStage::AmbientOcclusion, AnalysisStage::AssemblyOcclusion }) {
+        QAction* action = overlayMenu->addAction(AnalysisStage::arrayName(analysis));
+        action->setCheckable(true);
+        overlayGroup->addAction(action);
+        connect(action, &QAction::triggered, this, [this, analysis]() { showOverlay(analysis); });
+    }
+    overlayMenu->addSeparator();
+    connect(overlayMenu->addAction(tr("Deviation From &Revision...")), &QAction::triggered, this, [this, noOverlay]() {
+        QString folderPath = QFileDialog::getExistingDirectory(this, "Select Revision Folder", QDir::homePath());
+        if (folderPath.isEmpty())
+            return;
+        noOverlay->setChecked(true);
+        compareWithRevision(folderPath);
+    });
+
+    // --- Offscreen image export ---
+    QMenu* exportMenu = menuBar()->addMenu(tr("E&xport"));
+    connect(exportMenu->addAction(tr("&Snapshot...")), &QAction::triggered, this, &MainWindow::exportSnapshot);
+    connect(exportMenu->addAction(tr("&Turntable...")), &QAction::triggered, this, &MainWindow::exportTurntable);
+
     // --- Initialize VTK renderer ---
     setupVTK();
 
@@ -90,11 +292,29 @@ MainWindow::~MainWindow()
         vrThread->wait();
     }
     delete vrThread;
+
+    // Stop the desktop render thread before the view it draws into is destroyed
+    delete renderThread;
+    renderThread = nullptr;
+
+    // Background stages post results back to this window, so let them drain first
+    QThreadPool::globalInstance()->waitForDone();
     delete ui;
 }
 
 /**
- * @brief Initializes the VTK rendering window and renderer.
+ * @brief Sets the team cache for preprocessed geometry.
+ * @param cache The cache, or null.
+ */
+void MainWindow::setTeamCache(TeamCache* cache)
+{
+    ModelPart::setTeamCache(cache);
+    clusterLodStage->setTeamCache(cache);
+    outOfCoreStage->setTeamCache(cache);
+}
+
+/**
+ * @brief Starts the desktop render thread and shows its view in place of the UI file's vtkWidget.
  */
 void MainWindow::setupVTK()
 {
@@ -103,14 +323,24 @@ void MainWindow::setupVTK()
         return;
     }
 
-    renderWindow = vtkSmartPointer<vtkGenericOpenGLRenderWindow>::New();
-    ui->vtkWidget->setRenderWindow(renderWindow);
+    renderThread = new DesktopRenderThread(this);
+    renderView = new RenderView(renderThread);
+    connect(renderView, &RenderView::partClicked, this, &MainWindow::handlePartClicked);
+    connect(renderView, &RenderView::partHovered, this, &MainWindow::handlePartHovered);
+    connect(ui->treeView->selectionModel(), &QItemSelectionModel::selectionChanged, this, [this]() { updateHighlight(); });
 
-    renderer = vtkSmartPointer<vtkRenderer>::New();
-    renderWindow->AddRenderer(renderer);
+    // The designer widget only marks where the view goes
+    QWidget* container = ui->vtkWidget->parentWidget();
+    if (QSplitter* splitter = qobject_cast<QSplitter*>(container))
+        splitter->replaceWidget(splitter->indexOf(ui->vtkWidget), renderView);
+    else if (container && container->layout())
+        container->layout()->replaceWidget(ui->vtkWidget, renderView);
+    else
+        renderView->setParent(container);
+    ui->vtkWidget->hide();
 
-    renderer->SetBackground(0.1, 0.1, 0.1); // Dark background
-    renderWindow->Render();
+    renderThread->start();
+    requestRender();
 }
 
 /**
@@ -136,38 +366,188 @@ void MainWindow::handleButton()
 }
 
 /**
- * @brief Opens the option dialog for the selected tree item.
+ * @brief Collects the tree indexes of the parts currently selected in the tree view.
+ * Falls back to the current index when nothing is explicitly selected.
+ * @return Column 0 indexes of the selected parts (may be empty).
+ */
+QModelIndexList MainWindow::selectedPartIndexes() const
+{
+    QModelIndexList rows = ui->treeView->selectionModel()->selectedRows(0);
+    if (rows.isEmpty() && ui->treeView->currentIndex().isValid())
+        rows.append(ui->treeView->currentIndex().sibling(ui->treeView->currentIndex().row(), 0));
+    return rows;
+}
+
+/**
+ * @brief Opens the option dialog for the selected tree items.
+ *
+ * Colour changes are previewed live: each throttled slider update is written straight to the
+ * parts' vtkProperty, which is shared with their VR actors, and only the render window is
+ * redrawn. Accepting therefore only commits the remaining fields, and cancelling puts the
+ * original colours back.
  */
 void MainWindow::on_actionItemOptions_triggered()
 {
-    QModelIndex index = ui->treeView->currentIndex();
-    ModelPart* selectedPart = static_cast<ModelPart*>(index.internalPointer());
+    const QModelIndexList indexes = selectedPartIndexes();
+    QList<ModelPart*> parts;
+    for (const QModelIndex& index : indexes)
+        parts.append(static_cast<ModelPart*>(index.internalPointer()));
 
-    if (!selectedPart) {
+    if (parts.isEmpty()) {
         QMessageBox::warning(this, "No Selection", "Please select an item first.");
         return;
     }
 
+    ModelPart* firstPart = parts.first();
+    const int session = nextMergeSession++;
+    bool previewPushed = false;
+
+    const bool initiallyVisible = firstPart->visible();
+
     OptionDialog optionDialog(this);
-    QColor currentColor(selectedPart->getColourR(), selectedPart->getColourG(), selectedPart->getColourB());
-    optionDialog.setValues(selectedPart->data(0).toString(), currentColor, selectedPart->visible());
+    optionDialog.setValues(firstPart->data(0).toString(), firstPart->getColor(), initiallyVisible, firstPart->opacity());
+
+    // Every preview tick is pushed with the same merge session, so the whole drag
+    // collapses into one undo entry. Only the moved sliders' fields are written, so
+    // changing the opacity of several parts keeps each part's own colour, and vice versa
+    connect(&optionDialog, &OptionDialog::appearancePreview, this,
+            [&](const QColor& color, double opacity, bool colourChanged, bool opacityChanged) {
+        QVector<PartDelta> deltas;
+        for (ModelPart* part : parts) {
+            PartDelta delta;
+            delta.part = part;
+            if (colourChanged) {
+                delta.fields |= PartDelta::Colour;
+                delta.colourBefore = part->getColor().rgb();
+                delta.colourAfter = color.rgb();
+            }
+            if (opacityChanged) {
+                delta.fields |= PartDelta::Opacity;
+                delta.opacityBefore = part->opacity();
+                delta.opacityAfter = opacity;
+            }
+            deltas.append(delta);
+        }
+        undoStack->push(new PartEditCommand(tr("Change appearance"), deltas, partEditCallback(), session));
+        previewPushed = true;
+    });
 
     if (optionDialog.exec() == QDialog::Accepted) {
-        selectedPart->setData(0, optionDialog.getName());
-        QColor chosenColor = optionDialog.getColor();
-        selectedPart->setColour(chosenColor.red(), chosenColor.green(), chosenColor.blue());
-
-        // Placeholder for future VR actor update logic
-        if (vrThread && vrThread->isRunning()) {
-            vtkActor* actor = selectedPart->getActor();
-            // TODO: Implement actor update in VR thread
+        // The checkbox starts from the first part, so leaving it alone must not make
+        // the other selected parts match that part
+        const bool visibilityEdited = optionDialog.isVisible() != initiallyVisible;
+        QVector<PartDelta> deltas;
+        for (ModelPart* part : parts) {
+            PartDelta delta;
+            delta.part = part;
+
+            // A single name cannot sensibly be applied to several parts at once
+            if (parts.size() == 1 && part->data(0).toString() != optionDialog.getName()) {
+                delta.fields |= PartDelta::Name;
+                delta.nameBefore = part->data(0).toString();
+                delta.nameAfter = optionDialog.getName();
+            }
+            if (visibilityEdited && part->visible() != optionDialog.isVisible()) {
+                delta.fields |= PartDelta::Visibility;
+                delta.visibleBefore = part->visible();
+                delta.visibleAfter = optionDialog.isVisible();
+            }
+            deltas.append(delta);
         }
 
-        selectedPart->setVisible(optionDialog.isVisible());
-        partList->dataChanged(index, index);
-        updateRender();
+        // Colours and opacities are already on screen, so this only touches the tree and, for a
+        // visibility change, the actor set
+        bool anyChange = false;
+        for (const PartDelta& delta : deltas)
+            anyChange = anyChange || delta.fields != 0;
+        if (anyChange)
+            undoStack->push(new PartEditCommand(tr("Edit part options"), deltas, partEditCallback(), session));
+
         emit statusUpdateMessageSignal("Updated item options", 2000);
     }
+    else if (previewPushed) {
+        // Undo the previewed colours in one batch and drop the entry from the stack
+        const_cast<QUndoCommand*>(undoStack->command(undoStack->index() - 1))->setObsolete(true);
+        undoStack->undo();
+    }
+}
+
+/**
+ * @brief Returns the scene update callback handed to PartEditCommand.
+ * @return A callback that refreshes the tree and scene once per command.
+ */
+PartEditCommand::SceneUpdate MainWindow::partEditCallback()
+{
+    return [this](const QVector<ModelPart*>& parts, quint8 fields) {
+        applyPartEdits(parts, fields);
+    };
+}
+
+/**
+ * @brief Refreshes the tree and the scene after a batch of part edits.
+ *
+ * Called once per redo()/undo() regardless of how many parts the command touched.
+ * Colour and opacity edits just redraw, since the vtkProperty is shared with the VR actors;
+ * visibility edits rebuild the actor set. Moved parts are also moved in a running
+ * VR session. Parts that were given other geometry are indexed and overlaid again.
+ * Colour edits made while colouring by an attribute keep the attribute colours on screen.
+ * @param parts The parts whose attributes changed.
+ * @param fields Union of the PartDelta::Field values that changed.
+ */
+void MainWindow::applyPartEdits(const QVector<ModelPart*>& parts, quint8 fields)
+{
+    if (fields & (PartDelta::Name | PartDelta::Visibility)) {
+        for (ModelPart* part : parts)
+            emit partList->dataChanged(partList->indexForPart(part, 0), partList->indexForPart(part, 1));
+    }
+
+    // Moved parts only need their new world transforms; the rest of the tree keeps its cached ones
+    if ((fields & PartDelta::Transform) && vrThread && vrThread->isRunning()) {
+        for (ModelPart* part : parts)
+            moveInVR(part);
+    }
+
+    if (fields & PartDelta::Geometry) {
+        partsLoaded();
+        return;
+    }
+
+    // setColour() shows the user colour at once; while colouring by an attribute the
+    // attribute colours go back on top, and the edit shows when colour-by is turned off
+    if ((fields & PartDelta::Colour) && colourByAttribute >= 0)
+        colourBy(colourByAttribute);
+    else if (fields & PartDelta::Colour)
+        overlaysToVR();     // Occlusion tables follow the part colour
+
+    if (fields & PartDelta::Visibility)
+        updateRender();
+    else
+        requestRender();
+}
+
+/**
+ * @brief Sends the world transforms of a moved part and its descendants to the VR thread.
+ * @param part The part whose local transform changed.
+ */
+void MainWindow::moveInVR(ModelPart* part)
+{
+    vrThread->setPartTransform(reinterpret_cast<quintptr>(part), part->worldTransform());
+    for (int i = 0; i < part->childCount(); ++i)
+        moveInVR(part->child(i));
+}
+
+/**
+ * @brief Sends the overlay state of every loaded part to a running VR thread.
+ *
+ * The VR thread is given its own copies of the geometry and lookup tables and
+ * swaps them in between frames, so it never draws data the GUI thread is changing.
+ */
+void MainWindow::overlaysToVR()
+{
+    if (!vrThread || !vrThread->isRunning())
+        return;
+    for (ModelPart* part : attributeStore.parts())
+        vrThread->setPartOverlay(part->vrSnapshot());
 }
 
 /**
@@ -202,12 +582,116 @@ void MainWindow::on_actionOpenFile_triggered()
     QString folderPath = QFileDialog::getExistingDirectory(this, "Select Repositry Folder", QDir::homePath());
 
     if (!folderPath.isEmpty()) {
+        // Undo entries hold pointers to the parts about to be deleted
+        undoStack->clear();
+        attributeStore.clear();
+        partsByHash.clear();
+        streamingParts.clear();
+        // Hierarchies and descriptors of the old folder's parts would otherwise stay for the session
+        clusterLodStage->clear();
+        shapeIndex->clear();
+        compareReferences.clear();
+        partDeviations.clear();
         partList->clear();
-        renderer->RemoveAllViewProps();
+        ++treeGeneration;
+
+        // The render thread and click handling must stop referring to the deleted
+        // parts even if the new folder cannot be opened
+        renderedParts.clear();
+        requestRender();
         loadInitialPartsFromFolder(folderPath);
     }
 }
 
+/**
+ * @brief Opens a single STL file, plain or compressed, and adds it to the tree.
+ */
+void MainWindow::on_actionOpenSingleFile_triggered()
+{
+    QString filePath = QFileDialog::getOpenFileName(this, "Open STL File", QDir::homePath(),
+                                                    "STL Files (*.stl *.stl.gz *.stl.zst)");
+    if (filePath.isEmpty())
+        return;
+
+    partList->getRootItem()->appendChild(loadPartFile(filePath, QFileInfo(filePath).size()));
+    loadPendingParts();
+    partsLoaded();
+}
+
+/**
+ * @brief Opens an assembly manifest and adds the assembly to the tree.
+ */
+void MainWindow::openAssembly()
+{
+    QString filePath = QFileDialog::getOpenFileName(this, "Open Assembly", QDir::homePath(),
+                                                    "Assembly Manifests (*.json)");
+    if (filePath.isEmpty())
+        return;
+
+    loadAssembly(filePath);
+}
+
+/**
+ * @brief Adds the assembly described by a manifest to the tree.
+ *
+ * The first instance of each file is loaded like any other part. The others are
+ * made instances of it once it has loaded, so they share its mesh, its render
+ * copy and its uploaded buffers, and differ only in transform and colour.
+ * @param path The manifest file.
+ */
+void MainWindow::loadAssembly(const QString& path)
+{
+    AssemblyManifest::Node root;
+    QString error;
+    if (!AssemblyManifest::read(path, root, error)) {
+        QMessageBox::warning(this, "Open Assembly", QFileInfo(path).fileName() + ": " + error);
+        return;
+    }
+
+    QHash<QString, ModelPart*> prototypes;
+    QVector<QPair<ModelPart*, ModelPart*>> instances;
+    partList->getRootItem()->appendChild(buildAssembly(root, prototypes, instances));
+    loadPendingParts();
+    for (const auto& instance : instances)
+        instance.first->loadInstance(*instance.second);
+    partsLoaded();
+
+    emit statusUpdateMessageSignal(QString("Loaded %1 parts from %2 files")
+                                       .arg(prototypes.size() + instances.size()).arg(prototypes.size()), 3000);
+}
+
+/**
+ * @brief Creates the tree items of a manifest node and its children.
+ * @param node The manifest node.
+ * @param prototypes First part created for each file, by path; updated.
+ * @param instances Receives each later instance with the part whose geometry it shares.
+ * @return The new item, not yet added to the tree.
+ */
+ModelPart* MainWindow::buildAssembly(const AssemblyManifest::Node& node, QHash<QString, ModelPart*>& prototypes,
+                                     QVector<QPair<ModelPart*, ModelPart*>>& instances)
+{
+    ModelPart* item;
+    if (node.file.isEmpty()) {
+        item = new ModelPart({ node.name, QString("true") });
+    }
+    else if (ModelPart* prototype = prototypes.value(node.file)) {
+        item = new ModelPart({ node.name, QString("true") });
+        instances.append(qMakePair(item, prototype));
+    }
+    else {
+        item = loadPartFile(node.file, QFileInfo(node.file).size());
+        item->setData(0, node.name);
+        prototypes.insert(node.file, item);
+    }
+
+    item->setLocalTransform(node.transform);
+    if (node.colour.isValid())
+        item->setColor(node.colour);
+    for (const AssemblyManifest::Node& child : node.children)
+        item->appendChild(buildAssembly(child, prototypes, instances));
+    return item;
+}
+
 /**
  * @brief Shows a context menu for the tree view.
  * @param pos Position of the right-click event.
@@ -220,49 +704,357 @@ void MainWindow::showContextMenu(const QPoint& pos)
     ui->treeView->setCurrentIndex(index);
     QMenu contextMenu(this);
     contextMenu.addAction(ui->actionItemOptions);
+    connect(contextMenu.addAction(tr("Find &Similar Parts")), &QAction::triggered, this, &MainWindow::findSimilarParts);
     contextMenu.exec(ui->treeView->viewport()->mapToGlobal(pos));
 }
 
 /**
- * @brief Updates the render window with all currently visible model parts.
+ * @brief Selects the parts whose shape is most like the current part's.
+ *
+ * Parts loaded from the same file are selected too. The current part stays current,
+ * so the search can be repeated from it.
+ */
+void MainWindow::findSimilarParts()
+{
+    const QModelIndex current = ui->treeView->currentIndex();
+    ModelPart* part = static_cast<ModelPart*>(current.internalPointer());
+    if (!part || !shapeIndex->contains(part->contentHash())) {
+        emit statusUpdateMessageSignal("The part's shape has not been indexed yet", 3000);
+        return;
+    }
+
+    // Loose enough for re-triangulated and slightly revised parts, tight enough to skip unrelated ones
+    const double similarDistance = 0.25;
+    QVector<QPair<QByteArray, double>> similar = shapeIndex->nearest(part->contentHash(), 20, similarDistance);
+    similar.prepend(qMakePair(part->contentHash(), 0.0));
+
+    QItemSelection selection;
+    int count = 0;
+    for (const auto& match : similar) {
+        for (ModelPart* other : partsByHash.values(match.first)) {
+            const QModelIndex index = partList->indexForPart(other);
+            selection.select(index, index);
+            ++count;
+        }
+    }
+    ui->treeView->selectionModel()->select(selection, QItemSelectionModel::ClearAndSelect | QItemSelectionModel::Rows);
+    ui->treeView->scrollTo(current);
+    emit statusUpdateMessageSignal(QString("%1 parts similar to %2").arg(count - 1).arg(part->data(0).toString()), 3000);
+}
+
+/**
+ * @brief Makes parts that are the same as an earlier part within a tolerance instances of it.
+ *
+ * Candidates come from the shape index and must fill the same box in their own model
+ * coordinates. Descriptors and bounds cannot tell a moved hole or a mirrored variant
+ * apart, so each candidate is then confirmed by the Hausdorff distance between the
+ * two meshes, measured both ways. That check builds cell locators over both meshes,
+ * so it runs on the global pool over shallow copies and the question is asked when
+ * it finishes. The merge is pushed as one undoable edit; a merged part's own geometry
+ * is kept by the undo stack and only released when the edit can no longer be undone.
+ * @param tolerance Largest deviation allowed, as a fraction of the earlier part's diagonal.
+ */
+void MainWindow::mergeNearDuplicates(double tolerance)
+{
+    if (mergeRunning) {
+        emit statusUpdateMessageSignal("Still checking for near-duplicate parts", 3000);
+        return;
+    }
+
+    // Shapes further apart than this are not the same part, whatever their bounds
+    const double duplicateDistance = 0.1;
+
+    // Everything owned by the GUI thread is read here; the worker only sees copies
+    QVector<MergeCandidate> candidates;
+    QSet<QByteArray> seen;
+    for (ModelPart* part : attributeStore.parts()) {
+        const QByteArray hash = part->contentHash();
+        if (!part->polyData || seen.contains(hash) || !shapeIndex->contains(hash))
+            continue;
+        seen.insert(hash);
+
+        MergeCandidate candidate;
+        candidate.part = part;
+        candidate.hash = hash;
+        candidate.source = part->polyData;
+        candidate.mesh = vtkSmartPointer<vtkPolyData>::New();
+        candidate.mesh->ShallowCopy(part->polyData);
+        part->polyData->GetBounds(candidate.bounds);
+        candidate.length = part->polyData->GetLength();
+        for (const auto& neighbour : shapeIndex->nearest(hash, 8, duplicateDistance))
+            candidate.nearest.append(neighbour.first);
+        candidates.append(candidate);
+    }
+    if (candidates.isEmpty()) {
+        emit statusUpdateMessageSignal("Merged 0 near-duplicate parts", 3000);
+        return;
+    }
+
+    mergeRunning = true;
+    const quint64 generation = treeGeneration;
+    emit statusUpdateMessageSignal("Checking for near-duplicate parts...", 0);
+    QtConcurrent::run(QThreadPool::globalInstance(), [this, candidates, tolerance, generation]() {
+        // Parts are taken in tree order; one that matches no earlier prototype becomes one
+        QHash<QByteArray, int> prototypes;
+        QVector<QPair<int, int>> duplicates;
+        for (int i = 0; i < candidates.size(); ++i) {
+            const MergeCandidate& part = candidates[i];
+            int match = -1;
+            for (const QByteArray& neighbour : part.nearest) {
+                const int prototype = prototypes.value(neighbour, -1);
+                if (prototype < 0)
+                    continue;
+                const MergeCandidate& other = candidates[prototype];
+                const double limit = tolerance * other.length;
+                bool same = true;
+                for (int k = 0; k < 6; ++k)
+                    same = same && std::fabs(part.bounds[k] - other.bounds[k]) <= limit;
+                if (same && DeviationStage::hausdorffDistance(part.mesh, other.mesh) <= limit) {
+                    match = prototype;
+                    break;
+                }
+            }
+            if (match >= 0)
+                duplicates.append(qMakePair(i, match));
+            else
+                prototypes.insert(part.hash, i);
+        }
+
+        QMetaObject::invokeMethod(this, [this, candidates, duplicates, generation]() {
+            mergeRunning = false;
+            applyMerge(candidates, duplicates, generation);
+        }, Qt::QueuedConnection);
+    });
+}
+
+/**
+ * @brief Asks for confirmation and merges the duplicates found by mergeNearDuplicates().
+ *
+ * Pairs whose parts were deleted, or given other geometry, while the check ran are
+ * dropped, since their distances no longer hold.
+ * @param candidates The parts that were checked.
+ * @param duplicates Index of each duplicate in @p candidates, with the index of the part it matches.
+ * @param generation treeGeneration when the check started.
+ */
+void MainWindow::applyMerge(const QVector<MergeCandidate>& candidates, const QVector<QPair<int, int>>& duplicates,
+                            quint64 generation)
+{
+    if (generation != treeGeneration) {
+        emit statusUpdateMessageSignal("Parts were removed while checking for duplicates; nothing was merged", 3000);
+        return;
+    }
+
+    QVector<QPair<ModelPart*, ModelPart*>> merges;
+    for (const auto& duplicate : duplicates) {
+        const MergeCandidate& part = candidates[duplicate.first];
+        const MergeCandidate& prototype = candidates[duplicate.second];
+        if (part.part->polyData == part.source && prototype.part->polyData == prototype.source)
+            merges.append(qMakePair(part.part, prototype.part));
+    }
+    if (merges.isEmpty()) {
+        emit statusUpdateMessageSignal("Merged 0 near-duplicate parts", 3000);
+        return;
+    }
+
+    const QString question = QString("%1 parts match an earlier part within the tolerance. Show each of them "
+                                     "with the earlier part's geometry? This can be undone.").arg(merges.size());
+    if (QMessageBox::question(this, "Merge Near-Duplicate Parts", question) != QMessageBox::Yes) {
+        emit statusUpdateMessageSignal("Merged 0 near-duplicate parts", 3000);
+        return;
+    }
+
+    QVector<PartDelta> deltas;
+    for (const auto& merge : merges) {
+        PartDelta delta;
+        delta.part = merge.first;
+        delta.fields = PartDelta::Geometry;
+        delta.geometryBefore = merge.first->geometry();
+        delta.geometryAfter = merge.second->geometry();
+        deltas.append(delta);
+    }
+    undoStack->push(new PartEditCommand(tr("Merge near-duplicate parts"), deltas, partEditCallback()));
+    emit statusUpdateMessageSignal(QString("Merged %1 near-duplicate parts").arg(merges.size()), 3000);
+}
+
+/**
+ * @brief Moves the selected parts by an offset in scene coordinates.
+ *
+ * The offset is taken into each part's parent coordinates and added to the part's
+ * local transform, so rotated or scaled subassemblies move the way the user asked.
+ * A part inside a selected folder moves with the folder only. The move is one
+ * undoable edit.
+ * @param offset Translation along the scene's x, y and z axes.
+ * @return The number of parts moved.
+ */
+int MainWindow::moveSelectedParts(const double offset[3])
+{
+    QList<ModelPart*> selected;
+    for (const QModelIndex& index : selectedPartIndexes())
+        selected.append(static_cast<ModelPart*>(index.internalPointer()));
+
+    QVector<PartDelta> deltas;
+    for (ModelPart* part : selected) {
+        bool insideSelection = false;
+        for (ModelPart* ancestor = part->parentItem(); ancestor && !insideSelection; ancestor = ancestor->parentItem())
+            insideSelection = selected.contains(ancestor);
+        if (insideSelection)
+            continue;
+
+        // Directions are changed by the parent's rotation and scale, not by its translation
+        double parentOffset[3] = { offset[0], offset[1], offset[2] };
+        if (ModelPart* parent = part->parentItem()) {
+            double inverse[16];
+            vtkMatrix4x4::Invert(parent->worldTransform(), inverse);
+            for (int r = 0; r < 3; ++r)
+                parentOffset[r] = inverse[4 * r] * offset[0] + inverse[4 * r + 1] * offset[1] + inverse[4 * r + 2] * offset[2];
+        }
+
+        double local[16];
+        part->localTransform(local);
+        PartDelta delta;
+        delta.part = part;
+        delta.fields = PartDelta::Transform;
+        delta.transformBefore = QVector<double>(16);
+        std::copy(local, local + 16, delta.transformBefore.begin());
+        local[3] += parentOffset[0];
+        local[7] += parentOffset[1];
+        local[11] += parentOffset[2];
+        delta.transformAfter = QVector<double>(16);
+        std::copy(local, local + 16, delta.transformAfter.begin());
+        deltas.append(delta);
+    }
+
+    if (!deltas.isEmpty())
+        undoStack->push(new PartEditCommand(tr("Move parts"), deltas, partEditCallback()));
+    return deltas.size();
+}
+
+/**
+ * @brief Updates the render window with all currently visible model parts and refits the camera.
  */
 void MainWindow::updateRender()
 {
-    renderer->RemoveAllViewProps();
-    int topLevelCount = partList->rowCount(QModelIndex());
+    requestRender(true);
+}
+
+/**
+ * @brief Sends the render thread a snapshot of all currently visible model parts.
+ *
+ * Building the snapshot only copies colours and pointers; geometry copies are shallow
+ * and reused while a part is unchanged. The frame itself is drawn on the render thread.
+ * @param resetCamera Fit the camera to the visible parts before drawing.
+ */
+void MainWindow::requestRender(bool resetCamera)
+{
+    if (!renderThread)
+        return;
 
+    SceneSnapshot scene;
+    scene.resetCamera = resetCamera;
+    for (int k = 0; k < 3; ++k)
+        scene.background[k] = backgroundColour[k];
+
+    renderedParts.clear();
+    int topLevelCount = partList->rowCount(QModelIndex());
     for (int i = 0; i < topLevelCount; ++i) {
         QModelIndex topIndex = partList->index(i, 0, QModelIndex());
-        updateRenderFromTree(topIndex);
+        updateRenderFromTree(topIndex, scene);
     }
 
-    if (renderer->GetActors()->GetNumberOfItems() > 0) {
-        renderer->ResetCamera();
+    renderThread->submitScene(scene);
+    updateHighlight();
+}
+
+/**
+ * @brief Sends the render thread the parts to outline.
+ *
+ * Selecting a folder outlines every rendered part inside it. Only parts in the last
+ * scene are sent, so hidden or removed parts drop out of the highlight.
+ */
+void MainWindow::updateHighlight()
+{
+    if (!renderThread)
+        return;
+
+    QSet<quintptr> selected;
+    QList<QModelIndex> pending = ui->treeView->selectionModel()->selectedRows(0);
+    while (!pending.isEmpty()) {
+        const QModelIndex index = pending.takeLast();
+        const quintptr id = reinterpret_cast<quintptr>(index.internalPointer());
+        if (renderedParts.contains(id))
+            selected.insert(id);
+        for (int i = 0; i < partList->rowCount(index); ++i)
+            pending.append(partList->index(i, 0, index));
+    }
+
+    if (!renderedParts.contains(hoveredPartId))
+        hoveredPartId = 0;
+    renderThread->setHighlight(selected, hoveredPartId);
+}
+
+/**
+ * @brief Selects the part clicked in the 3D view in the tree.
+ *
+ * The tree is scrolled to the part, expanding its folders, so the view and the tree
+ * always show the same selection. Clicking the background clears it.
+ * @param id Id of the part from the ID buffer, or 0.
+ * @param extend True to toggle the part in the selection instead of replacing it.
+ */
+void MainWindow::handlePartClicked(quintptr id, bool extend)
+{
+    QItemSelectionModel* selection = ui->treeView->selectionModel();
+    ModelPart* part = renderedParts.value(id);
+    if (!part) {
+        if (!extend)
+            selection->clearSelection();
+        return;
     }
 
-    renderWindow->Render();
+    const QModelIndex index = partList->indexForPart(part);
+    const QItemSelectionModel::SelectionFlags flags = extend ? QItemSelectionModel::Toggle : QItemSelectionModel::ClearAndSelect;
+    selection->setCurrentIndex(index, flags | QItemSelectionModel::Rows);
+    ui->treeView->scrollTo(index);
+    emit statusUpdateMessageSignal("Selected item: " + part->data(0).toString(), 2000);
 }
 
 /**
- * @brief Recursively adds visible parts to the VTK renderer from the model tree.
+ * @brief Shows the name of the part under the cursor in the 3D view.
+ * @param id Id of the part from the ID buffer, or 0.
+ */
+void MainWindow::handlePartHovered(quintptr id)
+{
+    ModelPart* part = renderedParts.value(id);
+    if (part)
+        emit statusUpdateMessageSignal(part->data(0).toString(), 0);
+    else
+        emit statusUpdateMessageSignal(QString(), 0);
+
+    hoveredPartId = part ? id : 0;
+    updateHighlight();
+}
+
+/**
+ * @brief Recursively adds visible parts from the model tree to a scene snapshot.
  * @param index Current index in the model tree.
+ * @param scene The snapshot to add to.
  */
-void MainWindow::updateRenderFromTree(const QModelIndex& index)
+void MainWindow::updateRenderFromTree(const QModelIndex& index, SceneSnapshot& scene)
 {
     if (!index.isValid()) return;
 
     ModelPart* selectedPart = static_cast<ModelPart*>(index.internalPointer());
 
     if (selectedPart && selectedPart->visible()) {
-        vtkSmartPointer<vtkActor> actor = selectedPart->getActor();
-        if (actor) {
-            renderer->AddActor(actor);
+        PartSnapshot part = selectedPart->snapshot();
+        if (part.geometry || part.octree) {
+            scene.parts.append(part);
+            renderedParts.insert(part.id, selectedPart);
         }
     }
 
     int rows = partList->rowCount(index);
     for (int i = 0; i < rows; i++) {
-        updateRenderFromTree(partList->index(i, 0, index));
+        updateRenderFromTree(partList->index(i, 0, index), scene);
     }
 }
 
@@ -272,12 +1064,676 @@ void MainWindow::updateRenderFromTree(const QModelIndex& index)
  */
 void MainWindow::loadInitialPartsFromFolder(const QString& folderPath)
 {
-    QDir dir(folderPath);
-    if (!dir.exists()) {
+    // The index comes from disk when the folder was opened before, so nothing is listed here
+    const RepositoryIndex index = repositoryScanner->open(folderPath);
+    openIndex = index;
+    if (index.isEmpty()) {
         qDebug() << "Directory does not exist:" << folderPath;
         return;
     }
 
-    loadPartsRecursively(dir, partList->getRootItem());
+    loadPartsRecursively(index, QString(), partList->getRootItem());
+    loadPendingParts();
+    partsLoaded();
+}
+
+/**
+ * @brief Refreshes the derived state after parts have been added to the tree.
+ */
+void MainWindow::partsLoaded()
+{
+    emit partList->layoutChanged();
+    attributeStore.rebuild(partList->getRootItem());
+    partsByHash.clear();
+    streamingParts.clear();
+    for (ModelPart* part : attributeStore.parts()) {
+        if (part->contentHash().isEmpty()) {
+            if (!part->streamedFile().isEmpty())
+                streamingParts.insert(part->streamedFile(), part);
+            continue;
+        }
+        partsByHash.insert(part->contentHash(), part);
+        thumbnailCache->request(part->contentHash(), part->polyData);
+        clusterLodStage->submit(part->contentHash(), part->polyData);
+        shapeIndex->submit(part->contentHash(), part->polyData);
+    }
+    if (activeOverlay)
+        showOverlay(activeOverlay);
+    else if (!compareRoot.isEmpty())
+        compareWithRevision(compareRoot);
+    if (colourByAttribute >= 0)
+        colourBy(colourByAttribute);
+    updateRender();
+}
+
+/**
+ * @brief Attaches a newly built cluster hierarchy to every part with the given content hash.
+ * @param hash Content hash of the geometry.
+ */
+void MainWindow::handleLodReady(const QByteArray& hash)
+{
+    std::shared_ptr<const ClusterLod> lod = clusterLodStage->lod(hash);
+    for (ModelPart* part : partsByHash.values(hash))
+        part->setClusterLod(lod);
+    requestRender();
+}
+
+/**
+ * @brief Handles the start VR button.
+ */
+void MainWindow::handleStartVR()
+{
+    startVRRendering();
+}
+
+/**
+ * @brief Starts a VR session showing the currently visible parts.
+ *
+ * The VR scene is fixed once the thread runs, so a new thread is made for every session.
+ */
+void MainWindow::startVRRendering()
+{
+    if (vrThread && vrThread->isRunning()) {
+        emit statusUpdateMessageSignal("VR is already running", 2000);
+        return;
+    }
+
+    delete vrThread;
+    vrThread = new VRRenderThread(this);
+    addVisiblePartsToVR(vrThread);
+    vrThread->start();
+    emit statusUpdateMessageSignal("VR started", 2000);
+}
+
+/**
+ * @brief Handles the stop VR button. Ends the VR session and waits for the thread.
+ */
+void MainWindow::handleStopVR()
+{
+    if (!vrThread || !vrThread->isRunning())
+        return;
+
+    vrThread->issueCommand(VRRenderThread::END_RENDER, 0.0);
+    vrThread->wait();
+    emit statusUpdateMessageSignal("VR stopped", 2000);
+}
+
+/**
+ * @brief Adds the visible parts of the model tree to a VR thread that has not started yet.
+ * @param thread The VR thread.
+ */
+void MainWindow::addVisiblePartsToVR(VRRenderThread* thread)
+{
+    QHash<vtkPolyData*, vtkPolyDataMapper*> mappers;
+    int topLevelCount = partList->rowCount(QModelIndex());
+    for (int i = 0; i < topLevelCount; ++i) {
+        addPartsFromTree(partList->index(i, 0, QModelIndex()), thread, mappers);
+    }
+}
+
+/**
+ * @brief Recursively adds visible parts to a VR thread.
+ *
+ * Parts with a cluster hierarchy are added by clusters; every other part gets its
+ * own VR actor, which shares the part's property so colour changes follow.
+ * Instances of one geometry without an overlay share a VR mapper, so it is uploaded once.
+ * @param index Current index in the model tree.
+ * @param thread The VR thread.
+ * @param mappers VR mapper of each geometry already added; updated.
+ */
+void MainWindow::addPartsFromTree(const QModelIndex& index, VRRenderThread* thread,
+                                  QHash<vtkPolyData*, vtkPolyDataMapper*>& mappers)
+{
+    if (!index.isValid()) return;
+
+    ModelPart* part = static_cast<ModelPart*>(index.internalPointer());
+    if (part && part->visible()) {
+        // Overlay colours live on the mapper, so only plain instances share one
+        const bool plain = part->getActor() && !part->getActor()->GetMapper()->GetScalarVisibility();
+        vtkActor* actor = part->getNewActor(part->polyData && plain ? mappers.value(part->polyData) : nullptr);
+        if (actor && part->polyData && plain && !mappers.contains(part->polyData))
+            mappers.insert(part->polyData, vtkPolyDataMapper::SafeDownCast(actor->GetMapper()));
+        const quintptr id = reinterpret_cast<quintptr>(part);
+        if (actor && part->octree())
+            thread->addOctreeOffline(part->octree(), actor->GetProperty(), id, part->worldTransform());
+        else if (actor && part->clusterLod())
+            thread->addLodOffline(part->clusterLod(), actor->GetProperty(), id, part->worldTransform());
+        else if (actor)
+            thread->addActorOffline(actor, id, part->worldTransform());
+    }
+
+    int rows = partList->rowCount(index);
+    for (int i = 0; i < rows; i++) {
+        addPartsFromTree(partList->index(i, 0, index), thread, mappers);
+    }
+}
+
+/**
+ * @brief Adds the STL files in an indexed folder, and in its subfolders, to the tree.
+ *
+ * Each subfolder becomes a tree item of its own. STL files of at least
+ * outOfCoreThreshold bytes are not loaded; they are converted to octree files in
+ * the background and streamed once ready.
+ * @param index The repository index.
+ * @param relativePath The folder, relative to the index root.
+ * @param parentItem The tree item the folder's contents are added under.
+ */
+void MainWindow::loadPartsRecursively(const RepositoryIndex& index, const QString& relativePath, ModelPart* parentItem)
+{
+    const RepositoryIndex::Directory* directory = index.directory(relativePath);
+    if (!directory)
+        return;
+
+    const QString folderPath = relativePath.isEmpty() ? index.root() : index.root() + '/' + relativePath;
+    for (const QString& name : directory->subdirectories) {
+        ModelPart* folder = new ModelPart({ name, QString("true") });
+        parentItem->appendChild(folder);
+        loadPartsRecursively(index, RepositoryIndex::childPath(relativePath, name), folder);
+    }
+    for (const RepositoryIndex::File& file : directory->files)
+        parentItem->appendChild(loadPartFile(folderPath + '/' + file.name, file.size));
+}
+
+/**
+ * @brief Loads one STL file, plain or compressed, as a new part.
+ *
+ * Files whose decompressed size reaches the out-of-core threshold are converted
+ * to an octree in the background instead of being loaded into memory.
+ * @param filePath The file.
+ * @param fileSize Its size on disk, as already known from the folder listing.
+ * @return The new part; the caller adds it to the tree.
+ */
+ModelPart* MainWindow::loadPartFile(const QString& filePath, qint64 fileSize)
+{
+    ModelPart* part = new ModelPart({ QFileInfo(filePath).fileName(), QString("true") });
+    const bool compressed = DecompressingDevice::formatOf(filePath) != DecompressingDevice::None;
+    const qint64 size = compressed ? DecompressingDevice::estimatedSize(filePath) : fileSize;
+    if (size >= outOfCoreThreshold) {
+        part->loadOutOfCore(filePath);
+        outOfCoreStage->submit(filePath);
+    }
+    else if (!compressed && size <= batchReadLimit) {
+        pendingReads.append(qMakePair(part, filePath));
+    }
+    else {
+        part->loadSTL(filePath);
+    }
+    return part;
+}
+
+/**
+ * @brief Loads the parts whose small files were left for batch reading.
+ *
+ * The files are read many at a time in the background while the ones already read
+ * are parsed here, so parsing overlaps the per-file system call latency. Files the
+ * batch reader could not read are loaded directly, which reports errors as before.
+ */
+void MainWindow::loadPendingParts()
+{
+    QStringList paths;
+    for (const auto& pending : pendingReads)
+        paths.append(pending.second);
+
+    BatchFileReader reader(paths);
+    reader.start();
+    int index;
+    QByteArray contents;
+    while (reader.next(index, contents)) {
+        ModelPart* part = pendingReads[index].first;
+        if (contents.isEmpty())
+            part->loadSTL(pendingReads[index].second);
+        else
+            part->loadSTLFromMemory(contents);
+    }
+    pendingReads.clear();
+}
+
+/**
+ * @brief Attaches a newly opened octree to every out-of-core part streamed from the given file.
+ * The parts only now get their content hash, so they are indexed by it here.
+ * @param stlPath The STL file the octree was converted from.
+ * @param hash Content hash of the STL file.
+ */
+void MainWindow::handleOctreeReady(const QString& stlPath, const QByteArray& hash)
+{
+    std::shared_ptr<const OctreeFile> octree = outOfCoreStage->octree(hash);
+    for (ModelPart* part : streamingParts.values(stlPath)) {
+        part->setOctree(octree, hash);
+        partsByHash.insert(hash, part);
+    }
+    streamingParts.remove(stlPath);
+
+    // The triangle count and bounds are only known now
+    attributeStore.rebuild(partList->getRootItem());
+    if (colourByAttribute >= 0)
+        colourBy(colourByAttribute);
     updateRender();
 }
+
+/**
+ * @brief Brings the tree in line with folders of the open repository that changed on disk.
+ *
+ * Each changed folder is compared with what the tree was built from: entries that
+ * are gone are removed, new ones are loaded as on opening, and files whose size or
+ * modification time changed are loaded again in their old place. Parents are handled
+ * before their subfolders, so a new folder is loaded once, whole. Parts opened on
+ * their own are left alone. Removing parts ends undo history, as opening a folder does.
+ * @param index The revalidated index.
+ * @param changedDirectories Folders, relative to the root, that were added, removed or changed.
+ */
+void MainWindow::applyRepositoryChanges(const RepositoryIndex& index, const QStringList& changedDirectories)
+{
+    // A folder compared with, or one replaced by another since, is not in the tree
+    if (openIndex.isEmpty() || index.root() != openIndex.root())
+        return;
+
+    QStringList paths = changedDirectories;
+    std::sort(paths.begin(), paths.end());
+
+    bool removed = false;
+    int updated = 0;
+    for (const QString& path : paths) {
+        // Find the folder's item by name; one not in the tree yet is loaded with its parent
+        ModelPart* folder = partList->getRootItem();
+        for (const QString& name : path.split('/', Qt::SkipEmptyParts)) {
+            ModelPart* match = nullptr;
+            for (int i = 0; i < folder->childCount() && !match; ++i) {
+                if (folder->child(i)->data(0).toString() == name)
+                    match = folder->child(i);
+            }
+            folder = match;
+            if (!folder)
+                break;
+        }
+        if (!folder)
+            continue;
+
+        const RepositoryIndex::Directory* before = openIndex.directory(path);
+        const RepositoryIndex::Directory* after = index.directory(path);
+        ++updated;
+        if (!after) {
+            if (folder != partList->getRootItem() && before) {
+                partList->removePart(folder);
+                removed = true;
+            }
+            continue;
+        }
+
+        // Drop or reload what the tree was built from; other items stay as they are
+        const QString folderPath = path.isEmpty() ? index.root() : index.root() + '/' + path;
+        QSet<QString> present;
+        for (int i = folder->childCount() - 1; i >= 0; --i) {
+            ModelPart* item = folder->child(i);
+            const QString name = item->data(0).toString();
+            present.insert(name);
+            if (!before)
+                continue;
+            if (before->subdirectories.contains(name) && !after->subdirectories.contains(name)) {
+                partList->removePart(item);
+                present.remove(name);
+                removed = true;
+                continue;
+            }
+
+            const auto isNamed = [&name](const RepositoryIndex::File& file) { return file.name == name; };
+            const auto oldFile = std::find_if(before->files.cbegin(), before->files.cend(), isNamed);
+            if (oldFile == before->files.cend())
+                continue;
+            const auto newFile = std::find_if(after->files.cbegin(), after->files.cend(), isNamed);
+            if (newFile == after->files.cend()) {
+                partList->removePart(item);
+                present.remove(name);
+                removed = true;
+            }
+            else if (newFile->size != oldFile->size || newFile->modified != oldFile->modified) {
+                partList->replacePart(item, loadPartFile(folderPath + '/' + name, newFile->size));
+                removed = true;
+            }
+        }
+
+        for (const QString& name : after->subdirectories) {
+            if (present.contains(name))
+                continue;
+            ModelPart* subfolder = new ModelPart({ name, QString("true") });
+            folder->appendChild(subfolder);
+            loadPartsRecursively(index, RepositoryIndex::childPath(path, name), subfolder);
+        }
+        for (const RepositoryIndex::File& file : after->files) {
+            if (!present.contains(file.name))
+                folder->appendChild(loadPartFile(folderPath + '/' + file.name, file.size));
+        }
+    }
+    openIndex = index;
+
+    if (removed) {
+        // Undo entries and the scene still refer to the deleted parts
+        undoStack->clear();
+        ++treeGeneration;
+        renderedParts.clear();
+    }
+    loadPendingParts();
+    partsLoaded();
+    emit statusUpdateMessageSignal(QString("Updated %1 folder(s) in %2 that changed on disk")
+                                   .arg(updated).arg(QDir(index.root()).dirName()), 5000);
+}
+
+/**
+ * @brief Colours every loaded part by one of its attributes, or restores user colours.
+ *
+ * The attribute column is mapped to colours in one pass over the PartAttributeStore,
+ * the results are written to the actors' shared properties (so the VR view follows),
+ * and the scene is rendered once. User colours are never overwritten, so switching
+ * back only re-applies them.
+ * @param attribute A PartAttributeStore::Attribute, or -1 for the user-assigned colours.
+ */
+void MainWindow::colourBy(int attribute)
+{
+    colourByAttribute = attribute;
+    const QVector<ModelPart*>& parts = attributeStore.parts();
+
+    if (attribute < 0) {
+        for (ModelPart* part : parts)
+            part->restoreColour();
+    }
+    else {
+        QVector<float> red, green, blue;
+        attributeStore.mapToColours(static_cast<PartAttributeStore::Attribute>(attribute), red, green, blue);
+        for (int i = 0; i < parts.size(); ++i)
+            parts[i]->setDisplayColour(red[i], green[i], blue[i]);
+    }
+
+    overlaysToVR();
+    requestRender();
+}
+
+/**
+ * @brief Refreshes the tree rows of every part whose thumbnail has just become available.
+ * @param hash Content hash of the part's STL file.
+ */
+void MainWindow::handleThumbnailReady(const QByteArray& hash)
+{
+    for (ModelPart* part : partsByHash.values(hash)) {
+        QModelIndex index = partList->indexForPart(part);
+        emit partList->dataChanged(index, index, { Qt::DecorationRole });
+    }
+}
+
+/**
+ * @brief Shows a per-vertex analysis overlay on every loaded part.
+ *
+ * Parts whose analysis is not cached yet are queued on the AnalysisStage and pick up
+ * the overlay when it finishes. Parts that already have the array switch immediately.
+ * @param analysis An AnalysisStage::Analysis value, or 0 to turn overlays off.
+ */
+void MainWindow::showOverlay(int analysis)
+{
+    activeOverlay = analysis;
+
+    // Any overlay choice ends a comparison
+    if (!compareRoot.isEmpty()) {
+        compareRoot.clear();
+        compareReferences.clear();
+        partDeviations.clear();
+        partList->setDeviations(partDeviations, 0.0);
+    }
+
+    if (!analysis) {
+        for (ModelPart* part : attributeStore.parts())
+            part->clearOverlay();
+        overlaysToVR();
+        requestRender();
+        return;
+    }
+
+    if (analysis == AnalysisStage::AssemblyOcclusion) {
+        QVector<AnalysisStage::AssemblyPart> assembly;
+        for (ModelPart* part : attributeStore.parts()) {
+            // Out-of-core parts have no geometry in memory to bake against
+            if (!part->polyData)
+                continue;
+            AnalysisStage::AssemblyPart placed;
+            placed.hash = part->contentHash();
+            placed.geometry = part->polyData;
+            std::copy(part->worldTransform(), part->worldTransform() + 16, placed.transform);
+            assembly.append(placed);
+        }
+        analysisStage->submitAssembly(assembly);
+    }
+    else {
+        for (ModelPart* part : attributeStore.parts())
+            analysisStage->submit(part->contentHash(), part->polyData, analysis);
+    }
+    applyOverlay();
+}
+
+/**
+ * @brief Attaches freshly cached analysis arrays to every part with the given content hash.
+ * The active overlay is refreshed shortly after, so a burst of finished parts costs one render.
+ * @param hash Content hash of the analysed geometry.
+ * @param analyses OR'ed AnalysisStage::Analysis values now in the cache.
+ */
+void MainWindow::handleAnalysisFinished(const QByteArray& hash, int analyses)
+{
+    for (AnalysisStage::Analysis analysis : { AnalysisStage::Curvature, AnalysisStage::Thickness,
+                                              AnalysisStage::AmbientOcclusion }) {
+        GeometryCache::PointArray entry;
+        if (!(analyses & analysis) || !geometryCache.pointArray(hash, analysisStage->cacheName(analysis), &entry))
+            continue;
+        for (ModelPart* part : partsByHash.values(hash)) {
+            if (!part->hasPointArray(AnalysisStage::arrayName(analysis)))
+                part->addPointArray(entry.values);
+        }
+    }
+
+    if (activeOverlay && !overlayRefreshTimer.isActive())
+        overlayRefreshTimer.start();
+}
+
+/**
+ * @brief Attaches a newly cached assembly occlusion bake to the instances placed as baked.
+ *
+ * Each instance of a file sits elsewhere in the assembly and has a bake of its own,
+ * so the array goes on the instance alone. Instances moved since the bake was
+ * submitted no longer match its name and keep what they had.
+ * @param hash Content hash of the baked geometry.
+ * @param cacheName AnalysisStage::instanceCacheName() of the baked placement.
+ */
+void MainWindow::handleAssemblyOcclusionFinished(const QByteArray& hash, const QString& cacheName)
+{
+    GeometryCache::PointArray entry;
+    if (!geometryCache.pointArray(hash, cacheName, &entry))
+        return;
+    for (ModelPart* part : partsByHash.values(hash)) {
+        // Assembly occlusion changes with the assembly, so always take the latest bake
+        if (analysisStage->instanceCacheName(part->worldTransform()) == cacheName)
+            part->addInstancePointArray(entry.values);
+    }
+
+    if (activeOverlay && !overlayRefreshTimer.isActive())
+        overlayRefreshTimer.start();
+}
+
+/**
+ * @brief Applies the active overlay to all parts that have its array.
+ * A common value range is used across parts so colours are comparable between them.
+ */
+void MainWindow::applyOverlay()
+{
+    if (!compareRoot.isEmpty()) {
+        applyComparison();
+        return;
+    }
+    if (!activeOverlay)
+        return;
+
+    const AnalysisStage::Analysis analysis = static_cast<AnalysisStage::Analysis>(activeOverlay);
+    const QString name = AnalysisStage::arrayName(analysis);
+
+    // Occlusion is baked in [0, 1] and shades each part's own colour
+    if (analysis == AnalysisStage::AmbientOcclusion || analysis == AnalysisStage::AssemblyOcclusion) {
+        for (ModelPart* part : attributeStore.parts()) {
+            if (part->hasPointArray(name))
+                part->setOcclusionOverlay(name);
+        }
+        overlaysToVR();
+        requestRender();
+        return;
+    }
+
+    double lo = 0.0, hi = 0.0;
+    bool first = true;
+    for (ModelPart* part : attributeStore.parts()) {
+        GeometryCache::PointArray entry;
+        if (!part->hasPointArray(name) || !geometryCache.pointArray(part->contentHash(), analysisStage->cacheName(analysis), &entry))
+            continue;
+        lo = first ? entry.range[0] : qMin(lo, entry.range[0]);
+        hi = first ? entry.range[1] : qMax(hi, entry.range[1]);
+        first = false;
+    }
+
+    for (ModelPart* part : attributeStore.parts()) {
+        if (part->hasPointArray(name))
+            part->setOverlay(name, overlayLut, lo, hi);
+    }
+    overlaysToVR();
+    requestRender();
+}
+
+/**
+ * @brief Compares the loaded parts with the same parts in another revision.
+ *
+ * Parts are matched by tree path, which for an opened folder is the path of the
+ * file within it. Each matched part is measured on the DeviationStage; results for a
+ * content hash pair seen before come straight from the geometry cache.
+ * @param root The other revision's folder.
+ */
+void MainWindow::compareWithRevision(const QString& root)
+{
+    const QString folder = root;
+    showOverlay(0);
+
+    const RepositoryIndex index = repositoryScanner->open(folder);
+    QHash<QString, QString> files;
+    collectRevisionFiles(index, QString(), files);
+    compareRoot = folder;
+
+    for (ModelPart* part : attributeStore.parts()) {
+        const QString reference = files.value(revisionKey(treePath(part)));
+        // Out-of-core parts have no vertices in memory to measure
+        if (reference.isEmpty() || !part->polyData)
+            continue;
+        compareReferences.insert(part, reference);
+        deviationStage->submit(part->contentHash(), part->polyData, reference);
+    }
+
+    emit statusUpdateMessageSignal(QString("Comparing %1 of %2 parts with %3")
+                                   .arg(compareReferences.size()).arg(attributeStore.parts().size())
+                                   .arg(QDir(folder).dirName()), 5000);
+}
+
+/**
+ * @brief Attaches a newly cached deviation array to the parts compared with the given file.
+ * The comparison colours are refreshed shortly after, so a burst of results costs one render.
+ * @param hash Content hash of the compared geometry.
+ * @param referenceFile The file it was compared with.
+ * @param referenceHash Content hash of that file, or empty if it could not be read.
+ */
+void MainWindow::handleDeviationFinished(const QByteArray& hash, const QString& referenceFile, const QByteArray& referenceHash)
+{
+    GeometryCache::PointArray entry;
+    if (referenceHash.isEmpty()) {
+        emit statusUpdateMessageSignal("Could not read " + referenceFile, 5000);
+        return;
+    }
+    if (!geometryCache.pointArray(hash, DeviationStage::cacheName(referenceHash), &entry))
+        return;
+
+    for (ModelPart* part : partsByHash.values(hash)) {
+        if (compareReferences.value(part) != referenceFile)
+            continue;
+        part->addPointArray(entry.values);
+        partDeviations.insert(part, entry.range[1]);
+    }
+
+    if (!overlayRefreshTimer.isActive())
+        overlayRefreshTimer.start();
+}
+
+/**
+ * @brief Colours compared parts by their deviation from the other revision.
+ * Vertices use a range symmetric about zero and common to all parts, so colours
+ * are comparable between parts; tree rows fade from green to red at the largest deviation.
+ */
+void MainWindow::applyComparison()
+{
+    double largest = 0.0;
+    for (double deviation : partDeviations)
+        largest = qMax(largest, deviation);
+
+    for (auto it = partDeviations.constBegin(); it != partDeviations.constEnd(); ++it) {
+        if (it.key()->hasPointArray(DeviationStage::arrayName()))
+            it.key()->setOverlay(DeviationStage::arrayName(), overlayLut, -largest, largest);
+    }
+    partList->setDeviations(partDeviations, largest);
+    overlaysToVR();
+    requestRender();
+}
+
+/**
+ * @brief Prepares an offscreen exporter holding the current scene and camera.
+ * @param exporter The exporter to fill.
+ */
+void MainWindow::prepareExport(SceneExporter& exporter)
+{
+    ModelPart* root = partList->getRootItem();
+    for (int i = 0; i < root->childCount(); ++i)
+        exporter.addPart(root->child(i));
+
+    exporter.setBackground(backgroundColour[0], backgroundColour[1], backgroundColour[2]);
+
+    vtkNew<vtkCamera> camera;
+    renderThread->copyCamera(camera);
+    exporter.setCamera(camera);
+}
+
+/**
+ * @brief Exports the current view as a (possibly tiled) high resolution PNG.
+ */
+void MainWindow::exportSnapshot()
+{
+    QString fileName = QFileDialog::getSaveFileName(this, "Export Snapshot", QDir::homePath(), "PNG Images (*.png)");
+    if (fileName.isEmpty())
+        return;
+
+    bool ok = false;
+    int magnification = QInputDialog::getInt(this, "Export Snapshot", "Tiles per edge (image size multiplier):", 4, 1, 32, 1, &ok);
+    if (!ok)
+        return;
+
+    SceneExporter exporter(renderView->width(), renderView->height());
+    prepareExport(exporter);
+    if (exporter.exportSnapshot(fileName, magnification))
+        emit statusUpdateMessageSignal("Exported snapshot to " + fileName, 4000);
+    else
+        QMessageBox::warning(this, "Export Snapshot", "Could not write " + fileName);
+}
+
+/**
+ * @brief Exports a turntable image sequence of the current scene.
+ */
+void MainWindow::exportTurntable()
+{
+    QString directory = QFileDialog::getExistingDirectory(this, "Export Turntable", QDir::homePath());
+    if (directory.isEmpty())
+        return;
+
+    bool ok = false;
+    int frames = QInputDialog::getInt(this, "Export Turntable", "Number of frames:", 120, 2, 3600, 1, &ok);
+    if (!ok)
+        return;
+
+    SceneExporter exporter(renderView->width(), renderView->height());
+    prepareExport(exporter);
+    int written = exporter.exportTurntable(directory, frames);
+    emit statusUpdateMessageSignal(QString("Exported %1 of %2 turntable frames").arg(written).arg(frames), 4000);
+}
@@ -4,8 +4,8 @@
  *
  * This header file declares the MainWindow class, which is the central widget
  * of the application. It manages the user interface, the visualization of 3D
- * models using the Visualization Toolkit (VTK), and the interaction with a
- * separate thread responsible for Virtual Reality (VR) rendering.
+ * models using the Visualization Toolkit (VTK), and the interaction with the
+ * separate threads responsible for desktop and Virtual Reality (VR) rendering.
  */
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
@@ -13,18 +13,39 @@
 #include <QMainWindow>
 #include <QModelIndex>
 #include <QDir>
+#include <QMultiHash>
+#include <QTimer>
 
 #include "VRRenderThread.h"
+#include "PartEditCommand.h"
+#include "PartAttributeStore.h"
+#include "GeometryCache.h"
+#include "SceneSnapshot.h"
+#include "AssemblyManifest.h"
+#include "RepositoryIndex.h"
 
  // Forward declarations
 class ModelPart;
 class ModelPartList;
+class QUndoStack;
+class AnalysisStage;
+class DeviationStage;
+class ShapeIndex;
+class ClusterLodStage;
+class OutOfCoreStage;
+class RepositoryScanner;
+class TeamCache;
+class ThumbnailCache;
+class SceneExporter;
+class DesktopRenderThread;
+class RenderView;
+class vtkPolyData;
+class vtkPolyDataMapper;
 
 // VTK includes
 #include <vtkSmartPointer.h>
-#include <vtkRenderer.h>
-#include <vtkGenericOpenGLRenderWindow.h>
 #include <vtkActorCollection.h>
+#include <vtkLookupTable.h>
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -52,6 +73,12 @@ public:
      * especially the VR rendering thread.
      */
     ~MainWindow();
+    /**
+     * @brief Reads preprocessed geometry from, and publishes it to, a team cache directory.
+     * Covers welded meshes, cluster hierarchies and octree files of parts loaded afterwards.
+     * @param cache The cache, or nullptr for none; it must outlive the window.
+     */
+    void setTeamCache(TeamCache* cache);
 
 signals:
     /**
@@ -84,13 +111,6 @@ private slots:
      * reflecting any changes in the loaded models or their properties.
      */
     void updateRender();
-    /**
-     * @brief Recursively updates the render from the model tree.
-     * This slot traverses the model tree structure and adds the visible
-     * VTK actors of the model parts to the renderer.
-     * @param index The current index in the model tree being processed.
-     */
-    void updateRenderFromTree(const QModelIndex& index);
     /**
      * @brief Handles the action to open the options dialog.
      * This slot is invoked when the user requests to open the options dialog,
@@ -115,6 +135,10 @@ private slots:
      * through the application's menu or interface.
      */
     void on_actionOpenSingleFile_triggered();
+    /**
+     * @brief Asks for an assembly manifest and adds the assembly it describes to the tree.
+     */
+    void openAssembly();
     /**
      * @brief Handles the action to open the options for a selected item.
      * This slot is called when the user requests to view or modify the options
@@ -137,13 +161,44 @@ private slots:
      */
     void loadInitialPartsFromFolder(const QString& folderPath);
     /**
-     * @brief Recursively loads model parts from a directory and its subdirectories.
-     * This slot traverses a directory structure, identifies supported 3D model
+     * @brief Recursively loads model parts from an indexed directory and its subdirectories.
+     * This slot walks the repository index, which lists the supported 3D model
      * files, and adds them as ModelPart objects to the model tree.
-     * @param dir The current directory to process.
+     * @param index The index of the opened repository.
+     * @param relativePath The current directory, relative to the index root.
      * @param parentItem The parent item in the model tree to which new parts will be added.
      */
-    void loadPartsRecursively(const QDir& dir, ModelPart* parentItem);
+    void loadPartsRecursively(const RepositoryIndex& index, const QString& relativePath, ModelPart* parentItem);
+    /**
+     * @brief Loads one STL file, plain, gzip or Zstandard compressed, as a new part.
+     * @param filePath The file to load.
+     * @param fileSize Its size in bytes.
+     * @return The new part, not yet added to the tree.
+     */
+    ModelPart* loadPartFile(const QString& filePath, qint64 fileSize);
+    /**
+     * @brief Reads the files of the parts left pending by loadPartFile() in batches and loads them.
+     */
+    void loadPendingParts();
+    /**
+     * @brief Adds the assembly described by a manifest to the tree.
+     * Each STL file is loaded once; its other instances share the loaded geometry.
+     * @param path The manifest file.
+     */
+    void loadAssembly(const QString& path);
+    /**
+     * @brief Creates the tree items of a manifest node and its children.
+     * @param node The manifest node.
+     * @param prototypes First part created for each file, by path; updated.
+     * @param instances Receives each later instance with the part whose geometry it shares.
+     * @return The new item, not yet added to the tree.
+     */
+    ModelPart* buildAssembly(const AssemblyManifest::Node& node, QHash<QString, ModelPart*>& prototypes,
+                             QVector<QPair<ModelPart*, ModelPart*>>& instances);
+    /**
+     * @brief Updates the attribute store, hash index and background stages after parts are added.
+     */
+    void partsLoaded();
     /**
      * @brief Starts the VR rendering process.
      * This slot initiates the Virtual Reality rendering by communicating with
@@ -168,6 +223,84 @@ private slots:
      * ongoing Virtual Reality rendering process.
      */
     void handleStopVR();
+    /**
+     * @brief Colours all parts by an attribute, or restores the user-assigned colours.
+     * This slot is connected to the "Colour By" menu.
+     * @param attribute A PartAttributeStore::Attribute, or -1 for user colours.
+     */
+    void colourBy(int attribute);
+    /**
+     * @brief Shows a per-vertex analysis overlay, computing it in the background if needed.
+     * This slot is connected to the "Overlay" menu.
+     * @param analysis An AnalysisStage::Analysis value, or 0 for no overlay.
+     */
+    void showOverlay(int analysis);
+    /**
+     * @brief Attaches newly cached analysis arrays to the parts they belong to.
+     * @param hash Content hash of the analysed geometry.
+     * @param analyses OR'ed AnalysisStage::Analysis values now available.
+     */
+    void handleAnalysisFinished(const QByteArray& hash, int analyses);
+    /**
+     * @brief Attaches a newly cached assembly occlusion bake to the instances placed as baked.
+     * @param hash Content hash of the baked geometry.
+     * @param cacheName AnalysisStage::instanceCacheName() of the baked placement.
+     */
+    void handleAssemblyOcclusionFinished(const QByteArray& hash, const QString& cacheName);
+    /**
+     * @brief Compares the loaded parts with the same parts in another revision of the repository.
+     * Parts are matched by their path in the tree; compressed and plain files match.
+     * Any other overlay choice ends the comparison.
+     * @param root The other revision's folder.
+     */
+    void compareWithRevision(const QString& root);
+    /**
+     * @brief Attaches a newly cached deviation array to the compared parts it belongs to.
+     * @param hash Content hash of the compared geometry.
+     * @param referenceFile The file it was compared with.
+     * @param referenceHash Content hash of that file, or empty if it could not be read.
+     */
+    void handleDeviationFinished(const QByteArray& hash, const QString& referenceFile, const QByteArray& referenceHash);
+    /**
+     * @brief Attaches a newly built cluster hierarchy to the parts it belongs to.
+     * @param hash Content hash of the geometry.
+     */
+    void handleLodReady(const QByteArray& hash);
+    /**
+     * @brief Attaches a newly opened octree to the out-of-core parts it belongs to.
+     * @param stlPath The STL file the octree was converted from.
+     * @param hash Content hash of the STL file.
+     */
+    void handleOctreeReady(const QString& stlPath, const QByteArray& hash);
+    /**
+     * @brief Brings the tree in line with folders of the open repository that changed on disk.
+     * @param index The revalidated index.
+     * @param changedDirectories Folders, relative to the root, that were added, removed or changed.
+     */
+    void applyRepositoryChanges(const RepositoryIndex& index, const QStringList& changedDirectories);
+    /**
+     * @brief Applies the active overlay to all parts that have its data and renders once.
+     */
+    void applyOverlay();
+    /**
+     * @brief Colours the compared parts' vertices and tree rows by deviation and renders once.
+     */
+    void applyComparison();
+    /**
+     * @brief Updates the tree icons of the parts whose thumbnail has been rendered or loaded.
+     * @param hash Content hash of the parts' STL file.
+     */
+    void handleThumbnailReady(const QByteArray& hash);
+    /**
+     * @brief Exports the current view offscreen as a tiled high resolution image.
+     * This slot is connected to the "Export" menu.
+     */
+    void exportSnapshot();
+    /**
+     * @brief Exports a turntable image sequence of the current scene.
+     * This slot is connected to the "Export" menu.
+     */
+    void exportTurntable();
 private:
     /**
      * @brief Stores the index of the tree view item for context menu operations.
@@ -184,6 +317,126 @@ private:
      */
     VRRenderThread* vrThread = nullptr;
 
+    /**
+     * @brief Undo/redo history of part attribute edits.
+     * Holds PartEditCommand entries, which store compact per-part deltas rather
+     * than snapshots of the tree.
+     */
+    QUndoStack* undoStack = nullptr;
+    /**
+     * @brief Counter used to give each edit session (e.g. one dialog) its own merge id.
+     */
+    int nextMergeSession = 0;
+    /**
+     * @brief A part checked by mergeNearDuplicates(), with what the pool task needs to check it.
+     */
+    struct MergeCandidate {
+        ModelPart* part = nullptr;                  /**< The part; only used back on the GUI thread */
+        QByteArray hash;                            /**< Content hash of the part */
+        vtkPolyData* source = nullptr;              /**< The part's geometry when checked, to detect later changes */
+        vtkSmartPointer<vtkPolyData> mesh;          /**< Shallow copy of the geometry, read by the pool task */
+        double bounds[6] = { 0.0 };                 /**< Bounds of the geometry in model coordinates */
+        double length = 0.0;                        /**< Diagonal of the bounds */
+        QVector<QByteArray> nearest;                /**< Hashes of the nearest shapes in the shape index */
+    };
+    /**
+     * @brief True while mergeNearDuplicates() is checking on the pool.
+     */
+    bool mergeRunning = false;
+    /**
+     * @brief Incremented whenever parts are deleted from the tree, so background results about them can be discarded.
+     */
+    quint64 treeGeneration = 0;
+    /**
+     * @brief Per-part attributes of the loaded parts, used by the "Colour By" modes.
+     */
+    PartAttributeStore attributeStore;
+    /**
+     * @brief The active "Colour By" attribute, or -1 when showing user colours.
+     */
+    int colourByAttribute = -1;
+    /**
+     * @brief Loaded parts indexed by the content hash of their STL file.
+     */
+    QMultiHash<QByteArray, ModelPart*> partsByHash;
+    /**
+     * @brief Out-of-core parts still waiting for their octree, by STL file.
+     * Their content hash is only known once the octree is ready.
+     */
+    QMultiHash<QString, ModelPart*> streamingParts;
+    /**
+     * @brief Cache of per-vertex data derived from part geometry.
+     */
+    GeometryCache geometryCache;
+    /**
+     * @brief Background stage that computes analysis overlays into the geometry cache.
+     */
+    AnalysisStage* analysisStage = nullptr;
+    /**
+     * @brief Background stage that builds cluster hierarchies for very large parts.
+     */
+    ClusterLodStage* clusterLodStage = nullptr;
+    /**
+     * @brief Shape descriptors of the loaded parts, for finding similar parts.
+     */
+    ShapeIndex* shapeIndex = nullptr;
+    /**
+     * @brief Background stage that converts parts too large for memory into octree files.
+     */
+    OutOfCoreStage* outOfCoreStage = nullptr;
+    /**
+     * @brief Builds, saves and revalidates the indexes of opened folders.
+     */
+    RepositoryScanner* repositoryScanner = nullptr;
+    /**
+     * @brief STL files of at least this many bytes are loaded out of core.
+     */
+    qint64 outOfCoreThreshold = 0;
+    /**
+     * @brief Uncompressed STL files up to this many bytes are read in batches by loadPendingParts().
+     */
+    qint64 batchReadLimit = 16 * 1024 * 1024;
+    /**
+     * @brief Parts created by loadPartFile() whose files are still to be read, with their paths.
+     */
+    QList<QPair<ModelPart*, QString>> pendingReads;
+    /**
+     * @brief The overlay currently shown (an AnalysisStage::Analysis value), or 0 for none.
+     */
+    int activeOverlay = 0;
+    /**
+     * @brief Background stage that measures parts against another revision.
+     */
+    DeviationStage* deviationStage = nullptr;
+    /**
+     * @brief Folder of the revision being compared with, or empty when not comparing.
+     */
+    QString compareRoot;
+    /**
+     * @brief Index of the folder the tree was opened from, as the tree shows it; empty if none.
+     */
+    RepositoryIndex openIndex;
+    /**
+     * @brief File in the compared revision that each matched part is measured against.
+     */
+    QHash<ModelPart*, QString> compareReferences;
+    /**
+     * @brief Hausdorff distance of each compared part from its reference, once its result has arrived.
+     */
+    QHash<ModelPart*, double> partDeviations;
+    /**
+     * @brief Lookup table shared by all parts when showing an overlay.
+     */
+    vtkSmartPointer<vtkLookupTable> overlayLut;
+    /**
+     * @brief Coalesces overlay refreshes while analysis results are arriving.
+     */
+    QTimer overlayRefreshTimer;
+    /**
+     * @brief Persistent cache of part thumbnails shown in the tree view.
+     */
+    ThumbnailCache* thumbnailCache = nullptr;
+
 
 private:
     /**
@@ -199,25 +452,62 @@ private:
      */
     ModelPartList* partList;
     /**
-     * @brief VTK renderer for the 3D scene.
-     * This smart pointer manages the VTK renderer object, which is responsible
-     * for rendering the 3D models in the visualization window.
+     * @brief Thread that renders the desktop 3D view.
+     * The GUI thread never renders; it hands the thread scene snapshots instead.
+     */
+    DesktopRenderThread* renderThread = nullptr;
+    /**
+     * @brief Widget that shows the frames of the render thread and forwards input to it.
+     * It takes the place of the vtkWidget from the UI file.
+     */
+    RenderView* renderView = nullptr;
+    /**
+     * @brief Parts in the last scene sent to the render thread, by the id the ID buffer holds.
+     * Ids read back from a frame are only trusted if they are found here.
+     */
+    QHash<quintptr, ModelPart*> renderedParts;
+    /**
+     * @brief Id of the part under the cursor in the 3D view, or 0.
      */
-    vtkSmartPointer<vtkRenderer> renderer;
+    quintptr hoveredPartId = 0;
     /**
-     * @brief VTK render window for OpenGL rendering.
-     * This smart pointer manages the VTK render window, which provides the
-     * OpenGL context for rendering the 3D scene. It is embedded within a
-     * Qt widget.
+     * @brief Background colour of the 3D view (0-1).
      */
-    vtkSmartPointer<vtkGenericOpenGLRenderWindow> renderWindow;
+    double backgroundColour[3] = { 0.1, 0.1, 0.1 };
 
     /**
      * @brief Initializes the VTK rendering environment.
-     * This private function sets up the VTK render window and renderer,
-     * associating them with the Qt widget designed to host the visualization.
+     * This private function starts the desktop render thread and puts its view
+     * widget where the UI file places the visualization.
      */
     void setupVTK();
+    /**
+     * @brief Sends the render thread a snapshot of the visible parts.
+     * Returns immediately; the frame is drawn on the render thread.
+     * @param resetCamera Fit the camera to the visible parts before drawing.
+     */
+    void requestRender(bool resetCamera = false);
+    /**
+     * @brief Recursively adds the visible parts of the model tree to a scene snapshot.
+     * @param index The current index in the model tree being processed.
+     * @param scene The snapshot to add to.
+     */
+    void updateRenderFromTree(const QModelIndex& index, SceneSnapshot& scene);
+    /**
+     * @brief Sends the render thread the selected and hovered parts to outline.
+     */
+    void updateHighlight();
+    /**
+     * @brief Selects the part clicked in the 3D view in the tree.
+     * @param id Id of the part from the ID buffer, or 0 for the background.
+     * @param extend True to toggle the part in the selection instead of replacing it.
+     */
+    void handlePartClicked(quintptr id, bool extend);
+    /**
+     * @brief Shows the name of the part under the cursor in the 3D view.
+     * @param id Id of the part from the ID buffer, or 0 for none.
+     */
+    void handlePartHovered(quintptr id);
     /**
      * @brief Shows the context menu at the specified position in the tree view.
      * This private slot is triggered when the user right-clicks on an item in
@@ -225,6 +515,53 @@ private:
      * @param pos The position where the context menu is requested, in widget coordinates.
      */
     void showContextMenu(const QPoint& pos);
+    /**
+     * @brief Returns the tree indexes of the parts selected in the tree view.
+     * If nothing is selected, the current index is used instead.
+     * @return Column 0 indexes of the selected parts.
+     */
+    QModelIndexList selectedPartIndexes() const;
+    /**
+     * @brief Selects the parts whose shape is most like the current part's.
+     */
+    void findSimilarParts();
+    /**
+     * @brief Makes parts that are the same as an earlier part within a tolerance instances of it.
+     * Returns at once; the geometric check runs on the global pool, after which the
+     * merge is confirmed and pushed as one undoable edit.
+     * @param tolerance Largest deviation allowed, as a fraction of the earlier part's diagonal.
+     */
+    void mergeNearDuplicates(double tolerance);
+    /**
+     * @brief Confirms and applies the result of mergeNearDuplicates() on the GUI thread.
+     * @param candidates The parts that were checked.
+     * @param duplicates Index of each duplicate in @p candidates, with the index of the part it matches.
+     * @param generation treeGeneration when the check started.
+     */
+    void applyMerge(const QVector<MergeCandidate>& candidates, const QVector<QPair<int, int>>& duplicates,
+                    quint64 generation);
+    /**
+     * @brief Moves the selected parts by an offset in scene coordinates, as one undoable edit.
+     * @param offset Translation along the scene's x, y and z axes.
+     * @return The number of parts moved.
+     */
+    int moveSelectedParts(const double offset[3]);
+    /**
+     * @brief Returns the callback PartEditCommand uses to refresh the tree and scene.
+     * @return A callback that forwards to applyPartEdits().
+     */
+    PartEditCommand::SceneUpdate partEditCallback();
+    /**
+     * @brief Refreshes the tree view and scene once after a batch of part edits.
+     * @param parts The parts whose attributes changed.
+     * @param fields Union of the PartDelta::Field values that changed.
+     */
+    void applyPartEdits(const QVector<ModelPart*>& parts, quint8 fields);
+    /**
+     * @brief Fills an offscreen exporter with the visible parts, background and camera.
+     * @param exporter The exporter to fill.
+     */
+    void prepareExport(SceneExporter& exporter);
 
     /**
      * @brief Adds the currently visible parts to the VR rendering thread.
@@ -241,8 +578,19 @@ private:
      * managed by the VR rendering thread.
      * @param index The current index in the model tree being processed.
      * @param thread The VR rendering thread to which the actors are added.
+     * @param mappers VR mapper of each geometry already added, shared by the later
+     *        instances of the same geometry; updated.
+     */
+    void addPartsFromTree(const QModelIndex& index, VRRenderThread* thread, QHash<vtkPolyData*, vtkPolyDataMapper*>& mappers);
+    /**
+     * @brief Sends the new world transforms of moved parts and their descendants to a running VR thread.
+     * @param part A part whose local transform changed.
+     */
+    void moveInVR(ModelPart* part);
+    /**
+     * @brief Sends the overlay state of every loaded part to a running VR thread.
      */
-    void addPartsFromTree(const QModelIndex& index, VRRenderThread* thread);
+    void overlaysToVR();
 };
 
 #endif // MAINWINDOW_H
\ No newline at end of file
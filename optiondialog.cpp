@@ -2,13 +2,16 @@
  * @file optiondialog.cpp
  * @brief Implementation of the OptionDialog class.
  *
- * This class provides a dialog for setting properties such as name, color, and visibility
- * of an object. It uses sliders for color selection and input fields for other properties.
+ * This class provides a dialog for setting properties such as name, color, opacity and
+ * visibility of an object. It uses sliders for color selection and input fields for other properties.
  */
 
 #include "optiondialog.h"
 #include "ui_optiondialog.h"
-#include <QDebug>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QSignalBlocker>
+#include <QtMath>
 
  /**
   * @brief Constructor for OptionDialog.
@@ -16,6 +19,8 @@
   */
 OptionDialog::OptionDialog(QWidget* parent)
     : QDialog(parent)
+    , colourMoved(false)
+    , opacityMoved(false)
     , ui(new Ui::OptionDialog)
 {
     ui->setupUi(this);
@@ -49,54 +54,99 @@ OptionDialog::OptionDialog(QWidget* parent)
     s_blue->setValue(10);
     s_blue->setFixedSize(300, 20);
 
+    s_opacity = new QSlider(this);
+    s_opacity->setRange(0, 100);
+    s_opacity->setOrientation(Qt::Horizontal);
+    s_opacity->move(50, 145);
+    s_opacity->setValue(100);
+    s_opacity->setFixedSize(300, 20);
+    s_opacity->setToolTip(tr("Opacity"));
+
+    // Unlike the colour sliders, whose swatch shows what they do, opacity needs a caption
+    l_opacity = new QLabel(tr("Opacity"), this);
+    l_opacity->setFixedSize(45, 20);
+    l_opacity->move(5, 145);
+    l_opacity->setBuddy(s_opacity);
+
     // Initialize the color display label
     res = new QLabel(this);
     res->setFixedSize(300, 30);
-    res->move(50, 150);
+    res->move(50, 185);
     res->setStyleSheet("QLabel{background-color:rgb(255,0,0);border:2px solid red;}");
 
     // Connect slider value changes to color update slots
     connect(s_red, SIGNAL(valueChanged(int)), this, SLOT(red_change()));
     connect(s_green, SIGNAL(valueChanged(int)), this, SLOT(green_change()));
     connect(s_blue, SIGNAL(valueChanged(int)), this, SLOT(blue_change()));
+    connect(s_opacity, &QSlider::valueChanged, this, [this]() {
+        opacityMoved = true;
+        schedulePreview();
+    });
+
+    // Throttle previews to the display refresh rate so a fast drag costs one update per frame
+    qreal refreshRate = 60.0;
+    if (QScreen* screen = QGuiApplication::primaryScreen()) {
+        if (screen->refreshRate() > 0.0)
+            refreshRate = screen->refreshRate();
+    }
+    previewTimer.setSingleShot(true);
+    previewTimer.setInterval(qMax(1, qFloor(1000.0 / refreshRate)));
+    connect(&previewTimer, &QTimer::timeout, this, &OptionDialog::updatePreview);
+}
 
-    // Initialize color component strings
-    r = QString::number(s_red->value());
-    g = QString::number(s_green->value());
-    b = QString::number(s_blue->value());
+/**
+ * @brief Schedules a preview for the next display frame.
+ * Further slider ticks before the timer fires are folded into the same preview.
+ */
+void OptionDialog::schedulePreview()
+{
+    if (!previewTimer.isActive())
+        previewTimer.start();
+}
+
+/**
+ * @brief Updates the colour swatch and emits the values whose sliders moved since the last preview.
+ */
+void OptionDialog::updatePreview()
+{
+    QColor color = getColor();
+    res->setStyleSheet("QLabel{background-color:" + color.name() + "; }");
+    const bool colour = colourMoved;
+    const bool opacity = opacityMoved;
+    colourMoved = false;
+    opacityMoved = false;
+    if (colour || opacity)
+        emit appearancePreview(color, getOpacity(), colour, opacity);
 }
 
 /**
  * @brief Slot function to handle red color changes.
- * Updates the color display label with the new red value.
+ * Schedules a throttled preview of the new colour.
  */
 void OptionDialog::red_change()
 {
-    qDebug() << s_red->value(); // Debug output
-    r = QString::number(s_red->value());
-    res->setStyleSheet("QLabel{background-color:rgb(" + r + ", " + g + ", " + b + "); }");
+    colourMoved = true;
+    schedulePreview();
 }
 
 /**
  * @brief Slot function to handle green color changes.
- * Updates the color display label with the new green value.
+ * Schedules a throttled preview of the new colour.
  */
 void OptionDialog::green_change()
 {
-    qDebug() << s_green->value(); // Debug output
-    g = QString::number(s_green->value());
-    res->setStyleSheet("QLabel{background-color:rgb(" + r + ", " + g + ", " + b + "); }");
+    colourMoved = true;
+    schedulePreview();
 }
 
 /**
  * @brief Slot function to handle blue color changes.
- * Updates the color display label with the new blue value.
+ * Schedules a throttled preview of the new colour.
  */
 void OptionDialog::blue_change()
 {
-    qDebug() << s_blue->value(); // Debug output
-    b = QString::number(s_blue->value());
-    res->setStyleSheet("QLabel{background-color:rgb(" + r + ", " + g + ", " + b + "); }");
+    colourMoved = true;
+    schedulePreview();
 }
 
 /**
@@ -113,15 +163,39 @@ OptionDialog::~OptionDialog()
  * @param name The name to set.
  * @param color The color to set.
  * @param visible The visibility flag to set.
+ * @param opacity The opacity to set (0-1).
  */
-void OptionDialog::setValues(const QString& name, const QColor& color, bool visible)
+void OptionDialog::setValues(const QString& name, const QColor& color, bool visible, double opacity)
 {
     ui->nameLineEdit->setText(name);
     ui->checkBox->setChecked(visible);
+
+    // Initial values are not a user edit, so do not emit a preview for them
+    const QSignalBlocker blockRed(s_red);
+    const QSignalBlocker blockGreen(s_green);
+    const QSignalBlocker blockBlue(s_blue);
+    const QSignalBlocker blockOpacity(s_opacity);
     s_red->setValue(color.red());
     s_green->setValue(color.green());
     s_blue->setValue(color.blue());
-    res->setStyleSheet("QLabel{background-color:rgb(" + r + ", " + g + ", " + b + "); }");
+    s_opacity->setValue(qRound(opacity * 100.0));
+    res->setStyleSheet("QLabel{background-color:" + color.name() + "; }");
+}
+
+/**
+ * @brief Closes the dialog.
+ * If the dialog is accepted while a preview is still throttled, the final colour is
+ * emitted first so the scene already shows it when the caller commits.
+ * @param r The dialog result code.
+ */
+void OptionDialog::done(int r)
+{
+    if (previewTimer.isActive()) {
+        previewTimer.stop();
+        if (r == QDialog::Accepted)
+            updatePreview();
+    }
+    QDialog::done(r);
 }
 
 /**
@@ -142,6 +216,15 @@ QColor OptionDialog::getColor() const
     return QColor(s_red->value(), s_green->value(), s_blue->value());
 }
 
+/**
+ * @brief Gets the opacity selected in the dialog.
+ * @return The opacity (0-1).
+ */
+double OptionDialog::getOpacity() const
+{
+    return s_opacity->value() / 100.0;
+}
+
 /**
  * @brief Gets the visibility status selected in the dialog.
  * @return True if the object is set to visible, false otherwise.
@@ -2,8 +2,8 @@
  * @file optiondialog.h
  * @brief Header file for the OptionDialog class.
  *
- * This class provides a dialog for setting properties such as name, color, and visibility
- * of an object.
+ * This class provides a dialog for setting properties such as name, color, opacity and
+ * visibility of an object.
  */
 
 #ifndef OPTIONDIALOG_H
@@ -14,6 +14,7 @@
 #include <QSlider>
 #include <QLabel>
 #include <QString>
+#include <QTimer>
 
 namespace Ui {
     class OptionDialog;
@@ -22,8 +23,8 @@ namespace Ui {
 /**
  * @brief The OptionDialog class provides a dialog for setting object properties.
  *
- * This dialog allows users to set the name, color (using RGB sliders), and visibility
- * of an object.
+ * This dialog allows users to set the name, color (using RGB sliders), opacity and
+ * visibility of an object.
  */
 class OptionDialog : public QDialog
 {
@@ -33,15 +34,32 @@ private:
     QSlider* s_red;     /**< Slider for red color component. */
     QSlider* s_green;   /**< Slider for green color component. */
     QSlider* s_blue;    /**< Slider for blue color component. */
+    QSlider* s_opacity; /**< Slider for opacity, in percent. */
 
     QLabel* l_red;      /**< Label (currently unused) for red. */
     QLabel* l_green;    /**< Label (currently unused) for green. */
     QLabel* l_blue;     /**< Label (currently unused) for blue. */
+    QLabel* l_opacity;  /**< Caption of the opacity slider. */
 
     QLabel* res;        /**< Label to display the selected color. */
-    QString r;          /**< String representation of the red component. */
-    QString g;          /**< String representation of the green component. */
-    QString b;          /**< String representation of the blue component. */
+
+    /**
+     * @brief Single-shot timer that coalesces slider ticks into one preview per display frame.
+     */
+    QTimer previewTimer;
+
+    bool colourMoved;   /**< True if a colour slider moved since the last preview. */
+    bool opacityMoved;  /**< True if the opacity slider moved since the last preview. */
+
+    /**
+     * @brief Updates the colour swatch and emits appearancePreview() for the sliders that moved.
+     */
+    void updatePreview();
+
+    /**
+     * @brief Schedules a preview for the next display frame if one is not already pending.
+     */
+    void schedulePreview();
 
 public:
     /**
@@ -60,8 +78,9 @@ public:
      * @param name The name to set.
      * @param color The color to set.
      * @param visible The visibility flag to set.
+     * @param opacity The opacity to set (0-1).
      */
-    void setValues(const QString& name, const QColor& color, bool visible);
+    void setValues(const QString& name, const QColor& color, bool visible, double opacity);
 
     /**
      * @brief Gets the name entered in the dialog.
@@ -75,12 +94,34 @@ public:
      */
     QColor getColor() const;
 
+    /**
+     * @brief Gets the opacity selected in the dialog.
+     * @return The opacity (0-1).
+     */
+    double getOpacity() const;
+
     /**
      * @brief Gets the visibility status selected in the dialog.
      * @return True if the object is set to visible, false otherwise.
      */
     bool isVisible() const;
 
+    /**
+     * @brief Closes the dialog, flushing any colour preview still waiting on the throttle.
+     * @param r The dialog result code.
+     */
+    void done(int r) override;
+
+signals:
+    /**
+     * @brief Emitted at most once per display frame while the colour or opacity sliders move.
+     * @param color The colour currently selected by the sliders.
+     * @param opacity The opacity currently selected (0-1).
+     * @param colourChanged True if a colour slider moved since the previous preview.
+     * @param opacityChanged True if the opacity slider moved since the previous preview.
+     */
+    void appearancePreview(const QColor& color, double opacity, bool colourChanged, bool opacityChanged);
+
 public slots:
     /**
      * @brief Slot function to handle red color changes.